@@ -0,0 +1,622 @@
+// Compile throughput benchmarks, by default it runs over the real world headers in
+// the_pile and the codegen microbenchmarks in the_increment/bench:
+//
+//   cuik_bench [-n reps] [-p last_phase] [-o results.tsv] [-b baseline.tsv] [-t percent] [files...]
+//
+// every phase gets timed on its own (the phases before it are run but not timed)
+// and then the whole pipeline is timed end to end. The results are tab separated
+// so they can be stored and passed back in with -b later, anything which got slower
+// or used more memory than the threshold is reported and the exit code is 1.
+//
+// it's single threaded on purpose, we're measuring the phases and not the scheduler.
+#include <cuik.h>
+#include <cuik_ast.h>
+#include <dyn_array.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "helper.h"
+
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+typedef enum {
+    BENCH_LEX,
+    BENCH_PREPROCESS,
+    BENCH_PARSE,
+    BENCH_SEMA,
+    BENCH_IRGEN,
+    BENCH_CODEGEN,
+    BENCH_TOTAL,
+
+    BENCH_PHASE_COUNT
+} BenchPhase;
+
+static const char* bench_phase_names[BENCH_PHASE_COUNT] = {
+    "lex", "preprocess", "parse", "sema", "irgen", "codegen", "total"
+};
+
+// paths are relative to the repo root so the baselines work in any checkout
+static const struct {
+    const char* path;
+    // a few of the single header libraries are empty without their implementation define
+    const char* define;
+} bench_suite[] = {
+    { "tests/the_pile/sqlite3.h" },
+    { "tests/the_pile/jsmn/main.c" },
+    { "tests/stb_image.h", "STB_IMAGE_IMPLEMENTATION" },
+
+    { "tests/the_increment/bench/arith.c" },
+    { "tests/the_increment/bench/big_array.c" },
+    { "tests/the_increment/bench/bitcast.c" },
+    { "tests/the_increment/bench/copy.c" },
+    { "tests/the_increment/bench/csel.c" },
+    { "tests/the_increment/bench/dead.c" },
+    { "tests/the_increment/bench/gcd.c" },
+    { "tests/the_increment/bench/inline.c" },
+    { "tests/the_increment/bench/matmul.c" },
+    { "tests/the_increment/bench/max_array.c" },
+    { "tests/the_increment/bench/multiply.c" },
+    { "tests/the_increment/bench/newline_counter.c" },
+    { "tests/the_increment/bench/reassoc.c" },
+    { "tests/the_increment/bench/sroa.c" },
+    { "tests/the_increment/bench/switches.c" },
+    { "tests/the_increment/bench/tagged_ptr.c" },
+    { "tests/the_increment/bench/tiling_test.c" },
+    { "tests/the_increment/bench/ub.c" },
+};
+enum { BENCH_SUITE_COUNT = sizeof(bench_suite) / sizeof(bench_suite[0]) };
+
+typedef struct {
+    // what goes into the results, the path is what actually gets opened
+    const char* name;
+    const char* path;
+    const char* define;
+} BenchInput;
+
+typedef struct {
+    const char* name;
+    BenchPhase phase;
+
+    uint64_t min, median;
+    uint64_t bytes, lines, tokens;
+    uint64_t peak_kb;
+} BenchResult;
+
+static Cuik_Target target_desc;
+
+static int bench_reps = 5;
+static BenchPhase bench_last_phase = BENCH_CODEGEN;
+static double bench_threshold = 10.0;
+
+////////////////////////////////
+// memory
+////////////////////////////////
+// lowers the high water mark to what's currently resident so each phase reports its
+// own peak, only Linux can do this, elsewhere it's the peak of the whole run.
+static void reset_peak_memory(void) {
+    #ifdef __linux__
+    FILE* f = fopen("/proc/self/clear_refs", "w");
+    if (f != NULL) {
+        fputs("5", f);
+        fclose(f);
+    }
+    #endif
+}
+
+static uint64_t get_peak_memory_kb(void) {
+    #if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+    return pmc.PeakWorkingSetSize / 1024;
+    #elif defined(__linux__)
+    // ru_maxrss doesn't see the clear_refs reset but VmHWM does
+    FILE* f = fopen("/proc/self/status", "r");
+    if (f == NULL) return 0;
+
+    char line[256];
+    unsigned long long kb = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "VmHWM: %llu kB", &kb) == 1) break;
+    }
+    fclose(f);
+    return kb;
+    #else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    // it's in bytes on Mac
+    return usage.ru_maxrss / 1024;
+    #endif
+}
+
+////////////////////////////////
+// sema timing
+////////////////////////////////
+// sema (phase 4) runs inside cuik_parse_translation_unit, the profiler is the only
+// way to see where it starts and stops so it's on for the parse and nothing else.
+static int bench_region_depth, bench_sema_depth;
+static uint64_t bench_sema_start, bench_sema_time;
+
+static void bench__start(void* user_data) {
+    bench_region_depth = bench_sema_depth = 0;
+    bench_sema_time = 0;
+}
+
+static void bench__stop(void* user_data) {}
+
+static void bench__begin_plot(void* user_data, uint64_t nanos, uint32_t tid, const char* label) {
+    bench_region_depth += 1;
+    if (bench_sema_depth == 0 && strncmp(label, "phase 4", 7) == 0) {
+        bench_sema_depth = bench_region_depth;
+        bench_sema_start = nanos;
+    }
+}
+
+static void bench__end_plot(void* user_data, uint64_t nanos, uint32_t tid, const uint64_t* counters) {
+    if (bench_region_depth == bench_sema_depth) {
+        bench_sema_time += nanos - bench_sema_start;
+        bench_sema_depth = 0;
+    }
+    bench_region_depth -= 1;
+}
+
+static Cuik_IProfiler bench_profiler = {
+    .start      = bench__start,
+    .stop       = bench__stop,
+    .begin_plot = bench__begin_plot,
+    .end_plot   = bench__end_plot,
+};
+
+////////////////////////////////
+// phases
+////////////////////////////////
+typedef struct {
+    uint64_t times[BENCH_PHASE_COUNT];
+    uint64_t peak_kb[BENCH_PHASE_COUNT];
+
+    // lexing only sees the main file, the rest of the phases see the includes too
+    uint64_t main_bytes, main_lines, main_tokens;
+    uint64_t bytes, lines, tokens;
+
+    // the last phase which finished
+    int reached;
+} BenchRun;
+
+// same as the preprocessor's file loading, it wants a fat null terminator
+static char* load_file(const char* path, size_t* out_length) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "error: could not open %s\n", path);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    size_t length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char* text = malloc(length + 16);
+    length = fread(text, 1, length, file);
+    fclose(file);
+
+    memset(&text[length], 0, 16);
+    cuiklex_canonicalize(length, text);
+
+    *out_length = length;
+    return text;
+}
+
+static bool run_lexer(const BenchInput* input, BenchRun* run) {
+    size_t length;
+    char* text = load_file(input->path, &length);
+    if (text == NULL) return false;
+
+    reset_peak_memory();
+    uint64_t start = cuik_time_in_nanos();
+    TokenStream tokens = cuiklex_buffer(input->path, text);
+    run->times[BENCH_LEX] = cuik_time_in_nanos() - start;
+    run->peak_kb[BENCH_LEX] = get_peak_memory_kb();
+
+    // the EOF token doesn't count
+    size_t count = cuik_get_token_count(&tokens);
+    run->main_tokens = count - 1;
+    run->main_bytes = length;
+    run->main_lines = count > 1 ? tokens.locations[tokens.tokens[count - 2].location].line->line : 0;
+
+    dyn_array_destroy(tokens.tokens);
+    dyn_array_destroy(tokens.locations);
+    free(text);
+    return true;
+}
+
+// stops after the last phase, if split is set each phase gets timed and the total
+// is left alone, otherwise it's just the total (without any of the extra work the
+// split timings need).
+static void run_pipeline(const BenchInput* input, BenchRun* run, BenchPhase last, bool split) {
+    if (!split) reset_peak_memory();
+    uint64_t pipeline_start = cuik_time_in_nanos();
+    uint64_t start = pipeline_start;
+
+    #define PHASE_START(phase) (split ? (reset_peak_memory(), start = cuik_time_in_nanos()) : 0)
+    #define PHASE_END(phase) (split ? (run->times[phase] = cuik_time_in_nanos() - start, run->peak_kb[phase] = get_peak_memory_kb()) : 0)
+
+    // preprocess
+    Cuik_CPP* cpp = malloc(sizeof(Cuik_CPP));
+    PHASE_START(BENCH_PREPROCESS);
+    cuikpp_init(cpp, input->path);
+    cuikpp_set_common_defines(cpp, &target_desc, true);
+    if (input->define != NULL) {
+        cuikpp_define_empty(cpp, input->define);
+    }
+
+    // no file cache, the includes get lexed every time
+    Cuikpp_Status status = cuikpp_default_run(cpp, NULL);
+    PHASE_END(BENCH_PREPROCESS);
+
+    if (status == CUIKPP_ERROR) {
+        fprintf(stderr, "error: could not preprocess %s\n", input->path);
+        cuikpp_deinit(cpp);
+        free(cpp);
+        return;
+    }
+
+    Cuik_CPPStats stats = cuikpp_get_stats(cpp);
+    run->bytes = stats.bytes_lexed;
+    run->lines = stats.lines_lexed;
+    run->tokens = cuik_get_token_count(cuikpp_get_token_stream(cpp)) - 1;
+    run->reached = BENCH_PREPROCESS;
+    cuikpp_finalize(cpp);
+
+    // parse & sema
+    TB_Module* mod = NULL;
+    if (last >= BENCH_IRGEN) {
+        TB_FeatureSet features = { 0 };
+        mod = tb_module_create(TB_ARCH_X86_64, cuik_system_to_tb(target_desc.sys), &features, false);
+    }
+
+    Cuik_ErrorStatus errors;
+    Cuik_TranslationUnitDesc desc = {
+        .tokens    = cuikpp_get_token_stream(cpp),
+        .errors    = &errors,
+        .ir_module = mod,
+        .target    = &target_desc,
+    };
+
+    CompilationUnit compilation_unit;
+    cuik_create_compilation_unit(&compilation_unit);
+
+    TranslationUnit* tu = NULL;
+    if (last >= BENCH_PARSE) {
+        if (split) cuik_start_global_profiler(&bench_profiler);
+        PHASE_START(BENCH_PARSE);
+        tu = cuik_parse_translation_unit(&desc);
+        PHASE_END(BENCH_PARSE);
+
+        if (split) {
+            // the parse timing includes the profiler's own overhead but that's small
+            cuik_stop_global_profiler();
+            run->times[BENCH_SEMA] = bench_sema_time;
+            run->times[BENCH_PARSE] -= bench_sema_time;
+            run->peak_kb[BENCH_SEMA] = run->peak_kb[BENCH_PARSE];
+        }
+
+        if (tu == NULL) {
+            fprintf(stderr, "error: could not parse %s\n", input->path);
+            goto done;
+        }
+
+        cuik_add_to_compilation_unit(&compilation_unit, tu);
+        if (!cuik_internal_link_compilation_unit(&compilation_unit)) {
+            fprintf(stderr, "error: could not link %s\n", input->path);
+            goto done;
+        }
+        run->reached = BENCH_SEMA;
+    }
+
+    // irgen
+    if (last >= BENCH_IRGEN) {
+        PHASE_START(BENCH_IRGEN);
+        Stmt** stmts = cuik_get_top_level_stmts(tu);
+        size_t count = cuik_num_of_top_level_stmts(tu);
+        for (size_t i = 0; i < count; i++) {
+            if (stmts[i]->decl.attrs.is_typedef || !stmts[i]->decl.attrs.is_used) {
+                continue;
+            }
+
+            cuik_stmt_gen_ir(tu, stmts[i]);
+        }
+        PHASE_END(BENCH_IRGEN);
+        run->reached = BENCH_IRGEN;
+    }
+
+    // codegen
+    if (last >= BENCH_CODEGEN) {
+        PHASE_START(BENCH_CODEGEN);
+        TB_FOR_FUNCTIONS(f, mod) {
+            tb_module_compile_function(mod, f, TB_ISEL_FAST);
+        }
+        PHASE_END(BENCH_CODEGEN);
+        run->reached = BENCH_CODEGEN;
+    }
+
+    if (!split) {
+        run->times[BENCH_TOTAL] = cuik_time_in_nanos() - pipeline_start;
+        run->peak_kb[BENCH_TOTAL] = get_peak_memory_kb();
+    }
+
+    done:
+    #undef PHASE_START
+    #undef PHASE_END
+
+    cuik_destroy_compilation_unit(&compilation_unit);
+    if (mod != NULL) tb_module_destroy(mod);
+
+    cuikpp_deinit(cpp);
+    free(cpp);
+}
+
+////////////////////////////////
+// results
+////////////////////////////////
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+// returns false if the input couldn't make it through the pipeline, the phases
+// which did finish still get reported.
+static bool bench_input(const BenchInput* input, BenchResult** results) {
+    BenchRun* runs = calloc(bench_reps, sizeof(BenchRun));
+    int reached = BENCH_LEX;
+
+    // one warm up so the file system cache and the allocators are primed, it also
+    // finds out how far the input gets so the errors only show up once.
+    BenchPhase last = bench_last_phase;
+    for (int i = -1; i < bench_reps; i++) {
+        BenchRun* run = &runs[i < 0 ? 0 : i];
+        *run = (BenchRun){ .reached = -1 };
+
+        if (!run_lexer(input, run)) {
+            free(runs);
+            return false;
+        }
+        run->reached = BENCH_LEX;
+
+        if (last >= BENCH_PREPROCESS) {
+            run_pipeline(input, run, last, true);
+            if (run->reached < last) last = run->reached;
+        }
+
+        if (run->reached >= bench_last_phase && bench_last_phase >= BENCH_PREPROCESS) {
+            BenchRun total = { .reached = -1 };
+            run_pipeline(input, &total, last, false);
+            run->times[BENCH_TOTAL] = total.times[BENCH_TOTAL];
+            run->peak_kb[BENCH_TOTAL] = total.peak_kb[BENCH_TOTAL];
+        }
+        reached = run->reached;
+    }
+
+    uint64_t* samples = malloc(bench_reps * sizeof(uint64_t));
+    for (int p = 0; p < BENCH_PHASE_COUNT; p++) {
+        // the total is only meaningful if the pipeline made it all the way
+        if (p == BENCH_TOTAL ? reached < bench_last_phase || reached == BENCH_LEX : p > reached) {
+            continue;
+        }
+
+        BenchResult r = { .name = input->name, .phase = p };
+        for (int i = 0; i < bench_reps; i++) {
+            samples[i] = runs[i].times[p];
+            if (runs[i].peak_kb[p] > r.peak_kb) r.peak_kb = runs[i].peak_kb[p];
+        }
+
+        qsort(samples, bench_reps, sizeof(uint64_t), compare_u64);
+        r.min = samples[0];
+        r.median = samples[bench_reps / 2];
+
+        if (p == BENCH_LEX) {
+            r.bytes = runs[0].main_bytes, r.lines = runs[0].main_lines, r.tokens = runs[0].main_tokens;
+        } else {
+            r.bytes = runs[0].bytes, r.lines = runs[0].lines, r.tokens = runs[0].tokens;
+        }
+        dyn_array_put((*results), r);
+    }
+
+    free(samples);
+    free(runs);
+    return reached >= bench_last_phase;
+}
+
+static void print_result(const BenchResult* r) {
+    double seconds = r->median / 1000000000.0;
+    printf(
+        "  %-12s %10.3f ms %10.3f ms %12.2f Mtok/s %12.2f Klines/s %10.1f MB\n",
+        bench_phase_names[r->phase], r->median / 1000000.0, r->min / 1000000.0,
+        seconds > 0.0 ? (r->tokens / seconds) / 1000000.0 : 0.0,
+        seconds > 0.0 ? (r->lines / seconds) / 1000.0 : 0.0,
+        r->peak_kb / 1024.0
+    );
+}
+
+static bool write_results(const char* path, BenchResult* results) {
+    FILE* out = fopen(path, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "error: could not open %s\n", path);
+        return false;
+    }
+
+    fprintf(out, "file\tphase\treps\tmin_ns\tmedian_ns\tbytes\tlines\ttokens\tpeak_kb\n");
+    dyn_array_for(i, results) {
+        BenchResult* r = &results[i];
+        fprintf(
+            out, "%s\t%s\t%d\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\n",
+            r->name, bench_phase_names[r->phase], bench_reps,
+            (unsigned long long) r->min, (unsigned long long) r->median,
+            (unsigned long long) r->bytes, (unsigned long long) r->lines,
+            (unsigned long long) r->tokens, (unsigned long long) r->peak_kb
+        );
+    }
+
+    fclose(out);
+    return true;
+}
+
+static BenchResult* find_result(BenchResult* results, const char* name, const char* phase) {
+    dyn_array_for(i, results) {
+        if (strcmp(results[i].name, name) == 0 && strcmp(bench_phase_names[results[i].phase], phase) == 0) {
+            return &results[i];
+        }
+    }
+
+    return NULL;
+}
+
+static double percent_change(uint64_t before, uint64_t after) {
+    return before ? ((double) after - (double) before) * 100.0 / (double) before : 0.0;
+}
+
+// returns the number of regressions or -1 if the baseline couldn't be read
+static int compare_baseline(const char* path, BenchResult* results) {
+    FILE* in = fopen(path, "rb");
+    if (in == NULL) {
+        fprintf(stderr, "error: could not open baseline %s\n", path);
+        return -1;
+    }
+
+    int regressions = 0;
+    char line[FILENAME_MAX + 256];
+
+    // skip the header
+    fgets(line, sizeof(line), in);
+    while (fgets(line, sizeof(line), in)) {
+        char name[FILENAME_MAX], phase[32];
+        int reps;
+        unsigned long long min, median, bytes, lines, tokens, peak_kb;
+        if (sscanf(line, "%[^\t]\t%31[^\t]\t%d\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu", name, phase, &reps, &min, &median, &bytes, &lines, &tokens, &peak_kb) != 9) {
+            continue;
+        }
+
+        BenchResult* r = find_result(results, name, phase);
+        if (r == NULL) continue;
+
+        double time_change = percent_change(median, r->median);
+        double memory_change = percent_change(peak_kb, r->peak_kb);
+        if (time_change > bench_threshold) {
+            printf("regression: %s %s %.3f ms -> %.3f ms (%+.1f%%)\n", name, phase, median / 1000000.0, r->median / 1000000.0, time_change);
+            regressions += 1;
+        }
+
+        if (memory_change > bench_threshold) {
+            printf("regression: %s %s %.1f MB -> %.1f MB peak (%+.1f%%)\n", name, phase, peak_kb / 1024.0, r->peak_kb / 1024.0, memory_change);
+            regressions += 1;
+        }
+    }
+
+    fclose(in);
+    return regressions;
+}
+
+static BenchPhase parse_phase(const char* name) {
+    for (int i = 0; i < BENCH_TOTAL; i++) {
+        if (strcmp(bench_phase_names[i], name) == 0) return i;
+    }
+
+    fprintf(stderr, "error: unknown phase %s (lex, preprocess, parse, sema, irgen or codegen)\n", name);
+    exit(1);
+}
+
+int main(int argc, char** argv) {
+    cuik_init();
+    find_system_deps();
+
+    #if defined(_WIN32)
+    target_desc.sys = CUIK_SYSTEM_WINDOWS;
+    #elif defined(__linux) || defined(linux)
+    target_desc.sys = CUIK_SYSTEM_LINUX;
+    #elif defined(__APPLE__) || defined(__MACH__) || defined(macintosh)
+    target_desc.sys = CUIK_SYSTEM_MACOS;
+    #endif
+    target_desc.arch = cuik_get_x64_target_desc();
+
+    const char* output_path = NULL;
+    const char* baseline_path = NULL;
+    DynArray(BenchInput) inputs = dyn_array_create(BenchInput);
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            BenchInput input = { argv[i], argv[i] };
+            dyn_array_put(inputs, input);
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            fprintf(stderr, "error: %s expects a value\n", argv[i]);
+            return 1;
+        }
+
+        const char* value = argv[++i];
+        switch (argv[i - 1][1]) {
+            case 'n': bench_reps = atoi(value); break;
+            case 'p': bench_last_phase = parse_phase(value); break;
+            case 'o': output_path = value; break;
+            case 'b': baseline_path = value; break;
+            case 't': bench_threshold = atof(value); break;
+            default: {
+                fprintf(stderr, "error: unknown option %s\n", argv[i - 1]);
+                return 1;
+            }
+        }
+    }
+
+    if (bench_reps <= 0) {
+        fprintf(stderr, "error: there needs to be at least one repetition\n");
+        return 1;
+    }
+
+    // crt_dirpath is the repo root after find_system_deps
+    if (dyn_array_length(inputs) == 0) {
+        for (size_t i = 0; i < BENCH_SUITE_COUNT; i++) {
+            char* path = malloc(FILENAME_MAX);
+            snprintf(path, FILENAME_MAX, "%s/%s", crt_dirpath, bench_suite[i].path);
+
+            BenchInput input = { bench_suite[i].path, path, bench_suite[i].define };
+            dyn_array_put(inputs, input);
+        }
+    }
+
+    int failures = 0;
+    DynArray(BenchResult) results = dyn_array_create(BenchResult);
+
+    printf("%d reps, median and min\n", bench_reps);
+    dyn_array_for(i, inputs) {
+        size_t first = dyn_array_length(results);
+        if (!bench_input(&inputs[i], &results)) {
+            failures += 1;
+        }
+
+        printf("%s:\n", inputs[i].name);
+        for (size_t j = first; j < dyn_array_length(results); j++) {
+            print_result(&results[j]);
+        }
+    }
+
+    if (output_path != NULL && !write_results(output_path, results)) {
+        return 1;
+    }
+
+    int regressions = 0;
+    if (baseline_path != NULL) {
+        regressions = compare_baseline(baseline_path, results);
+        if (regressions < 0) return 1;
+
+        printf("%d regression%s past %.1f%%\n", regressions, regressions == 1 ? "" : "s", bench_threshold);
+    }
+
+    if (failures > 0) {
+        printf("%d file%s didn't make it through the pipeline\n", failures, failures == 1 ? "" : "s");
+    }
+
+    cuik_free_thread_resources();
+    return regressions > 0 || failures > 0;
+}
@@ -0,0 +1,257 @@
+// Checks the compact AST against the normal one, by default it runs over a few
+// files in tests:
+//
+//   cuik_compact_test [case...]
+//
+// every file is parsed and its compact AST is walked in lockstep with the pointer
+// AST through the kid iterators. The nodes have to come out in the same order with
+// the same hot fields, kids have to be numbered after their parents and every node
+// in the pools has to be reached exactly once. The exit code is 1 if anything
+// didn't go as expected.
+#include <cuik.h>
+#include <cuik_ast.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "helper.h"
+
+typedef struct {
+    const char* name;
+
+    // relative to tests
+    const char* path;
+} CompactCase;
+
+static const CompactCase compact_suite[] = {
+    { "reparse",  "the_reparse/base.c" },
+    { "basics",   "the_semantics/basics.c" },
+    { "isolate",  "the_semantics/isolate.c" },
+    { "donut",    "the_pile/donut/donut.c" },
+    { "morse",    "the_pile/morse/morse.c" },
+    { "jsmn",     "the_pile/jsmn/main.c" },
+};
+enum { COMPACT_SUITE_COUNT = sizeof(compact_suite) / sizeof(compact_suite[0]) };
+
+static Cuik_Target target_desc;
+
+typedef struct {
+    const char* name;
+    Cuik_CompactAST* ast;
+
+    // how many nodes of each pool we reached
+    size_t expr_count, stmt_count;
+} Walker;
+
+static bool compare_expr(Walker* w, Cuik_ExprIndex i, Expr* e) {
+    Cuik_CompactAST* ast = w->ast;
+    if (e == NULL) {
+        if (i == 0) return true;
+
+        fprintf(stderr, "error: %s has expression %u where there's none\n", w->name, i);
+        return false;
+    }
+
+    if (i == 0 || i >= ast->expr_count || ast->exprs[i] != e) {
+        fprintf(stderr, "error: %s has expression %u where it should have %p\n", w->name, i, e);
+        return false;
+    }
+
+    if (ast->expr_ops[i] != e->op || ast->expr_types[i] != e->type || ast->expr_locs[i] != e->start_loc) {
+        fprintf(stderr, "error: %s has the wrong hot fields on expression %u\n", w->name, i);
+        return false;
+    }
+    w->expr_count++;
+
+    Cuik_ExprIter it = { .parent_ = e };
+    CUIK_FOR_KID_IN_COMPACT_EXPR(kid, ast, i) {
+        if (!cuik_next_expr_kid(&it)) {
+            fprintf(stderr, "error: %s has too many kids on expression %u\n", w->name, i);
+            return false;
+        }
+
+        if (kid.expr_index <= i) {
+            fprintf(stderr, "error: %s numbered expression %u before its parent %u\n", w->name, kid.expr_index, i);
+            return false;
+        }
+
+        if (kid.expr != it.expr || !compare_expr(w, kid.expr_index, it.expr)) return false;
+    }
+
+    if (cuik_next_expr_kid(&it)) {
+        fprintf(stderr, "error: %s is missing kids on expression %u\n", w->name, i);
+        return false;
+    }
+
+    return true;
+}
+
+static size_t stmt_exprs(Stmt* s, Expr* out[2]) {
+    switch (s->op) {
+        case STMT_DECL:
+        case STMT_GLOBAL_DECL: out[0] = s->decl.initial; return 1;
+        case STMT_EXPR: out[0] = s->expr.expr; return 1;
+        case STMT_RETURN: out[0] = s->return_.expr; return 1;
+        case STMT_GOTO: out[0] = s->goto_.target; return 1;
+        case STMT_IF: out[0] = s->if_.cond; return 1;
+        case STMT_WHILE: out[0] = s->while_.cond; return 1;
+        case STMT_DO_WHILE: out[0] = s->do_while.cond; return 1;
+        case STMT_SWITCH: out[0] = s->switch_.condition; return 1;
+        case STMT_FOR: out[0] = s->for_.cond, out[1] = s->for_.next; return 2;
+        default: return 0;
+    }
+}
+
+static bool compare_stmt(Walker* w, Cuik_StmtIndex i, Stmt* s) {
+    Cuik_CompactAST* ast = w->ast;
+    if (i == 0 || i >= ast->stmt_count || ast->stmts[i] != s) {
+        fprintf(stderr, "error: %s has statement %u where it should have %p\n", w->name, i, s);
+        return false;
+    }
+
+    if (ast->stmt_ops[i] != s->op || ast->stmt_locs[i] != s->loc) {
+        fprintf(stderr, "error: %s has the wrong hot fields on statement %u\n", w->name, i);
+        return false;
+    }
+    w->stmt_count++;
+
+    if (s->op == STMT_FUNC_DECL && !compare_stmt(w, i + 1, s->decl.initial_as_stmt)) {
+        return false;
+    }
+
+    Expr* exprs[2];
+    size_t expr_count = stmt_exprs(s, exprs);
+    Cuik_CompactLinks links = ast->stmt_exprs[i];
+    if (links.count != expr_count) {
+        fprintf(stderr, "error: %s has %u expressions on statement %u, expected %zu\n", w->name, links.count, i, expr_count);
+        return false;
+    }
+
+    for (size_t j = 0; j < expr_count; j++) {
+        Cuik_ExprIndex e = ast->links[links.start + j];
+        if (!compare_expr(w, e, exprs[j])) return false;
+    }
+
+    Cuik_StmtIter it = { .parent_ = s };
+    CUIK_FOR_KID_IN_COMPACT_STMT(kid, ast, i) {
+        if (!cuik_next_stmt_kid(&it)) {
+            fprintf(stderr, "error: %s has too many kids on statement %u\n", w->name, i);
+            return false;
+        }
+
+        if (kid.stmt_index <= i) {
+            fprintf(stderr, "error: %s numbered statement %u before its parent %u\n", w->name, kid.stmt_index, i);
+            return false;
+        }
+
+        if (kid.stmt != it.stmt || !compare_stmt(w, kid.stmt_index, it.stmt)) return false;
+    }
+
+    if (cuik_next_stmt_kid(&it)) {
+        fprintf(stderr, "error: %s is missing kids on statement %u\n", w->name, i);
+        return false;
+    }
+
+    return true;
+}
+
+static bool test_case(const CompactCase* c) {
+    char path[FILENAME_MAX];
+    snprintf(path, FILENAME_MAX, "%s/tests/%s", crt_dirpath, c->path);
+
+    Cuik_CPP* cpp = malloc(sizeof(Cuik_CPP));
+    cuikpp_init(cpp, path);
+    cuikpp_set_common_defines(cpp, &target_desc, true);
+    if (cuikpp_default_run(cpp, NULL) == CUIKPP_ERROR) {
+        fprintf(stderr, "error: could not preprocess %s\n", c->path);
+        cuikpp_deinit(cpp);
+        free(cpp);
+        return false;
+    }
+    cuikpp_finalize(cpp);
+
+    Cuik_ErrorStatus errors;
+    Cuik_TranslationUnitDesc desc = {
+        .tokens = cuikpp_get_token_stream(cpp),
+        .errors = &errors,
+        .target = &target_desc,
+    };
+
+    TranslationUnit* tu = cuik_parse_translation_unit(&desc);
+    if (tu == NULL) {
+        fprintf(stderr, "error: could not parse %s\n", c->path);
+        cuikpp_deinit(cpp);
+        free(cpp);
+        return false;
+    }
+
+    Walker w = { .name = c->name, .ast = cuik_get_compact_ast(tu) };
+    bool success = true;
+    if (cuik_get_compact_ast(tu) != w.ast) {
+        fprintf(stderr, "error: %s built the compact AST twice\n", c->name);
+        success = false;
+    }
+
+    Stmt** stmts = cuik_get_top_level_stmts(tu);
+    size_t count = cuik_num_of_top_level_stmts(tu);
+    if (w.ast->top_level_count != count) {
+        fprintf(stderr, "error: %s has %zu top level statements, expected %zu\n", c->name, w.ast->top_level_count, count);
+        success = false;
+    }
+
+    for (size_t i = 0; success && i < count; i++) {
+        success = compare_stmt(&w, w.ast->top_level[i], stmts[i]);
+    }
+
+    // index 0 is the null node
+    if (success && (w.expr_count != w.ast->expr_count - 1 || w.stmt_count != w.ast->stmt_count - 1)) {
+        fprintf(stderr, "error: %s reached %zu of %zu statements and %zu of %zu expressions\n", c->name,
+            w.stmt_count, w.ast->stmt_count - 1, w.expr_count, w.ast->expr_count - 1);
+        success = false;
+    }
+
+    cuik_destroy_translation_unit(tu);
+    cuikpp_deinit(cpp);
+    free(cpp);
+    return success;
+}
+
+int main(int argc, char** argv) {
+    cuik_init();
+    find_system_deps();
+
+    #if defined(_WIN32)
+    target_desc.sys = CUIK_SYSTEM_WINDOWS;
+    #elif defined(__linux) || defined(linux)
+    target_desc.sys = CUIK_SYSTEM_LINUX;
+    #elif defined(__APPLE__) || defined(__MACH__) || defined(macintosh)
+    target_desc.sys = CUIK_SYSTEM_MACOS;
+    #endif
+    target_desc.arch = cuik_get_x64_target_desc();
+
+    int failures = 0, ran = 0;
+    for (size_t i = 0; i < COMPACT_SUITE_COUNT; i++) {
+        bool picked = argc <= 1;
+        for (int j = 1; j < argc; j++) {
+            if (strcmp(argv[j], compact_suite[i].name) == 0) picked = true;
+        }
+        if (!picked) continue;
+
+        bool success = test_case(&compact_suite[i]);
+        printf("%s: %s\n", compact_suite[i].name, success ? "ok" : "FAILED");
+
+        failures += !success;
+        ran += 1;
+    }
+
+    if (ran == 0) {
+        fprintf(stderr, "error: no cases picked\n");
+        return 1;
+    }
+
+    if (failures > 0) {
+        printf("%d case%s failed\n", failures, failures == 1 ? "" : "s");
+    }
+
+    cuik_free_thread_resources();
+    return failures > 0;
+}
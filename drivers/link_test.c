@@ -0,0 +1,214 @@
+// Runs the built-in ELF linker over tests/the_increment/link and checks what the
+// linked programs do:
+//
+//   cuik_link_test [case...]
+//
+// the inputs are compiled by the system C compiler ($CC or cc) so a broken
+// backend can't be mistaken for a broken linker. Each case gets linked, run and
+// its exit code and stdout have to match, the relink case is linked a second
+// time on top of the first with the incremental linker. The exit code is 1 if
+// anything didn't go as expected.
+#include <cuik.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "helper.h"
+
+#ifdef __linux__
+#include <sys/stat.h>
+#include <sys/wait.h>
+#endif
+
+enum { MAX_LINK_SOURCES = 4 };
+
+typedef struct {
+    const char* name;
+
+    // relative to tests/the_increment/link, they all get linked together
+    const char* sources[MAX_LINK_SOURCES];
+    const char* libs;
+    const char* cflags;
+
+    // NULL means --nocrt
+    const char* crt_name;
+
+    int exit_code;
+    const char* output;
+
+    // if set, the case is relinked incrementally after being rebuilt with
+    // -DSTEP=2 (the first link uses -DSTEP=1). Nothing moves between the two
+    // so the executable has to be patched in place.
+    int relink_exit_code;
+    const char* relink_output;
+} LinkCase;
+
+static const LinkCase link_suite[] = {
+    { "hello", { "hello.c" }, "-lm", "", "c", 3, "hello 5 sqrt=4.0 env=1\n" },
+    { "multi", { "multi_main.c", "multi_lib.c" }, "", "", "c", 0, "sum=10 callback=49 ctor=1 weak=1\n" },
+    { "tls", { "tls.c" }, "-lpthread", "", "c", 0, "main=7 worker=12 errno=1\n" },
+    { "nocrt", { "nocrt.c" }, "", "-fno-stack-protector", NULL, 42, "nocrt\n" },
+    { "relink", { "relink.c" }, "", "", "c", 1, "old 20\n", 2, "new 40\n" },
+};
+enum { LINK_SUITE_COUNT = sizeof(link_suite) / sizeof(link_suite[0]) };
+
+#ifdef __linux__
+static char work_dir[] = "/tmp/cuik_link_XXXXXX";
+
+static bool compile_sources(const LinkCase* c, int step) {
+    const char* cc = getenv("CC");
+    if (cc == NULL || *cc == 0) cc = "cc";
+
+    for (int i = 0; i < MAX_LINK_SOURCES && c->sources[i] != NULL; i++) {
+        char cmd[FILENAME_MAX * 3];
+        snprintf(cmd, sizeof(cmd), "%s -c -O1 %s -DSTEP=%d %s/tests/the_increment/link/%s -o %s/%s_%d.o",
+            cc, c->cflags, step, crt_dirpath, c->sources[i], work_dir, c->name, i);
+
+        if (system(cmd) != 0) {
+            fprintf(stderr, "error: could not compile %s (%s)\n", c->sources[i], cmd);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool link_case(const LinkCase* c, const char* exe_path, bool incremental) {
+    Cuik_Linker l;
+    if (!cuiklink_init(&l)) {
+        fprintf(stderr, "error: could not initialize the linker\n");
+        return false;
+    }
+
+    cuiklink_add_default_libpaths(&l);
+    cuiklink_set_incremental(&l, incremental);
+
+    for (int i = 0; i < MAX_LINK_SOURCES && c->sources[i] != NULL; i++) {
+        char path[FILENAME_MAX];
+        snprintf(path, FILENAME_MAX, "%s/%s_%d.o", work_dir, c->name, i);
+        cuiklink_add_input_file(&l, path);
+    }
+
+    // the libs are space separated
+    char libs[256];
+    snprintf(libs, sizeof(libs), "%s", c->libs);
+    for (char* lib = strtok(libs, " "); lib != NULL; lib = strtok(NULL, " ")) {
+        cuiklink_add_input_file(&l, lib);
+    }
+
+    bool linked = cuiklink_invoke(&l, exe_path, c->crt_name);
+    cuiklink_deinit(&l);
+    return linked;
+}
+
+static bool run_case(const LinkCase* c, const char* exe_path, int exit_code, const char* output) {
+    FILE* p = popen(exe_path, "r");
+    if (p == NULL) {
+        fprintf(stderr, "error: could not run %s\n", exe_path);
+        return false;
+    }
+
+    char got[1024];
+    size_t len = fread(got, 1, sizeof(got) - 1, p);
+    got[len] = 0;
+
+    int status = pclose(p);
+    if (!WIFEXITED(status)) {
+        fprintf(stderr, "error: %s didn't exit normally (status %#x)\n", c->name, status);
+        return false;
+    }
+
+    bool success = true;
+    if (WEXITSTATUS(status) != exit_code) {
+        fprintf(stderr, "error: %s exited with %d, expected %d\n", c->name, WEXITSTATUS(status), exit_code);
+        success = false;
+    }
+
+    if (strcmp(got, output) != 0) {
+        fprintf(stderr, "error: %s printed:\n%s\nexpected:\n%s\n", c->name, got, output);
+        success = false;
+    }
+
+    return success;
+}
+
+static bool test_case(const LinkCase* c) {
+    char exe_path[FILENAME_MAX];
+    snprintf(exe_path, FILENAME_MAX, "%s/%s", work_dir, c->name);
+
+    bool relink = c->relink_output != NULL;
+    if (!compile_sources(c, 1)) return false;
+    if (!link_case(c, exe_path, relink)) {
+        fprintf(stderr, "error: could not link %s\n", c->name);
+        return false;
+    }
+
+    if (!run_case(c, exe_path, c->exit_code, c->output)) return false;
+    if (!relink) return true;
+
+    // a fresh executable would be a new file
+    struct stat before, after;
+    if (stat(exe_path, &before) != 0) {
+        fprintf(stderr, "error: could not stat %s\n", exe_path);
+        return false;
+    }
+
+    if (!compile_sources(c, 2)) return false;
+    if (!link_case(c, exe_path, true)) {
+        fprintf(stderr, "error: could not relink %s\n", c->name);
+        return false;
+    }
+
+    if (stat(exe_path, &after) != 0 || after.st_ino != before.st_ino) {
+        fprintf(stderr, "error: %s was relinked from scratch instead of patched\n", c->name);
+        return false;
+    }
+
+    return run_case(c, exe_path, c->relink_exit_code, c->relink_output);
+}
+
+int main(int argc, char** argv) {
+    cuik_init();
+    find_system_deps();
+
+    if (mkdtemp(work_dir) == NULL) {
+        fprintf(stderr, "error: could not make a temporary directory\n");
+        return 1;
+    }
+
+    int failures = 0, ran = 0;
+    for (size_t i = 0; i < LINK_SUITE_COUNT; i++) {
+        bool picked = argc <= 1;
+        for (int j = 1; j < argc; j++) {
+            if (strcmp(argv[j], link_suite[i].name) == 0) picked = true;
+        }
+        if (!picked) continue;
+
+        bool success = test_case(&link_suite[i]);
+        printf("%s: %s\n", link_suite[i].name, success ? "ok" : "FAILED");
+
+        failures += !success;
+        ran += 1;
+    }
+
+    char cmd[FILENAME_MAX];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", work_dir);
+    system(cmd);
+
+    if (ran == 0) {
+        fprintf(stderr, "error: no cases picked\n");
+        return 1;
+    }
+
+    if (failures > 0) {
+        printf("%d case%s failed\n", failures, failures == 1 ? "" : "s");
+    }
+
+    cuik_free_thread_resources();
+    return failures > 0;
+}
+#else
+int main(int argc, char** argv) {
+    printf("the built-in ELF linker is only used on Linux, nothing to test\n");
+    return 0;
+}
+#endif
@@ -0,0 +1,261 @@
+// Checks the AST caches from cuik_serialize_translation_unit against a normal parse,
+// by default it runs over tests/the_prelude:
+//
+//   cuik_prelude_test [files...]
+//
+// the headers each file starts with are parsed on their own and serialized, then the
+// file is parsed again on top of that prelude and the two ASTs have to dump the same.
+// After that the prelude gets damaged a few ways (wrong version, cut short, a flipped
+// bit and handed to the wrong tokens) and each of those parses has to fail cleanly.
+// The exit code is 1 if anything didn't go as expected.
+#include <cuik.h>
+#include <cuik_ast.h>
+#include <dyn_array.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "helper.h"
+
+// paths are relative to the repo root
+static const char* prelude_suite[] = {
+    "tests/the_prelude/vec.c",
+    "tests/the_prelude/list.c",
+    "tests/the_prelude/libc.c",
+};
+enum { PRELUDE_SUITE_COUNT = sizeof(prelude_suite) / sizeof(prelude_suite[0]) };
+
+typedef enum {
+    DAMAGE_VERSION,
+    DAMAGE_TRUNCATE,
+    DAMAGE_BIT_FLIP,
+    DAMAGE_TOKENS,
+
+    DAMAGE_COUNT
+} PreludeDamage;
+
+static const char* damage_names[DAMAGE_COUNT] = {
+    "wrong version", "truncated", "flipped bit", "wrong tokens"
+};
+
+static Cuik_Target target_desc;
+
+static Cuik_CPP* preprocess(const char* path) {
+    Cuik_CPP* cpp = malloc(sizeof(Cuik_CPP));
+    cuikpp_init(cpp, path);
+    cuikpp_set_common_defines(cpp, &target_desc, true);
+
+    if (cuikpp_default_run(cpp, NULL) == CUIKPP_ERROR) {
+        fprintf(stderr, "error: could not preprocess %s\n", path);
+        cuikpp_deinit(cpp);
+        free(cpp);
+        return NULL;
+    }
+
+    cuikpp_finalize(cpp);
+    return cpp;
+}
+
+static void free_preprocessor(Cuik_CPP* cpp) {
+    cuikpp_deinit(cpp);
+    free(cpp);
+}
+
+static char* dump_to_string(TranslationUnit* tu) {
+    FILE* f = tmpfile();
+    if (f == NULL) {
+        fprintf(stderr, "error: could not make a temporary file\n");
+        exit(1);
+    }
+
+    cuik_dump_translation_unit(f, tu, true);
+
+    long size = ftell(f);
+    rewind(f);
+
+    char* str = malloc(size + 1);
+    str[fread(str, 1, size, f)] = 0;
+    fclose(f);
+    return str;
+}
+
+// the TU takes the tokens so every parse gets its own run of the preprocessor,
+// skip is where the tokens after the prelude start. returns NULL if it didn't parse.
+static char* parse_and_dump(const char* path, const void* prelude, size_t prelude_size, size_t skip) {
+    Cuik_CPP* cpp = preprocess(path);
+    if (cpp == NULL) return NULL;
+
+    TokenStream* tokens = cuikpp_get_token_stream(cpp);
+    tokens->current = skip;
+
+    Cuik_ErrorStatus errors;
+    Cuik_TranslationUnitDesc desc = {
+        .tokens       = tokens,
+        .errors       = &errors,
+        .target       = &target_desc,
+        .prelude      = prelude,
+        .prelude_size = prelude_size,
+    };
+
+    char* str = NULL;
+    TranslationUnit* tu = cuik_parse_translation_unit(&desc);
+    if (tu != NULL) {
+        str = dump_to_string(tu);
+        cuik_destroy_translation_unit(tu);
+    }
+
+    free_preprocessor(cpp);
+    return str;
+}
+
+// parses the headers at the top of the file as a TU of their own, the TU has to be
+// incremental to serialize it.
+static void* make_prelude(const char* path, size_t* out_size, size_t* out_token_count) {
+    Cuik_CPP* cpp = preprocess(path);
+    if (cpp == NULL) return NULL;
+
+    TokenStream* tokens = cuikpp_get_token_stream(cpp);
+    size_t token_count = cuikpp_count_prelude_tokens(tokens);
+    if (token_count == 0) {
+        fprintf(stderr, "error: %s doesn't start with any headers\n", path);
+        free_preprocessor(cpp);
+        return NULL;
+    }
+
+    TokenStream prefix = *tokens;
+    prefix.tokens = dyn_array_create_with_initial_cap(Token, token_count + 1);
+    prefix.current = 0;
+    for (size_t i = 0; i < token_count; i++) {
+        dyn_array_put(prefix.tokens, tokens->tokens[i]);
+    }
+
+    Token eof = { 0, true, 0, NULL, NULL };
+    dyn_array_put(prefix.tokens, eof);
+
+    Cuik_ErrorStatus errors;
+    Cuik_TranslationUnitDesc desc = {
+        .tokens      = &prefix,
+        .errors      = &errors,
+        .target      = &target_desc,
+        .incremental = true,
+    };
+
+    void* data = NULL;
+    TranslationUnit* tu = cuik_parse_translation_unit(&desc);
+    if (tu == NULL) {
+        fprintf(stderr, "error: the headers in %s don't parse on their own\n", path);
+    } else {
+        data = cuik_serialize_translation_unit(tu, out_size);
+        if (data == NULL) {
+            fprintf(stderr, "error: could not serialize the headers in %s\n", path);
+        }
+
+        cuik_destroy_translation_unit(tu);
+    }
+
+    // the unused tokens in the original stream are still ours
+    dyn_array_destroy(tokens->tokens);
+    free_preprocessor(cpp);
+
+    *out_token_count = token_count;
+    return data;
+}
+
+// 1-based line number of the first difference
+static int first_different_line(const char* a, const char* b) {
+    int line = 1;
+    for (; *a && *a == *b; a++, b++) {
+        if (*a == '\n') line++;
+    }
+
+    return line;
+}
+
+static bool test_input(const char* name, const char* path) {
+    char* expected = parse_and_dump(path, NULL, 0, 0);
+    if (expected == NULL) {
+        fprintf(stderr, "error: could not parse %s\n", name);
+        return false;
+    }
+
+    size_t size, token_count;
+    void* prelude = make_prelude(path, &size, &token_count);
+    if (prelude == NULL) {
+        free(expected);
+        return false;
+    }
+
+    bool success = true;
+    char* got = parse_and_dump(path, prelude, size, token_count);
+    if (got == NULL) {
+        fprintf(stderr, "error: %s doesn't parse on top of its prelude\n", name);
+        success = false;
+    } else if (strcmp(expected, got) != 0) {
+        fprintf(stderr, "error: %s has a different AST with the prelude (line %d of the dump)\n", name, first_different_line(expected, got));
+        success = false;
+    }
+
+    printf("%s: %zu tokens in %zu bytes, the %d errors after this are expected\n", name, token_count, size, DAMAGE_COUNT);
+    for (int i = 0; i < DAMAGE_COUNT; i++) {
+        unsigned char* damaged = malloc(size);
+        memcpy(damaged, prelude, size);
+
+        size_t damaged_size = size;
+        size_t skip = token_count;
+        switch (i) {
+            case DAMAGE_VERSION:  ((uint32_t*) damaged)[1] += 1; break;
+            case DAMAGE_TRUNCATE: damaged_size = size / 2; break;
+            case DAMAGE_BIT_FLIP: damaged[size / 2] ^= 0x10; break;
+            case DAMAGE_TOKENS:   skip = token_count - 1; break;
+        }
+
+        char* str = parse_and_dump(path, damaged, damaged_size, skip);
+        if (str != NULL) {
+            fprintf(stderr, "error: %s parsed with a damaged prelude (%s)\n", name, damage_names[i]);
+            success = false;
+            free(str);
+        }
+
+        free(damaged);
+    }
+
+    free(got);
+    free(expected);
+    free(prelude);
+    return success;
+}
+
+int main(int argc, char** argv) {
+    cuik_init();
+    find_system_deps();
+
+    #if defined(_WIN32)
+    target_desc.sys = CUIK_SYSTEM_WINDOWS;
+    #elif defined(__linux) || defined(linux)
+    target_desc.sys = CUIK_SYSTEM_LINUX;
+    #elif defined(__APPLE__) || defined(__MACH__) || defined(macintosh)
+    target_desc.sys = CUIK_SYSTEM_MACOS;
+    #endif
+    target_desc.arch = cuik_get_x64_target_desc();
+
+    int failures = 0;
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            failures += !test_input(argv[i], argv[i]);
+        }
+    } else {
+        // crt_dirpath is the repo root after find_system_deps
+        for (size_t i = 0; i < PRELUDE_SUITE_COUNT; i++) {
+            char path[FILENAME_MAX];
+            snprintf(path, FILENAME_MAX, "%s/%s", crt_dirpath, prelude_suite[i]);
+
+            failures += !test_input(prelude_suite[i], path);
+        }
+    }
+
+    if (failures > 0) {
+        printf("%d file%s failed\n", failures, failures == 1 ? "" : "s");
+    }
+
+    cuik_free_thread_resources();
+    return failures > 0;
+}
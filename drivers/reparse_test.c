@@ -0,0 +1,282 @@
+// Checks cuik_reparse_translation_unit against a normal parse, by default it runs
+// over tests/the_reparse:
+//
+//   cuik_reparse_test [case...]
+//
+// base.c is parsed incrementally and then reparsed as one of the edited copies of
+// it. Edits inside of function bodies have to be patched in place and report the
+// right statements as dirty, anything else has to come back as CUIK_REPARSE_FULL
+// without touching the TU. Either way the TU we end up with (the patched one or
+// the full parse we fall back to) has to dump the same AST as parsing the edited
+// file from scratch. The exit code is 1 if anything didn't go as expected.
+#include <cuik.h>
+#include <cuik_ast.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "helper.h"
+
+typedef struct {
+    const char* name;
+
+    // relative to tests/the_reparse
+    const char* edited;
+
+    Cuik_ReparseStatus status;
+
+    // the names of the statements which come back dirty, sorted and space
+    // separated (only for CUIK_REPARSE_OK)
+    const char* dirty;
+} ReparseCase;
+
+static const ReparseCase reparse_suite[] = {
+    // the body starts calling a static function nobody used before
+    { "body",   "edit_body.c",   CUIK_REPARSE_OK,   "compute unused_helper" },
+    { "inline", "edit_inline.c", CUIK_REPARSE_OK,   "twice" },
+    { "global", "edit_global.c", CUIK_REPARSE_FULL, NULL },
+};
+enum { REPARSE_SUITE_COUNT = sizeof(reparse_suite) / sizeof(reparse_suite[0]) };
+
+static Cuik_Target target_desc;
+
+static Cuik_CPP* preprocess(const char* path) {
+    Cuik_CPP* cpp = malloc(sizeof(Cuik_CPP));
+    cuikpp_init(cpp, path);
+    cuikpp_set_common_defines(cpp, &target_desc, true);
+
+    if (cuikpp_default_run(cpp, NULL) == CUIKPP_ERROR) {
+        fprintf(stderr, "error: could not preprocess %s\n", path);
+        cuikpp_deinit(cpp);
+        free(cpp);
+        return NULL;
+    }
+
+    cuikpp_finalize(cpp);
+    return cpp;
+}
+
+static void free_preprocessor(Cuik_CPP* cpp) {
+    cuikpp_deinit(cpp);
+    free(cpp);
+}
+
+static char* dump_to_string(TranslationUnit* tu) {
+    FILE* f = tmpfile();
+    if (f == NULL) {
+        fprintf(stderr, "error: could not make a temporary file\n");
+        exit(1);
+    }
+
+    cuik_dump_translation_unit(f, tu, true);
+
+    long size = ftell(f);
+    rewind(f);
+
+    char* str = malloc(size + 1);
+    str[fread(str, 1, size, f)] = 0;
+    fclose(f);
+    return str;
+}
+
+// the TU takes the tokens so the preprocessor has to stay alive as long as it does
+static TranslationUnit* parse(Cuik_CPP* cpp, Cuik_ErrorStatus* errors, bool incremental) {
+    Cuik_TranslationUnitDesc desc = {
+        .tokens      = cuikpp_get_token_stream(cpp),
+        .errors      = errors,
+        .target      = &target_desc,
+        .incremental = incremental,
+    };
+
+    return cuik_parse_translation_unit(&desc);
+}
+
+// returns NULL if it didn't parse
+static char* parse_and_dump(const char* path) {
+    Cuik_CPP* cpp = preprocess(path);
+    if (cpp == NULL) return NULL;
+
+    Cuik_ErrorStatus errors;
+    char* str = NULL;
+    TranslationUnit* tu = parse(cpp, &errors, false);
+    if (tu != NULL) {
+        str = dump_to_string(tu);
+        cuik_destroy_translation_unit(tu);
+    }
+
+    free_preprocessor(cpp);
+    return str;
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(const char**) a, *(const char**) b);
+}
+
+static void dirty_names(char* out, size_t out_size, Stmt** dirty, size_t dirty_count) {
+    const char** names = malloc((dirty_count + 1) * sizeof(const char*));
+    for (size_t i = 0; i < dirty_count; i++) {
+        names[i] = dirty[i]->decl.name ? (const char*) dirty[i]->decl.name : "<unnamed>";
+    }
+    qsort(names, dirty_count, sizeof(const char*), compare_names);
+
+    size_t len = 0;
+    out[0] = 0;
+    for (size_t i = 0; i < dirty_count && len < out_size; i++) {
+        len += snprintf(&out[len], out_size - len, "%s%s", i ? " " : "", names[i]);
+    }
+    free(names);
+}
+
+// 1-based line number of the first difference
+static int first_different_line(const char* a, const char* b) {
+    int line = 1;
+    for (; *a && *a == *b; a++, b++) {
+        if (*a == '\n') line++;
+    }
+
+    return line;
+}
+
+static bool test_case(const ReparseCase* c) {
+    char base_path[FILENAME_MAX], edited_path[FILENAME_MAX];
+    snprintf(base_path, FILENAME_MAX, "%s/tests/the_reparse/base.c", crt_dirpath);
+    snprintf(edited_path, FILENAME_MAX, "%s/tests/the_reparse/%s", crt_dirpath, c->edited);
+
+    char* expected = parse_and_dump(edited_path);
+    if (expected == NULL) {
+        fprintf(stderr, "error: could not parse %s\n", c->edited);
+        return false;
+    }
+
+    Cuik_CPP* base_cpp = preprocess(base_path);
+    if (base_cpp == NULL) {
+        free(expected);
+        return false;
+    }
+
+    Cuik_ErrorStatus errors;
+    TranslationUnit* tu = parse(base_cpp, &errors, true);
+    if (tu == NULL) {
+        fprintf(stderr, "error: could not parse base.c\n");
+        free_preprocessor(base_cpp);
+        free(expected);
+        return false;
+    }
+    char* before = dump_to_string(tu);
+
+    Cuik_CPP* cpp = preprocess(edited_path);
+    if (cpp == NULL) {
+        cuik_destroy_translation_unit(tu);
+        free_preprocessor(base_cpp);
+        free(before);
+        free(expected);
+        return false;
+    }
+
+    Cuik_ErrorStatus reparse_errors;
+    Cuik_TranslationUnitDesc desc = {
+        .tokens = cuikpp_get_token_stream(cpp),
+        .errors = &reparse_errors,
+        .target = &target_desc,
+    };
+
+    Stmt** dirty;
+    size_t dirty_count;
+    Cuik_ReparseStatus status = cuik_reparse_translation_unit(tu, &desc, &dirty, &dirty_count);
+
+    bool success = true;
+    if (status != c->status) {
+        fprintf(stderr, "error: %s reparsed with status %d, expected %d\n", c->name, status, c->status);
+        success = false;
+    }
+
+    if (status == CUIK_REPARSE_OK) {
+        // the TU has the new tokens now so the old ones can go
+        free_preprocessor(base_cpp);
+        base_cpp = NULL;
+
+        char names[256];
+        dirty_names(names, sizeof(names), dirty, dirty_count);
+        if (c->dirty != NULL && strcmp(names, c->dirty) != 0) {
+            fprintf(stderr, "error: %s marked \"%s\" as dirty, expected \"%s\"\n", c->name, names, c->dirty);
+            success = false;
+        }
+        free(dirty);
+    } else if (status == CUIK_REPARSE_FULL) {
+        char* after = dump_to_string(tu);
+        if (strcmp(before, after) != 0) {
+            fprintf(stderr, "error: %s changed the TU without patching it (line %d of the dump)\n", c->name, first_different_line(before, after));
+            success = false;
+        }
+        free(after);
+
+        // fall back to a full parse like a real user would
+        cuik_destroy_translation_unit(tu);
+        tu = parse(cpp, &errors, true);
+        if (tu == NULL) {
+            fprintf(stderr, "error: %s doesn't parse after falling back\n", c->name);
+            success = false;
+        }
+    } else {
+        // the TU is unusable
+        cuik_destroy_translation_unit(tu);
+        tu = NULL;
+    }
+
+    if (tu != NULL) {
+        char* got = dump_to_string(tu);
+        if (strcmp(expected, got) != 0) {
+            fprintf(stderr, "error: %s has a different AST than a full parse (line %d of the dump)\n", c->name, first_different_line(expected, got));
+            success = false;
+        }
+        free(got);
+
+        cuik_destroy_translation_unit(tu);
+    }
+
+    if (base_cpp != NULL) free_preprocessor(base_cpp);
+    free_preprocessor(cpp);
+    free(before);
+    free(expected);
+    return success;
+}
+
+int main(int argc, char** argv) {
+    cuik_init();
+    find_system_deps();
+
+    #if defined(_WIN32)
+    target_desc.sys = CUIK_SYSTEM_WINDOWS;
+    #elif defined(__linux) || defined(linux)
+    target_desc.sys = CUIK_SYSTEM_LINUX;
+    #elif defined(__APPLE__) || defined(__MACH__) || defined(macintosh)
+    target_desc.sys = CUIK_SYSTEM_MACOS;
+    #endif
+    target_desc.arch = cuik_get_x64_target_desc();
+
+    int failures = 0, ran = 0;
+    for (size_t i = 0; i < REPARSE_SUITE_COUNT; i++) {
+        bool picked = argc <= 1;
+        for (int j = 1; j < argc; j++) {
+            if (strcmp(argv[j], reparse_suite[i].name) == 0) picked = true;
+        }
+        if (!picked) continue;
+
+        bool success = test_case(&reparse_suite[i]);
+        printf("%s: %s\n", reparse_suite[i].name, success ? "ok" : "FAILED");
+
+        failures += !success;
+        ran += 1;
+    }
+
+    if (ran == 0) {
+        fprintf(stderr, "error: no cases picked\n");
+        return 1;
+    }
+
+    if (failures > 0) {
+        printf("%d case%s failed\n", failures, failures == 1 ? "" : "s");
+    }
+
+    cuik_free_thread_resources();
+    return failures > 0;
+}
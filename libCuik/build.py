@@ -34,6 +34,8 @@ if os_name == "Windows":
 	source_patterns.append("lib/back/microsoft_craziness.c")
 	cflags += " -D_CRT_SECURE_NO_WARNINGS"
 	cflags += " -I ../c11threads"
+elif os_name == "Linux":
+	source_patterns.append("lib/back/elf_linker.c")
 
 # configure architecture-specific targeting
 if platform.machine() == "AMD64":
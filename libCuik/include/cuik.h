@@ -26,6 +26,7 @@ typedef struct Token Token;
 typedef struct TranslationUnit TranslationUnit;
 typedef struct CompilationUnit CompilationUnit;
 typedef struct Cuik_Type Cuik_Type;
+typedef struct Cuik_CompactAST Cuik_CompactAST;
 
 /*typedef struct Cuik_Report {
     Cuik_ReportFormat format;
@@ -51,14 +52,33 @@ typedef struct Cuik_IThreadpool {
     void (*work_one_job)(void* user_data);
 } Cuik_IThreadpool;
 
+// sampled per region when cuik_profile_hw_counters is on
+typedef enum Cuik_HWCounter {
+    CUIK_HW_CYCLES,
+    CUIK_HW_INSTRUCTIONS,
+    CUIK_HW_L1D_MISSES,
+    CUIK_HW_LLC_MISSES,
+    CUIK_HW_BRANCH_MISSES,
+
+    CUIK_HW_COUNTER_COUNT
+} Cuik_HWCounter;
+
 typedef struct Cuik_IProfiler {
     void* user_data;
 
     void (*start)(void* user_data);
     void (*stop)(void* user_data);
 
-    void (*begin_plot)(void* user_data, uint64_t nanos, const char* label);
-    void (*end_plot)(void* user_data, uint64_t nanos);
+    // these are only ever called from the profiler's flushing thread, tid is
+    // the thread which reported the region.
+    void (*begin_plot)(void* user_data, uint64_t nanos, uint32_t tid, const char* label);
+
+    // counters is NULL unless hardware counters are on, otherwise it's what the
+    // region accumulated (indexed by Cuik_HWCounter).
+    void (*end_plot)(void* user_data, uint64_t nanos, uint32_t tid, const uint64_t* counters);
+
+    // optional, NULL if the profiler doesn't do counter tracks
+    void (*counter)(void* user_data, uint64_t nanos, uint32_t tid, const char* name, int64_t value);
 } Cuik_IProfiler;
 
 typedef struct Cuik_IDiagnostic {
@@ -82,12 +102,18 @@ const Cuik_ArchDesc* cuik_get_x64_target_desc(void);
 ////////////////////////////////////////////
 // Profiler
 ////////////////////////////////////////////
-// lock_on_plot is true if the profiler->plot function cannot be called on multiple threads at
-// the same time.
-CUIK_API void cuik_start_global_profiler(const Cuik_IProfiler* profiler, bool lock_on_plot);
+// regions are buffered per thread and handed to the profiler in the background
+// so it doesn't need to be thread safe.
+CUIK_API void cuik_start_global_profiler(const Cuik_IProfiler* profiler);
 CUIK_API void cuik_stop_global_profiler(void);
 CUIK_API bool cuik_is_profiling(void);
 
+// Samples the CPU's performance counters (Linux perf_event_open) around every
+// region, call it before starting the profiler. Returns false if they're not
+// available, in which case nothing changes.
+CUIK_API bool cuik_profile_hw_counters(bool enable);
+CUIK_API const char* cuik_hw_counter_name(Cuik_HWCounter counter);
+
 // the absolute values here don't have to mean anything, it's just about being able
 // to measure between two points.
 CUIK_API uint64_t cuik_time_in_nanos(void);
@@ -96,6 +122,10 @@ CUIK_API uint64_t cuik_time_in_nanos(void);
 CUIK_API void cuik_profile_region_start(uint64_t now, const char* fmt, ...);
 CUIK_API void cuik_profile_region_end(void);
 
+// Reports the current value of a counter track, the name isn't copied so
+// it should be a string literal.
+CUIK_API void cuik_profile_counter(const char* name, int64_t value);
+
 // Usage:
 // CUIK_TIMED_BLOCK("Beans %d", 5) {
 //   ...
@@ -201,6 +231,12 @@ CUIK_API void cuik_fscache_destroy(Cuik_FileCache* restrict c);
 CUIK_API void cuik_fscache_put(Cuik_FileCache* restrict c, const char* filepath, const TokenStream* tokens);
 CUIK_API bool cuik_fscache_lookup(Cuik_FileCache* restrict c, const char* filepath, TokenStream* out_tokens);
 CUIK_API bool cuik_fscache_query(Cuik_FileCache* restrict c, const char* filepath);
+// drops the cached tokens for a file so the next preprocessor which asks for it loads
+// it from disk again, no preprocessor can be running while this is called.
+CUIK_API void cuik_fscache_invalidate(Cuik_FileCache* restrict c, const char* filepath);
+// stats every cached file and drops the ones which changed on disk since they were
+// put in, returns how many were dropped. same rules as cuik_fscache_invalidate.
+CUIK_API size_t cuik_fscache_invalidate_stale(Cuik_FileCache* restrict c);
 
 // simplifies whitespace for the lexer
 CUIK_API void cuiklex_canonicalize(size_t length, char* data);
@@ -235,6 +271,45 @@ CUIK_API TokenStream* cuikpp_get_token_stream(Cuik_CPP* ctx);
 CUIK_API size_t cuikpp_get_file_table_count(Cuik_CPP* ctx);
 CUIK_API Cuik_FileEntry* cuikpp_get_file_table(Cuik_CPP* ctx);
 
+// These are always tracked, a preprocessor only runs on one thread at a time so
+// they're just plain counters on the instance.
+typedef struct Cuik_CPPStats {
+    // nanoseconds between an #include (or the main file) being requested and its
+    // tokens arriving, so the include search, IO and lexing when it's not cached.
+    uint64_t include_time;
+    uint64_t files_read;
+
+    // every path handed out in a CUIKPP_PACKET_QUERY_FILE, the default handler
+    // does a stat for each one the file cache doesn't know about.
+    uint64_t include_probes;
+
+    uint64_t define_lookups;
+    uint64_t macro_expansions;
+
+    // only counts the cuiklex_buffer calls made on the preprocessor's thread while
+    // it waited on a file, which is where cuikpp_default_run does them.
+    uint64_t bytes_lexed;
+    uint64_t lines_lexed;
+} Cuik_CPPStats;
+
+typedef struct Cuik_MacroStat {
+    size_t name_len;
+    const char* name;
+    uint64_t expansions;
+} Cuik_MacroStat;
+
+CUIK_API Cuik_CPPStats cuikpp_get_stats(Cuik_CPP* ctx);
+
+// the profiler's "tokens" counter track is a running total over every preprocessor
+// in the process, this puts it back at zero for the next profile.
+CUIK_API void cuikpp_reset_token_counter(void);
+
+// Writes out up to count of the most expanded macros (most first) and returns how
+// many it wrote, a macro which was #undef'd and defined again shows up once per
+// definition. The names live as long as the preprocessor, it must be called before
+// cuikpp_finalize.
+CUIK_API size_t cuikpp_get_macro_stats(Cuik_CPP* ctx, size_t count, Cuik_MacroStat* out);
+
 // Locates an include file from the `path` and copies it's fully qualified path into `output`
 CUIK_API bool cuikpp_find_include_include(Cuik_CPP* ctx, char output[FILENAME_MAX], const char* path);
 
@@ -326,6 +401,11 @@ CUIK_API bool cuikpp_is_in_main_file(TokenStream* tokens, SourceLocIndex loc);
 
 CUIK_API const char* cuikpp_get_main_file(TokenStream* tokens);
 
+// number of tokens before the first one which comes from the main file, those are
+// from the headers it includes up top so it's the part that's worth sharing as a
+// prelude between files.
+CUIK_API size_t cuikpp_count_prelude_tokens(TokenStream* tokens);
+
 // This is an iterator for include search list in the preprocessor:
 //
 // Cuik_FileIter it = cuikpp_first_file(cpp);
@@ -466,10 +546,45 @@ typedef struct Cuik_TranslationUnitDesc {
 
     // if thread_pool is NULL, parsing is single threaded
     Cuik_IThreadpool* thread_pool;
+
+    // static and inline functions which are never referenced don't get parsed
+    // or type checked by default, set this to check them anyways (it's what you
+    // want when the diagnostics are the point, like a syntax-only run).
+    bool check_unreachable;
+
+    // if prelude is non-NULL it's the output of cuik_serialize_translation_unit
+    // over the same tokens this TU starts with, tokens->current should point right
+    // after them. the declarations in it are added without going through those
+    // tokens, the bodies and initializers are still parsed from them when needed.
+    const void* prelude;
+    size_t prelude_size;
+
+    // keeps the tokens and the global symbol tables around after parsing so the
+    // TU can be passed to cuik_reparse_translation_unit later.
+    bool incremental;
 } Cuik_TranslationUnitDesc;
 
 CUIK_API TranslationUnit* cuik_parse_translation_unit(const Cuik_TranslationUnitDesc* restrict desc);
 
+typedef enum Cuik_ReparseStatus {
+    // only function bodies changed and the TU was updated in place
+    CUIK_REPARSE_OK,
+    // something outside of a function body changed, the TU wasn't touched and
+    // you need to parse it from scratch.
+    CUIK_REPARSE_FULL,
+    // one of the reparsed bodies had errors, the TU is unusable now so destroy it
+    CUIK_REPARSE_ERROR,
+} Cuik_ReparseStatus;
+
+// updates a TU made with desc->incremental to match new tokens (from the same file)
+// by only parsing and type checking the function bodies which changed along with
+// anything they pulled in. tokens, errors and thread_pool are taken from the desc,
+// the preprocessor which made the TU's current tokens has to be alive until this
+// returns. on CUIK_REPARSE_OK the statements which need IR generated again are
+// written to out_dirty (freed with free()), the functions in there keep their
+// TB_Function so clear it before running cuik_stmt_gen_ir on them.
+CUIK_API Cuik_ReparseStatus cuik_reparse_translation_unit(TranslationUnit* restrict tu, const Cuik_TranslationUnitDesc* restrict desc, Stmt*** out_dirty, size_t* out_dirty_count);
+
 // sets the user data field, returns the old value
 CUIK_API void* cuik_set_translation_unit_user_data(TranslationUnit* restrict tu, void* ud);
 
@@ -507,22 +622,31 @@ CUIK_API TB_Function* cuik_stmt_gen_ir(TranslationUnit* restrict tu, Stmt* restr
 ////////////////////////////////////////////
 // Translation unit management
 ////////////////////////////////////////////
+// the kid iterators walk either the pointer AST (parent_) or a Cuik_CompactAST
+// (compact_ and parent_index_), in the compact case the kid's index is written
+// out too.
 typedef struct {
     // public
     Expr* expr;
+    uint32_t expr_index;
 
     // internal
     size_t index_;
     Expr* parent_;
+    Cuik_CompactAST* compact_;
+    uint32_t parent_index_;
 } Cuik_ExprIter;
 
 typedef struct {
     // public
     Stmt* stmt;
+    uint32_t stmt_index;
 
     // internal
     size_t index_;
     Stmt* parent_;
+    Cuik_CompactAST* compact_;
+    uint32_t parent_index_;
 } Cuik_StmtIter;
 
 typedef struct {
@@ -536,11 +660,17 @@ typedef struct {
     Stmt** stmts_;
 } Cuik_TopLevelIter;
 
-#define CUIK_FOR_KID_IN_STMT(it, parent_) \
-for (Cuik_StmtIter it = { .parent = (parent_) }; cuik_next_stmt_kid(&it);)
+#define CUIK_FOR_KID_IN_STMT(it, parent) \
+for (Cuik_StmtIter it = { .parent_ = (parent) }; cuik_next_stmt_kid(&it);)
 
-#define CUIK_FOR_KID_IN_EXPR(it, parent_) \
-for (Cuik_ExprIter it = { .parent = (parent_) }; cuik_next_expr_kid(&it);)
+#define CUIK_FOR_KID_IN_EXPR(it, parent) \
+for (Cuik_ExprIter it = { .parent_ = (parent) }; cuik_next_expr_kid(&it);)
+
+#define CUIK_FOR_KID_IN_COMPACT_STMT(it, ast, parent) \
+for (Cuik_StmtIter it = { .compact_ = (ast), .parent_index_ = (parent) }; cuik_next_stmt_kid(&it);)
+
+#define CUIK_FOR_KID_IN_COMPACT_EXPR(it, ast, parent) \
+for (Cuik_ExprIter it = { .compact_ = (ast), .parent_index_ = (parent) }; cuik_next_expr_kid(&it);)
 
 #define CUIK_FOR_TOP_LEVEL_STMT(it, tu_, step_) \
 for (Cuik_TopLevelIter it = cuik_first_top_level_stmt(tu_); cuik_next_top_level_stmt(&it, step_);)
@@ -556,6 +686,24 @@ CUIK_API size_t cuik_num_of_top_level_stmts(TranslationUnit* restrict tu);
 
 CUIK_API void cuik_dump_translation_unit(FILE* stream, TranslationUnit* tu, bool minimalist);
 
+// builds a compact copy of the TU's statements and expressions (see Cuik_CompactAST
+// in cuik_ast.h) or returns the one it already built. It's a snapshot of the AST
+// once it's been type checked, the TU owns it and drops it when it's reparsed. Don't
+// call it while other threads are still working on the TU.
+CUIK_API Cuik_CompactAST* cuik_get_compact_ast(TranslationUnit* restrict tu);
+
+// writes out the top level declarations and the types they use into a binary blob
+// which can be passed as a prelude to any TU which starts with the same tokens (see
+// Cuik_TranslationUnitDesc). function bodies and initializers are kept as positions
+// in those tokens so the TU has to be parsed with desc->incremental. returns NULL
+// if it wasn't or it has a type which can't be cached (VLAs), the result is freed
+// with free().
+CUIK_API void* cuik_serialize_translation_unit(TranslationUnit* restrict tu, size_t* out_size);
+
+// hash of the kinds and spelling of the first count tokens, preludes can be keyed
+// on it (it's also how they check they're being used on the right tokens).
+CUIK_API uint64_t cuik_hash_tokens(TokenStream* restrict tokens, size_t count);
+
 // if the translation units are in a compilation unit you can walk this chain of pointers
 // to read them
 CUIK_API TranslationUnit* cuik_next_translation_unit(TranslationUnit* restrict tu);
@@ -574,8 +722,13 @@ CUIK_API void cuik_create_compilation_unit(CompilationUnit* restrict cu);
 CUIK_API void cuik_lock_compilation_unit(CompilationUnit* restrict cu);
 CUIK_API void cuik_unlock_compilation_unit(CompilationUnit* restrict cu);
 CUIK_API void cuik_add_to_compilation_unit(CompilationUnit* restrict cu, TranslationUnit* restrict tu);
+// detaches the TU without destroying it, the exports are rebuilt from the remaining
+// TUs so this can't be called while others are being added.
+CUIK_API void cuik_remove_from_compilation_unit(CompilationUnit* restrict cu, TranslationUnit* restrict tu);
 CUIK_API void cuik_destroy_compilation_unit(CompilationUnit* restrict cu);
-CUIK_API void cuik_internal_link_compilation_unit(CompilationUnit* restrict cu);
+// each TU's exports are resolved as it's added to the compilation unit, this just
+// reports if any of them were defined more than once (returns false if so).
+CUIK_API bool cuik_internal_link_compilation_unit(CompilationUnit* restrict cu);
 CUIK_API size_t cuik_num_of_translation_units_in_compilation_unit(CompilationUnit* restrict cu);
 
 ////////////////////////////////////////////
@@ -590,6 +743,15 @@ void cuiklink_deinit(Cuik_Linker* l);
 // uses the system library paths located by cuik_find_system_deps
 void cuiklink_add_default_libpaths(Cuik_Linker* l);
 
+// the fixed directories cuiklink_add_default_libpaths adds, it's NULL terminated
+// (empty on Windows, those paths are located with vswhere).
+const char* const* cuiklink_default_libpaths(void);
+
+// glibc's libc.so and libm.so are tiny GNU linker scripts, this only reads their
+// GROUP and INPUT lists and calls input on every file named there in order
+// (as_needed is set for the ones inside AS_NEEDED).
+void cuiklink_parse_linker_script(const char* text, size_t length, void* user_data, void (*input)(void* user_data, const char* name, bool as_needed));
+
 // Adds a directory to the library searches
 void cuiklink_add_libpath(Cuik_Linker* l, const char* filepath);
 
@@ -603,7 +765,16 @@ void cuiklink_add_input_file(Cuik_Linker* l, const char* filepath);
 
 void cuiklink_subsystem_windows(Cuik_Linker* l);
 
-// Calls the system linker
+// The built-in ELF linker will split its work across the threadpool
+void cuiklink_set_threadpool(Cuik_Linker* l, Cuik_IThreadpool* thread_pool);
+
+// The built-in ELF linker will keep a <filename>.ilk next to the output and
+// only rewrite the changed sections on the next link if nothing moved
+void cuiklink_set_incremental(Cuik_Linker* l, bool incremental);
+
+// Calls the system linker (on Linux it's the built-in ELF linker and crt_name
+// is the C library it links against, "c" means -lc, it can be NULL to skip the
+// C runtime)
 // return true if it succeeds
 bool cuiklink_invoke(Cuik_Linker* l, const char* filename, const char* crt_name);
 
@@ -141,6 +141,9 @@ struct Cuik_Type {
 
             int kid_count;
             Member* kids;
+
+            // flattened member lookup used by initializers, built by type_layout
+            struct RecordIndex* flat;
         } record;
 
         // Enumerators
@@ -165,6 +168,11 @@ struct Cuik_Type {
             Atom name;
         } placeholder;
     };
+
+    // set by type_layout (with release order) once the size, alignment, member
+    // offsets and record index are final, they're read-only after that. It's
+    // kept last so a typeof can be resolved in place without touching it.
+    _Atomic(bool) is_laid_out;
 };
 #define TYPE_IS_INTEGER(x) (((x)->kind >= KIND_CHAR) && ((x)->kind <= KIND_LONG))
 #define TYPE_IS_FLOAT(x) (((x)->kind >= KIND_FLOAT) && ((x)->kind <= KIND_DOUBLE))
@@ -405,6 +413,11 @@ struct Stmt {
                 Expr* initial;
             };
 
+            // number of tokens in the function body or initializer, it's
+            // a cheap estimate of how much work the later phases will do
+            // on this declaration (used to balance tasks across threads).
+            int token_count;
+
             Attribs attrs;
         } decl;
         struct StmtFor {
@@ -562,3 +575,52 @@ struct Expr {
 };
 //_Static_assert(offsetof(Expr, next_symbol_in_chain) == offsetof(Expr, next_symbol_in_chain2), "these should be aliasing");
 //_Static_assert(offsetof(Expr, next_symbol_in_chain) == offsetof(Expr, builtin_sym.next_symbol_in_chain), "these should be aliasing");
+
+// Compact AST (see cuik_get_compact_ast)
+//
+// statements and expressions are numbered into their own pools in preorder so a
+// node's kids come right after it. they refer to each other with 32-bit indices
+// and the hot fields are kept in separate arrays, 0 is the null node in both
+// pools. anything cold (names, literals, members...) is read from the node it was
+// built from.
+typedef uint32_t Cuik_ExprIndex;
+typedef uint32_t Cuik_StmtIndex;
+
+// range of Cuik_CompactAST.links
+typedef struct Cuik_CompactLinks {
+    uint32_t start, count;
+} Cuik_CompactLinks;
+
+struct Cuik_CompactAST {
+    size_t expr_count;
+    uint8_t* expr_ops; // ExprOp
+    Cuik_Type** expr_types;
+    SourceLocIndex* expr_locs;
+    // the same kids cuik_next_expr_kid yields
+    Cuik_CompactLinks* expr_kids;
+    Expr** exprs;
+
+    size_t stmt_count;
+    uint8_t* stmt_ops; // StmtOp
+    SourceLocIndex* stmt_locs;
+    // the same kids cuik_next_stmt_kid yields
+    Cuik_CompactLinks* stmt_kids;
+    // the expressions directly under the statement, the count only depends on
+    // the op and missing ones are 0:
+    //   DECL, GLOBAL_DECL: initial
+    //   EXPR, RETURN:      expr
+    //   GOTO:              target
+    //   IF, WHILE, DO_WHILE, SWITCH: cond
+    //   FOR:               cond, next
+    //
+    // a FUNC_DECL's body is the statement right after it.
+    Cuik_CompactLinks* stmt_exprs;
+    Stmt** stmts;
+
+    // same order as cuik_get_top_level_stmts
+    size_t top_level_count;
+    Cuik_StmtIndex* top_level;
+
+    size_t link_count;
+    uint32_t* links;
+};
@@ -4,7 +4,6 @@
 #define MACRO_BUCKET_COUNT 1024
 
 #define THE_SHTUFFS_SIZE (32 << 20)
-#define CUIK__CPP_STATS 0
 
 typedef struct Token {
     // TknType but GCC doesn't like incomplete enums
@@ -51,17 +50,14 @@ struct Cuik_CPP {
     struct CPPStackSlot* stack;
 
     // stats
-    #if CUIK__CPP_STATS
-    uint64_t total_lex_time;
-    uint64_t total_fstats;
-    uint64_t total_include_time;
-    uint64_t total_files_read;
-    uint64_t total_io_time;
-
-    // define table
-    uint64_t total_define_access_time;
-    uint64_t total_define_accesses;
-    #endif
+    Cuik_CPPStats stats;
+
+    // the thread's lexer tallies when the pending file was requested
+    uint64_t lexed_bytes_mark;
+    uint64_t lexed_lines_mark;
+
+    // DynArray(Cuik_MacroStat), the expansion counts of #undef'd macros
+    Cuik_MacroStat* undef_macro_stats;
 
     // NL_Strmap(int)
     int* include_once;
@@ -82,6 +78,7 @@ struct Cuik_CPP {
     const unsigned char** macro_bucket_values_start;
     const unsigned char** macro_bucket_values_end;
     SourceLocIndex* macro_bucket_source_locs;
+    uint32_t* macro_bucket_expansions;
     int macro_bucket_count[MACRO_BUCKET_COUNT];
 
     // tells you if the current scope has had an entry evaluated,
@@ -110,6 +107,12 @@ struct Cuik_Linker {
     #endif
     size_t libpaths_top;
     size_t libpaths_count;
+
+    // used by the built-in ELF linker, NULL means single threaded
+    Cuik_IThreadpool* thread_pool;
+
+    // patch the previous executable in place when its layout still fits
+    bool incremental;
 };
 
 struct CompilationUnit {
@@ -117,8 +120,11 @@ struct CompilationUnit {
     void* lock;
     size_t count;
 
-    // NL_Strmap but like without the macro wrapping
-    Stmt** export_table;
+    // Atom -> Stmt*, it's an AtomMap but we don't expose that
+    struct AtomMap* export_table;
+
+    // number of symbols defined in more than one TU, guarded by the lock
+    int link_errors;
 
     // linked list of all TUs referenced
     TranslationUnit* head;
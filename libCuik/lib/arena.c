@@ -1,4 +1,6 @@
 #include "arena.h"
+#include <cuik.h>
+#include <stdatomic.h>
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -7,6 +9,14 @@
 
 thread_local Arena thread_arena;
 
+// committed across every arena, it's only touched per segment so it's cheap
+// enough to feed the profiler's memory track.
+static _Atomic int64_t arena_total_memory;
+
+static void track_arena_memory(int64_t delta) {
+    cuik_profile_counter("arena memory", atomic_fetch_add_explicit(&arena_total_memory, delta, memory_order_relaxed) + delta);
+}
+
 void* arena_alloc(Arena* arena, size_t size, size_t align) {
     // alignment must be a power of two
     size_t align_mask = align - 1;
@@ -17,8 +27,10 @@ void* arena_alloc(Arena* arena, size_t size, size_t align) {
         exit(2);
     }
 
+    // the top might be a trimmed segment (see arena_append) so we check against
+    // its capacity, anything past that isn't mapped anymore.
     void* ptr;
-    if (arena->top && arena->top->used + size + align < ARENA_SEGMENT_SIZE - sizeof(ArenaSegment)) {
+    if (arena->top && arena->top->used + size + align < arena->top->capacity - sizeof(ArenaSegment)) {
         ptr = &arena->top->data[arena->top->used];
         arena->top->used = (arena->top->used + size + align_mask) & ~align_mask;
     } else {
@@ -35,6 +47,7 @@ void* arena_alloc(Arena* arena, size_t size, size_t align) {
         s->capacity = ARENA_SEGMENT_SIZE;
         s->_pad = 0;
         ptr = s->data;
+        track_arena_memory(ARENA_SEGMENT_SIZE);
 
         // Insert to top of nodes
         if (arena->top) arena->top->next = s;
@@ -49,11 +62,16 @@ void* arena_alloc(Arena* arena, size_t size, size_t align) {
 void arena_free(Arena* arena) {
     if (arena->base) {
         ArenaSegment* c = arena->base;
+        int64_t freed = 0;
         while (c) {
             ArenaSegment* next = c->next;
-            cuik__vfree(c, ARENA_SEGMENT_SIZE);
+            // trimmed segments already gave back their tail, don't unmap whatever
+            // got mapped there since
+            freed += c->capacity;
+            cuik__vfree(c, c->capacity);
             c = next;
         }
+        track_arena_memory(-freed);
 
         arena->base = arena->top = NULL;
     }
@@ -66,6 +84,7 @@ void arena_trim(Arena* arena) {
             size_t aligned_used = (sizeof(ArenaSegment) + c->used + 4095u) & ~4095u;
 
             if (aligned_used != c->capacity) {
+                track_arena_memory(-(int64_t) (c->capacity - aligned_used));
                 cuik__vfree((char*)c + aligned_used, c->capacity - aligned_used);
                 c->capacity = aligned_used;
             }
@@ -74,10 +93,14 @@ void arena_trim(Arena* arena) {
 }
 
 void arena_append(Arena* arena, Arena* other) {
-    if (arena->top != NULL && other != NULL) {
+    if (other == NULL || other->base == NULL) return;
+
+    if (arena->top != NULL) {
         arena->top->next = other->base;
-        arena->top = other->top;
+    } else {
+        arena->base = other->base;
     }
+    arena->top = other->top;
 }
 
 size_t arena_get_memory_usage(Arena* arena) {
@@ -0,0 +1,3252 @@
+// Native ELF64 linker for x86-64 Linux, it handles the objects TB emits along
+// with the usual C runtime bits (crt1.o, libc.so, libc_nonshared.a). It's not
+// trying to be ld, there's no linker scripts beyond the GROUP/INPUT files that
+// glibc ships, no garbage collection and no relaxation besides GOTPCRELX. The
+// output is a non-PIE executable which is either static or dynamically linked
+// with eager binding.
+//
+// Phases:
+//   * load: map every input, expand linker scripts and parse objects in parallel
+//   * resolve: build the global symbol table, extract archive members on demand
+//   * layout: bin input sections into output sections and scan the relocations
+//     (in parallel) to figure out what needs GOT/PLT slots or copy relocations
+//   * write: size the output, mmap it and let the thread pool copy and relocate
+//     the input sections straight into the file
+//
+// Incremental links give the code and data sections some slack and remember the
+// layout in a sidecar (<output>.ilk). As long as the next link fits every section
+// into its old slot, everything keeps its address and we only rewrite the sections
+// which changed (or reference a symbol which moved) into the existing executable.
+#include <cuik.h>
+#include "../common.h"
+#include "../arena.h"
+#include "linker.h"
+#include <dyn_array.h>
+#include <stdatomic.h>
+
+#include <elf.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define NL_STRING_MAP_IMPL
+#define NL_STRING_MAP_INLINE
+#include "../string_map.h"
+
+#define ELF_INTERPRETER "/lib64/ld-linux-x86-64.so.2"
+#define ELF_BASE_ADDRESS 0x400000
+#define ELF_PAGE_SIZE 4096
+
+// relocation work is packed into tasks until they cover roughly this many
+// bytes of section data (each relocation counts as 16 bytes).
+enum {
+    LINK_TASK_QUANTUM = 65536,
+};
+
+typedef struct ElfFile ElfFile;
+typedef struct LinkSymbol LinkSymbol;
+typedef struct OutputSection OutputSection;
+typedef struct ElfLinker ElfLinker;
+
+typedef struct {
+    ElfFile* file;
+    const Elf64_Shdr* shdr;
+    const char* name;
+
+    // NULL if the section doesn't make it into the output
+    OutputSection* out;
+    uint64_t offset;
+
+    const Elf64_Rela* relocs;
+    size_t reloc_count;
+
+    // space reserved in the output, it's bigger than the section when
+    // linking incrementally.
+    uint64_t slot;
+
+    // contents (and relocations) hash, incremental links only rewrite
+    // dirty sections.
+    uint64_t hash;
+    bool dirty;
+} InputSection;
+
+typedef enum {
+    FILE_OBJECT,
+    FILE_ARCHIVE,
+    FILE_SHARED,
+} FileKind;
+
+struct ElfFile {
+    FileKind kind;
+    const char* name;
+
+    const uint8_t* data;
+    size_t size;
+
+    // objects
+    const Elf64_Shdr* shdrs;
+    size_t shnum;
+    const char* shstrtab;
+    InputSection* sections;
+
+    const Elf64_Sym* syms;
+    size_t sym_count;
+    size_t first_global;
+    const char* strtab;
+    const uint32_t* symtab_shndx;
+
+    // global symbol for every entry past first_global
+    LinkSymbol** sym_map;
+
+    // archives, members are keyed by their header offset
+    const char* long_names;
+    size_t long_names_size;
+    size_t member_count;
+    uint64_t* member_offsets;
+    bool* extracted;
+
+    // shared objects
+    const char* soname;
+    bool as_needed, needed;
+    const uint16_t* versym;
+    const char** version_names;
+    size_t version_count;
+};
+
+typedef enum {
+    SYM_UNDEFINED,
+    SYM_LAZY,
+    SYM_DEFINED,
+    SYM_COMMON,
+    SYM_SHARED,
+    SYM_SYNTHETIC,
+} SymbolKind;
+
+enum {
+    NEEDS_GOT     = 1,
+    NEEDS_PLT     = 2,
+    NEEDS_COPY    = 4,
+    NEEDS_TLS_GOT = 8,
+    // a non-GOT reference to an imported function, the PLT entry
+    // becomes the function's address everywhere.
+    ADDRESS_TAKEN = 16,
+    // defined here but referenced by a shared object
+    EXPORTED      = 32,
+    REPORTED      = 64,
+};
+
+struct LinkSymbol {
+    const char* name;
+    SymbolKind kind;
+
+    // weak definition, or when undefined, only weakly referenced
+    bool weak;
+    uint8_t type;
+
+    // the defining file, if it's undefined it's the first file to reference it.
+    // archives define lazy symbols.
+    ElfFile* file;
+    uint32_t sym_index;
+    uint32_t member;
+
+    // common symbols and anything imported
+    uint64_t size, align;
+    uint16_t version;
+
+    _Atomic uint32_t flags;
+
+    // slots in the synthetic sections, -1 if none
+    int32_t got, tls_got, plt, dynsym;
+    uint16_t verneed;
+
+    // for synthetic symbols it's filled in after layout
+    uint64_t address;
+
+    // incremental links need to re-relocate anything referencing it
+    bool moved;
+};
+
+typedef enum {
+    RANK_INTERP,
+    RANK_NOTE,
+    RANK_HASH,
+    RANK_DYNSYM,
+    RANK_DYNSTR,
+    RANK_VERSYM,
+    RANK_VERNEED,
+    RANK_RELA_DYN,
+    RANK_RELA_PLT,
+    RANK_RODATA,
+    RANK_EH_FRAME,
+    RANK_READONLY,
+
+    RANK_INIT,
+    RANK_PLT,
+    RANK_TEXT,
+    RANK_EXEC,
+    RANK_FINI,
+
+    RANK_TDATA,
+    RANK_TBSS,
+    RANK_PREINIT_ARRAY,
+    RANK_INIT_ARRAY,
+    RANK_FINI_ARRAY,
+    RANK_DYNAMIC,
+    RANK_GOT,
+    RANK_GOT_PLT,
+    RANK_DATA,
+    RANK_WRITABLE,
+    RANK_BSS,
+
+    RANK_NONALLOC,
+    RANK_SYMTAB,
+    RANK_STRTAB,
+    RANK_SHSTRTAB,
+} SectionRank;
+
+typedef void SectionWriter(ElfLinker* l, OutputSection* s, uint8_t* dst);
+
+struct OutputSection {
+    const char* name;
+    uint32_t type;
+    uint64_t flags;
+    uint64_t align;
+    uint64_t entsize;
+    SectionRank rank;
+
+    DynArray(InputSection*) inputs;
+
+    // synthetic sections have a writer and know their size up front
+    SectionWriter* write;
+    uint32_t link, info;
+
+    uint64_t size, addr, offset;
+    uint32_t index, name_offset;
+};
+
+// the sidecar is just these arrays back to back
+#define INCREMENTAL_MAGIC "CUIKILK1"
+
+typedef struct {
+    char magic[8];
+
+    // what the executable looked like after we wrote it
+    uint64_t file_size, file_mtime;
+
+    uint64_t section_count, output_count, symbol_count;
+} IncrementalHeader;
+
+typedef struct {
+    uint64_t key, hash, slot;
+} IncrementalSection;
+
+typedef struct {
+    uint64_t key, addr, offset, size;
+} IncrementalOutput;
+
+// sorted by key
+typedef struct {
+    uint64_t key, state;
+} IncrementalSymbol;
+
+typedef struct {
+    uint32_t type;
+    LinkSymbol* sym;
+    uint64_t offset;
+    int64_t addend;
+} DynamicReloc;
+
+struct ElfLinker {
+    Cuik_Linker* desc;
+    Arena arena;
+    atomic_bool failed;
+
+    DynArray(ElfFile*) files;
+    DynArray(ElfFile*) shared;
+    DynArray(void*) mappings;
+    DynArray(size_t) mapping_sizes;
+
+    NL_Strmap(LinkSymbol*) symbols;
+    NL_Strmap(bool) comdat_groups;
+
+    // archive members waiting to be added
+    DynArray(ElfFile*) extract_queue;
+
+    DynArray(OutputSection*) sections;
+    DynArray(InputSection*) live_sections;
+
+    // sorted by output section, these are filled in by the scan
+    DynArray(LinkSymbol*) got_syms;
+    DynArray(LinkSymbol*) plt_syms;
+    DynArray(LinkSymbol*) dynsyms;
+    DynArray(LinkSymbol*) copy_syms;
+    DynArray(LinkSymbol*) common_syms;
+    DynArray(DynamicReloc) rela_dyn;
+    DynArray(DynamicReloc) rela_plt;
+
+    bool is_dynamic;
+    atomic_bool needs_got;
+
+    // dynamic string table, sonames and version names live here too
+    DynArray(char) dynstr;
+    NL_Strmap(uint32_t) dynstr_map;
+
+    // (file, version) pairs we've referenced, index i has version id i + 2
+    DynArray(ElfFile*) verneed_files;
+    DynArray(const char*) verneed_names;
+    size_t verneed_file_count;
+
+    // the symbol table for the output
+    DynArray(char) strtab;
+    DynArray(char) shstrtab;
+    size_t symtab_count, symtab_local_count;
+
+    OutputSection *interp, *hash, *dynsym, *dynstr_sec, *versym, *verneed, *rela_dyn_sec, *rela_plt_sec;
+    OutputSection *plt, *got, *got_plt, *dynamic, *bss, *text;
+    OutputSection *symtab, *strtab_sec, *shstrtab_sec;
+
+    // TLS segment
+    uint64_t tls_start, tls_size, tls_align;
+
+    // bss offset of the commons & copy relocations
+    uint64_t bss_tail;
+
+    size_t phdr_count;
+    uint64_t entry;
+    uint8_t* out;
+
+    // the previous incremental link, NULL if there's nothing to reuse
+    IncrementalHeader* prev;
+    IncrementalSection* prev_sections;
+    IncrementalOutput* prev_outputs;
+    IncrementalSymbol* prev_symbols;
+
+    // layout matched the previous link, only dirty sections get written
+    bool patching;
+};
+
+static void link_error(ElfLinker* l, const char* fmt, ...) {
+    char buffer[1024];
+
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, ap);
+    va_end(ap);
+
+    fprintf(stderr, "error: %s\n", buffer);
+    l->failed = true;
+}
+
+static void* link_alloc(ElfLinker* l, size_t size) {
+    // arena segments come fresh out of mmap so they're zeroed
+    return arena_alloc(&l->arena, size, 16);
+}
+
+static char* link_strdup(ElfLinker* l, const char* str) {
+    size_t len = strlen(str);
+    char* dst = link_alloc(l, len + 1);
+    memcpy(dst, str, len + 1);
+    return dst;
+}
+
+static uint64_t align_up(uint64_t a, uint64_t b) {
+    return b > 1 ? (a + b - 1) & ~(b - 1) : a;
+}
+
+// appends a NUL terminated string to a string table, returns its offset
+static uint32_t append_string(DynArray(char)* table, const char* str) {
+    uint32_t offset = dyn_array_length(*table);
+    size_t len = strlen(str) + 1;
+    dyn_array_put_uninit(*table, len);
+    memcpy(&(*table)[offset], str, len);
+    return offset;
+}
+
+static uint32_t elf_hash(const char* name) {
+    uint32_t h = 0;
+    for (const uint8_t* p = (const uint8_t*) name; *p; p++) {
+        h = (h << 4) + *p;
+        uint32_t g = h & 0xf0000000;
+        if (g) h ^= g >> 24;
+        h &= ~g;
+    }
+    return h;
+}
+
+////////////////////////////////
+// Thread pool helpers
+////////////////////////////////
+typedef void LinkFunc(ElfLinker* l, size_t i);
+
+typedef struct {
+    ElfLinker* l;
+    LinkFunc* fn;
+    size_t start, end;
+    atomic_size_t* remaining;
+} LinkTask;
+
+static void link_task(void* arg) {
+    LinkTask* task = arg;
+    for (size_t i = task->start; i < task->end; i++) {
+        task->fn(task->l, i);
+    }
+    *task->remaining -= 1;
+}
+
+// calls fn over [0, count) on the thread pool, consecutive items are packed
+// into the same task until their costs add up to LINK_TASK_QUANTUM.
+static void parallel_for(ElfLinker* l, size_t count, const uint64_t* costs, LinkFunc* fn) {
+    Cuik_IThreadpool* thread_pool = l->desc->thread_pool;
+    if (thread_pool == NULL || count <= 1) {
+        for (size_t i = 0; i < count; i++) fn(l, i);
+        return;
+    }
+
+    LinkTask* tasks = HEAP_ALLOC(sizeof(LinkTask) * count);
+    size_t task_count = 0;
+    for (size_t i = 0; i < count;) {
+        size_t start = i;
+        uint64_t total = 0;
+        while (i < count && total < LINK_TASK_QUANTUM) {
+            total += costs ? costs[i] : LINK_TASK_QUANTUM;
+            i += 1;
+        }
+
+        tasks[task_count++] = (LinkTask){ l, fn, start, i };
+    }
+
+    atomic_size_t tasks_remaining = task_count;
+    for (size_t i = 0; i < task_count; i++) {
+        tasks[i].remaining = &tasks_remaining;
+        CUIK_CALL(thread_pool, submit, link_task, &tasks[i]);
+    }
+
+    while (tasks_remaining != 0) {
+        CUIK_CALL(thread_pool, work_one_job);
+    }
+
+    HEAP_FREE(tasks);
+}
+
+////////////////////////////////
+// Inputs
+////////////////////////////////
+static bool file_exists(const char* path) {
+    struct stat s;
+    return stat(path, &s) == 0 && S_ISREG(s.st_mode);
+}
+
+static bool try_library_path(char* out, const char* dir, const char* prefix, const char* name, size_t name_len, const char* suffix) {
+    const char* slash = dir[0] && dir[strlen(dir) - 1] == '/' ? "" : "/";
+
+    int len = snprintf(out, FILENAME_MAX, "%s%s%s%.*s%s", dir, slash, prefix, (int) name_len, name, suffix);
+    return len < FILENAME_MAX && file_exists(out);
+}
+
+// libraries can be named like the linker would take them (-lm, m, libm.so),
+// like the Windows driver would (m.lib) or by path.
+static bool find_input(ElfLinker* l, const char* name, char* out) {
+    if (strncmp(name, "-l", 2) == 0) {
+        name += 2;
+    } else if (file_exists(name)) {
+        snprintf(out, FILENAME_MAX, "%s", name);
+        return true;
+    }
+
+    // only bare names get the lib prefix and extensions tacked on
+    size_t len = strlen(name);
+    bool bare = strchr(name, '/') == NULL && strchr(name, '.') == NULL;
+    if (len > 4 && strcmp(name + len - 4, ".lib") == 0) {
+        len -= 4, bare = true;
+    }
+
+    const char* dir = l->desc->libpaths_buffer;
+    for (size_t i = 0; i < l->desc->libpaths_count; i++, dir += strlen(dir) + 1) {
+        if (try_library_path(out, dir, "", name, strlen(name), "")) return true;
+
+        if (bare) {
+            if (try_library_path(out, dir, "lib", name, len, ".so")) return true;
+            if (try_library_path(out, dir, "lib", name, len, ".a")) return true;
+        }
+    }
+
+    return false;
+}
+
+static const uint8_t* map_file(ElfLinker* l, const char* path, size_t* out_size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        link_error(l, "could not open %s", path);
+        return NULL;
+    }
+
+    struct stat s;
+    if (fstat(fd, &s) != 0 || s.st_size == 0) {
+        link_error(l, "could not read %s", path);
+        close(fd);
+        return NULL;
+    }
+
+    void* data = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        link_error(l, "could not map %s", path);
+        return NULL;
+    }
+
+    dyn_array_put(l->mappings, data);
+    dyn_array_put(l->mapping_sizes, s.st_size);
+
+    *out_size = s.st_size;
+    return data;
+}
+
+static void add_input_path(ElfLinker* l, const char* path, bool as_needed);
+
+typedef struct {
+    ElfLinker* l;
+    const char* path;
+} ScriptInputs;
+
+static void add_script_input(void* user_data, const char* name, bool as_needed) {
+    ScriptInputs* script = user_data;
+
+    char resolved[FILENAME_MAX];
+    if (!find_input(script->l, name, resolved)) {
+        link_error(script->l, "could not find %s (referenced by %s)", name, script->path);
+        return;
+    }
+
+    add_input_path(script->l, resolved, as_needed);
+}
+
+// glibc's libc.so and friends are linker scripts, the files they name are loaded
+// like any other input.
+static void load_linker_script(ElfLinker* l, const char* path, const char* text, size_t length) {
+    ScriptInputs script = { l, path };
+    cuiklink_parse_linker_script(text, length, &script, add_script_input);
+}
+
+static bool check_elf_header(ElfLinker* l, const char* name, const uint8_t* data, size_t size, uint16_t type) {
+    const Elf64_Ehdr* ehdr = (const Elf64_Ehdr*) data;
+    if (size < sizeof(Elf64_Ehdr) || ehdr->e_ident[EI_CLASS] != ELFCLASS64 || ehdr->e_ident[EI_DATA] != ELFDATA2LSB) {
+        link_error(l, "%s: not a 64-bit little-endian ELF file", name);
+        return false;
+    }
+
+    if (ehdr->e_machine != EM_X86_64) {
+        link_error(l, "%s: not an x86-64 ELF file", name);
+        return false;
+    }
+
+    if (ehdr->e_type != type) {
+        link_error(l, "%s: unexpected ELF file type %d", name, ehdr->e_type);
+        return false;
+    }
+
+    return true;
+}
+
+static ElfFile* new_file(ElfLinker* l, FileKind kind, const char* name, const uint8_t* data, size_t size) {
+    ElfFile* f = link_alloc(l, sizeof(ElfFile));
+    f->kind = kind;
+    f->name = name;
+    f->data = data;
+    f->size = size;
+    return f;
+}
+
+static void add_input_path(ElfLinker* l, const char* path, bool as_needed) {
+    size_t size;
+    const uint8_t* data = map_file(l, path, &size);
+    if (data == NULL) return;
+
+    const char* name = link_strdup(l, path);
+    if (size >= 8 && memcmp(data, "!<arch>\n", 8) == 0) {
+        dyn_array_put(l->files, new_file(l, FILE_ARCHIVE, name, data, size));
+    } else if (size >= 4 && memcmp(data, ELFMAG, 4) == 0) {
+        const Elf64_Ehdr* ehdr = (const Elf64_Ehdr*) data;
+        if (size >= sizeof(Elf64_Ehdr) && ehdr->e_type == ET_DYN) {
+            if (!check_elf_header(l, path, data, size, ET_DYN)) return;
+
+            ElfFile* f = new_file(l, FILE_SHARED, name, data, size);
+            f->as_needed = as_needed;
+            dyn_array_put(l->files, f);
+        } else {
+            if (!check_elf_header(l, path, data, size, ET_REL)) return;
+
+            dyn_array_put(l->files, new_file(l, FILE_OBJECT, name, data, size));
+        }
+    } else if (size >= 8 && memcmp(data, "!<thin>\n", 8) == 0) {
+        link_error(l, "%s: thin archives aren't supported", path);
+    } else {
+        load_linker_script(l, path, (const char*) data, size);
+    }
+}
+
+////////////////////////////////
+// Objects
+////////////////////////////////
+static bool parse_object_headers(ElfLinker* l, ElfFile* f) {
+    const Elf64_Ehdr* ehdr = (const Elf64_Ehdr*) f->data;
+    if (ehdr->e_shoff == 0 || ehdr->e_shoff + sizeof(Elf64_Shdr) > f->size) {
+        link_error(l, "%s: missing section headers", f->name);
+        return false;
+    }
+
+    f->shdrs = (const Elf64_Shdr*) (f->data + ehdr->e_shoff);
+
+    // with lots of sections the real counts live in the null section
+    f->shnum = ehdr->e_shnum ? ehdr->e_shnum : f->shdrs[0].sh_size;
+    size_t shstrndx = ehdr->e_shstrndx == SHN_XINDEX ? f->shdrs[0].sh_link : ehdr->e_shstrndx;
+    if (ehdr->e_shoff + f->shnum * sizeof(Elf64_Shdr) > f->size || shstrndx >= f->shnum) {
+        link_error(l, "%s: section headers are out of bounds", f->name);
+        return false;
+    }
+
+    f->shstrtab = (const char*) (f->data + f->shdrs[shstrndx].sh_offset);
+    return true;
+}
+
+static void parse_object(ElfLinker* l, ElfFile* f) {
+    if (!parse_object_headers(l, f)) return;
+
+    // the lookup tables get allocated by the caller since the arena isn't thread safe
+    for (size_t i = 0; i < f->shnum; i++) {
+        const Elf64_Shdr* shdr = &f->shdrs[i];
+        if (shdr->sh_type != SHT_NOBITS && shdr->sh_offset + shdr->sh_size > f->size) {
+            link_error(l, "%s: section %zu is out of bounds", f->name, i);
+            return;
+        }
+
+        InputSection* sec = &f->sections[i];
+        sec->file = f;
+        sec->shdr = shdr;
+        sec->name = f->shstrtab + shdr->sh_name;
+
+        if (shdr->sh_type == SHT_SYMTAB) {
+            f->syms = (const Elf64_Sym*) (f->data + shdr->sh_offset);
+            f->sym_count = shdr->sh_size / sizeof(Elf64_Sym);
+            f->first_global = shdr->sh_info;
+            f->strtab = (const char*) (f->data + f->shdrs[shdr->sh_link].sh_offset);
+        } else if (shdr->sh_type == SHT_SYMTAB_SHNDX) {
+            f->symtab_shndx = (const uint32_t*) (f->data + shdr->sh_offset);
+        }
+    }
+
+    // attach relocations to the sections they apply to
+    for (size_t i = 0; i < f->shnum; i++) {
+        const Elf64_Shdr* shdr = &f->shdrs[i];
+        if (shdr->sh_type == SHT_REL) {
+            link_error(l, "%s: REL relocations aren't supported on x86-64", f->name);
+            return;
+        } else if (shdr->sh_type == SHT_RELA && shdr->sh_info < f->shnum) {
+            InputSection* target = &f->sections[shdr->sh_info];
+            target->relocs = (const Elf64_Rela*) (f->data + shdr->sh_offset);
+            target->reloc_count = shdr->sh_size / sizeof(Elf64_Rela);
+        }
+    }
+}
+
+static uint32_t symbol_shndx(ElfFile* f, size_t i) {
+    const Elf64_Sym* sym = &f->syms[i];
+    if (sym->st_shndx == SHN_XINDEX) {
+        return f->symtab_shndx ? f->symtab_shndx[i] : SHN_UNDEF;
+    }
+    return sym->st_shndx;
+}
+
+static bool is_discarded(ElfFile* f, uint32_t shndx) {
+    return shndx != SHN_UNDEF && shndx < SHN_LORESERVE && shndx < f->shnum && f->sections[shndx].shdr == NULL;
+}
+
+static LinkSymbol* intern_symbol(ElfLinker* l, const char* name) {
+    ptrdiff_t search = nl_strmap_get_cstr(l->symbols, name);
+    if (search >= 0) {
+        return l->symbols[search];
+    }
+
+    LinkSymbol* s = link_alloc(l, sizeof(LinkSymbol));
+    s->name = name;
+    s->kind = SYM_UNDEFINED;
+    s->weak = true;
+    s->got = s->tls_got = s->plt = s->dynsym = -1;
+    nl_strmap_put_cstr(l->symbols, name, s);
+    return s;
+}
+
+static void extract_member(ElfLinker* l, ElfFile* archive, uint32_t member);
+
+static void resolve_object_symbol(ElfLinker* l, ElfFile* f, size_t i) {
+    const Elf64_Sym* sym = &f->syms[i];
+    const char* name = f->strtab + sym->st_name;
+    uint8_t bind = ELF64_ST_BIND(sym->st_info);
+    uint32_t shndx = symbol_shndx(f, i);
+
+    LinkSymbol* s = intern_symbol(l, name);
+    f->sym_map[i - f->first_global] = s;
+
+    bool weak = (bind == STB_WEAK);
+    if (shndx == SHN_UNDEF || is_discarded(f, shndx)) {
+        if (s->kind == SYM_UNDEFINED) {
+            if (s->file == NULL) s->file = f;
+            if (!weak) s->weak = false;
+        } else if (s->kind == SYM_LAZY && !weak) {
+            extract_member(l, s->file, s->member);
+        }
+        return;
+    }
+
+    if (shndx == SHN_COMMON) {
+        switch (s->kind) {
+            case SYM_DEFINED:
+            case SYM_SYNTHETIC:
+            return;
+
+            case SYM_COMMON:
+            if (s->size >= sym->st_size) {
+                s->align = s->align > sym->st_value ? s->align : sym->st_value;
+                return;
+            }
+            break;
+
+            default: break;
+        }
+
+        uint64_t align = s->kind == SYM_COMMON ? s->align : 1;
+        s->kind = SYM_COMMON;
+        s->file = f;
+        s->sym_index = i;
+        s->weak = false;
+        s->type = STT_OBJECT;
+        s->size = sym->st_size;
+        s->align = align > sym->st_value ? align : sym->st_value;
+        return;
+    }
+
+    if (s->kind == SYM_DEFINED) {
+        if (weak || s->weak) {
+            // strong definitions beat weak ones, otherwise the first one wins
+            if (weak || !s->weak) return;
+        } else {
+            link_error(l, "duplicate symbol: %s\n    defined in %s\n    defined in %s", name, s->file->name, f->name);
+            return;
+        }
+    }
+
+    s->kind = SYM_DEFINED;
+    s->file = f;
+    s->sym_index = i;
+    s->weak = weak;
+    s->type = ELF64_ST_TYPE(sym->st_info);
+    s->size = sym->st_size;
+}
+
+static void add_object(ElfLinker* l, ElfFile* f) {
+    // COMDAT groups are deduplicated by signature, the first one wins and the
+    // rest of them get discarded along with the symbols defined in them.
+    for (size_t i = 0; i < f->shnum; i++) {
+        const Elf64_Shdr* shdr = &f->shdrs[i];
+        if (shdr->sh_type != SHT_GROUP || f->syms == NULL) continue;
+
+        const uint32_t* entries = (const uint32_t*) (f->data + shdr->sh_offset);
+        size_t count = shdr->sh_size / sizeof(uint32_t);
+        if (count == 0 || (entries[0] & GRP_COMDAT) == 0) continue;
+
+        const char* signature = f->strtab + f->syms[shdr->sh_info].st_name;
+        if (nl_strmap_get_cstr(l->comdat_groups, signature) >= 0) {
+            for (size_t j = 1; j < count; j++) {
+                if (entries[j] < f->shnum) f->sections[entries[j]].shdr = NULL;
+            }
+        } else {
+            nl_strmap_put_cstr(l->comdat_groups, signature, true);
+        }
+    }
+
+    for (size_t i = f->first_global; i < f->sym_count; i++) {
+        resolve_object_symbol(l, f, i);
+    }
+}
+
+static ElfFile* load_object(ElfLinker* l, ElfFile* f) {
+    if (f->shdrs == NULL && !parse_object_headers(l, f)) return NULL;
+
+    f->sections = link_alloc(l, f->shnum * sizeof(InputSection));
+    parse_object(l, f);
+
+    if (f->sym_count > f->first_global) {
+        f->sym_map = link_alloc(l, (f->sym_count - f->first_global) * sizeof(LinkSymbol*));
+    }
+    return f;
+}
+
+////////////////////////////////
+// Archives
+////////////////////////////////
+typedef struct {
+    char name[16];
+    char date[12];
+    char uid[6];
+    char gid[6];
+    char mode[8];
+    char size[10];
+    char magic[2];
+} ArchiveHeader;
+
+static uint64_t parse_decimal(const char* str, size_t len) {
+    uint64_t x = 0;
+    for (size_t i = 0; i < len && str[i] >= '0' && str[i] <= '9'; i++) {
+        x = (x * 10) + (str[i] - '0');
+    }
+    return x;
+}
+
+static uint64_t read_be(const uint8_t* p, size_t bytes) {
+    uint64_t x = 0;
+    for (size_t i = 0; i < bytes; i++) x = (x << 8) | p[i];
+    return x;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t find_member(ElfFile* f, uint64_t offset) {
+    uint64_t* slot = bsearch(&offset, f->member_offsets, f->member_count, sizeof(uint64_t), compare_u64);
+    return slot - f->member_offsets;
+}
+
+// registers all the symbols in the archive's index as lazy, the members are
+// only parsed once something references them.
+static void add_archive(ElfLinker* l, ElfFile* f) {
+    const uint8_t* index = NULL;
+    size_t index_size = 0, word = 4;
+
+    for (size_t pos = 8; pos + sizeof(ArchiveHeader) <= f->size;) {
+        const ArchiveHeader* hdr = (const ArchiveHeader*) (f->data + pos);
+        size_t size = parse_decimal(hdr->size, sizeof(hdr->size));
+        const uint8_t* body = f->data + pos + sizeof(ArchiveHeader);
+
+        if (memcmp(hdr->name, "/               ", 16) == 0) {
+            index = body, index_size = size, word = 4;
+        } else if (memcmp(hdr->name, "/SYM64/         ", 16) == 0) {
+            index = body, index_size = size, word = 8;
+        } else if (memcmp(hdr->name, "//              ", 16) == 0) {
+            f->long_names = (const char*) body;
+            f->long_names_size = size;
+        }
+
+        pos = align_up(pos + sizeof(ArchiveHeader) + size, 2);
+    }
+
+    if (index == NULL || index_size < word) {
+        // there's nothing to pull from an archive without an index
+        return;
+    }
+
+    size_t count = read_be(index, word);
+    if (word + (count * word) > index_size) {
+        link_error(l, "%s: broken archive symbol table", f->name);
+        return;
+    }
+
+    const uint8_t* offsets = index + word;
+    const char* names = (const char*) (offsets + count * word);
+    const char* names_end = (const char*) (index + index_size);
+
+    f->member_offsets = link_alloc(l, count * sizeof(uint64_t));
+    for (size_t i = 0; i < count; i++) {
+        f->member_offsets[i] = read_be(offsets + i * word, word);
+    }
+
+    qsort(f->member_offsets, count, sizeof(uint64_t), compare_u64);
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (unique == 0 || f->member_offsets[unique - 1] != f->member_offsets[i]) {
+            f->member_offsets[unique++] = f->member_offsets[i];
+        }
+    }
+    f->member_count = unique;
+    f->extracted = link_alloc(l, unique * sizeof(bool));
+
+    for (size_t i = 0; i < count && names < names_end; i++) {
+        const char* name = names;
+        names += strlen(names) + 1;
+
+        LinkSymbol* s = intern_symbol(l, name);
+        uint32_t member = find_member(f, read_be(offsets + i * word, word));
+        if (s->kind == SYM_UNDEFINED && s->file != NULL && !s->weak) {
+            extract_member(l, f, member);
+        } else if (s->kind == SYM_UNDEFINED) {
+            s->kind = SYM_LAZY;
+            s->file = f;
+            s->member = member;
+        }
+    }
+}
+
+static void extract_member(ElfLinker* l, ElfFile* archive, uint32_t member) {
+    if (archive->extracted[member]) return;
+    archive->extracted[member] = true;
+
+    uint64_t pos = archive->member_offsets[member];
+    if (pos + sizeof(ArchiveHeader) > archive->size) {
+        link_error(l, "%s: member is out of bounds", archive->name);
+        return;
+    }
+
+    const ArchiveHeader* hdr = (const ArchiveHeader*) (archive->data + pos);
+    size_t size = parse_decimal(hdr->size, sizeof(hdr->size));
+    const uint8_t* data = archive->data + pos + sizeof(ArchiveHeader);
+    if (pos + sizeof(ArchiveHeader) + size > archive->size) {
+        link_error(l, "%s: member is out of bounds", archive->name);
+        return;
+    }
+
+    // GNU names either end in a slash or are an offset into the long names
+    char member_name[FILENAME_MAX];
+    if (hdr->name[0] == '/' && archive->long_names != NULL) {
+        size_t offset = parse_decimal(hdr->name + 1, sizeof(hdr->name) - 1);
+        size_t len = 0;
+        while (offset + len < archive->long_names_size && archive->long_names[offset + len] != '/' && archive->long_names[offset + len] != '\n') {
+            len++;
+        }
+        snprintf(member_name, sizeof(member_name), "%s(%.*s)", archive->name, (int) len, archive->long_names + offset);
+    } else {
+        size_t len = 0;
+        while (len < sizeof(hdr->name) && hdr->name[len] != '/' && hdr->name[len] != ' ') len++;
+        snprintf(member_name, sizeof(member_name), "%s(%.*s)", archive->name, (int) len, hdr->name);
+    }
+
+    // members are only 2 byte aligned, the ELF structures want better
+    if (((uintptr_t) data & 7) != 0) {
+        uint8_t* copy = link_alloc(l, size);
+        memcpy(copy, data, size);
+        data = copy;
+    }
+
+    const char* name = link_strdup(l, member_name);
+    if (!check_elf_header(l, name, data, size, ET_REL)) return;
+
+    ElfFile* f = load_object(l, new_file(l, FILE_OBJECT, name, data, size));
+    if (f != NULL) {
+        dyn_array_put(l->extract_queue, f);
+    }
+}
+
+////////////////////////////////
+// Shared objects
+////////////////////////////////
+static const Elf64_Shdr* find_section_of_type(ElfFile* f, uint32_t type) {
+    for (size_t i = 0; i < f->shnum; i++) {
+        if (f->shdrs[i].sh_type == type) return &f->shdrs[i];
+    }
+    return NULL;
+}
+
+static void add_shared(ElfLinker* l, ElfFile* f) {
+    if (!parse_object_headers(l, f)) return;
+
+    const Elf64_Shdr* dynsym = find_section_of_type(f, SHT_DYNSYM);
+    if (dynsym == NULL) {
+        link_error(l, "%s: shared object has no dynamic symbols", f->name);
+        return;
+    }
+
+    f->syms = (const Elf64_Sym*) (f->data + dynsym->sh_offset);
+    f->sym_count = dynsym->sh_size / sizeof(Elf64_Sym);
+    f->strtab = (const char*) (f->data + f->shdrs[dynsym->sh_link].sh_offset);
+
+    // DT_NEEDED wants the soname, if there isn't one we'll settle for the filename
+    const char* slash = strrchr(f->name, '/');
+    f->soname = slash ? slash + 1 : f->name;
+
+    const Elf64_Shdr* dynamic = find_section_of_type(f, SHT_DYNAMIC);
+    if (dynamic != NULL) {
+        const Elf64_Dyn* dyn = (const Elf64_Dyn*) (f->data + dynamic->sh_offset);
+        const char* dynstr = (const char*) (f->data + f->shdrs[dynamic->sh_link].sh_offset);
+        for (size_t i = 0; i < dynamic->sh_size / sizeof(Elf64_Dyn) && dyn[i].d_tag != DT_NULL; i++) {
+            if (dyn[i].d_tag == DT_SONAME) f->soname = dynstr + dyn[i].d_un.d_val;
+        }
+    }
+
+    // version definitions, we need the names to ask for the same versions
+    const Elf64_Shdr* versym = find_section_of_type(f, SHT_GNU_versym);
+    const Elf64_Shdr* verdef = find_section_of_type(f, SHT_GNU_verdef);
+    if (versym != NULL && verdef != NULL) {
+        f->versym = (const uint16_t*) (f->data + versym->sh_offset);
+
+        const char* strtab = (const char*) (f->data + f->shdrs[verdef->sh_link].sh_offset);
+        const uint8_t* p = f->data + verdef->sh_offset;
+        for (size_t i = 0; i < verdef->sh_info; i++) {
+            const Elf64_Verdef* vd = (const Elf64_Verdef*) p;
+            if (vd->vd_ndx >= f->version_count) {
+                size_t new_count = (vd->vd_ndx + 1) * 2;
+                const char** names = link_alloc(l, new_count * sizeof(const char*));
+                if (f->version_count) memcpy(names, f->version_names, f->version_count * sizeof(const char*));
+
+                f->version_names = names;
+                f->version_count = new_count;
+            }
+
+            const Elf64_Verdaux* aux = (const Elf64_Verdaux*) (p + vd->vd_aux);
+            f->version_names[vd->vd_ndx] = strtab + aux->vda_name;
+
+            if (vd->vd_next == 0) break;
+            p += vd->vd_next;
+        }
+    }
+
+    for (size_t i = 1; i < f->sym_count; i++) {
+        const Elf64_Sym* sym = &f->syms[i];
+        uint8_t bind = ELF64_ST_BIND(sym->st_info);
+        if (sym->st_shndx == SHN_UNDEF || bind == STB_LOCAL) continue;
+
+        // hidden versions can only be asked for by name
+        uint16_t version = f->versym ? f->versym[i] : VER_NDX_GLOBAL;
+        if ((version & 0x8000) || version == VER_NDX_LOCAL) continue;
+
+        LinkSymbol* s = intern_symbol(l, f->strtab + sym->st_name);
+        if (s->kind != SYM_UNDEFINED && s->kind != SYM_LAZY) continue;
+
+        s->kind = SYM_SHARED;
+        s->file = f;
+        s->sym_index = i;
+        s->weak = (bind == STB_WEAK);
+        s->type = ELF64_ST_TYPE(sym->st_info);
+        s->size = sym->st_size;
+        s->version = version;
+    }
+}
+
+////////////////////////////////
+// Symbol resolution
+////////////////////////////////
+static void drain_extract_queue(ElfLinker* l) {
+    while (dyn_array_length(l->extract_queue) > 0) {
+        size_t last = dyn_array_length(l->extract_queue) - 1;
+        ElfFile* f = l->extract_queue[last];
+        dyn_array_set_length(l->extract_queue, last);
+
+        dyn_array_put(l->files, f);
+        add_object(l, f);
+    }
+}
+
+static void parse_object_task(ElfLinker* l, size_t i) {
+    ElfFile* f = l->files[i];
+    if (f->kind == FILE_OBJECT) {
+        parse_object(l, f);
+    }
+}
+
+static void resolve_symbols(ElfLinker* l) {
+    // the section headers are cheap to find, the rest of the parsing can
+    // happen in parallel once the tables are allocated.
+    size_t file_count = dyn_array_length(l->files);
+    dyn_array_for(i, l->files) {
+        ElfFile* f = l->files[i];
+        if (f->kind == FILE_OBJECT && parse_object_headers(l, f)) {
+            f->sections = link_alloc(l, f->shnum * sizeof(InputSection));
+        }
+    }
+    if (l->failed) return;
+
+    uint64_t* costs = HEAP_ALLOC(file_count * sizeof(uint64_t));
+    for (size_t i = 0; i < file_count; i++) costs[i] = LINK_TASK_QUANTUM / 4;
+    parallel_for(l, file_count, costs, parse_object_task);
+    HEAP_FREE(costs);
+    if (l->failed) return;
+
+    for (size_t i = 0; i < file_count; i++) {
+        ElfFile* f = l->files[i];
+        if (f->kind == FILE_OBJECT && f->sym_count > f->first_global) {
+            f->sym_map = link_alloc(l, (f->sym_count - f->first_global) * sizeof(LinkSymbol*));
+        }
+    }
+
+    for (size_t i = 0; i < file_count; i++) {
+        ElfFile* f = l->files[i];
+        switch (f->kind) {
+            case FILE_OBJECT:  add_object(l, f);  break;
+            case FILE_ARCHIVE: add_archive(l, f); break;
+            case FILE_SHARED:
+            add_shared(l, f);
+            dyn_array_put(l->shared, f);
+            break;
+        }
+
+        drain_extract_queue(l);
+    }
+}
+
+// these are the symbols ld would've made up for us, we only define the ones
+// someone asked for.
+static const char* synthetic_symbols[] = {
+    "_GLOBAL_OFFSET_TABLE_", "_DYNAMIC", "__ehdr_start", "__executable_start",
+    "__init_array_start", "__init_array_end", "__fini_array_start", "__fini_array_end",
+    "__preinit_array_start", "__preinit_array_end", "__rela_iplt_start", "__rela_iplt_end",
+    "_etext", "etext", "_edata", "edata", "__bss_start", "_end", "end",
+};
+
+static void define_synthetic_symbols(ElfLinker* l) {
+    for (size_t i = 0; i < sizeof(synthetic_symbols) / sizeof(synthetic_symbols[0]); i++) {
+        ptrdiff_t search = nl_strmap_get_cstr(l->symbols, synthetic_symbols[i]);
+        if (search < 0) continue;
+
+        LinkSymbol* s = l->symbols[search];
+        if (s->kind == SYM_UNDEFINED || s->kind == SYM_LAZY) {
+            s->kind = SYM_SYNTHETIC;
+            s->weak = false;
+            s->type = STT_NOTYPE;
+
+            if (strcmp(s->name, "_GLOBAL_OFFSET_TABLE_") == 0) l->needs_got = true;
+        }
+    }
+
+    // __start_SECTION and __stop_SECTION bound the sections with C identifier
+    // names, glibc uses them for things like __libc_atexit.
+    nl_strmap_for(i, l->symbols) {
+        LinkSymbol* s = l->symbols[i];
+        if ((s->kind == SYM_UNDEFINED || s->kind == SYM_LAZY) && (strncmp(s->name, "__start_", 8) == 0 || strncmp(s->name, "__stop_", 7) == 0)) {
+            s->kind = SYM_SYNTHETIC;
+            s->weak = false;
+            s->type = STT_NOTYPE;
+        }
+    }
+
+    // crtbegin.o usually provides this, it's a NULL pointer for executables
+    // so it can go in the bss like a common symbol.
+    ptrdiff_t search = nl_strmap_get_cstr(l->symbols, "__dso_handle");
+    if (search >= 0 && (l->symbols[search]->kind == SYM_UNDEFINED || l->symbols[search]->kind == SYM_LAZY)) {
+        LinkSymbol* s = l->symbols[search];
+        s->kind = SYM_COMMON;
+        s->weak = false;
+        s->type = STT_OBJECT;
+        s->size = s->align = 8;
+    }
+}
+
+////////////////////////////////
+// Output sections
+////////////////////////////////
+static OutputSection* new_section(ElfLinker* l, const char* name, uint32_t type, uint64_t flags, SectionRank rank, uint64_t align) {
+    OutputSection* s = link_alloc(l, sizeof(OutputSection));
+    s->name = name;
+    s->type = type;
+    s->flags = flags;
+    s->rank = rank;
+    s->align = align;
+    dyn_array_put(l->sections, s);
+    return s;
+}
+
+static bool has_prefix(const char* name, const char* prefix) {
+    size_t len = strlen(prefix);
+    return strncmp(name, prefix, len) == 0 && (name[len] == 0 || name[len] == '.');
+}
+
+static const char* output_section_name(const char* name) {
+    static const char* prefixes[] = {
+        ".text", ".rodata", ".data.rel.ro", ".data", ".bss", ".tdata", ".tbss",
+        ".init_array", ".fini_array", ".preinit_array", ".gcc_except_table",
+    };
+
+    for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+        if (has_prefix(name, prefixes[i])) {
+            return i == 2 ? ".data" : prefixes[i];
+        }
+    }
+
+    if (strncmp(name, ".note.", 6) == 0) return ".note";
+    return name;
+}
+
+static SectionRank section_rank(const char* name, uint32_t type, uint64_t flags) {
+    if ((flags & SHF_ALLOC) == 0) return RANK_NONALLOC;
+
+    if (flags & SHF_TLS) {
+        return type == SHT_NOBITS ? RANK_TBSS : RANK_TDATA;
+    } else if (flags & SHF_EXECINSTR) {
+        if (strcmp(name, ".init") == 0) return RANK_INIT;
+        if (strcmp(name, ".fini") == 0) return RANK_FINI;
+        if (strcmp(name, ".text") == 0) return RANK_TEXT;
+        return RANK_EXEC;
+    } else if (flags & SHF_WRITE) {
+        if (type == SHT_NOBITS) return RANK_BSS;
+        if (type == SHT_PREINIT_ARRAY) return RANK_PREINIT_ARRAY;
+        if (type == SHT_INIT_ARRAY) return RANK_INIT_ARRAY;
+        if (type == SHT_FINI_ARRAY) return RANK_FINI_ARRAY;
+        if (strcmp(name, ".data") == 0) return RANK_DATA;
+        return RANK_WRITABLE;
+    } else {
+        if (type == SHT_NOTE) return RANK_NOTE;
+        if (strcmp(name, ".rodata") == 0) return RANK_RODATA;
+        if (strcmp(name, ".eh_frame") == 0) return RANK_EH_FRAME;
+        return RANK_READONLY;
+    }
+}
+
+static bool is_kept_section(const InputSection* sec) {
+    const Elf64_Shdr* shdr = sec->shdr;
+    if (shdr == NULL || (shdr->sh_flags & SHF_EXCLUDE)) return false;
+
+    switch (shdr->sh_type) {
+        case SHT_PROGBITS: case SHT_NOBITS: case SHT_INIT_ARRAY:
+        case SHT_FINI_ARRAY: case SHT_PREINIT_ARRAY: case SHT_X86_64_UNWIND:
+        break;
+
+        // the only notes which matter are loaded ones, and property notes
+        // make promises about CET we can't keep.
+        case SHT_NOTE:
+        return (shdr->sh_flags & SHF_ALLOC) && strcmp(sec->name, ".note.gnu.property") != 0;
+
+        default:
+        return false;
+    }
+
+    // debug info is the only unloaded thing worth keeping
+    if ((shdr->sh_flags & SHF_ALLOC) == 0) {
+        return strncmp(sec->name, ".debug", 6) == 0;
+    }
+
+    return true;
+}
+
+static OutputSection* find_or_create_section(ElfLinker* l, const char* name, uint32_t type, uint64_t flags) {
+    dyn_array_for(i, l->sections) {
+        OutputSection* s = l->sections[i];
+        if (s->write == NULL && strcmp(s->name, name) == 0 && ((s->flags ^ flags) & (SHF_ALLOC | SHF_TLS)) == 0) {
+            return s;
+        }
+    }
+
+    SectionRank rank = section_rank(name, type, flags);
+    OutputSection* s = new_section(l, name, type, flags & (SHF_ALLOC | SHF_WRITE | SHF_EXECINSTR | SHF_TLS), rank, 1);
+    s->inputs = dyn_array_create_with_initial_cap(InputSection*, 16);
+    return s;
+}
+
+typedef struct {
+    InputSection* sec;
+    uint32_t priority;
+    uint32_t order;
+} SortedInput;
+
+static int compare_sorted_inputs(const void* a, const void* b) {
+    const SortedInput* x = a;
+    const SortedInput* y = b;
+    if (x->priority != y->priority) return x->priority < y->priority ? -1 : 1;
+    return (x->order > y->order) - (x->order < y->order);
+}
+
+// .init_array.00100 style sections run in order of priority, the plain ones go last
+static void sort_by_init_priority(OutputSection* s) {
+    size_t count = dyn_array_length(s->inputs);
+    SortedInput* sorted = HEAP_ALLOC(count * sizeof(SortedInput));
+    for (size_t i = 0; i < count; i++) {
+        const char* dot = strchr(s->inputs[i]->name + 1, '.');
+        sorted[i] = (SortedInput){ s->inputs[i], dot ? strtoul(dot + 1, NULL, 10) : 65536, i };
+    }
+
+    qsort(sorted, count, sizeof(SortedInput), compare_sorted_inputs);
+    for (size_t i = 0; i < count; i++) s->inputs[i] = sorted[i].sec;
+    HEAP_FREE(sorted);
+}
+
+static void bin_sections(ElfLinker* l) {
+    dyn_array_for(i, l->files) {
+        ElfFile* f = l->files[i];
+        if (f->kind != FILE_OBJECT) continue;
+
+        for (size_t j = 1; j < f->shnum; j++) {
+            InputSection* sec = &f->sections[j];
+            if (!is_kept_section(sec)) continue;
+
+            const Elf64_Shdr* shdr = sec->shdr;
+            const char* name = (shdr->sh_flags & SHF_ALLOC) ? output_section_name(sec->name) : sec->name;
+            OutputSection* out = find_or_create_section(l, name, shdr->sh_type, shdr->sh_flags);
+
+            // anything with contents makes the whole section PROGBITS
+            if (out->type == SHT_NOBITS || dyn_array_length(out->inputs) == 0) {
+                out->type = shdr->sh_type == SHT_X86_64_UNWIND ? SHT_PROGBITS : shdr->sh_type;
+            }
+            out->flags |= shdr->sh_flags & (SHF_WRITE | SHF_EXECINSTR);
+            if (shdr->sh_addralign > out->align) out->align = shdr->sh_addralign;
+
+            sec->out = out;
+            sec->slot = shdr->sh_size;
+            dyn_array_put(out->inputs, sec);
+            dyn_array_put(l->live_sections, sec);
+        }
+    }
+
+    dyn_array_for(i, l->sections) {
+        OutputSection* s = l->sections[i];
+        if (s->type == SHT_INIT_ARRAY || s->type == SHT_FINI_ARRAY) {
+            sort_by_init_priority(s);
+        }
+    }
+
+    // common symbols and copy relocations get placed after the regular .bss
+    dyn_array_for(i, l->sections) {
+        if (strcmp(l->sections[i]->name, ".bss") == 0) l->bss = l->sections[i];
+        if (strcmp(l->sections[i]->name, ".text") == 0) l->text = l->sections[i];
+    }
+
+    if (l->bss == NULL) {
+        l->bss = find_or_create_section(l, ".bss", SHT_NOBITS, SHF_ALLOC | SHF_WRITE);
+    }
+}
+
+////////////////////////////////
+// Relocation scanning
+////////////////////////////////
+static bool is_imported(const LinkSymbol* s) {
+    return s->kind == SYM_SHARED;
+}
+
+static bool is_function(const LinkSymbol* s) {
+    return s->type == STT_FUNC || s->type == STT_GNU_IFUNC;
+}
+
+static bool is_local_ifunc(const LinkSymbol* s) {
+    return s->kind == SYM_DEFINED && s->type == STT_GNU_IFUNC;
+}
+
+static bool is_got_reloc(uint32_t type) {
+    switch (type) {
+        case R_X86_64_GOTPCREL: case R_X86_64_GOTPCRELX: case R_X86_64_REX_GOTPCRELX:
+        case R_X86_64_GOT32: case R_X86_64_GOT64: case R_X86_64_GOTPCREL64: case R_X86_64_GOTPLT64:
+        return true;
+
+        default:
+        return false;
+    }
+}
+
+// GOTPCRELX lets us turn the load from the GOT into a direct reference
+// when the symbol ends up in the executable, it's the same as what ld does:
+//   mov foo@GOTPCREL(%rip), %reg => lea foo(%rip), %reg
+//   call *foo@GOTPCREL(%rip)     => addr32 call foo
+//   jmp *foo@GOTPCREL(%rip)      => jmp foo; nop
+static bool can_relax_got(uint32_t type, const uint8_t* loc, uint64_t offset, const LinkSymbol* s) {
+    if (type != R_X86_64_GOTPCRELX && type != R_X86_64_REX_GOTPCRELX) return false;
+    if (offset < 2) return false;
+
+    // imported, absent and resolver-picked addresses aren't known yet
+    if (s != NULL) {
+        if (s->kind == SYM_SHARED || s->kind == SYM_UNDEFINED || s->type == STT_GNU_IFUNC) return false;
+    }
+
+    if (loc[-2] == 0x8b) return true;
+    return type == R_X86_64_GOTPCRELX && loc[-2] == 0xff && (loc[-1] == 0x15 || loc[-1] == 0x25);
+}
+
+// initial-exec TLS against something in the executable becomes local-exec:
+//   mov foo@GOTTPOFF(%rip), %reg => mov $foo@TPOFF, %reg
+//   add foo@GOTTPOFF(%rip), %reg => lea foo@TPOFF(%reg), %reg
+static bool can_relax_tls(const uint8_t* loc, uint64_t offset, const LinkSymbol* s) {
+    if (offset < 3 || (s != NULL && s->kind == SYM_SHARED)) return false;
+    if (loc[-3] != 0x48 && loc[-3] != 0x4c) return false;
+
+    return (loc[-2] == 0x8b || loc[-2] == 0x03) && (loc[-1] & 0xc7) == 0x05;
+}
+
+static void report_undefined(ElfLinker* l, LinkSymbol* s, ElfFile* f) {
+    if ((atomic_fetch_or(&s->flags, REPORTED) & REPORTED) == 0) {
+        link_error(l, "undefined symbol: %s (referenced by %s)", s->name, f->name);
+    }
+}
+
+static void scan_section(ElfLinker* l, size_t i) {
+    InputSection* sec = l->live_sections[i];
+    if ((sec->shdr->sh_flags & SHF_ALLOC) == 0) return;
+
+    ElfFile* f = sec->file;
+    const uint8_t* data = f->data + sec->shdr->sh_offset;
+    for (size_t j = 0; j < sec->reloc_count; j++) {
+        const Elf64_Rela* r = &sec->relocs[j];
+        uint32_t type = ELF64_R_TYPE(r->r_info);
+        uint32_t sym_index = ELF64_R_SYM(r->r_info);
+        if (type == R_X86_64_NONE) continue;
+
+        if (r->r_offset >= sec->shdr->sh_size) {
+            link_error(l, "%s: relocation offset is out of bounds in %s", f->name, sec->name);
+            return;
+        }
+
+        if (sym_index >= f->sym_count) {
+            link_error(l, "%s: bad symbol index %u", f->name, sym_index);
+            return;
+        }
+
+        LinkSymbol* s = sym_index >= f->first_global ? f->sym_map[sym_index - f->first_global] : NULL;
+        if (s != NULL && s->kind == SYM_UNDEFINED && !s->weak) {
+            report_undefined(l, s, f);
+            continue;
+        }
+
+        switch (type) {
+            case R_X86_64_64: case R_X86_64_32: case R_X86_64_32S:
+            case R_X86_64_PC32: case R_X86_64_PC64: case R_X86_64_PLT32: {
+                if (s == NULL) break;
+
+                bool absolute = (type == R_X86_64_64 || type == R_X86_64_32 || type == R_X86_64_32S);
+                if (is_imported(s)) {
+                    if (s->type == STT_TLS) {
+                        link_error(l, "%s: direct reference to thread local %s from a shared object", f->name, s->name);
+                    } else if (is_function(s)) {
+                        atomic_fetch_or(&s->flags, NEEDS_PLT | (absolute || type == R_X86_64_PC32 ? ADDRESS_TAKEN : 0));
+                    } else {
+                        atomic_fetch_or(&s->flags, NEEDS_COPY);
+                    }
+                } else if (is_local_ifunc(s)) {
+                    atomic_fetch_or(&s->flags, NEEDS_PLT);
+                }
+                break;
+            }
+
+            case R_X86_64_GOTPCREL: case R_X86_64_GOTPCRELX: case R_X86_64_REX_GOTPCRELX:
+            case R_X86_64_GOT32: case R_X86_64_GOT64: case R_X86_64_GOTPCREL64: case R_X86_64_GOTPLT64: {
+                l->needs_got = true;
+                if (can_relax_got(type, data + r->r_offset, r->r_offset, s)) break;
+
+                if (s == NULL) {
+                    link_error(l, "%s: GOT reference to a local symbol in %s", f->name, sec->name);
+                    return;
+                }
+
+                atomic_fetch_or(&s->flags, NEEDS_GOT);
+                break;
+            }
+
+            case R_X86_64_GOTTPOFF: {
+                if (can_relax_tls(data + r->r_offset, r->r_offset, s)) break;
+
+                if (s == NULL) {
+                    link_error(l, "%s: GOT reference to a local symbol in %s", f->name, sec->name);
+                    return;
+                }
+
+                l->needs_got = true;
+                atomic_fetch_or(&s->flags, NEEDS_TLS_GOT);
+                break;
+            }
+
+            case R_X86_64_GOTPC32: case R_X86_64_GOTPC64: case R_X86_64_GOTOFF64:
+            l->needs_got = true;
+            break;
+
+            case R_X86_64_TPOFF32: case R_X86_64_TPOFF64:
+            if (s != NULL && is_imported(s)) {
+                link_error(l, "%s: local-exec reference to %s which lives in a shared object", f->name, s->name);
+            }
+            break;
+
+            case R_X86_64_DTPOFF32: case R_X86_64_DTPOFF64:
+            case R_X86_64_SIZE32: case R_X86_64_SIZE64:
+            break;
+
+            default:
+            link_error(l, "%s: unsupported relocation type %u in %s", f->name, type, sec->name);
+            return;
+        }
+    }
+}
+
+static uint64_t section_cost(const InputSection* sec) {
+    return (sec->shdr->sh_type == SHT_NOBITS ? 0 : sec->shdr->sh_size) + (sec->reloc_count * 16) + 64;
+}
+
+static void scan_relocations(ElfLinker* l) {
+    size_t count = dyn_array_length(l->live_sections);
+    uint64_t* costs = HEAP_ALLOC(count * sizeof(uint64_t) + 1);
+    for (size_t i = 0; i < count; i++) costs[i] = l->live_sections[i]->reloc_count * 16 + 64;
+
+    parallel_for(l, count, costs, scan_section);
+    HEAP_FREE(costs);
+}
+
+////////////////////////////////
+// Dynamic linking tables
+////////////////////////////////
+static uint32_t add_dynstr(ElfLinker* l, const char* str) {
+    ptrdiff_t search = nl_strmap_get_cstr(l->dynstr_map, str);
+    if (search >= 0) return l->dynstr_map[search];
+
+    uint32_t offset = append_string(&l->dynstr, str);
+    nl_strmap_put_cstr(l->dynstr_map, str, offset);
+    return offset;
+}
+
+static uint16_t get_verneed(ElfLinker* l, LinkSymbol* s) {
+    ElfFile* f = s->file;
+    uint16_t version = s->version & 0x7fff;
+    if (version <= VER_NDX_GLOBAL || version >= f->version_count || f->version_names[version] == NULL) {
+        return VER_NDX_GLOBAL;
+    }
+
+    const char* name = f->version_names[version];
+    dyn_array_for(i, l->verneed_names) {
+        if (l->verneed_files[i] == f && strcmp(l->verneed_names[i], name) == 0) return i + 2;
+    }
+
+    dyn_array_put(l->verneed_files, f);
+    dyn_array_put(l->verneed_names, name);
+    return dyn_array_length(l->verneed_names) + 1;
+}
+
+static void add_dynsym(ElfLinker* l, LinkSymbol* s) {
+    if (s->dynsym >= 0) return;
+
+    // the null symbol takes slot 0
+    s->dynsym = dyn_array_length(l->dynsyms) + 1;
+    dyn_array_put(l->dynsyms, s);
+}
+
+static void build_dynamic_tables(ElfLinker* l) {
+    // the shared object has to see its own writes to a copy relocated variable
+    // so the aliases (environ, __environ...) get copied and exported with it.
+    nl_strmap_for(i, l->symbols) {
+        LinkSymbol* s = l->symbols[i];
+        if (!is_imported(s) || (s->flags & NEEDS_COPY) == 0) continue;
+
+        ElfFile* f = s->file;
+        uint64_t value = f->syms[s->sym_index].st_value;
+        for (size_t j = 1; j < f->sym_count; j++) {
+            if (j == s->sym_index || f->syms[j].st_value != value || f->syms[j].st_shndx == SHN_UNDEF) continue;
+
+            ptrdiff_t search = nl_strmap_get_cstr(l->symbols, f->strtab + f->syms[j].st_name);
+            if (search >= 0 && l->symbols[search]->file == f && l->symbols[search]->sym_index == j) {
+                l->symbols[search]->flags |= NEEDS_COPY;
+            }
+        }
+    }
+
+    nl_strmap_for(i, l->symbols) {
+        LinkSymbol* s = l->symbols[i];
+        uint32_t flags = s->flags;
+
+        if (is_imported(s) && (flags & (NEEDS_GOT | NEEDS_PLT | NEEDS_COPY | NEEDS_TLS_GOT))) {
+            s->file->needed = true;
+        }
+    }
+
+    dyn_array_for(i, l->shared) {
+        ElfFile* f = l->shared[i];
+        if (!f->as_needed) f->needed = true;
+        if (f->needed) l->is_dynamic = true;
+    }
+
+    // anything a shared object wants from us has to be exported, this is mostly
+    // for callbacks like the ones libc wants (and copy relocated data)
+    if (l->is_dynamic) {
+        dyn_array_for(i, l->shared) {
+            ElfFile* f = l->shared[i];
+            if (!f->needed) continue;
+
+            for (size_t j = 1; j < f->sym_count; j++) {
+                if (f->syms[j].st_shndx != SHN_UNDEF) continue;
+
+                ptrdiff_t search = nl_strmap_get_cstr(l->symbols, f->strtab + f->syms[j].st_name);
+                if (search < 0) continue;
+
+                LinkSymbol* s = l->symbols[search];
+                const Elf64_Sym* def = s->kind == SYM_DEFINED ? &s->file->syms[s->sym_index] : NULL;
+                if ((s->kind == SYM_DEFINED && ELF64_ST_VISIBILITY(def->st_other) == STV_DEFAULT) || s->kind == SYM_COMMON) {
+                    s->flags |= EXPORTED;
+                }
+            }
+        }
+    }
+
+    nl_strmap_for(i, l->symbols) {
+        LinkSymbol* s = l->symbols[i];
+        uint32_t flags = s->flags;
+
+        if (flags & (NEEDS_GOT | NEEDS_TLS_GOT)) {
+            if (flags & NEEDS_GOT) {
+                s->got = dyn_array_length(l->got_syms);
+                dyn_array_put(l->got_syms, s);
+            }
+
+            if (flags & NEEDS_TLS_GOT) {
+                s->tls_got = dyn_array_length(l->got_syms);
+                dyn_array_put(l->got_syms, s);
+            }
+        }
+
+        if (flags & NEEDS_PLT) {
+            s->plt = dyn_array_length(l->plt_syms);
+            dyn_array_put(l->plt_syms, s);
+        }
+
+        if (is_imported(s) && (flags & NEEDS_COPY)) {
+            dyn_array_put(l->copy_syms, s);
+        } else if (s->kind == SYM_COMMON) {
+            dyn_array_put(l->common_syms, s);
+        }
+
+        if (is_imported(s) && (flags & (NEEDS_GOT | NEEDS_PLT | NEEDS_COPY | NEEDS_TLS_GOT))) {
+            add_dynsym(l, s);
+            s->verneed = get_verneed(l, s);
+        } else if (l->is_dynamic && (flags & EXPORTED)) {
+            add_dynsym(l, s);
+            s->verneed = VER_NDX_GLOBAL;
+        }
+    }
+
+    if (dyn_array_length(l->got_syms) > 0) l->needs_got = true;
+
+    if (l->is_dynamic) {
+        l->dynstr = dyn_array_create_with_initial_cap(char, 4096);
+        dyn_array_put(l->dynstr, 0);
+
+        dyn_array_for(i, l->dynsyms) add_dynstr(l, l->dynsyms[i]->name);
+        dyn_array_for(i, l->shared) {
+            if (l->shared[i]->needed) add_dynstr(l, l->shared[i]->soname);
+        }
+        dyn_array_for(i, l->verneed_names) add_dynstr(l, l->verneed_names[i]);
+
+        // count the files which end up with a Verneed
+        dyn_array_for(i, l->verneed_files) {
+            bool seen = false;
+            for (ptrdiff_t j = 0; j < i; j++) seen |= (l->verneed_files[j] == l->verneed_files[i]);
+            if (!seen) l->verneed_file_count += 1;
+        }
+    }
+}
+
+// bss tail is the commons then the copy relocations
+static uint64_t place_in_bss_tail(ElfLinker* l, uint64_t size, uint64_t align) {
+    if (align > l->bss->align) l->bss->align = align;
+
+    l->bss_tail = align_up(l->bss_tail, align);
+    uint64_t offset = l->bss_tail;
+    l->bss_tail += size;
+    return offset;
+}
+
+// aliases like environ and __environ have to share the same copy, this
+// finds the first copy relocated symbol at the same spot.
+static LinkSymbol* find_copy_alias(ElfLinker* l, ptrdiff_t i) {
+    LinkSymbol* s = l->copy_syms[i];
+    uint64_t value = s->file->syms[s->sym_index].st_value;
+    for (ptrdiff_t j = 0; j < i; j++) {
+        LinkSymbol* other = l->copy_syms[j];
+        if (other->file == s->file && other->file->syms[other->sym_index].st_value == value) {
+            return other;
+        }
+    }
+
+    return NULL;
+}
+
+static uint64_t copy_alignment(const LinkSymbol* s) {
+    // we don't know the alignment the shared object wanted, the address tells
+    // us at least as much as we need.
+    uint64_t value = s->file->syms[s->sym_index].st_value;
+    uint64_t align = value ? value & -value : 64;
+    return align > 64 ? 64 : align;
+}
+
+////////////////////////////////
+// Synthetic sections
+////////////////////////////////
+static uint32_t section_name_offset(ElfLinker* l, const char* name) {
+    return append_string(&l->shstrtab, name);
+}
+
+static uint64_t symbol_address(ElfLinker* l, const LinkSymbol* s);
+static uint64_t got_entry_address(ElfLinker* l, int32_t slot);
+
+static void write_interp(ElfLinker* l, OutputSection* s, uint8_t* dst) {
+    memcpy(dst, ELF_INTERPRETER, sizeof(ELF_INTERPRETER));
+}
+
+static void write_dynstr(ElfLinker* l, OutputSection* s, uint8_t* dst) {
+    memcpy(dst, l->dynstr, dyn_array_length(l->dynstr));
+}
+
+static void write_dynsym(ElfLinker* l, OutputSection* s, uint8_t* dst) {
+    Elf64_Sym* syms = (Elf64_Sym*) dst;
+    dyn_array_for(i, l->dynsyms) {
+        LinkSymbol* sym = l->dynsyms[i];
+        Elf64_Sym* out = &syms[sym->dynsym];
+
+        out->st_name = add_dynstr(l, sym->name);
+        // our references to imports are strong, the weakness is the shared object's business
+        uint32_t flags = sym->flags;
+        bool weak = sym->weak && !(is_imported(sym) && (flags & NEEDS_COPY) == 0);
+        out->st_info = ELF64_ST_INFO(weak ? STB_WEAK : STB_GLOBAL, sym->type == STT_GNU_IFUNC ? STT_FUNC : sym->type);
+
+        if (is_imported(sym) && (flags & NEEDS_COPY)) {
+            out->st_shndx = l->bss->index;
+            out->st_value = symbol_address(l, sym);
+            out->st_size = sym->size;
+        } else if (is_imported(sym)) {
+            // the canonical address of the function is the PLT entry
+            out->st_shndx = SHN_UNDEF;
+            out->st_value = (flags & ADDRESS_TAKEN) ? symbol_address(l, sym) : 0;
+        } else {
+            out->st_shndx = SHN_ABS;
+            if (sym->kind == SYM_DEFINED) {
+                const Elf64_Sym* def = &sym->file->syms[sym->sym_index];
+                uint32_t shndx = symbol_shndx(sym->file, sym->sym_index);
+                if (shndx < sym->file->shnum && sym->file->sections[shndx].out) {
+                    out->st_shndx = sym->file->sections[shndx].out->index;
+                }
+                out->st_size = def->st_size;
+            } else if (sym->kind == SYM_COMMON) {
+                out->st_shndx = l->bss->index;
+                out->st_size = sym->size;
+            }
+            out->st_value = symbol_address(l, sym);
+        }
+    }
+}
+
+static void write_hash(ElfLinker* l, OutputSection* s, uint8_t* dst) {
+    uint32_t* words = (uint32_t*) dst;
+    uint32_t nchain = dyn_array_length(l->dynsyms) + 1;
+    uint32_t nbucket = words[0] = (nchain / 2) + 1;
+    words[1] = nchain;
+
+    uint32_t* buckets = &words[2];
+    uint32_t* chains = &buckets[nbucket];
+    dyn_array_for(i, l->dynsyms) {
+        LinkSymbol* sym = l->dynsyms[i];
+        uint32_t b = elf_hash(sym->name) % nbucket;
+
+        chains[sym->dynsym] = buckets[b];
+        buckets[b] = sym->dynsym;
+    }
+}
+
+static void write_versym(ElfLinker* l, OutputSection* s, uint8_t* dst) {
+    uint16_t* versions = (uint16_t*) dst;
+    dyn_array_for(i, l->dynsyms) {
+        versions[l->dynsyms[i]->dynsym] = l->dynsyms[i]->verneed;
+    }
+}
+
+static void write_verneed(ElfLinker* l, OutputSection* s, uint8_t* dst) {
+    size_t count = dyn_array_length(l->verneed_files);
+    bool* done = HEAP_ALLOC(count + 1);
+    memset(done, 0, count + 1);
+
+    uint8_t* p = dst;
+    Elf64_Verneed* prev = NULL;
+    for (size_t i = 0; i < count; i++) {
+        if (done[i]) continue;
+
+        ElfFile* f = l->verneed_files[i];
+        Elf64_Verneed* vn = (Elf64_Verneed*) p;
+        if (prev) prev->vn_next = (uint8_t*) vn - (uint8_t*) prev;
+
+        vn->vn_version = VER_NEED_CURRENT;
+        vn->vn_file = add_dynstr(l, f->soname);
+        vn->vn_aux = sizeof(Elf64_Verneed);
+        p += sizeof(Elf64_Verneed);
+
+        Elf64_Vernaux* prev_aux = NULL;
+        for (size_t j = i; j < count; j++) {
+            if (l->verneed_files[j] != f) continue;
+            done[j] = true;
+
+            Elf64_Vernaux* aux = (Elf64_Vernaux*) p;
+            if (prev_aux) prev_aux->vna_next = sizeof(Elf64_Vernaux);
+
+            aux->vna_hash = elf_hash(l->verneed_names[j]);
+            aux->vna_other = j + 2;
+            aux->vna_name = add_dynstr(l, l->verneed_names[j]);
+            vn->vn_cnt += 1;
+
+            prev_aux = aux;
+            p += sizeof(Elf64_Vernaux);
+        }
+
+        prev = vn;
+    }
+
+    HEAP_FREE(done);
+}
+
+static void write_relocs(ElfLinker* l, DynArray(DynamicReloc) relocs, uint8_t* dst) {
+    Elf64_Rela* out = (Elf64_Rela*) dst;
+    dyn_array_for(i, relocs) {
+        DynamicReloc* r = &relocs[i];
+        out[i].r_offset = r->offset;
+        out[i].r_info = ELF64_R_INFO(r->sym ? r->sym->dynsym : 0, r->type);
+        out[i].r_addend = r->addend;
+    }
+}
+
+static void write_rela_dyn(ElfLinker* l, OutputSection* s, uint8_t* dst) {
+    write_relocs(l, l->rela_dyn, dst);
+}
+
+static void write_rela_plt(ElfLinker* l, OutputSection* s, uint8_t* dst) {
+    write_relocs(l, l->rela_plt, dst);
+}
+
+static uint64_t tpoff(ElfLinker* l, uint64_t address) {
+    return address - (l->tls_start + align_up(l->tls_size, l->tls_align));
+}
+
+static void write_got(ElfLinker* l, OutputSection* s, uint8_t* dst) {
+    uint64_t* slots = (uint64_t*) dst;
+    dyn_array_for(i, l->got_syms) {
+        LinkSymbol* sym = l->got_syms[i];
+
+        if (sym->tls_got == i) {
+            slots[i] = is_imported(sym) ? 0 : tpoff(l, symbol_address(l, sym));
+        } else if (is_imported(sym) && (sym->flags & (NEEDS_COPY | ADDRESS_TAKEN)) == 0) {
+            // filled in by the GLOB_DAT
+            slots[i] = 0;
+        } else {
+            slots[i] = symbol_address(l, sym);
+        }
+    }
+}
+
+static void write_plt(ElfLinker* l, OutputSection* s, uint8_t* dst) {
+    // no lazy binding so each entry is just:
+    //   jmp *slot(%rip)
+    //   xchg %ax, %ax
+    dyn_array_for(i, l->plt_syms) {
+        uint8_t* entry = dst + (i * 8);
+        uint64_t slot = l->got_plt->addr + (i * 8);
+        int32_t disp = (int32_t) (slot - (s->addr + (i * 8) + 6));
+
+        entry[0] = 0xff, entry[1] = 0x25;
+        memcpy(&entry[2], &disp, sizeof(int32_t));
+        entry[6] = 0x66, entry[7] = 0x90;
+    }
+}
+
+static void write_got_plt(ElfLinker* l, OutputSection* s, uint8_t* dst) {
+    // JUMP_SLOT and IRELATIVE fill these in at startup
+    memset(dst, 0, s->size);
+}
+
+static size_t count_dynamic_entries(ElfLinker* l) {
+    size_t count = 8; // HASH STRTAB SYMTAB STRSZ SYMENT DEBUG FLAGS FLAGS_1
+    dyn_array_for(i, l->shared) count += l->shared[i]->needed;
+
+    if (l->rela_dyn_sec) count += 3;
+    if (l->rela_plt_sec) count += 4;
+    if (l->verneed_file_count) count += 3;
+    count += 12; // INIT FINI and the arrays, whichever exist
+    return count + 1;
+}
+
+static void write_dynamic(ElfLinker* l, OutputSection* s, uint8_t* dst) {
+    Elf64_Dyn* dyn = (Elf64_Dyn*) dst;
+    size_t i = 0;
+
+    #define DYN(tag, val) (dyn[i++] = (Elf64_Dyn){ .d_tag = (tag), .d_un.d_val = (val) })
+    dyn_array_for(j, l->shared) {
+        if (l->shared[j]->needed) DYN(DT_NEEDED, add_dynstr(l, l->shared[j]->soname));
+    }
+
+    DYN(DT_HASH, l->hash->addr);
+    DYN(DT_STRTAB, l->dynstr_sec->addr);
+    DYN(DT_SYMTAB, l->dynsym->addr);
+    DYN(DT_STRSZ, l->dynstr_sec->size);
+    DYN(DT_SYMENT, sizeof(Elf64_Sym));
+
+    if (l->rela_dyn_sec) {
+        DYN(DT_RELA, l->rela_dyn_sec->addr);
+        DYN(DT_RELASZ, l->rela_dyn_sec->size);
+        DYN(DT_RELAENT, sizeof(Elf64_Rela));
+    }
+
+    if (l->rela_plt_sec) {
+        DYN(DT_JMPREL, l->rela_plt_sec->addr);
+        DYN(DT_PLTRELSZ, l->rela_plt_sec->size);
+        DYN(DT_PLTREL, DT_RELA);
+        DYN(DT_PLTGOT, l->got_plt->addr);
+    }
+
+    if (l->verneed_file_count) {
+        DYN(DT_VERSYM, l->versym->addr);
+        DYN(DT_VERNEED, l->verneed->addr);
+        DYN(DT_VERNEEDNUM, l->verneed_file_count);
+    }
+
+    // crti.o's _init and _fini, glibc runs them through the dynamic section now
+    ptrdiff_t init = nl_strmap_get_cstr(l->symbols, "_init");
+    if (init >= 0 && l->symbols[init]->kind == SYM_DEFINED) DYN(DT_INIT, symbol_address(l, l->symbols[init]));
+
+    ptrdiff_t fini = nl_strmap_get_cstr(l->symbols, "_fini");
+    if (fini >= 0 && l->symbols[fini]->kind == SYM_DEFINED) DYN(DT_FINI, symbol_address(l, l->symbols[fini]));
+
+    dyn_array_for(j, l->sections) {
+        OutputSection* sec = l->sections[j];
+        switch (sec->type) {
+            case SHT_PREINIT_ARRAY: DYN(DT_PREINIT_ARRAY, sec->addr); DYN(DT_PREINIT_ARRAYSZ, sec->size); break;
+            case SHT_INIT_ARRAY:    DYN(DT_INIT_ARRAY, sec->addr);    DYN(DT_INIT_ARRAYSZ, sec->size);    break;
+            case SHT_FINI_ARRAY:    DYN(DT_FINI_ARRAY, sec->addr);    DYN(DT_FINI_ARRAYSZ, sec->size);    break;
+            default: break;
+        }
+    }
+
+    // everything gets bound at startup, the PLT has no lazy stubs
+    DYN(DT_DEBUG, 0);
+    DYN(DT_FLAGS, DF_BIND_NOW);
+    DYN(DT_FLAGS_1, DF_1_NOW);
+    DYN(DT_NULL, 0);
+    #undef DYN
+}
+
+static void write_symtab(ElfLinker* l, OutputSection* s, uint8_t* dst);
+
+static void write_strtab(ElfLinker* l, OutputSection* s, uint8_t* dst) {
+    memcpy(dst, l->strtab, dyn_array_length(l->strtab));
+}
+
+static void write_shstrtab(ElfLinker* l, OutputSection* s, uint8_t* dst) {
+    memcpy(dst, l->shstrtab, dyn_array_length(l->shstrtab));
+}
+
+static OutputSection* new_synthetic(ElfLinker* l, const char* name, uint32_t type, uint64_t flags, SectionRank rank, uint64_t align, uint64_t size, SectionWriter* write) {
+    OutputSection* s = new_section(l, name, type, flags, rank, align);
+    s->size = size;
+    s->write = write;
+    return s;
+}
+
+static bool is_local_symbol_kept(ElfFile* f, size_t i) {
+    const Elf64_Sym* sym = &f->syms[i];
+    uint8_t type = ELF64_ST_TYPE(sym->st_info);
+    if (type != STT_NOTYPE && type != STT_OBJECT && type != STT_FUNC && type != STT_TLS) return false;
+
+    const char* name = f->strtab + sym->st_name;
+    if (name[0] == 0 || (name[0] == '.' && name[1] == 'L')) return false;
+
+    uint32_t shndx = symbol_shndx(f, i);
+    if (shndx == SHN_ABS) return true;
+    return shndx != SHN_UNDEF && shndx < f->shnum && f->sections[shndx].out != NULL;
+}
+
+static bool is_global_symbol_kept(const LinkSymbol* s) {
+    switch (s->kind) {
+        case SYM_DEFINED: {
+            uint32_t shndx = symbol_shndx(s->file, s->sym_index);
+            return shndx == SHN_ABS || (shndx < s->file->shnum && s->file->sections[shndx].out != NULL);
+        }
+
+        case SYM_COMMON:
+        case SYM_SYNTHETIC:
+        return true;
+
+        case SYM_SHARED:
+        return (s->flags & (NEEDS_COPY | NEEDS_PLT)) != 0;
+
+        default:
+        return false;
+    }
+}
+
+static void size_symtab(ElfLinker* l) {
+    l->strtab = dyn_array_create_with_initial_cap(char, 65536);
+    dyn_array_put(l->strtab, 0);
+
+    // locals are written in the same order we count them here
+    size_t count = 1;
+    dyn_array_for(i, l->files) {
+        ElfFile* f = l->files[i];
+        if (f->kind != FILE_OBJECT) continue;
+
+        for (size_t j = 1; j < f->first_global && j < f->sym_count; j++) {
+            if (is_local_symbol_kept(f, j)) count++;
+        }
+    }
+    l->symtab_local_count = count;
+
+    nl_strmap_for(i, l->symbols) {
+        if (is_global_symbol_kept(l->symbols[i])) count++;
+    }
+    l->symtab_count = count;
+}
+
+static void create_synthetic_sections(ElfLinker* l) {
+    if (l->is_dynamic) {
+        size_t dynsym_count = dyn_array_length(l->dynsyms) + 1;
+        size_t nbucket = (dynsym_count / 2) + 1;
+
+        l->interp = new_synthetic(l, ".interp", SHT_PROGBITS, SHF_ALLOC, RANK_INTERP, 1, sizeof(ELF_INTERPRETER), write_interp);
+        l->hash = new_synthetic(l, ".hash", SHT_HASH, SHF_ALLOC, RANK_HASH, 8, (2 + nbucket + dynsym_count) * sizeof(uint32_t), write_hash);
+        l->dynsym = new_synthetic(l, ".dynsym", SHT_DYNSYM, SHF_ALLOC, RANK_DYNSYM, 8, dynsym_count * sizeof(Elf64_Sym), write_dynsym);
+        l->dynstr_sec = new_synthetic(l, ".dynstr", SHT_STRTAB, SHF_ALLOC, RANK_DYNSTR, 1, dyn_array_length(l->dynstr), write_dynstr);
+
+        l->hash->entsize = 4;
+        l->dynsym->entsize = sizeof(Elf64_Sym);
+        l->dynsym->info = 1;
+
+        if (l->verneed_file_count) {
+            size_t verneed_size = (l->verneed_file_count * sizeof(Elf64_Verneed)) + (dyn_array_length(l->verneed_names) * sizeof(Elf64_Vernaux));
+            l->versym = new_synthetic(l, ".gnu.version", SHT_GNU_versym, SHF_ALLOC, RANK_VERSYM, 2, dynsym_count * sizeof(uint16_t), write_versym);
+            l->verneed = new_synthetic(l, ".gnu.version_r", SHT_GNU_verneed, SHF_ALLOC, RANK_VERNEED, 8, verneed_size, write_verneed);
+            l->versym->entsize = 2;
+            l->verneed->info = l->verneed_file_count;
+        }
+    }
+
+    if (l->needs_got || dyn_array_length(l->got_syms) > 0) {
+        l->got = new_synthetic(l, ".got", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, RANK_GOT, 8, dyn_array_length(l->got_syms) * 8, write_got);
+        l->got->entsize = 8;
+    }
+
+    if (dyn_array_length(l->plt_syms) > 0) {
+        size_t plt_count = dyn_array_length(l->plt_syms);
+        l->plt = new_synthetic(l, ".plt", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, RANK_PLT, 16, plt_count * 8, write_plt);
+        l->got_plt = new_synthetic(l, ".got.plt", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, RANK_GOT_PLT, 8, plt_count * 8, write_got_plt);
+        l->got_plt->entsize = 8;
+    }
+
+    // the dynamic relocations only need their counts here, the contents
+    // are figured out after layout.
+    size_t rela_dyn_count = 0, rela_plt_count = dyn_array_length(l->plt_syms);
+    dyn_array_for(i, l->got_syms) {
+        LinkSymbol* s = l->got_syms[i];
+        if (is_imported(s) && (s->tls_got == i || (s->flags & (NEEDS_COPY | ADDRESS_TAKEN)) == 0)) rela_dyn_count++;
+    }
+    dyn_array_for(i, l->copy_syms) {
+        if (find_copy_alias(l, i) == NULL) rela_dyn_count++;
+    }
+
+    if (rela_dyn_count > 0) {
+        l->rela_dyn_sec = new_synthetic(l, ".rela.dyn", SHT_RELA, SHF_ALLOC, RANK_RELA_DYN, 8, rela_dyn_count * sizeof(Elf64_Rela), write_rela_dyn);
+        l->rela_dyn_sec->entsize = sizeof(Elf64_Rela);
+    }
+
+    if (rela_plt_count > 0) {
+        // static executables apply their IRELATIVEs from __rela_iplt_start
+        l->rela_plt_sec = new_synthetic(l, l->is_dynamic ? ".rela.plt" : ".rela.iplt", SHT_RELA, SHF_ALLOC | SHF_INFO_LINK, RANK_RELA_PLT, 8, rela_plt_count * sizeof(Elf64_Rela), write_rela_plt);
+        l->rela_plt_sec->entsize = sizeof(Elf64_Rela);
+    }
+
+    if (l->is_dynamic) {
+        l->dynamic = new_synthetic(l, ".dynamic", SHT_DYNAMIC, SHF_ALLOC | SHF_WRITE, RANK_DYNAMIC, 8, count_dynamic_entries(l) * sizeof(Elf64_Dyn), write_dynamic);
+        l->dynamic->entsize = sizeof(Elf64_Dyn);
+    }
+
+    size_symtab(l);
+    l->symtab = new_synthetic(l, ".symtab", SHT_SYMTAB, 0, RANK_SYMTAB, 8, l->symtab_count * sizeof(Elf64_Sym), write_symtab);
+    l->symtab->entsize = sizeof(Elf64_Sym);
+    l->symtab->info = l->symtab_local_count;
+
+    // the string table is filled while writing the symbols so it's sized conservatively
+    size_t strtab_size = 1;
+    dyn_array_for(i, l->files) {
+        ElfFile* f = l->files[i];
+        if (f->kind != FILE_OBJECT) continue;
+
+        for (size_t j = 1; j < f->first_global && j < f->sym_count; j++) {
+            if (is_local_symbol_kept(f, j)) strtab_size += strlen(f->strtab + f->syms[j].st_name) + 1;
+        }
+    }
+    nl_strmap_for(i, l->symbols) {
+        if (is_global_symbol_kept(l->symbols[i])) strtab_size += strlen(l->symbols[i]->name) + 1;
+    }
+    l->strtab_sec = new_synthetic(l, ".strtab", SHT_STRTAB, 0, RANK_STRTAB, 1, strtab_size, write_strtab);
+
+    l->shstrtab = dyn_array_create_with_initial_cap(char, 1024);
+    dyn_array_put(l->shstrtab, 0);
+    l->shstrtab_sec = new_synthetic(l, ".shstrtab", SHT_STRTAB, 0, RANK_SHSTRTAB, 1, 0, write_shstrtab);
+}
+
+////////////////////////////////
+// Layout
+////////////////////////////////
+static int compare_sections(const void* a, const void* b) {
+    const OutputSection* x = *(const OutputSection**) a;
+    const OutputSection* y = *(const OutputSection**) b;
+    if (x->rank != y->rank) return x->rank < y->rank ? -1 : 1;
+    return 0;
+}
+
+typedef enum { SEGMENT_NONE, SEGMENT_R, SEGMENT_RX, SEGMENT_RW } SegmentKind;
+
+static SegmentKind rank_segment(SectionRank rank) {
+    if (rank <= RANK_READONLY) return SEGMENT_R;
+    if (rank <= RANK_FINI) return SEGMENT_RX;
+    if (rank <= RANK_BSS) return SEGMENT_RW;
+    return SEGMENT_NONE;
+}
+
+static void layout_sections(ElfLinker* l) {
+    // input sections get their offsets within the output sections
+    dyn_array_for(i, l->sections) {
+        OutputSection* s = l->sections[i];
+        if (s->write != NULL) continue;
+
+        uint64_t size = 0;
+        dyn_array_for(j, s->inputs) {
+            InputSection* sec = s->inputs[j];
+            size = align_up(size, sec->shdr->sh_addralign);
+            sec->offset = size;
+            size += sec->slot;
+        }
+        s->size = size;
+    }
+
+    // commons and copy relocations go after the regular bss
+    l->bss_tail = l->bss->size;
+    dyn_array_for(i, l->common_syms) {
+        LinkSymbol* s = l->common_syms[i];
+        s->address = place_in_bss_tail(l, s->size, s->align ? s->align : 1);
+    }
+    dyn_array_for(i, l->copy_syms) {
+        LinkSymbol* s = l->copy_syms[i];
+
+        LinkSymbol* alias = find_copy_alias(l, i);
+        if (alias != NULL) {
+            s->address = alias->address;
+        } else {
+            s->address = place_in_bss_tail(l, s->size ? s->size : 1, copy_alignment(s));
+        }
+    }
+    l->bss->size = l->bss_tail;
+
+    qsort(l->sections, dyn_array_length(l->sections), sizeof(OutputSection*), compare_sections);
+
+    // drop empty sections which don't mean anything
+    size_t kept = 0;
+    dyn_array_for(i, l->sections) {
+        OutputSection* s = l->sections[i];
+        if (s->write == NULL && dyn_array_length(s->inputs) == 0 && s->size == 0) continue;
+        l->sections[kept++] = s;
+    }
+    dyn_array_set_length(l->sections, kept);
+
+    dyn_array_for(i, l->sections) {
+        OutputSection* s = l->sections[i];
+        s->index = i + 1;
+        s->name_offset = section_name_offset(l, s->name);
+    }
+    l->shstrtab_sec->size = dyn_array_length(l->shstrtab);
+
+    // program headers: PHDR INTERP LOAD*3 DYNAMIC TLS NOTE GNU_STACK
+    bool has_tls = false, has_note = false;
+    dyn_array_for(i, l->sections) {
+        has_tls |= (l->sections[i]->flags & SHF_TLS) != 0;
+        has_note |= l->sections[i]->type == SHT_NOTE;
+    }
+
+    l->phdr_count = 4 + (l->is_dynamic ? 3 : 0) + has_tls + has_note;
+    uint64_t offset = sizeof(Elf64_Ehdr) + (l->phdr_count * sizeof(Elf64_Phdr));
+
+    // file offsets and addresses move in lockstep, each segment starts on a new page
+    SegmentKind segment = SEGMENT_R;
+    l->tls_start = 0, l->tls_size = 0, l->tls_align = 1;
+    dyn_array_for(i, l->sections) {
+        OutputSection* s = l->sections[i];
+        SegmentKind kind = rank_segment(s->rank);
+        if (kind != segment && kind != SEGMENT_NONE) {
+            offset = align_up(offset, ELF_PAGE_SIZE);
+            segment = kind;
+        }
+
+        if (kind == SEGMENT_NONE) {
+            s->offset = offset = align_up(offset, s->align);
+            s->addr = 0;
+            offset += s->size;
+            continue;
+        }
+
+        offset = align_up(offset, s->align);
+        s->offset = offset;
+        s->addr = ELF_BASE_ADDRESS + offset;
+
+        if (s->flags & SHF_TLS) {
+            if (l->tls_size == 0 && l->tls_start == 0) l->tls_start = s->addr;
+            if (s->align > l->tls_align) l->tls_align = s->align;
+            l->tls_size = (s->addr + s->size) - l->tls_start;
+        }
+
+        // .tbss takes no space in the image, the next section overlaps it
+        if (s->type == SHT_NOBITS && (s->flags & SHF_TLS)) continue;
+
+        // the rest of the NOBITS are at the end of the last segment, they
+        // occupy addresses but not the file.
+        if (s->type == SHT_NOBITS) {
+            uint64_t end = s->addr + s->size;
+            while (i + 1 < dyn_array_length(l->sections) && l->sections[i + 1]->type == SHT_NOBITS && rank_segment(l->sections[i + 1]->rank) == SEGMENT_RW) {
+                OutputSection* next = l->sections[++i];
+                end = align_up(end, next->align);
+                next->addr = end;
+                next->offset = offset;
+                end += next->size;
+            }
+
+            // keep the file offset congruent for whatever comes later
+            offset = align_up(offset, ELF_PAGE_SIZE);
+            continue;
+        }
+
+        offset += s->size;
+    }
+
+    l->symtab->link = l->strtab_sec->index;
+    if (l->is_dynamic) {
+        l->dynsym->link = l->dynstr_sec->index;
+        l->hash->link = l->dynsym->index;
+        l->dynamic->link = l->dynstr_sec->index;
+        if (l->versym) l->versym->link = l->dynsym->index;
+        if (l->verneed) l->verneed->link = l->dynstr_sec->index;
+    }
+    if (l->rela_dyn_sec) l->rela_dyn_sec->link = l->is_dynamic ? l->dynsym->index : 0;
+    if (l->rela_plt_sec) {
+        l->rela_plt_sec->link = l->is_dynamic ? l->dynsym->index : 0;
+        l->rela_plt_sec->info = l->got_plt->index;
+    }
+}
+
+static uint64_t got_entry_address(ElfLinker* l, int32_t slot) {
+    return l->got->addr + (slot * 8);
+}
+
+static uint64_t input_section_address(const InputSection* sec) {
+    return sec->out ? sec->out->addr + sec->offset : 0;
+}
+
+static uint64_t symbol_address(ElfLinker* l, const LinkSymbol* s) {
+    switch (s->kind) {
+        case SYM_DEFINED: {
+            const Elf64_Sym* sym = &s->file->syms[s->sym_index];
+            uint32_t shndx = symbol_shndx(s->file, s->sym_index);
+            if (shndx == SHN_ABS) return sym->st_value;
+            if (shndx >= s->file->shnum) return 0;
+
+            return input_section_address(&s->file->sections[shndx]) + sym->st_value;
+        }
+
+        case SYM_COMMON:
+        return l->bss->addr + s->address;
+
+        case SYM_SHARED:
+        if (s->flags & NEEDS_COPY) return l->bss->addr + s->address;
+        if (s->plt >= 0) return l->plt->addr + (s->plt * 8);
+        return 0;
+
+        case SYM_SYNTHETIC:
+        return s->address;
+
+        default:
+        return 0;
+    }
+}
+
+// symbol address for relocations, references to ifuncs go through the PLT
+static uint64_t relocation_target(ElfLinker* l, const LinkSymbol* s) {
+    if (s->plt >= 0 && (is_imported(s) || s->type == STT_GNU_IFUNC)) {
+        return l->plt->addr + (s->plt * 8);
+    }
+    return symbol_address(l, s);
+}
+
+static OutputSection* find_output_section(ElfLinker* l, const char* name) {
+    dyn_array_for(i, l->sections) {
+        if (strcmp(l->sections[i]->name, name) == 0) return l->sections[i];
+    }
+    return NULL;
+}
+
+static void resolve_synthetic_symbols(ElfLinker* l) {
+    uint64_t etext = 0, edata = 0, end = 0;
+    dyn_array_for(i, l->sections) {
+        OutputSection* s = l->sections[i];
+        SegmentKind kind = rank_segment(s->rank);
+        if (kind == SEGMENT_RX) etext = s->addr + s->size;
+        if (kind == SEGMENT_RW && s->type != SHT_NOBITS) edata = s->addr + s->size;
+        if (kind == SEGMENT_RW && !(s->type == SHT_NOBITS && (s->flags & SHF_TLS))) end = s->addr + s->size;
+    }
+
+    uint64_t rela_iplt = l->rela_plt_sec && !l->is_dynamic ? l->rela_plt_sec->addr : 0;
+    uint64_t rela_iplt_end = rela_iplt ? rela_iplt + l->rela_plt_sec->size : 0;
+
+    nl_strmap_for(i, l->symbols) {
+        LinkSymbol* s = l->symbols[i];
+        if (s->kind != SYM_SYNTHETIC) continue;
+
+        const char* name = s->name;
+        OutputSection* sec;
+        if (strcmp(name, "_GLOBAL_OFFSET_TABLE_") == 0) {
+            s->address = l->got ? l->got->addr : 0;
+        } else if (strcmp(name, "_DYNAMIC") == 0) {
+            s->address = l->dynamic ? l->dynamic->addr : 0;
+        } else if (strcmp(name, "__ehdr_start") == 0 || strcmp(name, "__executable_start") == 0) {
+            s->address = ELF_BASE_ADDRESS;
+        } else if (strncmp(name, "__init_array_", 13) == 0 || strncmp(name, "__fini_array_", 13) == 0 || strncmp(name, "__preinit_array_", 16) == 0) {
+            char section_name[32];
+            const char* suffix = strrchr(name, '_');
+            snprintf(section_name, sizeof(section_name), ".%.*s", (int) (suffix - name - 2), name + 2);
+
+            sec = find_output_section(l, section_name);
+            if (sec == NULL) {
+                // empty arrays still need a consistent pair of addresses
+                s->address = l->bss->addr;
+            } else {
+                s->address = sec->addr + (strcmp(suffix, "_end") == 0 ? sec->size : 0);
+            }
+        } else if (strncmp(name, "__start_", 8) == 0 || strncmp(name, "__stop_", 7) == 0) {
+            bool is_start = strncmp(name, "__start_", 8) == 0;
+            sec = find_output_section(l, name + (is_start ? 8 : 7));
+            s->address = sec ? sec->addr + (is_start ? 0 : sec->size) : 0;
+        } else if (strcmp(name, "__rela_iplt_start") == 0) {
+            s->address = rela_iplt;
+        } else if (strcmp(name, "__rela_iplt_end") == 0) {
+            s->address = rela_iplt_end;
+        } else if (strcmp(name, "_etext") == 0 || strcmp(name, "etext") == 0) {
+            s->address = etext;
+        } else if (strcmp(name, "_edata") == 0 || strcmp(name, "edata") == 0 || strcmp(name, "__bss_start") == 0) {
+            s->address = edata;
+        } else if (strcmp(name, "_end") == 0 || strcmp(name, "end") == 0) {
+            s->address = end;
+        }
+    }
+}
+
+static void build_dynamic_relocs(ElfLinker* l) {
+    l->rela_dyn = dyn_array_create_with_initial_cap(DynamicReloc, 64);
+    l->rela_plt = dyn_array_create_with_initial_cap(DynamicReloc, 64);
+
+    dyn_array_for(i, l->got_syms) {
+        LinkSymbol* s = l->got_syms[i];
+        if (!is_imported(s)) continue;
+
+        if (s->tls_got == i) {
+            dyn_array_put(l->rela_dyn, (DynamicReloc){ R_X86_64_TPOFF64, s, got_entry_address(l, i), 0 });
+        } else if ((s->flags & (NEEDS_COPY | ADDRESS_TAKEN)) == 0) {
+            dyn_array_put(l->rela_dyn, (DynamicReloc){ R_X86_64_GLOB_DAT, s, got_entry_address(l, i), 0 });
+        }
+    }
+
+    dyn_array_for(i, l->copy_syms) {
+        LinkSymbol* s = l->copy_syms[i];
+
+        // one copy per address, the aliases will point to it regardless
+        if (find_copy_alias(l, i) != NULL) continue;
+
+        dyn_array_put(l->rela_dyn, (DynamicReloc){ R_X86_64_COPY, s, symbol_address(l, s), 0 });
+    }
+
+    dyn_array_for(i, l->plt_syms) {
+        LinkSymbol* s = l->plt_syms[i];
+        uint64_t slot = l->got_plt->addr + (i * 8);
+        if (is_imported(s)) {
+            dyn_array_put(l->rela_plt, (DynamicReloc){ R_X86_64_JUMP_SLOT, s, slot, 0 });
+        } else {
+            dyn_array_put(l->rela_plt, (DynamicReloc){ R_X86_64_IRELATIVE, NULL, slot, symbol_address(l, s) });
+        }
+    }
+
+    // static executables have nothing to apply JUMP_SLOTs so they can't
+    // have imports, the scan should've caught that.
+    assert(l->is_dynamic || dyn_array_length(l->rela_dyn) == 0);
+}
+
+////////////////////////////////
+// Incremental linking
+////////////////////////////////
+static uint64_t hash_bytes(uint64_t h, const void* data, size_t len) {
+    const uint8_t* p = data;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        h = (h ^ w) * 0x9E3779B97F4A7C15ull;
+        h ^= h >> 29;
+    }
+
+    for (; len > 0; p++, len--) {
+        h = (h ^ *p) * 0x100000001B3ull;
+    }
+    return h;
+}
+
+static uint64_t hash_string(uint64_t h, const char* str) {
+    return hash_bytes(h, str, strlen(str) + 1);
+}
+
+static uint64_t hash_u64(uint64_t h, uint64_t x) {
+    return hash_bytes(h, &x, sizeof(x));
+}
+
+static bool get_output_stamp(const char* path, uint64_t* size, uint64_t* mtime) {
+    struct stat s;
+    if (stat(path, &s) != 0) {
+        return false;
+    }
+
+    *size = s.st_size;
+    *mtime = (uint64_t) s.st_mtim.tv_sec * 1000000000ull + s.st_mtim.tv_nsec;
+    return true;
+}
+
+static void sidecar_path(char* out, const char* filename) {
+    snprintf(out, FILENAME_MAX, "%s.ilk", filename);
+}
+
+// padding between the pieces of these would break them (.init is a single
+// function split across crti.o and crtn.o, the arrays would grow NULL entries)
+// so only these get slack.
+static bool is_padded_section(const OutputSection* s) {
+    return strcmp(s->name, ".text") == 0 || strcmp(s->name, ".rodata") == 0 ||
+        strcmp(s->name, ".data") == 0 || strcmp(s->name, ".bss") == 0 ||
+        strcmp(s->name, ".tdata") == 0 || strcmp(s->name, ".tbss") == 0;
+}
+
+static uint64_t section_key(const InputSection* sec) {
+    uint64_t h = hash_string(0, sec->file->name);
+    h = hash_string(h, sec->name);
+    return hash_u64(h, sec->shdr - sec->file->shdrs);
+}
+
+static uint64_t output_key(const OutputSection* s) {
+    return hash_u64(hash_string(0, s->name), s->type | (s->flags << 32));
+}
+
+// what a relocation against the symbol would see
+static uint64_t symbol_state(ElfLinker* l, const LinkSymbol* s) {
+    uint64_t h = hash_u64(0, relocation_target(l, s));
+    h = hash_u64(h, s->size);
+    return hash_u64(h, ((uint64_t) s->got << 32) ^ ((uint64_t) s->tls_got << 16) ^ s->plt);
+}
+
+static int compare_incremental_symbols(const void* a, const void* b) {
+    uint64_t x = ((const IncrementalSymbol*) a)->key, y = ((const IncrementalSymbol*) b)->key;
+    return (x > y) - (x < y);
+}
+
+static void load_incremental_state(ElfLinker* l, const char* filename) {
+    char path[FILENAME_MAX];
+    sidecar_path(path, filename);
+
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return;
+
+    fseek(file, 0, SEEK_END);
+    size_t size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    IncrementalHeader* header = HEAP_ALLOC(size + 1);
+    bool ok = size >= sizeof(IncrementalHeader) && fread(header, size, 1, file) == 1;
+    fclose(file);
+
+    // the executable has to be exactly what we left behind
+    uint64_t file_size, file_mtime;
+    ok = ok && memcmp(header->magic, INCREMENTAL_MAGIC, 8) == 0 &&
+        get_output_stamp(filename, &file_size, &file_mtime) &&
+        file_size == header->file_size && file_mtime == header->file_mtime;
+
+    ok = ok && size == sizeof(IncrementalHeader)
+        + (header->section_count * sizeof(IncrementalSection))
+        + (header->output_count * sizeof(IncrementalOutput))
+        + (header->symbol_count * sizeof(IncrementalSymbol));
+
+    if (!ok) {
+        HEAP_FREE(header);
+        return;
+    }
+
+    l->prev = header;
+    l->prev_sections = (IncrementalSection*) &header[1];
+    l->prev_outputs = (IncrementalOutput*) &l->prev_sections[header->section_count];
+    l->prev_symbols = (IncrementalSymbol*) &l->prev_outputs[header->output_count];
+}
+
+static void drop_incremental_state(ElfLinker* l) {
+    HEAP_FREE(l->prev);
+    l->prev = NULL;
+}
+
+static void hash_section_task(ElfLinker* l, size_t i) {
+    InputSection* sec = l->live_sections[i];
+    ElfFile* f = sec->file;
+    const Elf64_Shdr* shdr = sec->shdr;
+
+    uint64_t h = hash_u64(0, shdr->sh_size);
+    if (shdr->sh_type != SHT_NOBITS) {
+        h = hash_bytes(h, f->data + shdr->sh_offset, shdr->sh_size);
+    }
+
+    // relocations against locals resolve relative to their section which
+    // doesn't move, globals are tracked separately.
+    h = hash_bytes(h, sec->relocs, sec->reloc_count * sizeof(Elf64_Rela));
+    for (size_t j = 0; j < sec->reloc_count; j++) {
+        uint32_t sym_index = ELF64_R_SYM(sec->relocs[j].r_info);
+        if (sym_index < f->first_global && sym_index < f->sym_count) {
+            h = hash_u64(h, f->syms[sym_index].st_value);
+            h = hash_u64(h, symbol_shndx(f, sym_index));
+        }
+    }
+
+    sec->hash = h;
+}
+
+// picks the slot for every section, either the padded size for a fresh layout or
+// the previous slot if it still fits. if anything doesn't fit we drop the old
+// state and do a full link.
+static void assign_slots(ElfLinker* l) {
+    size_t count = dyn_array_length(l->live_sections);
+    if (l->prev != NULL && l->prev->section_count != count) {
+        drop_incremental_state(l);
+    }
+
+    if (l->prev != NULL) {
+        for (size_t i = 0; i < count; i++) {
+            InputSection* sec = l->live_sections[i];
+            IncrementalSection* old = &l->prev_sections[i];
+
+            uint64_t size = sec->shdr->sh_size;
+            bool fits = is_padded_section(sec->out) ? size <= old->slot : size == old->slot;
+            if (old->key != section_key(sec) || !fits) {
+                drop_incremental_state(l);
+                break;
+            }
+
+            sec->slot = old->slot;
+        }
+
+        if (l->prev != NULL) return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        InputSection* sec = l->live_sections[i];
+        uint64_t size = sec->shdr->sh_size;
+
+        if ((sec->shdr->sh_flags & SHF_ALLOC) && is_padded_section(sec->out)) {
+            sec->slot = align_up(size + (size / 4) + 64, sec->shdr->sh_addralign);
+        } else {
+            sec->slot = size;
+        }
+    }
+}
+
+static void mark_dirty_task(ElfLinker* l, size_t i) {
+    InputSection* sec = l->live_sections[i];
+    ElfFile* f = sec->file;
+
+    if ((sec->shdr->sh_flags & SHF_ALLOC) == 0 || sec->hash != l->prev_sections[i].hash) {
+        sec->dirty = true;
+        return;
+    }
+
+    for (size_t j = 0; j < sec->reloc_count; j++) {
+        uint32_t sym_index = ELF64_R_SYM(sec->relocs[j].r_info);
+        if (sym_index >= f->first_global && sym_index < f->sym_count && f->sym_map[sym_index - f->first_global]->moved) {
+            sec->dirty = true;
+            return;
+        }
+    }
+}
+
+// if every loaded section landed where it did last time we can patch the
+// existing executable rather than writing a new one.
+static bool match_previous_layout(ElfLinker* l) {
+    size_t output_count = 0;
+    dyn_array_for(i, l->sections) {
+        OutputSection* s = l->sections[i];
+        if ((s->flags & SHF_ALLOC) == 0) continue;
+
+        if (output_count >= l->prev->output_count) return false;
+
+        IncrementalOutput* old = &l->prev_outputs[output_count++];
+        if (old->key != output_key(s) || old->addr != s->addr || old->offset != s->offset || old->size != s->size) {
+            return false;
+        }
+    }
+
+    if (output_count != l->prev->output_count) return false;
+
+    nl_strmap_for(i, l->symbols) {
+        LinkSymbol* s = l->symbols[i];
+        IncrementalSymbol key = { hash_string(0, s->name) };
+
+        IncrementalSymbol* old = bsearch(&key, l->prev_symbols, l->prev->symbol_count, sizeof(IncrementalSymbol), compare_incremental_symbols);
+        s->moved = old == NULL || old->state != symbol_state(l, s);
+    }
+
+    size_t count = dyn_array_length(l->live_sections);
+    uint64_t* costs = HEAP_ALLOC(count * sizeof(uint64_t) + 1);
+    for (size_t i = 0; i < count; i++) costs[i] = l->live_sections[i]->reloc_count * 16 + 64;
+
+    parallel_for(l, count, costs, mark_dirty_task);
+    HEAP_FREE(costs);
+    return true;
+}
+
+static void save_incremental_state(ElfLinker* l, const char* filename) {
+    char path[FILENAME_MAX];
+    sidecar_path(path, filename);
+
+    IncrementalHeader header = { .magic = INCREMENTAL_MAGIC };
+    if (!get_output_stamp(filename, &header.file_size, &header.file_mtime)) return;
+
+    header.section_count = dyn_array_length(l->live_sections);
+    dyn_array_for(i, l->sections) {
+        header.output_count += (l->sections[i]->flags & SHF_ALLOC) != 0;
+    }
+    header.symbol_count = nl_strmap_get_load(l->symbols);
+
+    IncrementalSection* sections = HEAP_ALLOC(header.section_count * sizeof(IncrementalSection) + 1);
+    dyn_array_for(i, l->live_sections) {
+        InputSection* sec = l->live_sections[i];
+        sections[i] = (IncrementalSection){ section_key(sec), sec->hash, sec->slot };
+    }
+
+    IncrementalOutput* outputs = HEAP_ALLOC(header.output_count * sizeof(IncrementalOutput) + 1);
+    size_t output_count = 0;
+    dyn_array_for(i, l->sections) {
+        OutputSection* s = l->sections[i];
+        if (s->flags & SHF_ALLOC) {
+            outputs[output_count++] = (IncrementalOutput){ output_key(s), s->addr, s->offset, s->size };
+        }
+    }
+
+    IncrementalSymbol* symbols = HEAP_ALLOC(header.symbol_count * sizeof(IncrementalSymbol) + 1);
+    size_t symbol_count = 0;
+    nl_strmap_for(i, l->symbols) {
+        LinkSymbol* s = l->symbols[i];
+        symbols[symbol_count++] = (IncrementalSymbol){ hash_string(0, s->name), symbol_state(l, s) };
+    }
+    qsort(symbols, symbol_count, sizeof(IncrementalSymbol), compare_incremental_symbols);
+
+    FILE* file = fopen(path, "wb");
+    if (file != NULL) {
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = ok && fwrite(sections, sizeof(IncrementalSection), header.section_count, file) == header.section_count;
+        ok = ok && fwrite(outputs, sizeof(IncrementalOutput), header.output_count, file) == header.output_count;
+        ok = ok && fwrite(symbols, sizeof(IncrementalSymbol), header.symbol_count, file) == header.symbol_count;
+        fclose(file);
+
+        // a broken sidecar just means a full link next time
+        if (!ok) remove(path);
+    }
+
+    HEAP_FREE(sections);
+    HEAP_FREE(outputs);
+    HEAP_FREE(symbols);
+}
+
+////////////////////////////////
+// Writing
+////////////////////////////////
+static bool write_overflow_check(ElfLinker* l, InputSection* sec, const Elf64_Rela* r, int64_t value, int64_t min, int64_t max) {
+    if (value < min || value > max) {
+        uint32_t sym_index = ELF64_R_SYM(r->r_info);
+        ElfFile* f = sec->file;
+        link_error(l, "%s: relocation overflow in %s against %s", f->name, sec->name, f->strtab + f->syms[sym_index].st_name);
+        return false;
+    }
+    return true;
+}
+
+static void write32(uint8_t* p, uint32_t x) { memcpy(p, &x, sizeof(x)); }
+static void write64(uint8_t* p, uint64_t x) { memcpy(p, &x, sizeof(x)); }
+
+static void relocate_section(ElfLinker* l, InputSection* sec, uint8_t* dst) {
+    ElfFile* f = sec->file;
+    uint64_t base = input_section_address(sec);
+    bool is_alloc = (sec->shdr->sh_flags & SHF_ALLOC) != 0;
+
+    for (size_t j = 0; j < sec->reloc_count; j++) {
+        const Elf64_Rela* r = &sec->relocs[j];
+        uint32_t type = ELF64_R_TYPE(r->r_info);
+        uint32_t sym_index = ELF64_R_SYM(r->r_info);
+        if (type == R_X86_64_NONE || sym_index >= f->sym_count || r->r_offset >= sec->shdr->sh_size) continue;
+
+        uint8_t* loc = dst + r->r_offset;
+        uint64_t P = base + r->r_offset;
+        int64_t A = r->r_addend;
+
+        LinkSymbol* s = sym_index >= f->first_global ? f->sym_map[sym_index - f->first_global] : NULL;
+        uint64_t S = 0, size = 0;
+        if (s != NULL) {
+            S = relocation_target(l, s);
+            size = s->size;
+        } else {
+            const Elf64_Sym* sym = &f->syms[sym_index];
+            uint32_t shndx = symbol_shndx(f, sym_index);
+            if (shndx == SHN_ABS) {
+                S = sym->st_value;
+            } else if (shndx != SHN_UNDEF && shndx < f->shnum && f->sections[shndx].out != NULL) {
+                S = input_section_address(&f->sections[shndx]) + sym->st_value;
+            }
+            size = sym->st_size;
+        }
+
+        // debug info just wants the address, nothing is imported from its point of view
+        if (!is_alloc && s != NULL && is_imported(s) && (s->flags & NEEDS_COPY) == 0) {
+            S = 0;
+        }
+
+        switch (type) {
+            case R_X86_64_64:
+            write64(loc, S + A);
+            break;
+
+            case R_X86_64_32:
+            if (!write_overflow_check(l, sec, r, S + A, 0, UINT32_MAX)) return;
+            write32(loc, S + A);
+            break;
+
+            case R_X86_64_32S:
+            if (!write_overflow_check(l, sec, r, S + A, INT32_MIN, INT32_MAX)) return;
+            write32(loc, S + A);
+            break;
+
+            case R_X86_64_PC32:
+            case R_X86_64_PLT32: {
+                int64_t value = S + A - P;
+                if (!write_overflow_check(l, sec, r, value, INT32_MIN, INT32_MAX)) return;
+                write32(loc, value);
+                break;
+            }
+
+            case R_X86_64_PC64:
+            write64(loc, S + A - P);
+            break;
+
+            case R_X86_64_GOTPCREL: case R_X86_64_GOTPCRELX: case R_X86_64_REX_GOTPCRELX: {
+                const uint8_t* original = f->data + sec->shdr->sh_offset + r->r_offset;
+                if (can_relax_got(type, original, r->r_offset, s)) {
+                    if (loc[-2] == 0x8b) {
+                        loc[-2] = 0x8d;
+                    } else if (loc[-1] == 0x15) {
+                        loc[-2] = 0x67, loc[-1] = 0xe8;
+                    } else {
+                        // the displacement moves back a byte, the last one becomes a nop
+                        loc[-2] = 0xe9;
+                        loc -= 1, P -= 1;
+                        loc[4] = 0x90;
+                    }
+
+                    int64_t value = S + A - P;
+                    if (!write_overflow_check(l, sec, r, value, INT32_MIN, INT32_MAX)) return;
+                    write32(loc, value);
+                    break;
+                }
+
+                int64_t value = got_entry_address(l, s->got) + A - P;
+                if (!write_overflow_check(l, sec, r, value, INT32_MIN, INT32_MAX)) return;
+                write32(loc, value);
+                break;
+            }
+
+            case R_X86_64_GOTPCREL64:
+            write64(loc, got_entry_address(l, s->got) + A - P);
+            break;
+
+            case R_X86_64_GOT32:
+            write32(loc, (s->got * 8) + A);
+            break;
+
+            case R_X86_64_GOT64: case R_X86_64_GOTPLT64:
+            write64(loc, (s->got * 8) + A);
+            break;
+
+            case R_X86_64_GOTPC32:
+            write32(loc, l->got->addr + A - P);
+            break;
+
+            case R_X86_64_GOTPC64:
+            write64(loc, l->got->addr + A - P);
+            break;
+
+            case R_X86_64_GOTOFF64:
+            write64(loc, S + A - l->got->addr);
+            break;
+
+            case R_X86_64_GOTTPOFF: {
+                const uint8_t* original = f->data + sec->shdr->sh_offset + r->r_offset;
+                if (can_relax_tls(original, r->r_offset, s)) {
+                    uint8_t reg = (loc[-1] >> 3) & 7;
+                    if (loc[-2] == 0x8b) {
+                        if (loc[-3] == 0x4c) loc[-3] = 0x49;
+                        loc[-2] = 0xc7, loc[-1] = 0xc0 | reg;
+                    } else if (reg == 4) {
+                        // %rsp can't be the base of the lea
+                        if (loc[-3] == 0x4c) loc[-3] = 0x49;
+                        loc[-2] = 0x81, loc[-1] = 0xc0 | reg;
+                    } else {
+                        if (loc[-3] == 0x4c) loc[-3] = 0x4d;
+                        loc[-2] = 0x8d, loc[-1] = 0x80 | (reg << 3) | reg;
+                    }
+
+                    // the addend accounted for the PC being after the displacement
+                    write32(loc, tpoff(l, S) + A + 4);
+                    break;
+                }
+
+                int64_t value = got_entry_address(l, s->tls_got) + A - P;
+                if (!write_overflow_check(l, sec, r, value, INT32_MIN, INT32_MAX)) return;
+                write32(loc, value);
+                break;
+            }
+
+            case R_X86_64_TPOFF32:
+            write32(loc, tpoff(l, S) + A);
+            break;
+
+            case R_X86_64_TPOFF64:
+            write64(loc, tpoff(l, S) + A);
+            break;
+
+            case R_X86_64_DTPOFF32:
+            write32(loc, S + A - l->tls_start);
+            break;
+
+            case R_X86_64_DTPOFF64:
+            write64(loc, S + A - l->tls_start);
+            break;
+
+            case R_X86_64_SIZE32:
+            write32(loc, size + A);
+            break;
+
+            case R_X86_64_SIZE64:
+            write64(loc, size + A);
+            break;
+
+            default:
+            if (!is_alloc) {
+                link_error(l, "%s: unsupported relocation type %u in %s", f->name, type, sec->name);
+                return;
+            }
+            break;
+        }
+    }
+}
+
+static void write_section_task(ElfLinker* l, size_t i) {
+    InputSection* sec = l->live_sections[i];
+    if (sec->shdr->sh_type == SHT_NOBITS || sec->out->type == SHT_NOBITS) return;
+    if (l->patching && !sec->dirty) return;
+
+    uint8_t* dst = l->out + sec->out->offset + sec->offset;
+    memcpy(dst, sec->file->data + sec->shdr->sh_offset, sec->shdr->sh_size);
+    relocate_section(l, sec, dst);
+
+    // slack in code is filled with int3
+    if (sec->slot > sec->shdr->sh_size) {
+        memset(dst + sec->shdr->sh_size, (sec->out->flags & SHF_EXECINSTR) ? 0xCC : 0, sec->slot - sec->shdr->sh_size);
+    }
+}
+
+static void write_symbol(ElfLinker* l, Elf64_Sym* out, const char* name, uint8_t info, uint8_t other, uint16_t shndx, uint64_t value, uint64_t size) {
+    out->st_name = append_string(&l->strtab, name);
+
+    out->st_info = info;
+    out->st_other = other;
+    out->st_shndx = shndx;
+    out->st_value = value;
+    out->st_size = size;
+}
+
+static void write_symtab(ElfLinker* l, OutputSection* s, uint8_t* dst) {
+    Elf64_Sym* syms = (Elf64_Sym*) dst;
+    size_t count = 1;
+
+    dyn_array_for(i, l->files) {
+        ElfFile* f = l->files[i];
+        if (f->kind != FILE_OBJECT) continue;
+
+        for (size_t j = 1; j < f->first_global && j < f->sym_count; j++) {
+            if (!is_local_symbol_kept(f, j)) continue;
+
+            const Elf64_Sym* sym = &f->syms[j];
+            uint32_t shndx = symbol_shndx(f, j);
+            uint64_t value = sym->st_value;
+            uint16_t out_shndx = SHN_ABS;
+            if (shndx != SHN_ABS) {
+                InputSection* sec = &f->sections[shndx];
+                out_shndx = sec->out->index;
+                value = (sym->st_info & 0xf) == STT_TLS ? value + sec->offset : input_section_address(sec) + value;
+            }
+
+            write_symbol(l, &syms[count++], f->strtab + sym->st_name, sym->st_info, sym->st_other, out_shndx, value, sym->st_size);
+        }
+    }
+
+    nl_strmap_for(i, l->symbols) {
+        LinkSymbol* sym = l->symbols[i];
+        if (!is_global_symbol_kept(sym)) continue;
+
+        uint8_t bind = sym->weak ? STB_WEAK : STB_GLOBAL;
+        uint8_t other = 0;
+        uint16_t shndx = SHN_ABS;
+        uint64_t value = symbol_address(l, sym);
+        if (sym->kind == SYM_DEFINED) {
+            const Elf64_Sym* def = &sym->file->syms[sym->sym_index];
+            uint32_t def_shndx = symbol_shndx(sym->file, sym->sym_index);
+            other = def->st_other;
+            if (def_shndx != SHN_ABS) {
+                InputSection* sec = &sym->file->sections[def_shndx];
+                shndx = sec->out->index;
+                if (sym->type == STT_TLS) value = def->st_value + sec->offset;
+            }
+        } else if (sym->kind == SYM_COMMON || (sym->flags & NEEDS_COPY)) {
+            shndx = l->bss->index;
+        } else if (sym->kind == SYM_SHARED) {
+            shndx = SHN_UNDEF;
+        }
+
+        write_symbol(l, &syms[count++], sym->name, ELF64_ST_INFO(bind, sym->type), other, shndx, value, sym->size);
+    }
+
+    l->strtab_sec->size = dyn_array_length(l->strtab);
+}
+
+static void write_headers(ElfLinker* l, uint64_t shoff, size_t shnum) {
+    Elf64_Ehdr* ehdr = (Elf64_Ehdr*) l->out;
+    memcpy(ehdr->e_ident, ELFMAG, SELFMAG);
+    ehdr->e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr->e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr->e_ident[EI_OSABI] = ELFOSABI_NONE;
+    ehdr->e_type = ET_EXEC;
+    ehdr->e_machine = EM_X86_64;
+    ehdr->e_version = EV_CURRENT;
+    ehdr->e_entry = l->entry;
+    ehdr->e_phoff = sizeof(Elf64_Ehdr);
+    ehdr->e_shoff = shoff;
+    ehdr->e_ehsize = sizeof(Elf64_Ehdr);
+    ehdr->e_phentsize = sizeof(Elf64_Phdr);
+    ehdr->e_phnum = l->phdr_count;
+    ehdr->e_shentsize = sizeof(Elf64_Shdr);
+    ehdr->e_shnum = shnum;
+    ehdr->e_shstrndx = l->shstrtab_sec->index;
+
+    Elf64_Phdr* phdrs = (Elf64_Phdr*) (l->out + sizeof(Elf64_Ehdr));
+    size_t phdr_count = 0;
+    if (l->is_dynamic) {
+        uint64_t size = l->phdr_count * sizeof(Elf64_Phdr);
+        phdrs[phdr_count++] = (Elf64_Phdr){
+            .p_type = PT_PHDR, .p_flags = PF_R, .p_offset = sizeof(Elf64_Ehdr),
+            .p_vaddr = ELF_BASE_ADDRESS + sizeof(Elf64_Ehdr), .p_paddr = ELF_BASE_ADDRESS + sizeof(Elf64_Ehdr),
+            .p_filesz = size, .p_memsz = size, .p_align = 8,
+        };
+
+        phdrs[phdr_count++] = (Elf64_Phdr){
+            .p_type = PT_INTERP, .p_flags = PF_R, .p_offset = l->interp->offset,
+            .p_vaddr = l->interp->addr, .p_paddr = l->interp->addr,
+            .p_filesz = l->interp->size, .p_memsz = l->interp->size, .p_align = 1,
+        };
+    }
+
+    // the first segment also maps the headers
+    static const uint32_t segment_flags[] = { [SEGMENT_R] = PF_R, [SEGMENT_RX] = PF_R | PF_X, [SEGMENT_RW] = PF_R | PF_W };
+    for (SegmentKind kind = SEGMENT_R; kind <= SEGMENT_RW; kind++) {
+        uint64_t start = kind == SEGMENT_R ? 0 : UINT64_MAX, file_end = 0, mem_end = 0;
+        dyn_array_for(i, l->sections) {
+            OutputSection* s = l->sections[i];
+            if (rank_segment(s->rank) != kind) continue;
+
+            if (s->offset < start) start = s->offset;
+            if (s->type != SHT_NOBITS && s->offset + s->size > file_end) file_end = s->offset + s->size;
+            if (!(s->type == SHT_NOBITS && (s->flags & SHF_TLS)) && s->addr + s->size > mem_end) mem_end = s->addr + s->size;
+        }
+
+        if (start == UINT64_MAX) {
+            // empty segments still take a program header, leave it as a NULL one
+            phdrs[phdr_count++] = (Elf64_Phdr){ .p_type = PT_NULL };
+            continue;
+        }
+
+        if (file_end < start) file_end = start;
+        uint64_t vaddr = ELF_BASE_ADDRESS + start;
+        phdrs[phdr_count++] = (Elf64_Phdr){
+            .p_type = PT_LOAD, .p_flags = segment_flags[kind], .p_offset = start,
+            .p_vaddr = vaddr, .p_paddr = vaddr,
+            .p_filesz = file_end - start, .p_memsz = (mem_end > vaddr ? mem_end : vaddr) - vaddr,
+            .p_align = ELF_PAGE_SIZE,
+        };
+    }
+
+    if (l->is_dynamic) {
+        phdrs[phdr_count++] = (Elf64_Phdr){
+            .p_type = PT_DYNAMIC, .p_flags = PF_R | PF_W, .p_offset = l->dynamic->offset,
+            .p_vaddr = l->dynamic->addr, .p_paddr = l->dynamic->addr,
+            .p_filesz = l->dynamic->size, .p_memsz = l->dynamic->size, .p_align = 8,
+        };
+    }
+
+    OutputSection* tdata = NULL;
+    OutputSection* note = NULL;
+    dyn_array_for(i, l->sections) {
+        OutputSection* s = l->sections[i];
+        if ((s->flags & SHF_TLS) && tdata == NULL) tdata = s;
+        if (s->type == SHT_NOTE && note == NULL) note = s;
+    }
+
+    if (tdata != NULL) {
+        uint64_t filesz = 0;
+        dyn_array_for(i, l->sections) {
+            OutputSection* s = l->sections[i];
+            if ((s->flags & SHF_TLS) && s->type != SHT_NOBITS) filesz = (s->addr + s->size) - l->tls_start;
+        }
+
+        phdrs[phdr_count++] = (Elf64_Phdr){
+            .p_type = PT_TLS, .p_flags = PF_R, .p_offset = tdata->offset,
+            .p_vaddr = l->tls_start, .p_paddr = l->tls_start,
+            .p_filesz = filesz, .p_memsz = l->tls_size, .p_align = l->tls_align,
+        };
+    }
+
+    if (note != NULL) {
+        phdrs[phdr_count++] = (Elf64_Phdr){
+            .p_type = PT_NOTE, .p_flags = PF_R, .p_offset = note->offset,
+            .p_vaddr = note->addr, .p_paddr = note->addr,
+            .p_filesz = note->size, .p_memsz = note->size, .p_align = note->align,
+        };
+    }
+
+    phdrs[phdr_count++] = (Elf64_Phdr){ .p_type = PT_GNU_STACK, .p_flags = PF_R | PF_W, .p_align = 16 };
+    assert(phdr_count == l->phdr_count);
+
+    // section headers
+    Elf64_Shdr* shdrs = (Elf64_Shdr*) (l->out + shoff);
+    dyn_array_for(i, l->sections) {
+        OutputSection* s = l->sections[i];
+        shdrs[s->index] = (Elf64_Shdr){
+            .sh_name = s->name_offset, .sh_type = s->type, .sh_flags = s->flags,
+            .sh_addr = s->addr, .sh_offset = s->offset, .sh_size = s->size,
+            .sh_link = s->link, .sh_info = s->info, .sh_addralign = s->align, .sh_entsize = s->entsize,
+        };
+    }
+}
+
+static bool write_output(ElfLinker* l, const char* path) {
+    OutputSection* last = l->sections[dyn_array_length(l->sections) - 1];
+    uint64_t shoff = align_up(last->offset + last->size, 8);
+    size_t shnum = dyn_array_length(l->sections) + 1;
+    uint64_t file_size = shoff + (shnum * sizeof(Elf64_Shdr));
+
+    // patching writes into the old executable, if it's running (ETXTBSY) we
+    // write a new one instead.
+    int fd = -1;
+    if (l->patching) {
+        fd = open(path, O_RDWR);
+        l->patching = (fd >= 0);
+    }
+
+    if (fd < 0) {
+        // don't scribble over an executable someone's running
+        unlink(path);
+        fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0777);
+    }
+
+    if (fd < 0) {
+        link_error(l, "could not open %s for writing", path);
+        return false;
+    }
+
+    if (ftruncate(fd, file_size) != 0) {
+        link_error(l, "could not resize %s", path);
+        close(fd);
+        return false;
+    }
+
+    l->out = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (l->out == MAP_FAILED) {
+        link_error(l, "could not map %s", path);
+        return false;
+    }
+
+    CUIK_TIMED_BLOCK("write sections") {
+        size_t count = dyn_array_length(l->live_sections);
+        uint64_t* costs = HEAP_ALLOC(count * sizeof(uint64_t) + 1);
+        for (size_t i = 0; i < count; i++) costs[i] = section_cost(l->live_sections[i]);
+
+        parallel_for(l, count, costs, write_section_task);
+        HEAP_FREE(costs);
+    }
+
+    // synthetic sections are small, the symbol table goes before the string table
+    // since it's the one that fills it in.
+    // they're all rewritten when patching, the writers expect zeroed memory.
+    dyn_array_for(i, l->sections) {
+        OutputSection* s = l->sections[i];
+        if (s->write != NULL && s != l->strtab_sec && s != l->dynstr_sec) {
+            if (l->patching) memset(l->out + s->offset, 0, s->size);
+            s->write(l, s, l->out + s->offset);
+        }
+    }
+    if (l->dynstr_sec) l->dynstr_sec->write(l, l->dynstr_sec, l->out + l->dynstr_sec->offset);
+    l->strtab_sec->write(l, l->strtab_sec, l->out + l->strtab_sec->offset);
+
+    write_headers(l, shoff, shnum);
+
+    munmap(l->out, file_size);
+    return !l->failed;
+}
+
+////////////////////////////////
+// Driver
+////////////////////////////////
+static bool add_named_input(ElfLinker* l, const char* name, bool required) {
+    char path[FILENAME_MAX];
+    if (!find_input(l, name, path)) {
+        if (required) link_error(l, "could not find %s", name);
+        return false;
+    }
+
+    add_input_path(l, path, false);
+    return true;
+}
+
+static void cleanup(ElfLinker* l) {
+    dyn_array_for(i, l->mappings) {
+        munmap(l->mappings[i], l->mapping_sizes[i]);
+    }
+
+    dyn_array_destroy(l->mappings);
+    dyn_array_destroy(l->mapping_sizes);
+    dyn_array_destroy(l->files);
+    dyn_array_destroy(l->shared);
+    dyn_array_destroy(l->extract_queue);
+    dyn_array_destroy(l->live_sections);
+    dyn_array_destroy(l->got_syms);
+    dyn_array_destroy(l->plt_syms);
+    dyn_array_destroy(l->dynsyms);
+    dyn_array_destroy(l->copy_syms);
+    dyn_array_destroy(l->common_syms);
+    dyn_array_destroy(l->verneed_files);
+    dyn_array_destroy(l->verneed_names);
+    if (l->rela_dyn) dyn_array_destroy(l->rela_dyn);
+    if (l->rela_plt) dyn_array_destroy(l->rela_plt);
+    if (l->dynstr) dyn_array_destroy(l->dynstr);
+    if (l->strtab) dyn_array_destroy(l->strtab);
+    if (l->shstrtab) dyn_array_destroy(l->shstrtab);
+
+    dyn_array_for(i, l->sections) {
+        if (l->sections[i]->inputs) dyn_array_destroy(l->sections[i]->inputs);
+    }
+    dyn_array_destroy(l->sections);
+
+    nl_strmap_free(l->symbols);
+    nl_strmap_free(l->comdat_groups);
+    nl_strmap_free(l->dynstr_map);
+    if (l->prev) HEAP_FREE(l->prev);
+    arena_free(&l->arena);
+}
+
+bool cuiklink__elf(Cuik_Linker* desc, const char* filename, const char* crt_name) {
+    ElfLinker l = { .desc = desc };
+    l.files = dyn_array_create_with_initial_cap(ElfFile*, 64);
+    l.shared = dyn_array_create_with_initial_cap(ElfFile*, 16);
+    l.mappings = dyn_array_create_with_initial_cap(void*, 64);
+    l.mapping_sizes = dyn_array_create_with_initial_cap(size_t, 64);
+    l.extract_queue = dyn_array_create_with_initial_cap(ElfFile*, 64);
+    l.sections = dyn_array_create_with_initial_cap(OutputSection*, 64);
+    l.live_sections = dyn_array_create_with_initial_cap(InputSection*, 1024);
+    l.got_syms = dyn_array_create_with_initial_cap(LinkSymbol*, 64);
+    l.plt_syms = dyn_array_create_with_initial_cap(LinkSymbol*, 64);
+    l.dynsyms = dyn_array_create_with_initial_cap(LinkSymbol*, 64);
+    l.copy_syms = dyn_array_create_with_initial_cap(LinkSymbol*, 16);
+    l.common_syms = dyn_array_create_with_initial_cap(LinkSymbol*, 16);
+    l.verneed_files = dyn_array_create_with_initial_cap(ElfFile*, 16);
+    l.verneed_names = dyn_array_create_with_initial_cap(const char*, 16);
+    l.symbols = nl_strmap_alloc(LinkSymbol*, 4096);
+    l.comdat_groups = nl_strmap_alloc(bool, 64);
+    l.dynstr_map = nl_strmap_alloc(uint32_t, 1024);
+
+    CUIK_TIMED_BLOCK("load inputs") {
+        // the C runtime goes around the user's inputs: crt1.o crti.o ... -l<crt_name> crtn.o
+        if (crt_name != NULL) {
+            add_named_input(&l, "crt1.o", true);
+            add_named_input(&l, "crti.o", true);
+        }
+
+        const char* str = desc->input_file_buffer;
+        for (size_t i = 0; i < desc->input_file_count; i++, str += strlen(str) + 1) {
+            add_named_input(&l, str, true);
+        }
+
+        if (crt_name != NULL) {
+            char crt_lib[FILENAME_MAX];
+            snprintf(crt_lib, FILENAME_MAX, "-l%s", crt_name);
+
+            add_named_input(&l, crt_lib, true);
+            add_named_input(&l, "crtn.o", true);
+        }
+    }
+    if (l.failed) goto error;
+
+    CUIK_TIMED_BLOCK("resolve symbols") {
+        resolve_symbols(&l);
+        define_synthetic_symbols(&l);
+    }
+    if (l.failed) goto error;
+
+    CUIK_TIMED_BLOCK("scan relocations") {
+        bin_sections(&l);
+        scan_relocations(&l);
+    }
+    if (l.failed) goto error;
+
+    if (desc->incremental) {
+        CUIK_TIMED_BLOCK("hash sections") {
+            load_incremental_state(&l, filename);
+
+            size_t count = dyn_array_length(l.live_sections);
+            uint64_t* costs = HEAP_ALLOC(count * sizeof(uint64_t) + 1);
+            for (size_t i = 0; i < count; i++) costs[i] = section_cost(l.live_sections[i]);
+
+            parallel_for(&l, count, costs, hash_section_task);
+            HEAP_FREE(costs);
+
+            assign_slots(&l);
+        }
+    }
+
+    CUIK_TIMED_BLOCK("layout") {
+        build_dynamic_tables(&l);
+        create_synthetic_sections(&l);
+        layout_sections(&l);
+        resolve_synthetic_symbols(&l);
+        build_dynamic_relocs(&l);
+
+        if (l.prev != NULL) {
+            l.patching = match_previous_layout(&l);
+        }
+    }
+
+    ptrdiff_t entry = nl_strmap_get_cstr(l.symbols, "_start");
+    if (entry >= 0 && l.symbols[entry]->kind == SYM_DEFINED) {
+        l.entry = symbol_address(&l, l.symbols[entry]);
+    } else {
+        l.entry = l.text ? l.text->addr : ELF_BASE_ADDRESS;
+        fprintf(stderr, "warning: cannot find entry symbol _start; defaulting to %#"PRIx64"\n", l.entry);
+    }
+
+    // the sidecar is only valid for the executable it was written with
+    char ilk_path[FILENAME_MAX];
+    sidecar_path(ilk_path, filename);
+    remove(ilk_path);
+
+    bool success;
+    CUIK_TIMED_BLOCK(l.patching ? "patch output" : "write output") {
+        success = write_output(&l, filename);
+    }
+
+    if (success && desc->incremental) {
+        save_incremental_state(&l, filename);
+    }
+
+    cleanup(&l);
+    return success;
+
+    error:
+    cleanup(&l);
+    return false;
+}
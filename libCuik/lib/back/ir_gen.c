@@ -393,11 +393,9 @@ InitNode* eval_initializer_objects(TranslationUnit* tu, TB_Function* func, Sourc
                                 CompilationUnit* restrict cu = tu->parent;
                                 cuik_lock_compilation_unit(cu);
 
-                                ptrdiff_t search = nl_strmap_get_cstr(cu->export_table, name);
-                                if (search >= 0) {
-                                    // Figure out what the symbol is and link it together
-                                    Stmt* real_symbol = cu->export_table[search];
-
+                                // Figure out what the symbol is and link it together
+                                Stmt* real_symbol = atom_map_get(cu->export_table, (Atom) name);
+                                if (real_symbol != NULL) {
                                     if (real_symbol->op == STMT_FUNC_DECL) {
                                         tb_initializer_add_function(tu->ir_mod, init, offset, real_symbol->backing.f);
                                     } else if (real_symbol->op == STMT_GLOBAL_DECL) {
@@ -863,11 +861,9 @@ IRVal irgen_expr(TranslationUnit* tu, TB_Function* func, Expr* e) {
                             CompilationUnit* restrict cu = tu->parent;
                             cuik_lock_compilation_unit(cu);
 
-                            ptrdiff_t search = nl_strmap_get_cstr(cu->export_table, name);
-                            if (search >= 0) {
-                                // Figure out what the symbol is and link it together
-                                Stmt* real_symbol = cu->export_table[search];
-
+                            // Figure out what the symbol is and link it together
+                            Stmt* real_symbol = atom_map_get(cu->export_table, (Atom) name);
+                            if (real_symbol != NULL) {
                                 if (real_symbol->op == STMT_FUNC_DECL) {
                                     stmt->backing.f = real_symbol->backing.f;
                                 } else if (real_symbol->op == STMT_GLOBAL_DECL) {
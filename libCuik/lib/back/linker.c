@@ -1,5 +1,6 @@
 #include <cuik.h>
 #include "../common.h"
+#include "linker.h"
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -31,6 +32,19 @@ void cuiklink_deinit(Cuik_Linker* l) {
     free(l->libpaths_buffer);
 }
 
+#ifdef __linux__
+// where the C runtime and system libraries live on the common distros
+static const char* const default_libpaths[] = {
+    "/usr/lib/x86_64-linux-gnu", "/lib/x86_64-linux-gnu", "/usr/lib64", "/lib64", "/usr/lib", "/lib", NULL
+};
+#else
+static const char* const default_libpaths[] = { NULL };
+#endif
+
+const char* const* cuiklink_default_libpaths(void) {
+    return default_libpaths;
+}
+
 void cuiklink_add_default_libpaths(Cuik_Linker* l) {
     #ifdef _WIN32
     if (cuik__vswhere.vs_exe_path == NULL) {
@@ -42,6 +56,56 @@ void cuiklink_add_default_libpaths(Cuik_Linker* l) {
     //cuiklink_add_libpath_wide(l, libs->vswhere.windows_sdk_ucrt_library_path);
     cuiklink_add_libpath_wide(l, cuik__vswhere.windows_sdk_um_library_path);
     #endif
+
+    for (const char* const* dir = default_libpaths; *dir != NULL; dir++) {
+        cuiklink_add_libpath(l, *dir);
+    }
+}
+
+// they look like:
+//   GROUP ( /lib/x86_64-linux-gnu/libc.so.6 libc_nonshared.a AS_NEEDED ( ld-linux-x86-64.so.2 ) )
+// we only care about GROUP, INPUT and AS_NEEDED. since the symbol resolution
+// doesn't depend on the order of archives, GROUP is the same as INPUT.
+void cuiklink_parse_linker_script(const char* text, size_t length, void* user_data, void (*input)(void* user_data, const char* name, bool as_needed)) {
+    const char* end = text + length;
+    const char* p = text;
+
+    int depth = 0, as_needed_depth = -1;
+    bool in_inputs = false;
+    char token[FILENAME_MAX];
+    while (p < end) {
+        if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == ',') {
+            p++;
+            continue;
+        } else if (p + 1 < end && p[0] == '/' && p[1] == '*') {
+            const char* close = p + 2;
+            while (close + 1 < end && !(close[0] == '*' && close[1] == '/')) close++;
+            p = close + 2;
+            continue;
+        } else if (*p == '(') {
+            depth++, p++;
+            continue;
+        } else if (*p == ')') {
+            if (depth == as_needed_depth) as_needed_depth = -1;
+            if (--depth == 0) in_inputs = false;
+            p++;
+            continue;
+        }
+
+        size_t len = 0;
+        while (p < end && !strchr(" \t\r\n(),", *p) && len + 1 < FILENAME_MAX) {
+            token[len++] = *p++;
+        }
+        token[len] = 0;
+
+        if (depth == 0) {
+            in_inputs = strcmp(token, "GROUP") == 0 || strcmp(token, "INPUT") == 0;
+        } else if (in_inputs && strcmp(token, "AS_NEEDED") == 0) {
+            as_needed_depth = depth + 1;
+        } else if (in_inputs) {
+            input(user_data, token, as_needed_depth >= 0);
+        }
+    }
 }
 
 #ifdef _WIN32
@@ -97,6 +161,14 @@ void cuiklink_subsystem_windows(Cuik_Linker* l) {
     l->subsystem_windows = true;
 }
 
+void cuiklink_set_threadpool(Cuik_Linker* l, Cuik_IThreadpool* thread_pool) {
+    l->thread_pool = thread_pool;
+}
+
+void cuiklink_set_incremental(Cuik_Linker* l, bool incremental) {
+    l->incremental = incremental;
+}
+
 bool cuiklink_invoke(Cuik_Linker* l, const char* filename, const char* crt_name) {
     #if defined(_WIN32)
     wchar_t cmd_line[CMD_LINE_MAX];
@@ -163,6 +235,8 @@ bool cuiklink_invoke(Cuik_Linker* l, const char* filename, const char* crt_name)
     if (pi.hProcess && pi.hProcess != INVALID_HANDLE_VALUE) CloseHandle(pi.hProcess);
     if (pi.hThread && pi.hThread != INVALID_HANDLE_VALUE) CloseHandle(pi.hThread);
     return false;
+    #elif defined(__linux__)
+    return cuiklink__elf(l, filename, crt_name);
     #elif defined(__unix__) || defined(__APPLE__)
     char cmd_line[CMD_LINE_MAX];
     int cmd_line_len = snprintf(cmd_line, CMD_LINE_MAX, "gcc ");
@@ -172,6 +246,7 @@ bool cuiklink_invoke(Cuik_Linker* l, const char* filename, const char* crt_name)
     for (size_t i = l->libpaths_count; i--;) {
         cmd_line_len += snprintf(&cmd_line[cmd_line_len], CMD_LINE_MAX - cmd_line_len, "-L%s ", str);
         str += strlen(str) + 1;
+        if (cmd_line_len >= CMD_LINE_MAX) goto too_long;
     }
 
     // Add all the input files
@@ -179,9 +254,11 @@ bool cuiklink_invoke(Cuik_Linker* l, const char* filename, const char* crt_name)
     for (size_t i = l->input_file_count; i--;) {
         cmd_line_len += snprintf(&cmd_line[cmd_line_len], CMD_LINE_MAX - cmd_line_len, "%s ", str);
         str += strlen(str) + 1;
+        if (cmd_line_len >= CMD_LINE_MAX) goto too_long;
     }
 
     cmd_line_len += snprintf(&cmd_line[cmd_line_len], CMD_LINE_MAX - cmd_line_len, "-ldl -o %s ", filename);
+    if (cmd_line_len >= CMD_LINE_MAX) goto too_long;
 
     int exit_code = system(cmd_line);
     if (exit_code != 0) {
@@ -191,6 +268,10 @@ bool cuiklink_invoke(Cuik_Linker* l, const char* filename, const char* crt_name)
     }
 
     return true;
+
+    too_long:
+    fprintf(stderr, "error: linker command line is longer than %d characters\n", CMD_LINE_MAX);
+    return false;
     #else
     #error "Implement system linker on other platforms"
     #endif
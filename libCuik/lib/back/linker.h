@@ -0,0 +1,8 @@
+#pragma once
+#include <cuik.h>
+
+// built-in ELF64 linker for x86-64 Linux (elf_linker.c)
+bool cuiklink__elf(Cuik_Linker* l, const char* filename, const char* crt_name);
+
+// the library paths and linker script reader are shared with the JIT, see
+// cuiklink_default_libpaths and cuiklink_parse_linker_script in cuik.h
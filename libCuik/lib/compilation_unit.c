@@ -2,6 +2,7 @@
 
 CUIK_API void cuik_create_compilation_unit(CompilationUnit* restrict cu) {
     *cu = (CompilationUnit){0};
+    cu->export_table = atom_map_create();
     cu->lock = HEAP_ALLOC(sizeof(mtx_t));
     mtx_init((mtx_t*) cu->lock, mtx_plain);
 }
@@ -14,6 +15,70 @@ CUIK_API void cuik_unlock_compilation_unit(CompilationUnit* restrict cu) {
     mtx_unlock((mtx_t*) cu->lock);
 }
 
+// functions and globals which aren't static or extern are visible to the other TUs
+static bool is_exported_stmt(Stmt* s) {
+    if (s->op == STMT_FUNC_DECL) {
+        return !s->decl.attrs.is_static && !s->decl.attrs.is_inline;
+    } else if (s->op == STMT_GLOBAL_DECL || s->op == STMT_DECL) {
+        return !s->decl.attrs.is_static &&
+            !s->decl.attrs.is_extern &&
+            !s->decl.attrs.is_typedef &&
+            !s->decl.attrs.is_inline &&
+            s->decl.type->kind != KIND_FUNC &&
+            s->decl.name != NULL;
+    } else {
+        return false;
+    }
+}
+
+// only bodies and initializers count as definitions, tentative definitions
+// (int x;) in multiple TUs get merged like common symbols.
+static bool is_export_definition(Stmt* s) {
+    return s->op == STMT_FUNC_DECL || s->decl.initial != NULL;
+}
+
+static void report_duplicate_export(CompilationUnit* restrict cu, TranslationUnit* restrict tu, Stmt* s, Stmt* old) {
+    // this is the slow path so just go looking for whoever owns the old one
+    TranslationUnit* other = NULL;
+    cuik_lock_compilation_unit(cu);
+    cu->link_errors += 1;
+    FOR_EACH_TU(it, cu) {
+        size_t count = dyn_array_length(it->top_level_stmts);
+        for (size_t i = 0; i < count && other == NULL; i++) {
+            if (it->top_level_stmts[i] == old) other = it;
+        }
+    }
+    cuik_unlock_compilation_unit(cu);
+
+    mtx_lock(&report_mutex);
+    report_header(REPORT_ERROR, "multiple definitions of symbol: %s", s->decl.name);
+    report_line(&tu->tokens, s->loc, 4);
+    if (other != NULL) report_line(&other->tokens, old->loc, 4);
+    printf("\n");
+    mtx_unlock(&report_mutex);
+}
+
+// safe to call from multiple threads at once, every TU is exported by the thread
+// which adds it so the exports are built in parallel with the other TUs parsing.
+static void export_translation_unit(CompilationUnit* restrict cu, TranslationUnit* restrict tu) {
+    size_t count = dyn_array_length(tu->top_level_stmts);
+    for (size_t i = 0; i < count; i++) {
+        Stmt* s = tu->top_level_stmts[i];
+        if (!is_exported_stmt(s)) continue;
+
+        Stmt* old = atom_map_put_if_absent(cu->export_table, s->decl.name, s);
+        while (old != s) {
+            if (is_export_definition(old)) {
+                if (is_export_definition(s)) report_duplicate_export(cu, tu, s, old);
+                break;
+            }
+
+            // the real definition replaces a tentative one
+            if (atom_map_compare_exchange(cu->export_table, s->decl.name, (void**) &old, s)) break;
+        }
+    }
+}
+
 CUIK_API void cuik_add_to_compilation_unit(CompilationUnit* restrict cu, TranslationUnit* restrict tu) {
     assert(tu->next == NULL && "somehow the TU is already attached to something...");
     cuik_lock_compilation_unit(cu);
@@ -26,6 +91,39 @@ CUIK_API void cuik_add_to_compilation_unit(CompilationUnit* restrict cu, Transla
     cu->count += 1;
 
     cuik_unlock_compilation_unit(cu);
+
+    CUIK_TIMED_BLOCK("export: %s", tu->filepath) {
+        export_translation_unit(cu, tu);
+    }
+}
+
+CUIK_API void cuik_remove_from_compilation_unit(CompilationUnit* restrict cu, TranslationUnit* restrict tu) {
+    assert(tu->parent == cu && "the TU isn't in this compilation unit");
+    cuik_lock_compilation_unit(cu);
+
+    TranslationUnit* prev = NULL;
+    for (TranslationUnit* it = cu->head; it != tu; it = it->next) {
+        prev = it;
+    }
+
+    if (prev == NULL) cu->head = tu->next;
+    else prev->next = tu->next;
+    if (cu->tail == tu) cu->tail = prev;
+    cu->count -= 1;
+
+    tu->parent = NULL;
+    tu->next = NULL;
+
+    // the export table can't forget symbols so we just make it again
+    atom_map_destroy(cu->export_table);
+    cu->export_table = atom_map_create();
+    cu->link_errors = 0;
+
+    cuik_unlock_compilation_unit(cu);
+
+    for (TranslationUnit* it = cu->head; it != NULL; it = it->next) {
+        export_translation_unit(cu, it);
+    }
 }
 
 CUIK_API void cuik_destroy_compilation_unit(CompilationUnit* restrict cu) {
@@ -37,6 +135,7 @@ CUIK_API void cuik_destroy_compilation_unit(CompilationUnit* restrict cu) {
         tu = next;
     }
 
+    atom_map_destroy(cu->export_table);
     mtx_destroy((mtx_t*) cu->lock);
     HEAP_FREE(cu->lock);
     *cu = (CompilationUnit){0};
@@ -46,31 +145,10 @@ CUIK_API size_t cuik_num_of_translation_units_in_compilation_unit(CompilationUni
     return cu->count;
 }
 
-CUIK_API void cuik_internal_link_compilation_unit(CompilationUnit* restrict cu) {
-    FOR_EACH_TU(tu, cu) {
-        size_t count = dyn_array_length(tu->top_level_stmts);
-        // printf("%s:\n", cuikpp_get_main_file(&tu->tokens));
-
-        for (size_t i = 0; i < count; i++) {
-            Stmt* s = tu->top_level_stmts[i];
-
-            if (s->op == STMT_FUNC_DECL) {
-                if (!s->decl.attrs.is_static &&
-                    !s->decl.attrs.is_inline) {
-                    // printf("  Func Export! %s\n", s->decl.name);
-                    nl_strmap_put_cstr(cu->export_table, s->decl.name, s);
-                }
-            } else if (s->op == STMT_GLOBAL_DECL || s->op == STMT_DECL) {
-                if (!s->decl.attrs.is_static &&
-                    !s->decl.attrs.is_extern &&
-                    !s->decl.attrs.is_typedef &&
-                    !s->decl.attrs.is_inline &&
-                    s->decl.type->kind != KIND_FUNC &&
-                    s->decl.name != NULL) {
-                    // printf("  Global Export! %s\n", s->decl.name);
-                    nl_strmap_put_cstr(cu->export_table, s->decl.name, s);
-                }
-            }
-        }
-    }
+CUIK_API bool cuik_internal_link_compilation_unit(CompilationUnit* restrict cu) {
+    cuik_lock_compilation_unit(cu);
+    int errors = cu->link_errors;
+    cuik_unlock_compilation_unit(cu);
+
+    return errors == 0;
 }
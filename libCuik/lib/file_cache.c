@@ -1,45 +1,126 @@
 #include <cuik.h>
 #include "front/parser.h"
+#include <sys/stat.h>
+
+typedef struct {
+    // owned by the cache since it outlives any one preprocessor
+    char* filepath;
+    TokenStream tokens;
+
+    // what the file looked like when it was put in, used to notice stale entries
+    uint64_t mtime;
+    uint64_t size;
+} CachedFile;
 
 struct Cuik_FileCache {
     mtx_t lock;
-    NL_Strmap(TokenStream) table;
+    NL_Strmap(CachedFile) table;
 };
 
+static bool get_file_stamp(const char* filepath, uint64_t* mtime, uint64_t* size) {
+    struct stat s;
+    if (stat(filepath, &s) != 0) {
+        return false;
+    }
+
+    #if defined(_WIN32) || defined(__APPLE__)
+    *mtime = (uint64_t) s.st_mtime * 1000000000ull;
+    #else
+    *mtime = (uint64_t) s.st_mtim.tv_sec * 1000000000ull + s.st_mtim.tv_nsec;
+    #endif
+    *size = s.st_size;
+    return true;
+}
+
 CUIK_API Cuik_FileCache* cuik_fscache_create(void) {
     Cuik_FileCache* c = HEAP_ALLOC(sizeof(Cuik_FileCache));
     memset(c, 0, sizeof(Cuik_FileCache));
 
-    c->table = nl_strmap_alloc(TokenStream, 1024);
+    c->table = nl_strmap_alloc(CachedFile, 1024);
     mtx_init(&c->lock, mtx_plain);
     return c;
 }
 
 CUIK_API void cuik_fscache_destroy(Cuik_FileCache* restrict c) {
     nl_strmap_for(i, c->table) {
-        dyn_array_destroy(c->table[i].tokens);
-        dyn_array_destroy(c->table[i].locations);
+        dyn_array_destroy(c->table[i].tokens.tokens);
+        dyn_array_destroy(c->table[i].tokens.locations);
+        HEAP_FREE(c->table[i].filepath);
     }
 
+    nl_strmap_free(c->table);
     mtx_destroy(&c->lock);
     HEAP_FREE(c);
 }
 
 CUIK_API void cuik_fscache_put(Cuik_FileCache* restrict c, const char* filepath, const TokenStream* tokens) {
+    uint64_t mtime = 0, size = 0;
+    get_file_stamp(filepath, &mtime, &size);
+
+    mtx_lock(&c->lock);
+    ptrdiff_t search = nl_strmap_get_cstr(c->table, filepath);
+    if (search >= 0) {
+        // reuse the slot (and key) of an invalidated entry
+        c->table[search].tokens = *tokens;
+        c->table[search].mtime = mtime;
+        c->table[search].size = size;
+    } else {
+        size_t len = strlen(filepath);
+        char* key = HEAP_ALLOC(len + 1);
+        memcpy(key, filepath, len + 1);
+
+        CachedFile entry = { .filepath = key, .tokens = *tokens, .mtime = mtime, .size = size };
+        nl_strmap_put_cstr(c->table, key, entry);
+    }
+    mtx_unlock(&c->lock);
+}
+
+CUIK_API void cuik_fscache_invalidate(Cuik_FileCache* restrict c, const char* filepath) {
     mtx_lock(&c->lock);
-    nl_strmap_put_cstr(c->table, filepath, *tokens);
+    ptrdiff_t search = nl_strmap_get_cstr(c->table, filepath);
+    if (search >= 0) {
+        // the string map can't remove entries so we just leave an empty
+        // stream behind, the next put will take over the key.
+        dyn_array_destroy(c->table[search].tokens.tokens);
+        dyn_array_destroy(c->table[search].tokens.locations);
+    }
     mtx_unlock(&c->lock);
 }
 
+CUIK_API size_t cuik_fscache_invalidate_stale(Cuik_FileCache* restrict c) {
+    size_t count = 0;
+
+    mtx_lock(&c->lock);
+    nl_strmap_for(i, c->table) {
+        CachedFile* entry = &c->table[i];
+        if (entry->tokens.tokens == NULL) continue;
+
+        uint64_t mtime, size;
+        if (!get_file_stamp(entry->filepath, &mtime, &size) || mtime != entry->mtime || size != entry->size) {
+            dyn_array_destroy(entry->tokens.tokens);
+            dyn_array_destroy(entry->tokens.locations);
+            count += 1;
+        }
+    }
+    mtx_unlock(&c->lock);
+
+    return count;
+}
+
 CUIK_API bool cuik_fscache_query(Cuik_FileCache* restrict c, const char* filepath) {
-    return nl_strmap_get_cstr(c->table, filepath) >= 0;
+    ptrdiff_t search = nl_strmap_get_cstr(c->table, filepath);
+    return search >= 0 && c->table[search].tokens.tokens != NULL;
 }
 
 CUIK_API bool cuik_fscache_lookup(Cuik_FileCache* restrict c, const char* filepath, TokenStream* out_tokens) {
     mtx_lock(&c->lock);
     ptrdiff_t search = nl_strmap_get_cstr(c->table, filepath);
+    if (search >= 0 && c->table[search].tokens.tokens == NULL) {
+        search = -1;
+    }
+
     if (search >= 0) {
-        if (out_tokens) *out_tokens = c->table[search];
+        if (out_tokens) *out_tokens = c->table[search].tokens;
     }
     mtx_unlock(&c->lock);
 
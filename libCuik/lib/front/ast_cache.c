@@ -0,0 +1,761 @@
+// Binary cache of a TU's top level declarations and every type they can reach.
+// It's meant for preludes (that pile of system headers every file includes), you
+// parse them once and then splice the result into the next TUs which start with
+// the same tokens with Cuik_TranslationUnitDesc.prelude instead of running phase 1
+// over those tokens again.
+//
+// Layout, everything is a native uint32_t:
+//   header  magic, version, token count, token hash (2 words), hash of the
+//           rest of the cache (2 words), atom count, type count, decl count
+//   atoms   length then the characters padded to 4 bytes
+//   types   one record per type, pointers are written out as indices
+//   decls   the top level declarations
+//
+// Function bodies and initializers aren't written out, the TU loading the cache
+// has the same tokens up front so we just keep where they start and it parses
+// them if they're needed (most of the static inline functions in headers aren't).
+// Source locations work the same way, they're stored as token indices.
+#include "parser.h"
+
+#define AST_CACHE_MAGIC   (0x54534143) // "CAST"
+#define AST_CACHE_VERSION (2)
+
+// type references, 0 is NULL then come the builtins and then the cached types
+#define AST_CACHE_FIRST_TYPE (1 + BUILTIN_TYPE_COUNT)
+
+enum {
+    CACHED_CONST       = 1,
+    CACHED_ATOMIC      = 2,
+    CACHED_INCOMPLETE  = 4,
+    CACHED_UNSIGNED    = 8,
+    CACHED_RESTRICT    = 16,
+    CACHED_VARARGS     = 32,
+};
+
+enum {
+    CACHED_STATIC  = 1,
+    CACHED_TYPEDEF = 2,
+    CACHED_INLINE  = 4,
+    CACHED_EXTERN  = 8,
+    CACHED_TLS     = 16,
+};
+
+////////////////////////////////
+// Writer
+////////////////////////////////
+// pointer -> index, both atoms and types go through these
+typedef struct {
+    size_t capacity, count;
+    const void** keys;
+    uint32_t* values;
+} PtrIndexMap;
+
+// source location -> index of the first token with it
+typedef struct {
+    size_t capacity;
+    SourceLocIndex* keys;
+    uint32_t* values;
+} LocIndexMap;
+
+typedef struct {
+    bool failed;
+
+    AtomMap* global_symbols;
+    LocIndexMap loc_map;
+
+    PtrIndexMap atom_map, type_map;
+    DynArray(Atom) atoms;
+    DynArray(Cuik_Type*) types;
+
+    DynArray(uint32_t) type_words;
+    DynArray(uint32_t) decl_words;
+} AstWriter;
+
+static uint32_t* ptr_index_map_slot(PtrIndexMap* map, const void* key) {
+    if ((map->count + 1) * 2 > map->capacity) {
+        size_t old_capacity = map->capacity;
+        const void** old_keys = map->keys;
+        uint32_t* old_values = map->values;
+
+        map->capacity = old_capacity ? old_capacity * 2 : 256;
+        map->keys = HEAP_ALLOC(map->capacity * sizeof(const void*));
+        map->values = HEAP_ALLOC(map->capacity * sizeof(uint32_t));
+        memset(map->keys, 0, map->capacity * sizeof(const void*));
+
+        size_t mask = map->capacity - 1;
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old_keys[i] == NULL) continue;
+
+            size_t j = ((uintptr_t) old_keys[i] >> 3) & mask;
+            while (map->keys[j] != NULL) j = (j + 1) & mask;
+
+            map->keys[j] = old_keys[i];
+            map->values[j] = old_values[i];
+        }
+
+        if (old_keys) HEAP_FREE(old_keys);
+        if (old_values) HEAP_FREE(old_values);
+    }
+
+    size_t mask = map->capacity - 1;
+    size_t i = ((uintptr_t) key >> 3) & mask;
+    while (map->keys[i] != NULL && map->keys[i] != key) i = (i + 1) & mask;
+
+    if (map->keys[i] == NULL) {
+        map->keys[i] = key;
+        map->values[i] = 0;
+        map->count += 1;
+    }
+
+    return &map->values[i];
+}
+
+static void ptr_index_map_free(PtrIndexMap* map) {
+    if (map->keys) HEAP_FREE(map->keys);
+    if (map->values) HEAP_FREE(map->values);
+}
+
+static void loc_index_map_init(LocIndexMap* map, const Token* tokens, size_t count) {
+    map->capacity = 256;
+    while (map->capacity < count * 2) map->capacity *= 2;
+
+    map->keys = HEAP_ALLOC(map->capacity * sizeof(SourceLocIndex));
+    map->values = HEAP_ALLOC(map->capacity * sizeof(uint32_t));
+    memset(map->values, 0, map->capacity * sizeof(uint32_t));
+
+    // values are the token index plus one, zero means the slot's empty
+    size_t mask = map->capacity - 1;
+    for (size_t i = 0; i < count; i++) {
+        SourceLocIndex loc = tokens[i].location;
+
+        size_t j = (loc * 11400714819323198485ull >> 32) & mask;
+        while (map->values[j] != 0 && map->keys[j] != loc) j = (j + 1) & mask;
+
+        if (map->values[j] == 0) {
+            map->keys[j] = loc;
+            map->values[j] = i + 1;
+        }
+    }
+}
+
+static void loc_index_map_free(LocIndexMap* map) {
+    if (map->keys) HEAP_FREE(map->keys);
+    if (map->values) HEAP_FREE(map->values);
+}
+
+// 0 if the location doesn't belong to any of the tokens
+static uint32_t write_loc_ref(AstWriter* w, SourceLocIndex loc) {
+    LocIndexMap* map = &w->loc_map;
+
+    size_t mask = map->capacity - 1;
+    size_t j = (loc * 11400714819323198485ull >> 32) & mask;
+    while (map->values[j] != 0 && map->keys[j] != loc) j = (j + 1) & mask;
+
+    return map->values[j];
+}
+
+static uint32_t write_atom_ref(AstWriter* w, Atom atom) {
+    if (atom == NULL) return 0;
+
+    uint32_t* slot = ptr_index_map_slot(&w->atom_map, atom);
+    if (*slot == 0) {
+        dyn_array_put(w->atoms, atom);
+        *slot = dyn_array_length(w->atoms);
+    }
+
+    return *slot;
+}
+
+static uint32_t write_type_ref(AstWriter* w, Cuik_Type* type) {
+    if (type == NULL) return 0;
+    if (type >= builtin_types && type < &builtin_types[BUILTIN_TYPE_COUNT]) {
+        return 1 + (type - builtin_types);
+    }
+
+    // new types go on the worklist, their contents get written once
+    // we get to them in cuik_serialize_translation_unit
+    uint32_t* slot = ptr_index_map_slot(&w->type_map, type);
+    if (*slot == 0) {
+        *slot = AST_CACHE_FIRST_TYPE + dyn_array_length(w->types);
+        dyn_array_put(w->types, type);
+    }
+
+    return *slot;
+}
+
+static void write_type(AstWriter* w, Cuik_Type* type) {
+    uint32_t flags = 0;
+    if (type->is_const) flags |= CACHED_CONST;
+    if (type->is_atomic) flags |= CACHED_ATOMIC;
+    if (type->is_incomplete) flags |= CACHED_INCOMPLETE;
+
+    switch (type->kind) {
+        case KIND_BOOL: case KIND_CHAR: case KIND_SHORT: case KIND_INT: case KIND_LONG:
+        if (type->is_unsigned) flags |= CACHED_UNSIGNED;
+        break;
+
+        case KIND_PTR:
+        if (type->is_ptr_restrict) flags |= CACHED_RESTRICT;
+        break;
+
+        case KIND_FUNC:
+        if (type->func.has_varargs) flags |= CACHED_VARARGS;
+        break;
+
+        default: break;
+    }
+
+    DynArray(uint32_t) out = w->type_words;
+    dyn_array_put(out, type->kind);
+    dyn_array_put(out, type->size);
+    dyn_array_put(out, type->align);
+    dyn_array_put(out, flags);
+    dyn_array_put(out, write_loc_ref(w, type->loc));
+    dyn_array_put(out, write_atom_ref(w, type->also_known_as));
+    dyn_array_put(out, write_type_ref(w, type->based));
+
+    switch (type->kind) {
+        case KIND_VOID: case KIND_BOOL: case KIND_CHAR: case KIND_SHORT:
+        case KIND_INT: case KIND_LONG: case KIND_FLOAT: case KIND_DOUBLE:
+        break;
+
+        case KIND_ENUM: {
+            dyn_array_put(out, write_atom_ref(w, type->enumerator.name));
+            dyn_array_put(out, type->enumerator.count);
+            for (int i = 0; i < type->enumerator.count; i++) {
+                // the values are resolved by now so lexer_pos doesn't matter
+                EnumEntry* e = &type->enumerator.entries[i];
+                dyn_array_put(out, write_atom_ref(w, e->key));
+                dyn_array_put(out, e->value);
+            }
+            break;
+        }
+
+        case KIND_PTR:
+        dyn_array_put(out, write_type_ref(w, type->ptr_to));
+        break;
+
+        case KIND_FUNC: {
+            dyn_array_put(out, write_atom_ref(w, type->func.name));
+            dyn_array_put(out, write_type_ref(w, type->func.return_type));
+            dyn_array_put(out, type->func.param_count);
+            for (size_t i = 0; i < type->func.param_count; i++) {
+                Param* p = &type->func.param_list[i];
+
+                dyn_array_put(out, write_type_ref(w, p->type));
+                dyn_array_put(out, write_atom_ref(w, p->name));
+            }
+            break;
+        }
+
+        // same deal as the enums, array_count_lexer_pos doesn't get cleared once
+        // the count is resolved
+        case KIND_ARRAY:
+        dyn_array_put(out, write_type_ref(w, type->array_of));
+        dyn_array_put(out, type->array_count);
+        break;
+
+        case KIND_STRUCT:
+        case KIND_UNION: {
+            dyn_array_put(out, write_atom_ref(w, type->record.name));
+            dyn_array_put(out, type->record.kid_count);
+            for (int i = 0; i < type->record.kid_count; i++) {
+                Member* m = &type->record.kids[i];
+
+                dyn_array_put(out, write_type_ref(w, m->type));
+                dyn_array_put(out, write_atom_ref(w, m->name));
+                dyn_array_put(out, write_loc_ref(w, m->loc));
+                dyn_array_put(out, m->align);
+                dyn_array_put(out, m->offset);
+                dyn_array_put(out, m->bit_offset);
+                dyn_array_put(out, m->bit_width);
+                dyn_array_put(out, m->is_bitfield);
+            }
+            break;
+        }
+
+        case KIND_VECTOR:
+        dyn_array_put(out, type->vector_.count);
+        dyn_array_put(out, write_type_ref(w, type->vector_.base));
+        break;
+
+        // VLAs, unresolved typeofs and friends can't show up in a
+        // declaration we'd want to cache
+        default:
+        w->failed = true;
+        break;
+    }
+
+    w->type_words = out;
+}
+
+static void write_decl(AstWriter* w, Stmt* s) {
+    // bodies and initializers are written as the position the parser left in the
+    // symbol, it's only there if this is the declaration which owns the symbol
+    // (same as the parser, a later redeclaration forgets the body).
+    uint32_t body_start = 0, body_count = 0;
+    Cuik_Type* typedef_type = NULL;
+    if (s->decl.name != NULL) {
+        Symbol* sym = atom_map_get(w->global_symbols, s->decl.name);
+        if (sym != NULL && sym->stmt == s && sym->current != 0) {
+            body_start = sym->current;
+            body_count = s->decl.token_count;
+        }
+
+        // everyone using the typedef points at its named copy, not the statement's type
+        if (sym != NULL && s->decl.attrs.is_typedef && sym->storage_class == STORAGE_TYPEDEF) {
+            typedef_type = sym->type;
+        }
+    }
+
+    uint32_t attrs = 0;
+    if (s->decl.attrs.is_static) attrs |= CACHED_STATIC;
+    if (s->decl.attrs.is_typedef) attrs |= CACHED_TYPEDEF;
+    if (s->decl.attrs.is_inline) attrs |= CACHED_INLINE;
+    if (s->decl.attrs.is_extern) attrs |= CACHED_EXTERN;
+    if (s->decl.attrs.is_tls) attrs |= CACHED_TLS;
+
+    // everything goes back to being unparsed, the importer will parse whatever it needs
+    dyn_array_put(w->decl_words, s->op == STMT_FUNC_DECL ? STMT_GLOBAL_DECL : s->op);
+    dyn_array_put(w->decl_words, write_atom_ref(w, s->decl.name));
+    dyn_array_put(w->decl_words, write_type_ref(w, s->decl.type));
+    dyn_array_put(w->decl_words, attrs);
+    dyn_array_put(w->decl_words, write_loc_ref(w, s->loc));
+    dyn_array_put(w->decl_words, write_type_ref(w, typedef_type));
+    dyn_array_put(w->decl_words, body_start);
+    dyn_array_put(w->decl_words, body_count);
+}
+
+// FNV-1a, the cache is checked as a whole since a flipped bit in a name or
+// an offset would still parse into something which looks sane.
+static uint64_t hash_words(const uint32_t* data, size_t count) {
+    const unsigned char* p = (const unsigned char*) data;
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < count * sizeof(uint32_t); i++) {
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    }
+
+    return h;
+}
+
+CUIK_API uint64_t cuik_hash_tokens(TokenStream* restrict tokens, size_t count) {
+    // FNV-1a over the token kinds and their spelling
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < count; i++) {
+        const Token* t = &tokens->tokens[i];
+
+        h = (h ^ (uint32_t) t->type) * 0x100000001b3ull;
+        for (const unsigned char* p = t->start; p != t->end; p++) {
+            h = (h ^ *p) * 0x100000001b3ull;
+        }
+    }
+
+    return h;
+}
+
+CUIK_API void* cuik_serialize_translation_unit(TranslationUnit* restrict tu, size_t* out_size) {
+    // we need the tokens and where the bodies are in them, only incremental TUs
+    // keep those around
+    if (tu->global_symbols == NULL || tu->tokens.tokens == NULL) {
+        return NULL;
+    }
+
+    // everything but the EOF
+    size_t token_count = dyn_array_length(tu->tokens.tokens) - 1;
+    uint64_t token_hash = cuik_hash_tokens(&tu->tokens, token_count);
+
+    AstWriter w = {
+        .global_symbols = tu->global_symbols,
+        .atoms = dyn_array_create(Atom),
+        .types = dyn_array_create(Cuik_Type*),
+        .type_words = dyn_array_create(uint32_t),
+        .decl_words = dyn_array_create(uint32_t),
+    };
+
+    loc_index_map_init(&w.loc_map, tu->tokens.tokens, token_count);
+
+    size_t decl_count = 0;
+    for (size_t i = 0, count = dyn_array_length(tu->top_level_stmts); i < count && !w.failed; i++) {
+        Stmt* s = tu->top_level_stmts[i];
+        if (s->op != STMT_DECL && s->op != STMT_GLOBAL_DECL && s->op != STMT_FUNC_DECL) continue;
+
+        // function literals come back when whatever they're in gets parsed
+        if (s->op == STMT_FUNC_DECL && s->decl.name == NULL) continue;
+
+        write_decl(&w, s);
+        decl_count += 1;
+    }
+
+    // writing a type might discover more types so we can't cache the length
+    for (size_t i = 0; i < dyn_array_length(w.types) && !w.failed; i++) {
+        write_type(&w, w.types[i]);
+    }
+
+    uint32_t* result = NULL;
+    if (!w.failed) {
+        size_t atom_words = 0, atom_count = dyn_array_length(w.atoms);
+        for (size_t i = 0; i < atom_count; i++) {
+            atom_words += 1 + (atoms_len(w.atoms[i]) + 3) / 4;
+        }
+
+        size_t type_words = dyn_array_length(w.type_words);
+        size_t decl_words = dyn_array_length(w.decl_words);
+        size_t total = 10 + atom_words + type_words + decl_words;
+
+        result = HEAP_ALLOC(total * sizeof(uint32_t));
+        memset(result, 0, total * sizeof(uint32_t));
+
+        uint32_t* out = result;
+        *out++ = AST_CACHE_MAGIC;
+        *out++ = AST_CACHE_VERSION;
+        *out++ = token_count;
+        *out++ = token_hash;
+        *out++ = token_hash >> 32;
+
+        // filled in once the rest is written
+        uint32_t* data_hash = out;
+        out += 2;
+
+        *out++ = atom_count;
+        *out++ = dyn_array_length(w.types);
+        *out++ = decl_count;
+
+        for (size_t i = 0; i < atom_count; i++) {
+            size_t len = atoms_len(w.atoms[i]);
+
+            *out++ = len;
+            memcpy(out, w.atoms[i], len);
+            out += (len + 3) / 4;
+        }
+
+        memcpy(out, w.type_words, type_words * sizeof(uint32_t));
+        out += type_words;
+
+        memcpy(out, w.decl_words, decl_words * sizeof(uint32_t));
+
+        uint64_t h = hash_words(data_hash + 2, total - (data_hash + 2 - result));
+        data_hash[0] = h;
+        data_hash[1] = h >> 32;
+        *out_size = total * sizeof(uint32_t);
+    }
+
+    loc_index_map_free(&w.loc_map);
+    ptr_index_map_free(&w.atom_map);
+    ptr_index_map_free(&w.type_map);
+    dyn_array_destroy(w.atoms);
+    dyn_array_destroy(w.types);
+    dyn_array_destroy(w.type_words);
+    dyn_array_destroy(w.decl_words);
+    return result;
+}
+
+////////////////////////////////
+// Reader
+////////////////////////////////
+typedef struct {
+    const uint32_t* data;
+    size_t cursor, length;
+    bool failed;
+
+    // the importing TU's tokens, the cached ones are the first token_count
+    const Token* tokens;
+    size_t token_count;
+
+    Atom* atoms;
+    size_t atom_count;
+
+    Cuik_Type** types;
+    size_t type_count;
+} AstReader;
+
+static uint32_t read_u32(AstReader* r) {
+    if (r->cursor >= r->length) {
+        r->failed = true;
+        return 0;
+    }
+
+    return r->data[r->cursor++];
+}
+
+static Atom read_atom(AstReader* r) {
+    uint32_t i = read_u32(r);
+    if (i == 0) return NULL;
+    if (i > r->atom_count) {
+        r->failed = true;
+        return NULL;
+    }
+
+    return r->atoms[i - 1];
+}
+
+static Cuik_Type* read_type_ref(AstReader* r) {
+    uint32_t i = read_u32(r);
+    if (i == 0) return NULL;
+    if (i < AST_CACHE_FIRST_TYPE) return &builtin_types[i - 1];
+    if (i - AST_CACHE_FIRST_TYPE >= r->type_count) {
+        r->failed = true;
+        return NULL;
+    }
+
+    return r->types[i - AST_CACHE_FIRST_TYPE];
+}
+
+static SourceLocIndex read_loc(AstReader* r) {
+    uint32_t i = read_u32(r);
+    if (i == 0) return 0;
+    if (i > r->token_count) {
+        r->failed = true;
+        return 0;
+    }
+
+    return r->tokens[i - 1].location;
+}
+
+// sanity check on counts so a corrupt cache can't make us allocate the world
+static size_t read_count(AstReader* r, size_t words_per_item) {
+    uint32_t count = read_u32(r);
+    if ((size_t) count * words_per_item > r->length - r->cursor) {
+        r->failed = true;
+        return 0;
+    }
+
+    return count;
+}
+
+static void* cache_alloc(TranslationUnit* tu, size_t size, size_t align) {
+    if (size == 0) return NULL;
+
+    mtx_lock(&tu->arena_mutex);
+    void* ptr = arena_alloc(&tu->ast_arena, size, align);
+    mtx_unlock(&tu->arena_mutex);
+    return ptr;
+}
+
+static void read_type(AstReader* r, TranslationUnit* tu, Cuik_Type* type) {
+    Cuik_TypeKind kind = read_u32(r);
+    int size = read_u32(r);
+    int align = read_u32(r);
+    uint32_t flags = read_u32(r);
+    SourceLocIndex loc = read_loc(r);
+
+    *type = (Cuik_Type){
+        .kind = kind,
+        .size = size,
+        .align = align,
+        .loc = loc,
+        .is_const = (flags & CACHED_CONST) != 0,
+        .is_atomic = (flags & CACHED_ATOMIC) != 0,
+        .is_incomplete = (flags & CACHED_INCOMPLETE) != 0,
+    };
+    type->also_known_as = read_atom(r);
+    type->based = read_type_ref(r);
+
+    switch (kind) {
+        case KIND_VOID: case KIND_FLOAT: case KIND_DOUBLE:
+        break;
+
+        case KIND_BOOL: case KIND_CHAR: case KIND_SHORT: case KIND_INT: case KIND_LONG:
+        type->is_unsigned = (flags & CACHED_UNSIGNED) != 0;
+        break;
+
+        case KIND_ENUM: {
+            type->enumerator.name = read_atom(r);
+            type->enumerator.count = read_count(r, 2);
+            type->enumerator.entries = cache_alloc(tu, type->enumerator.count * sizeof(EnumEntry), _Alignof(EnumEntry));
+
+            for (int i = 0; i < type->enumerator.count; i++) {
+                Atom key = read_atom(r);
+                int value = read_u32(r);
+
+                type->enumerator.entries[i] = (EnumEntry){ .key = key, .value = value };
+            }
+            break;
+        }
+
+        case KIND_PTR:
+        type->ptr_to = read_type_ref(r);
+        type->is_ptr_restrict = (flags & CACHED_RESTRICT) != 0;
+        break;
+
+        case KIND_FUNC: {
+            type->func.name = read_atom(r);
+            type->func.return_type = read_type_ref(r);
+            type->func.has_varargs = (flags & CACHED_VARARGS) != 0;
+            type->func.param_count = read_count(r, 2);
+            type->func.param_list = cache_alloc(tu, type->func.param_count * sizeof(Param), _Alignof(Param));
+
+            for (size_t i = 0; i < type->func.param_count; i++) {
+                Cuik_Type* param_type = read_type_ref(r);
+                Atom param_name = read_atom(r);
+
+                type->func.param_list[i] = (Param){ param_type, param_name };
+            }
+            break;
+        }
+
+        case KIND_ARRAY:
+        type->array_of = read_type_ref(r);
+        type->array_count = read_u32(r);
+        break;
+
+        case KIND_STRUCT:
+        case KIND_UNION: {
+            type->record.name = read_atom(r);
+            type->record.kid_count = read_count(r, 8);
+            type->record.kids = cache_alloc(tu, type->record.kid_count * sizeof(Member), _Alignof(Member));
+
+            for (int i = 0; i < type->record.kid_count; i++) {
+                Member* m = &type->record.kids[i];
+
+                *m = (Member){ 0 };
+                m->type = read_type_ref(r);
+                m->name = read_atom(r);
+                m->loc = read_loc(r);
+                m->align = read_u32(r);
+                m->offset = read_u32(r);
+                m->bit_offset = read_u32(r);
+                m->bit_width = read_u32(r);
+                m->is_bitfield = read_u32(r) != 0;
+            }
+            break;
+        }
+
+        case KIND_VECTOR:
+        type->vector_.count = read_u32(r);
+        type->vector_.base = read_type_ref(r);
+        break;
+
+        default:
+        r->failed = true;
+        break;
+    }
+}
+
+bool ast_cache_import(TranslationUnit* tu, const void* data, size_t size, AstCacheImport* out) {
+    AstReader r = { .data = data, .length = size / sizeof(uint32_t) };
+    if (read_u32(&r) != AST_CACHE_MAGIC || read_u32(&r) != AST_CACHE_VERSION) {
+        return false;
+    }
+
+    // the cached tokens have to be exactly the ones in front of us
+    size_t token_count = read_u32(&r);
+    uint64_t token_hash = read_u32(&r);
+    token_hash |= (uint64_t) read_u32(&r) << 32;
+    if (r.failed || tu->tokens.current != token_count || dyn_array_length(tu->tokens.tokens) <= token_count) {
+        return false;
+    }
+
+    if (cuik_hash_tokens(&tu->tokens, token_count) != token_hash) {
+        return false;
+    }
+
+    uint64_t data_hash = read_u32(&r);
+    data_hash |= (uint64_t) read_u32(&r) << 32;
+    if (r.failed || hash_words(&r.data[r.cursor], r.length - r.cursor) != data_hash) {
+        return false;
+    }
+
+    r.tokens = tu->tokens.tokens;
+    r.token_count = token_count;
+
+    size_t atom_count = read_count(&r, 1);
+    size_t type_count = read_count(&r, 7);
+    size_t decl_count = read_count(&r, 8);
+    if (r.failed) return false;
+
+    // atoms
+    r.atoms = HEAP_ALLOC((atom_count ? atom_count : 1) * sizeof(Atom));
+    for (size_t i = 0; i < atom_count && !r.failed; i++) {
+        size_t len = read_count(&r, 0);
+        size_t words = (len + 3) / 4;
+        if (words > r.length - r.cursor) {
+            r.failed = true;
+            break;
+        }
+
+        r.atoms[i] = atoms_put(len, (const unsigned char*) &r.data[r.cursor]);
+        r.atom_count += 1;
+        r.cursor += words;
+    }
+
+    // every type gets a slot up front so the references can be fixed up as we go
+    r.types = HEAP_ALLOC((type_count ? type_count : 1) * sizeof(Cuik_Type*));
+    for (size_t i = 0; i < type_count; i++) {
+        r.types[i] = new_blank_type(tu);
+    }
+    r.type_count = type_count;
+
+    for (size_t i = 0; i < type_count && !r.failed; i++) {
+        read_type(&r, tu, r.types[i]);
+    }
+
+    // the pointers and arrays the TU makes from now on should be the cached ones
+    for (size_t i = 0; i < type_count && !r.failed; i++) {
+        intern_cached_type(tu, r.types[i]);
+    }
+
+    AstCacheSymbol* symbols = HEAP_ALLOC((decl_count ? decl_count : 1) * sizeof(AstCacheSymbol));
+    for (size_t i = 0; i < decl_count && !r.failed; i++) {
+        StmtOp op = read_u32(&r);
+        Atom name = read_atom(&r);
+        Cuik_Type* type = read_type_ref(&r);
+        uint32_t attrs = read_u32(&r);
+        SourceLocIndex loc = read_loc(&r);
+        Cuik_Type* typedef_type = read_type_ref(&r);
+        uint32_t body_start = read_u32(&r);
+        uint32_t body_count = read_u32(&r);
+
+        if ((op != STMT_DECL && op != STMT_GLOBAL_DECL) || type == NULL || (typedef_type != NULL && !(attrs & CACHED_TYPEDEF))) {
+            r.failed = true;
+            break;
+        }
+
+        // the body is somewhere in the cached tokens, we only need to know what ends
+        // it: braces for function bodies and initializer lists, otherwise it's the
+        // token right after it (a ';' or ',').
+        symbols[i] = (AstCacheSymbol){ .type = typedef_type };
+        if (body_start != 0) {
+            if (name == NULL || body_count == 0 || body_start >= token_count || body_count > token_count - body_start) {
+                r.failed = true;
+                break;
+            }
+
+            int first = r.tokens[body_start].type;
+            symbols[i].current = body_start;
+            symbols[i].terminator = first == '{' ? '}' : r.tokens[body_start + body_count].type;
+        }
+
+        Stmt* n = cache_alloc(tu, offsetof(Stmt, compound) + sizeof(struct StmtDecl), _Alignof(Stmt));
+        memset(n, 0, offsetof(Stmt, compound) + sizeof(struct StmtDecl));
+        n->op = op;
+        n->loc = loc;
+        n->decl.name = name;
+        n->decl.type = type;
+        n->decl.token_count = body_count;
+        n->decl.attrs = (Attribs){
+            .is_static  = (attrs & CACHED_STATIC) != 0,
+            .is_typedef = (attrs & CACHED_TYPEDEF) != 0,
+            .is_inline  = (attrs & CACHED_INLINE) != 0,
+            .is_extern  = (attrs & CACHED_EXTERN) != 0,
+            .is_tls     = (attrs & CACHED_TLS) != 0,
+        };
+
+        dyn_array_put(tu->top_level_stmts, n);
+    }
+
+    HEAP_FREE(r.atoms);
+    if (r.failed) {
+        // the half built types are left in the arena as placeholders, the caller
+        // is gonna bail on the TU anyways.
+        HEAP_FREE(r.types);
+        HEAP_FREE(symbols);
+        return false;
+    }
+
+    *out = (AstCacheImport){
+        .types = r.types,
+        .type_count = type_count,
+        .symbols = symbols,
+    };
+    return true;
+}
@@ -6,23 +6,23 @@ static thread_local char temp_string0[1024], temp_string1[1024];
 static thread_local Stmt* function_stmt;
 static thread_local bool barz[64];
 
-static void print_barz(int depth, bool last_node) {
+static void print_barz(FILE* stream, int depth, bool last_node) {
     if (last_node) {
         for (int i = 0; i < depth - 1; i++) {
-            printf(barz[i] ? "| " : "  ");
+            fprintf(stream, barz[i] ? "| " : "  ");
         }
-        printf("`-");
+        fprintf(stream, "`-");
     } else {
         for (int i = 0; i < depth - 1; i++) {
-            printf(barz[i] ? "| " : "  ");
+            fprintf(stream, barz[i] ? "| " : "  ");
         }
-        printf("|-");
+        fprintf(stream, "|-");
     }
     barz[depth - 1] = !last_node;
 }
 
 static void dump_expr(TranslationUnit* tu, FILE* stream, Expr* restrict e, int depth, bool last_node) {
-    print_barz(depth, last_node);
+    print_barz(stream, depth, last_node);
 
     if (e->cast_type != e->type) {
         type_as_string(tu, sizeof(temp_string0), temp_string0, e->type);
@@ -33,7 +33,7 @@ static void dump_expr(TranslationUnit* tu, FILE* stream, Expr* restrict e, int d
             fprintf(stream, "ImplicitCast '%s' -> '%s'\n", temp_string0, temp_string1);
 
             depth++;
-            print_barz(depth, true);
+            print_barz(stream, depth, true);
         }
     }
 
@@ -51,7 +51,7 @@ static void dump_expr(TranslationUnit* tu, FILE* stream, Expr* restrict e, int d
         }
         case EXPR_ENUM: {
             type_as_string(tu, sizeof(temp_string0), temp_string0, e->type);
-            fprintf(stream, "EnumLiteral %lld '%s'\n", (long long)e->enum_val.num, temp_string0);
+            fprintf(stream, "EnumLiteral %lld '%s'\n", (long long)*e->enum_val.num, temp_string0);
             break;
         }
         case EXPR_FLOAT32:
@@ -375,7 +375,7 @@ static void dump_expr(TranslationUnit* tu, FILE* stream, Expr* restrict e, int d
 }
 
 static void dump_stmt(TranslationUnit* tu, FILE* stream, Stmt* restrict s, int depth, bool last_node) {
-    print_barz(depth, last_node);
+    print_barz(stream, depth, last_node);
 
     switch (s->op) {
         case STMT_DECL:
@@ -472,7 +472,7 @@ static void dump_stmt(TranslationUnit* tu, FILE* stream, Stmt* restrict s, int d
                 dump_stmt(tu, stream, s->if_.body, depth + 1, s->if_.next == 0);
 
                 if (s->if_.next) {
-                    print_barz(depth, false);
+                    print_barz(stream, depth, false);
                     fprintf(stream, "Else:\n");
                     dump_stmt(tu, stream, s->if_.next, depth + 1, true);
                 }
@@ -504,7 +504,7 @@ static void dump_stmt(TranslationUnit* tu, FILE* stream, Stmt* restrict s, int d
         case STMT_FOR: {
             fprintf(stream, "For\n");
             if (s->for_.first) {
-                print_barz(depth + 1, false);
+                print_barz(stream, depth + 1, false);
                 fprintf(stream, "Init:\n");
 
                 Stmt* first = s->for_.first;
@@ -521,17 +521,17 @@ static void dump_stmt(TranslationUnit* tu, FILE* stream, Stmt* restrict s, int d
             }
 
             if (s->for_.cond) {
-                print_barz(depth + 1, false);
+                print_barz(stream, depth + 1, false);
                 fprintf(stream, "Cond:\n");
                 dump_expr(tu, stream, s->for_.cond, depth + 2, true);
             }
 
-            print_barz(depth + 1, s->for_.next == 0);
+            print_barz(stream, depth + 1, s->for_.next == 0);
             fprintf(stream, "Body:\n");
             dump_stmt(tu, stream, s->for_.body, depth + 2, true);
 
             if (s->for_.next) {
-                print_barz(depth + 1, true);
+                print_barz(stream, depth + 1, true);
                 fprintf(stream, "Next:\n");
                 dump_expr(tu, stream, s->for_.next, depth + 2, true);
             }
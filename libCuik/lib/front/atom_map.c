@@ -0,0 +1,249 @@
+#include "atom_map.h"
+#include <threads.h>
+#include <stdatomic.h>
+
+// Same layout as the atom interner, the shard is picked by the top bits of the hash
+// and each one publishes an open addressing table of entry pointers. The entries
+// never move so a reader on a retired table still sees the latest value, it might
+// just miss keys that were inserted after the resize.
+#define ATOM_MAP_SHARD_BITS  (4)
+#define ATOM_MAP_SHARD_COUNT (1u << ATOM_MAP_SHARD_BITS)
+#define ATOM_MAP_TABLE_INIT  (64)
+#define ATOM_MAP_CHUNK_SIZE  (256)
+
+typedef struct AtomMapEntry {
+    Atom key;
+    _Atomic(void*) value;
+} AtomMapEntry;
+
+typedef struct AtomMapTable {
+    // previous (smaller) tables, kept alive for readers
+    struct AtomMapTable* prev;
+    size_t capacity;
+
+    _Atomic(AtomMapEntry*) slots[];
+} AtomMapTable;
+
+typedef struct AtomMapChunk {
+    struct AtomMapChunk* next;
+    size_t used;
+
+    AtomMapEntry entries[ATOM_MAP_CHUNK_SIZE];
+} AtomMapChunk;
+
+typedef struct {
+    mtx_t lock;
+    _Atomic(AtomMapTable*) table;
+
+    // these are only touched with the lock held
+    size_t count;
+    AtomMapChunk* chunks;
+} AtomMapShard;
+
+struct AtomMap {
+    AtomMapShard shards[ATOM_MAP_SHARD_COUNT];
+};
+
+static AtomMapTable* atom_map_table_alloc(size_t capacity) {
+    AtomMapTable* table = HEAP_ALLOC(sizeof(AtomMapTable) + (capacity * sizeof(_Atomic(AtomMapEntry*))));
+    table->prev = NULL;
+    table->capacity = capacity;
+
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&table->slots[i], NULL);
+    }
+    return table;
+}
+
+AtomMap* atom_map_create(void) {
+    AtomMap* map = HEAP_ALLOC(sizeof(AtomMap));
+    for (size_t i = 0; i < ATOM_MAP_SHARD_COUNT; i++) {
+        mtx_init(&map->shards[i].lock, mtx_plain);
+        atomic_init(&map->shards[i].table, atom_map_table_alloc(ATOM_MAP_TABLE_INIT));
+        map->shards[i].count = 0;
+        map->shards[i].chunks = NULL;
+    }
+
+    return map;
+}
+
+void atom_map_destroy(AtomMap* map) {
+    if (map == NULL) return;
+
+    for (size_t i = 0; i < ATOM_MAP_SHARD_COUNT; i++) {
+        AtomMapTable* table = atomic_load(&map->shards[i].table);
+        while (table != NULL) {
+            AtomMapTable* prev = table->prev;
+            HEAP_FREE(table);
+            table = prev;
+        }
+
+        AtomMapChunk* chunk = map->shards[i].chunks;
+        while (chunk != NULL) {
+            AtomMapChunk* next = chunk->next;
+            HEAP_FREE(chunk);
+            chunk = next;
+        }
+
+        mtx_destroy(&map->shards[i].lock);
+    }
+
+    HEAP_FREE(map);
+}
+
+static AtomMapShard* atom_map_shard(AtomMap* map, uint32_t hash) {
+    return &map->shards[hash >> (32 - ATOM_MAP_SHARD_BITS)];
+}
+
+static AtomMapEntry* atom_map_find(AtomMapTable* table, uint32_t hash, Atom key) {
+    size_t mask = table->capacity - 1;
+
+    // the load factor never goes above 50% so there's always an empty slot
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        AtomMapEntry* e = atomic_load_explicit(&table->slots[i], memory_order_acquire);
+        if (e == NULL) return NULL;
+        if (e->key == key) return e;
+    }
+}
+
+static void atom_map_insert_slot(AtomMapTable* table, AtomMapEntry* e) {
+    size_t mask = table->capacity - 1;
+    size_t i = atoms_hash(e->key) & mask;
+    while (atomic_load_explicit(&table->slots[i], memory_order_relaxed) != NULL) {
+        i = (i + 1) & mask;
+    }
+
+    // release so readers never see a half written entry
+    atomic_store_explicit(&table->slots[i], e, memory_order_release);
+}
+
+// finds or makes the entry for the key, only call with the shard's lock held.
+// new entries are initialized with value and *inserted is set.
+static AtomMapEntry* atom_map_insert_locked(AtomMapShard* shard, uint32_t hash, Atom key, void* value, bool* inserted) {
+    AtomMapTable* table = atomic_load_explicit(&shard->table, memory_order_relaxed);
+
+    AtomMapEntry* e = atom_map_find(table, hash, key);
+    if (e != NULL) {
+        *inserted = false;
+        return e;
+    }
+
+    if ((shard->count + 1) * 2 > table->capacity) {
+        AtomMapTable* new_table = atom_map_table_alloc(table->capacity * 2);
+        new_table->prev = table;
+
+        for (size_t i = 0; i < table->capacity; i++) {
+            AtomMapEntry* old = atomic_load_explicit(&table->slots[i], memory_order_relaxed);
+            if (old != NULL) atom_map_insert_slot(new_table, old);
+        }
+
+        atomic_store_explicit(&shard->table, new_table, memory_order_release);
+        table = new_table;
+    }
+
+    AtomMapChunk* chunk = shard->chunks;
+    if (chunk == NULL || chunk->used >= ATOM_MAP_CHUNK_SIZE) {
+        chunk = HEAP_ALLOC(sizeof(AtomMapChunk));
+        chunk->next = shard->chunks;
+        chunk->used = 0;
+        shard->chunks = chunk;
+    }
+
+    e = &chunk->entries[chunk->used++];
+    e->key = key;
+    atomic_init(&e->value, value);
+
+    atom_map_insert_slot(table, e);
+    shard->count += 1;
+
+    *inserted = true;
+    return e;
+}
+
+void* atom_map_get(AtomMap* map, Atom key) {
+    uint32_t hash = atoms_hash(key);
+    AtomMapShard* shard = atom_map_shard(map, hash);
+
+    AtomMapEntry* e = atom_map_find(atomic_load_explicit(&shard->table, memory_order_acquire), hash, key);
+    return e ? atomic_load_explicit(&e->value, memory_order_acquire) : NULL;
+}
+
+void atom_map_put(AtomMap* map, Atom key, void* value) {
+    uint32_t hash = atoms_hash(key);
+    AtomMapShard* shard = atom_map_shard(map, hash);
+
+    // replacing doesn't need the lock
+    AtomMapEntry* e = atom_map_find(atomic_load_explicit(&shard->table, memory_order_acquire), hash, key);
+    if (e == NULL) {
+        bool inserted;
+        mtx_lock(&shard->lock);
+        e = atom_map_insert_locked(shard, hash, key, value, &inserted);
+        mtx_unlock(&shard->lock);
+
+        if (inserted) return;
+    }
+
+    atomic_store_explicit(&e->value, value, memory_order_release);
+}
+
+void* atom_map_put_if_absent(AtomMap* map, Atom key, void* value) {
+    uint32_t hash = atoms_hash(key);
+    AtomMapShard* shard = atom_map_shard(map, hash);
+
+    AtomMapEntry* e = atom_map_find(atomic_load_explicit(&shard->table, memory_order_acquire), hash, key);
+    if (e == NULL) {
+        bool inserted;
+        mtx_lock(&shard->lock);
+        e = atom_map_insert_locked(shard, hash, key, value, &inserted);
+        mtx_unlock(&shard->lock);
+    }
+
+    return atomic_load_explicit(&e->value, memory_order_acquire);
+}
+
+bool atom_map_compare_exchange(AtomMap* map, Atom key, void** expected, void* desired) {
+    uint32_t hash = atoms_hash(key);
+    AtomMapShard* shard = atom_map_shard(map, hash);
+
+    AtomMapEntry* e = atom_map_find(atomic_load_explicit(&shard->table, memory_order_acquire), hash, key);
+    if (e == NULL) {
+        // might've been inserted after a resize we haven't seen yet
+        mtx_lock(&shard->lock);
+        e = atom_map_find(atomic_load_explicit(&shard->table, memory_order_relaxed), hash, key);
+        mtx_unlock(&shard->lock);
+
+        assert(e != NULL && "atom_map_compare_exchange needs the key to be in the map");
+    }
+
+    return atomic_compare_exchange_strong_explicit(&e->value, expected, desired, memory_order_acq_rel, memory_order_acquire);
+}
+
+size_t atom_map_count(AtomMap* map) {
+    size_t count = 0;
+    for (size_t i = 0; i < ATOM_MAP_SHARD_COUNT; i++) {
+        mtx_lock(&map->shards[i].lock);
+        count += map->shards[i].count;
+        mtx_unlock(&map->shards[i].lock);
+    }
+
+    return count;
+}
+
+bool atom_map_next(AtomMapIter* it) {
+    while (it->shard < ATOM_MAP_SHARD_COUNT) {
+        AtomMapTable* table = atomic_load_explicit(&it->map->shards[it->shard].table, memory_order_acquire);
+
+        while (it->slot < table->capacity) {
+            AtomMapEntry* e = atomic_load_explicit(&table->slots[it->slot++], memory_order_acquire);
+            if (e != NULL) {
+                it->key = e->key;
+                it->value = atomic_load_explicit(&e->value, memory_order_acquire);
+                return true;
+            }
+        }
+
+        it->shard += 1, it->slot = 0;
+    }
+
+    return false;
+}
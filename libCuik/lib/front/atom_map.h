@@ -0,0 +1,41 @@
+#pragma once
+#include "atoms.h"
+#include <stdbool.h>
+
+// Atom keyed hash map which is safe to use from many threads, lookups never lock
+// and insertions only lock the shard the key lands in. Since atoms are unique we
+// just compare pointers and reuse the hash the interner already computed.
+//
+// values are pointers, the map doesn't own them. iterating is only safe while
+// nobody is inserting.
+typedef struct AtomMap AtomMap;
+
+typedef struct AtomMapIter {
+    AtomMap* map;
+    size_t shard, slot;
+
+    // the current entry
+    Atom key;
+    void* value;
+} AtomMapIter;
+
+AtomMap* atom_map_create(void);
+void atom_map_destroy(AtomMap* map);
+
+void* atom_map_get(AtomMap* map, Atom key);
+
+// inserts or replaces the value
+void atom_map_put(AtomMap* map, Atom key, void* value);
+
+// inserts the value if the key isn't in there yet, either way it returns what the
+// map ends up holding so you can tell if you won the race by comparing.
+void* atom_map_put_if_absent(AtomMap* map, Atom key, void* value);
+
+// atomically swaps the value for the key (which has to be in the map already) if
+// it's still expected, same deal as atomic_compare_exchange_strong
+bool atom_map_compare_exchange(AtomMap* map, Atom key, void** expected, void* desired);
+
+size_t atom_map_count(AtomMap* map);
+bool atom_map_next(AtomMapIter* it);
+
+#define atom_map_for(it, m) for (AtomMapIter it = { .map = (m) }; atom_map_next(&it);)
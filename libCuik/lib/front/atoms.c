@@ -1,38 +1,208 @@
 #include "cuik.h"
 #include "atoms.h"
+#include <threads.h>
+#include <stdatomic.h>
 
-#define NL_STRING_MAP_IMPL
-#define NL_STRING_MAP_INLINE
-#include "../string_map.h"
+// The interner is shared by every thread in the process, it's split into shards
+// (picked by the top bits of the hash) which each have a lock for insertions while
+// lookups never lock, they just probe whichever table is currently published.
+//
+// Old tables aren't freed after a resize because a reader might still be probing
+// them, they're perfectly valid just a bit stale (any miss goes through the lock).
+#define ATOM_SHARD_BITS   (6)
+#define ATOM_SHARD_COUNT  (1u << ATOM_SHARD_BITS)
+#define ATOM_TABLE_INIT   (1024)
+#define ATOM_CHUNK_SIZE   (64 * 1024)
 
-thread_local static Arena atoms_arena;
-thread_local static NL_Strmap(Atom) interner;
+typedef struct AtomTable {
+    // previous (smaller) tables, kept alive for readers
+    struct AtomTable* prev;
+    size_t capacity;
+
+    _Atomic(AtomHeader*) slots[];
+} AtomTable;
+
+typedef struct AtomChunk {
+    struct AtomChunk* next;
+    size_t used, capacity;
+
+    _Alignas(AtomHeader) char data[];
+} AtomChunk;
+
+typedef struct {
+    mtx_t lock;
+    _Atomic(AtomTable*) table;
+
+    // these are only touched with the lock held
+    size_t count;
+    AtomChunk* chunks;
+} AtomShard;
+
+static once_flag atoms_once = ONCE_FLAG_INIT;
+static AtomShard shards[ATOM_SHARD_COUNT];
+
+static uint32_t atoms_hash_string(size_t length, const unsigned char* data) {
+    // FNV1A
+    uint32_t hash = 0x811C9DC5;
+    for (size_t i = 0; i < length; i++) {
+        hash = (data[i] ^ hash) * 0x01000193;
+    }
+
+    return hash;
+}
+
+static AtomTable* atoms_table_alloc(size_t capacity) {
+    AtomTable* table = HEAP_ALLOC(sizeof(AtomTable) + (capacity * sizeof(_Atomic(AtomHeader*))));
+    table->prev = NULL;
+    table->capacity = capacity;
+
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&table->slots[i], NULL);
+    }
+    return table;
+}
+
+static void atoms_init_shards(void) {
+    for (size_t i = 0; i < ATOM_SHARD_COUNT; i++) {
+        mtx_init(&shards[i].lock, mtx_plain);
+        atomic_init(&shards[i].table, atoms_table_alloc(ATOM_TABLE_INIT));
+        shards[i].count = 0;
+        shards[i].chunks = NULL;
+    }
+}
 
 void atoms_init(void) {
-    interner = nl_strmap_alloc(Atom, 65536);
+    call_once(&atoms_once, atoms_init_shards);
 }
 
+// single-threaded teardown: nothing else can be interning or probing when this
+// runs (every atom handed out dies with it) and the shards can't be brought back
+// since atoms_init only ever runs once.
 void atoms_deinit(void) {
-    arena_free(&atoms_arena);
+    for (size_t i = 0; i < ATOM_SHARD_COUNT; i++) {
+        AtomTable* table = atomic_load_explicit(&shards[i].table, memory_order_relaxed);
+        if (table == NULL) {
+            // never initialized (or already torn down)
+            continue;
+        }
+
+        while (table != NULL) {
+            AtomTable* prev = table->prev;
+            HEAP_FREE(table);
+            table = prev;
+        }
+
+        AtomChunk* chunk = shards[i].chunks;
+        while (chunk != NULL) {
+            AtomChunk* next = chunk->next;
+            HEAP_FREE(chunk);
+            chunk = next;
+        }
+
+        atomic_store_explicit(&shards[i].table, NULL, memory_order_relaxed);
+        shards[i].count = 0;
+        shards[i].chunks = NULL;
+        mtx_destroy(&shards[i].lock);
+    }
 }
 
 void atoms_dump_stats(void) {
-    printf("Atoms arena: %zu MB\n", arena_get_memory_usage(&atoms_arena) / (1024*1024));
+    size_t count = 0, memory = 0;
+    for (size_t i = 0; i < ATOM_SHARD_COUNT; i++) {
+        mtx_lock(&shards[i].lock);
+        count += shards[i].count;
+        for (AtomChunk* c = shards[i].chunks; c != NULL; c = c->next) {
+            memory += c->capacity;
+        }
+        mtx_unlock(&shards[i].lock);
+    }
+
+    printf("Atoms: %zu (%zu KB)\n", count, memory / 1024);
 }
 
-Atom atoms_put(size_t len, const unsigned char* str) {
-    ptrdiff_t search = nl_strmap_get(interner, ((NL_Slice){ len, str }));
-    if (search >= 0) {
-        // printf("Reused memory! %zu bytes\n", len+1);
-        return interner[search];
+static AtomHeader* atoms_find(AtomTable* table, uint32_t hash, size_t len, const unsigned char* str) {
+    size_t mask = table->capacity - 1;
+
+    // the load factor never goes above 50% so there's always an empty slot
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        AtomHeader* a = atomic_load_explicit(&table->slots[i], memory_order_acquire);
+        if (a == NULL) return NULL;
+
+        if (a->hash == hash && a->length == len && memcmp(a->data, str, len) == 0) {
+            return a;
+        }
+    }
+}
+
+static void atoms_insert_slot(AtomTable* table, AtomHeader* a) {
+    size_t mask = table->capacity - 1;
+    size_t i = a->hash & mask;
+    while (atomic_load_explicit(&table->slots[i], memory_order_relaxed) != NULL) {
+        i = (i + 1) & mask;
+    }
+
+    // release so readers never see a half written atom
+    atomic_store_explicit(&table->slots[i], a, memory_order_release);
+}
+
+static AtomHeader* atoms_alloc(AtomShard* shard, uint32_t hash, size_t len, const unsigned char* str) {
+    size_t size = (sizeof(AtomHeader) + len + 1 + (_Alignof(AtomHeader) - 1)) & ~(_Alignof(AtomHeader) - 1);
+
+    AtomChunk* chunk = shard->chunks;
+    if (chunk == NULL || chunk->used + size > chunk->capacity) {
+        size_t capacity = size > ATOM_CHUNK_SIZE ? size : ATOM_CHUNK_SIZE;
+
+        chunk = HEAP_ALLOC(sizeof(AtomChunk) + capacity);
+        chunk->next = shard->chunks;
+        chunk->used = 0;
+        chunk->capacity = capacity;
+        shard->chunks = chunk;
     }
 
-    Atom newstr = arena_alloc(&atoms_arena, len + 1, 1);
-    memcpy(newstr, str, len);
-    newstr[len] = 0;
+    AtomHeader* a = (AtomHeader*) &chunk->data[chunk->used];
+    chunk->used += size;
+
+    a->hash = hash;
+    a->length = len;
+    memcpy(a->data, str, len);
+    a->data[len] = 0;
+    return a;
+}
+
+Atom atoms_put(size_t len, const unsigned char* str) {
+    uint32_t hash = atoms_hash_string(len, str);
+    AtomShard* shard = &shards[hash >> (32 - ATOM_SHARD_BITS)];
+
+    // fast path, most identifiers have been seen before (probably on another thread)
+    AtomHeader* a = atoms_find(atomic_load_explicit(&shard->table, memory_order_acquire), hash, len, str);
+    if (a != NULL) return a->data;
+
+    mtx_lock(&shard->lock);
+    AtomTable* table = atomic_load_explicit(&shard->table, memory_order_relaxed);
+
+    // someone might've beaten us to it
+    a = atoms_find(table, hash, len, str);
+    if (a == NULL) {
+        if ((shard->count + 1) * 2 > table->capacity) {
+            AtomTable* new_table = atoms_table_alloc(table->capacity * 2);
+            new_table->prev = table;
+
+            for (size_t i = 0; i < table->capacity; i++) {
+                AtomHeader* old = atomic_load_explicit(&table->slots[i], memory_order_relaxed);
+                if (old != NULL) atoms_insert_slot(new_table, old);
+            }
+
+            atomic_store_explicit(&shard->table, new_table, memory_order_release);
+            table = new_table;
+        }
+
+        a = atoms_alloc(shard, hash, len, str);
+        atoms_insert_slot(table, a);
+        shard->count += 1;
+    }
+    mtx_unlock(&shard->lock);
 
-    nl_strmap_put(interner, ((NL_Slice){ len, str }), newstr);
-    return newstr;
+    return a->data;
 }
 
 Atom atoms_putc(const unsigned char* str) {
@@ -1,11 +1,30 @@
 #pragma once
 #include "arena.h"
 #include "common.h"
+#include <stddef.h>
 
 typedef char* Atom;
 
+// every atom has this header in front of the characters, atoms are interned
+// process-wide so two atoms with the same contents are the same pointer.
+typedef struct {
+    uint32_t hash;
+    uint32_t length;
+    char data[];
+} AtomHeader;
+
+#define ATOM_HEADER(atom) ((AtomHeader*) ((atom) - offsetof(AtomHeader, data)))
+
 void atoms_init(void);
 void atoms_deinit(void);
 void atoms_dump_stats(void);
 Atom atoms_put(size_t len, const unsigned char* str);
 Atom atoms_putc(const unsigned char* str);
+
+inline static uint32_t atoms_hash(Atom atom) {
+    return ATOM_HEADER(atom)->hash;
+}
+
+inline static size_t atoms_len(Atom atom) {
+    return ATOM_HEADER(atom)->length;
+}
@@ -0,0 +1,171 @@
+// Builds the Cuik_CompactAST for a TU, the kids come from the normal iterators so
+// walking either layout gives the same tree.
+#include "parser.h"
+
+static uint32_t reserve_links(Cuik_CompactAST* restrict ast, size_t count) {
+    size_t start = dyn_array_length(ast->links);
+    assert(start + count <= UINT32_MAX);
+
+    dyn_array_put_uninit(ast->links, count);
+    return start;
+}
+
+static Cuik_ExprIndex compact_expr(Cuik_CompactAST* restrict ast, Expr* restrict e) {
+    if (e == NULL) return 0;
+
+    size_t count = 0;
+    for (Cuik_ExprIter it = { .parent_ = e }; cuik_next_expr_kid(&it);) count++;
+
+    Cuik_ExprIndex i = dyn_array_length(ast->exprs);
+    uint32_t start = reserve_links(ast, count);
+    dyn_array_put(ast->exprs, e);
+    dyn_array_put(ast->expr_ops, e->op);
+    dyn_array_put(ast->expr_types, e->type);
+    dyn_array_put(ast->expr_locs, e->start_loc);
+    dyn_array_put(ast->expr_kids, (Cuik_CompactLinks){ start, count });
+
+    // the links array might move while the kids are being added
+    size_t j = 0;
+    for (Cuik_ExprIter it = { .parent_ = e }; cuik_next_expr_kid(&it);) {
+        Cuik_ExprIndex kid = compact_expr(ast, it.expr);
+        ast->links[start + j++] = kid;
+    }
+
+    return i;
+}
+
+static size_t stmt_exprs(Stmt* restrict s, Expr* out[2]) {
+    switch (s->op) {
+        case STMT_DECL:
+        case STMT_GLOBAL_DECL: out[0] = s->decl.initial; return 1;
+        case STMT_EXPR: out[0] = s->expr.expr; return 1;
+        case STMT_RETURN: out[0] = s->return_.expr; return 1;
+        case STMT_GOTO: out[0] = s->goto_.target; return 1;
+        case STMT_IF: out[0] = s->if_.cond; return 1;
+        case STMT_WHILE: out[0] = s->while_.cond; return 1;
+        case STMT_DO_WHILE: out[0] = s->do_while.cond; return 1;
+        case STMT_SWITCH: out[0] = s->switch_.condition; return 1;
+        case STMT_FOR: out[0] = s->for_.cond, out[1] = s->for_.next; return 2;
+        default: return 0;
+    }
+}
+
+static Cuik_StmtIndex compact_stmt(Cuik_CompactAST* restrict ast, Stmt* restrict s) {
+    if (s == NULL) return 0;
+
+    Expr* exprs[2];
+    size_t expr_count = stmt_exprs(s, exprs);
+
+    size_t count = 0;
+    for (Cuik_StmtIter it = { .parent_ = s }; cuik_next_stmt_kid(&it);) count++;
+
+    Cuik_StmtIndex i = dyn_array_length(ast->stmts);
+    uint32_t expr_start = reserve_links(ast, expr_count);
+    uint32_t start = reserve_links(ast, count);
+    dyn_array_put(ast->stmts, s);
+    dyn_array_put(ast->stmt_ops, s->op);
+    dyn_array_put(ast->stmt_locs, s->loc);
+    dyn_array_put(ast->stmt_kids, (Cuik_CompactLinks){ start, count });
+    dyn_array_put(ast->stmt_exprs, (Cuik_CompactLinks){ expr_start, expr_count });
+
+    if (s->op == STMT_FUNC_DECL) {
+        assert(s->decl.initial_as_stmt != NULL);
+        Cuik_StmtIndex body = compact_stmt(ast, s->decl.initial_as_stmt);
+        assert(body == i + 1);
+        (void) body;
+    }
+
+    for (size_t j = 0; j < expr_count; j++) {
+        Cuik_ExprIndex e = compact_expr(ast, exprs[j]);
+        ast->links[expr_start + j] = e;
+    }
+
+    size_t j = 0;
+    for (Cuik_StmtIter it = { .parent_ = s }; cuik_next_stmt_kid(&it);) {
+        Cuik_StmtIndex kid = compact_stmt(ast, it.stmt);
+        ast->links[start + j++] = kid;
+    }
+
+    return i;
+}
+
+CUIK_API Cuik_CompactAST* cuik_get_compact_ast(TranslationUnit* restrict tu) {
+    if (tu->compact != NULL) {
+        return tu->compact;
+    }
+
+    Cuik_CompactAST* ast = HEAP_ALLOC(sizeof(Cuik_CompactAST));
+    *ast = (Cuik_CompactAST){
+        .expr_ops   = dyn_array_create(uint8_t),
+        .expr_types = dyn_array_create(Cuik_Type*),
+        .expr_locs  = dyn_array_create(SourceLocIndex),
+        .expr_kids  = dyn_array_create(Cuik_CompactLinks),
+        .exprs      = dyn_array_create(Expr*),
+        .stmt_ops   = dyn_array_create(uint8_t),
+        .stmt_locs  = dyn_array_create(SourceLocIndex),
+        .stmt_kids  = dyn_array_create(Cuik_CompactLinks),
+        .stmt_exprs = dyn_array_create(Cuik_CompactLinks),
+        .stmts      = dyn_array_create(Stmt*),
+        .links      = dyn_array_create(uint32_t),
+    };
+
+    CUIK_TIMED_BLOCK("compact AST: %s", tu->filepath) {
+        // the null nodes
+        dyn_array_put(ast->exprs, NULL);
+        dyn_array_put(ast->expr_ops, EXPR_NONE);
+        dyn_array_put(ast->expr_types, NULL);
+        dyn_array_put(ast->expr_locs, 0);
+        dyn_array_put(ast->expr_kids, (Cuik_CompactLinks){ 0 });
+        dyn_array_put(ast->stmts, NULL);
+        dyn_array_put(ast->stmt_ops, STMT_NONE);
+        dyn_array_put(ast->stmt_locs, 0);
+        dyn_array_put(ast->stmt_kids, (Cuik_CompactLinks){ 0 });
+        dyn_array_put(ast->stmt_exprs, (Cuik_CompactLinks){ 0 });
+
+        size_t count = dyn_array_length(tu->top_level_stmts);
+        ast->top_level = HEAP_ALLOC((count + 1) * sizeof(Cuik_StmtIndex));
+        ast->top_level_count = count;
+        for (size_t i = 0; i < count; i++) {
+            ast->top_level[i] = compact_stmt(ast, tu->top_level_stmts[i]);
+        }
+
+        dyn_array_trim(ast->expr_ops);
+        dyn_array_trim(ast->expr_types);
+        dyn_array_trim(ast->expr_locs);
+        dyn_array_trim(ast->expr_kids);
+        dyn_array_trim(ast->exprs);
+        dyn_array_trim(ast->stmt_ops);
+        dyn_array_trim(ast->stmt_locs);
+        dyn_array_trim(ast->stmt_kids);
+        dyn_array_trim(ast->stmt_exprs);
+        dyn_array_trim(ast->stmts);
+        dyn_array_trim(ast->links);
+    }
+
+    assert(dyn_array_length(ast->exprs) <= UINT32_MAX && dyn_array_length(ast->stmts) <= UINT32_MAX);
+    ast->expr_count = dyn_array_length(ast->exprs);
+    ast->stmt_count = dyn_array_length(ast->stmts);
+    ast->link_count = dyn_array_length(ast->links);
+
+    tu->compact = ast;
+    return ast;
+}
+
+void compact_ast_free(TranslationUnit* restrict tu) {
+    Cuik_CompactAST* ast = tu->compact;
+    if (ast == NULL) return;
+
+    dyn_array_destroy(ast->expr_ops);
+    dyn_array_destroy(ast->expr_types);
+    dyn_array_destroy(ast->expr_locs);
+    dyn_array_destroy(ast->expr_kids);
+    dyn_array_destroy(ast->exprs);
+    dyn_array_destroy(ast->stmt_ops);
+    dyn_array_destroy(ast->stmt_locs);
+    dyn_array_destroy(ast->stmt_kids);
+    dyn_array_destroy(ast->stmt_exprs);
+    dyn_array_destroy(ast->stmts);
+    dyn_array_destroy(ast->links);
+    HEAP_FREE(ast->top_level);
+    HEAP_FREE(tu->compact);
+}
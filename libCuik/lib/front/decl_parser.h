@@ -94,18 +94,19 @@ static Decl parse_declarator(TranslationUnit* tu, TokenStream* restrict s, Cuik_
 
     // handle pointers
     while (tokens_get(s)->type == '*') {
-        type = type ? new_pointer(tu, type) : 0;
         tokens_next(s);
 
+        // pointer types are shared so we need all the qualifiers before making one
+        bool is_atomic = false, is_restrict = false;
         parse_another_qualifier : {
             switch (tokens_get(s)->type) {
                 case TOKEN_KW_Atomic: {
-                    type->is_atomic = true;
+                    is_atomic = true;
                     tokens_next(s);
                     goto parse_another_qualifier;
                 }
                 case TOKEN_KW_restrict: {
-                    type->is_ptr_restrict = true;
+                    is_restrict = true;
                     tokens_next(s);
                     goto parse_another_qualifier;
                 }
@@ -122,6 +123,8 @@ static Decl parse_declarator(TranslationUnit* tu, TokenStream* restrict s, Cuik_
                 break;
             }
         }
+
+        type = type ? new_qualified_pointer(tu, type, is_atomic, is_restrict) : 0;
     }
 
     skip_over_declspec(tu, s);
@@ -721,7 +724,7 @@ static Cuik_Type* parse_declspec(TranslationUnit* tu, TokenStream* restrict s, A
                         // don't track it
                         if (name) {
                             if (out_of_order_mode) {
-                                nl_strmap_put_cstr(tu->global_tags, name, type);
+                                atom_map_put(tu->global_tags, name, type);
                             } else {
                                 if (local_tag_count + 1 >= MAX_LOCAL_TAGS) {
                                     SourceLocIndex loc2 = tokens_get_location_index(s);
@@ -729,7 +732,7 @@ static Cuik_Type* parse_declspec(TranslationUnit* tu, TokenStream* restrict s, A
                                     abort();
                                 }
 
-                                local_tags[local_tag_count++] = (TagEntry){name, type};
+                                push_local_tag(name, type);
                             }
                         }
                     }
@@ -820,6 +823,10 @@ static Cuik_Type* parse_declspec(TranslationUnit* tu, TokenStream* restrict s, A
 
                     type->record.kids = permanent_store;
                     type->record.kid_count = member_count;
+                    type->record.flat = NULL;
+
+                    // it's got a body now, even if it was forward declared before
+                    type->is_incomplete = false;
 
                     if (!out_of_order_mode) {
                         type_layout(tu, type, true);
@@ -838,7 +845,7 @@ static Cuik_Type* parse_declspec(TranslationUnit* tu, TokenStream* restrict s, A
                         type->is_incomplete = true;
 
                         if (out_of_order_mode) {
-                            nl_strmap_put_cstr(tu->global_tags, name, type);
+                            atom_map_put(tu->global_tags, name, type);
                         } else {
                             if (local_tag_count + 1 >= MAX_LOCAL_TAGS) {
                                 SourceLocIndex loc2 = tokens_get_location_index(s);
@@ -846,7 +853,7 @@ static Cuik_Type* parse_declspec(TranslationUnit* tu, TokenStream* restrict s, A
                                 abort();
                             }
 
-                            local_tags[local_tag_count++] = (TagEntry){name, type};
+                            push_local_tag(name, type);
                         }
                     }
                     counter += OTHER;
@@ -887,7 +894,7 @@ static Cuik_Type* parse_declspec(TranslationUnit* tu, TokenStream* restrict s, A
 
                         if (name) {
                             if (out_of_order_mode)
-                                nl_strmap_put_cstr(tu->global_tags, name, type);
+                                atom_map_put(tu->global_tags, name, type);
                             else {
                                 if (local_tag_count + 1 >= MAX_LOCAL_TAGS) {
                                     SourceLocIndex loc2 = tokens_get_location_index(s);
@@ -895,7 +902,7 @@ static Cuik_Type* parse_declspec(TranslationUnit* tu, TokenStream* restrict s, A
                                     abort();
                                 }
 
-                                local_tags[local_tag_count++] = (TagEntry){name, type};
+                                push_local_tag(name, type);
                             }
                         }
                     }
@@ -956,9 +963,9 @@ static Cuik_Type* parse_declspec(TranslationUnit* tu, TokenStream* restrict s, A
                             .enum_value = count};
 
                         if (out_of_order_mode) {
-                            nl_strmap_put_cstr(tu->global_symbols, name, sym);
+                            put_global_symbol(tu, name, &sym);
                         } else {
-                            local_symbols[local_symbol_count++] = sym;
+                            push_local_symbol(sym);
                             cursor += 1;
                         }
 
@@ -978,6 +985,9 @@ static Cuik_Type* parse_declspec(TranslationUnit* tu, TokenStream* restrict s, A
                     type->enumerator.entries = permanent_store;
                     type->enumerator.count = count;
 
+                    // a forward declared enum might've been laid out already
+                    atomic_store_explicit(&type->is_laid_out, false, memory_order_relaxed);
+
                     if (out_of_order_mode) {
                         type->is_incomplete = true;
                         type->size = 0;
@@ -993,7 +1003,7 @@ static Cuik_Type* parse_declspec(TranslationUnit* tu, TokenStream* restrict s, A
                         type->is_incomplete = true;
 
                         if (out_of_order_mode) {
-                            nl_strmap_put_cstr(tu->global_tags, name, type);
+                            atom_map_put(tu->global_tags, name, type);
                         } else {
                             if (local_tag_count + 1 >= MAX_LOCAL_TAGS) {
                                 SourceLocIndex loc2 = tokens_get_location_index(s);
@@ -1001,7 +1011,7 @@ static Cuik_Type* parse_declspec(TranslationUnit* tu, TokenStream* restrict s, A
                                 abort();
                             }
 
-                            local_tags[local_tag_count] = (TagEntry){name, type};
+                            push_local_tag(name, type);
                         }
                     }
 
@@ -1053,7 +1063,7 @@ static Cuik_Type* parse_declspec(TranslationUnit* tu, TokenStream* restrict s, A
                         type->placeholder.name = name;
                         counter += OTHER;
 
-                        nl_strmap_put_cstr(tu->global_symbols, name, sym);
+                        put_global_symbol(tu, name, &sym);
                     }
 
                     break;
@@ -1170,14 +1180,18 @@ static Cuik_Type* parse_declspec(TranslationUnit* tu, TokenStream* restrict s, A
 
         type = new_qualified_type(tu, type, is_atomic, is_const);
 
-        if (forced_align) {
-            type->align = forced_align;
-        } else if (alignas_pending_expr != NULL) {
-            type->align = -1;
-            alignas_pending_expr->dst = &type->align;
-        }
+        // qualified types are shared, if we wanna mess with the alignment we need our own
+        if (forced_align || alignas_pending_expr != NULL) {
+            type = copy_type(tu, type);
+            type->loc = loc;
 
-        type->loc = loc;
+            if (forced_align) {
+                type->align = forced_align;
+            } else {
+                type->align = -1;
+                alignas_pending_expr->dst = &type->align;
+            }
+        }
     }
 
     return type;
@@ -46,11 +46,17 @@ static Expr* parse_function_literal(TranslationUnit* tu, TokenStream* restrict s
         },
         .initial_as_stmt = NULL,
     };
+
+    // phase 3 might have multiple functions being parsed at once
+    mtx_lock(&tu->arena_mutex);
     dyn_array_put(tu->top_level_stmts, n);
+    mtx_unlock(&tu->arena_mutex);
 
+    size_t body_start = s->current;
     LOCAL_SCOPE {
         parse_function_definition(tu, s, n);
     }
+    n->decl.token_count = s->current - body_start;
 
     Expr* e = make_expr(tu);
     *e = (Expr){
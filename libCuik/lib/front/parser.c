@@ -15,14 +15,23 @@
 
 #define OUT_OF_ORDER_CRAP 1
 
-// how big are the phase2 parse tasks
-#define PARSE_MUNCH_SIZE (131072)
+// how many tokens worth of function bodies go into one phase 3 parse task
+#define PARSE_TASK_QUANTUM (16384)
 
 typedef struct {
     Atom key;
     Cuik_Type* value;
 } TagEntry;
 
+// maps names to the index of the innermost local (symbol or tag) with that name,
+// -1 if there's none in scope. keys are never removed, they're just set back to -1
+// so the map only grows to the number of unique local names the thread has seen.
+typedef struct {
+    size_t capacity, count;
+    Atom* keys;
+    int* values;
+} LocalNameMap;
+
 typedef struct {
     enum {
         PENDING_ALIGNAS
@@ -40,6 +49,13 @@ thread_local static Symbol* local_symbols;
 thread_local static int local_tag_count = 0;
 thread_local static TagEntry* local_tags;
 
+// each local remembers the index of the local it shadowed (or -1) so popping a
+// scope just walks back down the stack restoring the old bindings.
+thread_local static int* local_symbol_shadows;
+thread_local static int* local_tag_shadows;
+thread_local static LocalNameMap local_symbol_map;
+thread_local static LocalNameMap local_tag_map;
+
 // Global symbol stuff
 thread_local static DynArray(PendingExpr) pending_exprs;
 thread_local static NL_Strmap(Stmt*) labels;
@@ -87,7 +103,7 @@ static bool is_typename(TranslationUnit* tu, TokenStream* restrict s);
 static _Noreturn void generic_error(TranslationUnit* tu, TokenStream* restrict s, const char* msg);
 
 // saves the local_symbol_count and local_tag_count before entering
-// and restores them when exiting since that'll allow us to open and
+// and pops back to them when exiting since that'll allow us to open and
 // close local scopes in the perspective of variable lookup...
 //
 // TODO(NeGate): add a field to keep track of "last local symbol count"
@@ -99,7 +115,7 @@ static _Noreturn void generic_error(TranslationUnit* tu, TokenStream* restrict s
 //  }
 #define LOCAL_SCOPE \
 for (int saved = local_symbol_count, saved2 = local_tag_count, _i_ = 0; _i_ == 0; \
-    _i_ += 1, local_symbol_count = saved, local_tag_count = saved2)
+    _i_ += 1, pop_local_scope(saved, saved2))
 
 static int align_up(int a, int b) {
     if (b == 0) return 0;
@@ -107,9 +123,11 @@ static int align_up(int a, int b) {
     return a + (b - (a % b)) % b;
 }
 
-// allocated size is sizeof(struct StmtHeader) + extra_size
+// allocated size is sizeof(struct StmtHeader) + extra_size, the op is never changed
+// into a bigger variant so we don't need to pay for the whole union.
 static Stmt* make_stmt(TranslationUnit* tu, TokenStream* restrict s, StmtOp op, size_t extra_size) {
-    Stmt* stmt = arena_alloc(&local_ast_arena, sizeof(Stmt), _Alignof(max_align_t));
+    assert(extra_size <= sizeof(Stmt) - offsetof(Stmt, compound));
+    Stmt* stmt = arena_alloc(&local_ast_arena, offsetof(Stmt, compound) + extra_size, _Alignof(Stmt));
 
     memset(stmt, 0, offsetof(Stmt, backing.user_data) + sizeof(((Stmt*)0)->backing.user_data));
 
@@ -123,22 +141,131 @@ static Expr* make_expr(TranslationUnit* tu) {
 }
 
 static Symbol* find_global_symbol(TranslationUnit* tu, const char* name) {
-    ptrdiff_t search = nl_strmap_get_cstr(tu->global_symbols, name);
-    return (search >= 0) ? &tu->global_symbols[search] : NULL;
+    return atom_map_get(tu->global_symbols, (Atom) name);
+}
+
+// global symbols live in the AST arena so the pointers stay valid while the table
+// grows, if the name is already in there it's overwritten.
+static Symbol* put_global_symbol(TranslationUnit* tu, Atom name, const Symbol* src) {
+    Symbol* sym = atom_map_get(tu->global_symbols, name);
+    if (sym == NULL) {
+        Symbol* new_sym = ARENA_ALLOC(&local_ast_arena, Symbol);
+        *new_sym = *src;
+
+        sym = atom_map_put_if_absent(tu->global_symbols, name, new_sym);
+        if (sym == new_sym) return sym;
+    }
+
+    *sym = *src;
+    return sym;
+}
+
+// returns the slot for the name, if insert is false and the name hasn't been seen yet
+// it returns NULL.
+static int* local_name_map_slot(LocalNameMap* restrict map, Atom name, bool insert) {
+    if (map->capacity == 0) {
+        if (!insert) return NULL;
+
+        map->capacity = 1024;
+        map->keys = calloc(map->capacity, sizeof(Atom));
+        map->values = malloc(map->capacity * sizeof(int));
+    } else if (insert && (map->count + 1) * 2 > map->capacity) {
+        // keep the load factor under 50%
+        LocalNameMap new_map = {
+            .capacity = map->capacity * 2,
+            .count = map->count,
+            .keys = calloc(map->capacity * 2, sizeof(Atom)),
+            .values = malloc(map->capacity * 2 * sizeof(int)),
+        };
+
+        size_t mask = new_map.capacity - 1;
+        for (size_t i = 0; i < map->capacity; i++) {
+            if (map->keys[i] == NULL) continue;
+
+            size_t j = atoms_hash(map->keys[i]) & mask;
+            while (new_map.keys[j] != NULL) j = (j + 1) & mask;
+
+            new_map.keys[j] = map->keys[i];
+            new_map.values[j] = map->values[i];
+        }
+
+        free(map->keys);
+        free(map->values);
+        *map = new_map;
+    }
+
+    // atoms are unique so we only need to compare pointers
+    size_t mask = map->capacity - 1;
+    size_t i = atoms_hash(name) & mask;
+    for (; map->keys[i] != NULL; i = (i + 1) & mask) {
+        if (map->keys[i] == name) return &map->values[i];
+    }
+
+    if (!insert) return NULL;
+    map->keys[i] = name;
+    map->values[i] = -1;
+    map->count += 1;
+    return &map->values[i];
+}
+
+static int local_name_map_get(LocalNameMap* restrict map, Atom name) {
+    int* slot = local_name_map_slot(map, name, false);
+    return slot ? *slot : -1;
+}
+
+static void push_local_symbol(Symbol sym) {
+    int i = local_symbol_count++;
+    local_symbols[i] = sym;
+
+    if (sym.name != NULL) {
+        int* slot = local_name_map_slot(&local_symbol_map, sym.name, true);
+        local_symbol_shadows[i] = *slot;
+        *slot = i;
+    }
+}
+
+static void push_local_tag(Atom name, Cuik_Type* type) {
+    int i = local_tag_count++;
+    local_tags[i] = (TagEntry){ name, type };
+
+    int* slot = local_name_map_slot(&local_tag_map, name, true);
+    local_tag_shadows[i] = *slot;
+    *slot = i;
+}
+
+static void pop_local_scope(int symbol_count, int tag_count) {
+    while (local_symbol_count > symbol_count) {
+        int i = --local_symbol_count;
+
+        if (local_symbols[i].name != NULL) {
+            *local_name_map_slot(&local_symbol_map, local_symbols[i].name, false) = local_symbol_shadows[i];
+        }
+    }
+
+    while (local_tag_count > tag_count) {
+        int i = --local_tag_count;
+        *local_name_map_slot(&local_tag_map, local_tags[i].key, false) = local_tag_shadows[i];
+    }
+}
+
+static void alloc_local_symbol_tables(void) {
+    if (local_symbols == NULL) {
+        local_symbols = realloc(local_symbols, sizeof(Symbol) * MAX_LOCAL_SYMBOLS);
+        local_tags = realloc(local_tags, sizeof(TagEntry) * MAX_LOCAL_TAGS);
+        local_symbol_shadows = realloc(local_symbol_shadows, sizeof(int) * MAX_LOCAL_SYMBOLS);
+        local_tag_shadows = realloc(local_tag_shadows, sizeof(int) * MAX_LOCAL_TAGS);
+    }
 }
 
 static Cuik_Type* find_tag(TranslationUnit* tu, const char* name) {
     // try locals
-    size_t i = local_tag_count;
-    while (i--) {
-        if (strcmp((const char*)local_tags[i].key, name) == 0) {
-            return local_tags[i].value;
-        }
+    int i = local_name_map_get(&local_tag_map, (Atom) name);
+    if (i >= 0) {
+        return local_tags[i].value;
     }
 
     // try globals
-    ptrdiff_t search = nl_strmap_get_cstr(tu->global_tags, name);
-    return (search >= 0) ? tu->global_tags[search] : NULL;
+    return atom_map_get(tu->global_tags, (Atom) name);
 }
 
 // ( SOMETHING )
@@ -209,27 +336,24 @@ static void diag_unresolved_symbol(TranslationUnit* tu, Atom name, SourceLocInde
     d->name = name;
     d->loc = loc;
 
-    mtx_lock(&tu->diag_mutex);
-    ptrdiff_t search = nl_strmap_get_cstr(tu->unresolved_symbols, name);
-    if (search < 0) {
-        search = nl_strmap_puti_cstr(tu->unresolved_symbols, name);
-        tu->unresolved_symbols[search] = d;
-    } else {
-        Diag_UnresolvedSymbol* old = tu->unresolved_symbols[search];
-        while (old->next != NULL) old = old->next;
-
-        old->next = d;
+    // push onto the name's list, it's in reverse order but the reporting
+    // flips it back once all the threads are done.
+    Diag_UnresolvedSymbol* head = atom_map_put_if_absent(tu->unresolved_symbols, name, d);
+    while (head != d) {
+        d->next = head;
+        if (atom_map_compare_exchange(tu->unresolved_symbols, name, (void**) &head, d)) break;
     }
-    mtx_unlock(&tu->diag_mutex);
 }
 
 #include "expr_parser.h"
 #include "decl_parser.h"
 
 typedef struct {
-    // shared state, every run of phase2_parse_task will decrement this by one
+    // shared state, every run of phase3_parse_task will decrement this by one
     atomic_size_t* tasks_remaining;
-    size_t start, end;
+
+    Symbol** syms;
+    size_t count;
 
     TranslationUnit* tu;
     const TokenStream* base_token_stream;
@@ -239,38 +363,125 @@ typedef struct {
 // a brand new parser on this thread
 static void reset_global_parser_state() {
     labels = NULL;
-    local_symbol_start = local_symbol_count = 0;
+    pop_local_scope(0, 0);
+    local_symbol_start = 0;
     current_switch_or_case = current_breakable = current_continuable = NULL;
     symbol_chain_start = symbol_chain_current = NULL;
 }
 
-static void parse_global_symbols(TranslationUnit* tu, size_t start, size_t end, TokenStream tokens) {
-    CUIK_TIMED_BLOCK("phase 3: %zu-%zu", start, end) {
+// the global symbol table is a hash map, anything which cares about the order
+// (diagnostics mostly) sorts the symbols by where they start.
+static int compare_symbol_order(const void* a, const void* b) {
+    int a_pos = (*(Symbol**) a)->current;
+    int b_pos = (*(Symbol**) b)->current;
+    return (a_pos > b_pos) - (a_pos < b_pos);
+}
+
+static size_t function_body_cost(Symbol* sym) {
+    int c = sym->stmt->decl.token_count;
+    return c > 0 ? c : 1;
+}
+
+static int compare_function_bodies(const void* a, const void* b) {
+    size_t a_cost = function_body_cost(*(Symbol**) a);
+    size_t b_cost = function_body_cost(*(Symbol**) b);
+
+    // biggest first, ties go in source order so it doesn't depend on the hash order
+    if (a_cost != b_cost) return (a_cost < b_cost) - (a_cost > b_cost);
+    return compare_symbol_order(a, b);
+}
+
+// static and inline functions don't need to exist unless someone references them,
+// so we put off parsing their bodies until the marking proves they're reachable.
+// static non-inline functions are still parsed eagerly if the user wants to know
+// about unused functions, we can't warn about something we never looked at.
+static bool is_lazy_function_body(TranslationUnit* tu, Stmt* restrict s) {
+    if (tu->check_unreachable || s->decl.attrs.is_root) return false;
+    if (!s->decl.attrs.is_inline && tu->warnings->unused_funcs) return false;
+
+    return s->decl.attrs.is_static || s->decl.attrs.is_inline;
+}
+
+static void parser_mark_chain(Expr* sym);
+static void parser_mark_stmt(Stmt* restrict s) {
+    if (s->op == STMT_FUNC_DECL || s->op == STMT_DECL || s->op == STMT_GLOBAL_DECL) {
+        if (!s->decl.attrs.is_used) {
+            s->decl.attrs.is_used = true;
+
+            // if the body hasn't been parsed yet the chain is empty, we'll walk it
+            // once the body is ready.
+            parser_mark_chain(s->decl.first_symbol);
+        }
+    }
+}
+
+static void parser_mark_chain(Expr* sym) {
+    for (; sym != NULL; sym = sym->next_symbol_in_chain) {
+        // builtins and unresolved symbols don't point to anything
+        if (sym->op == EXPR_SYMBOL) parser_mark_stmt(sym->symbol);
+    }
+}
+
+// writes out all the global symbols which have function bodies left to parse and
+// are known to be needed, sorted by their token count such that the biggest come first.
+static size_t collect_function_bodies(TranslationUnit* tu, Symbol** out) {
+    size_t count = 0;
+    atom_map_for(it, tu->global_symbols) {
+        Symbol* sym = it.value;
+
+        // don't worry about normal globals, those have been taken care of...
+        if (sym->current != 0 && (sym->storage_class == STORAGE_STATIC_FUNC || sym->storage_class == STORAGE_FUNC)) {
+            Stmt* restrict s = sym->stmt;
+
+            // parse_function_definition turns it into a STMT_FUNC_DECL so
+            // anything else is still pending
+            if (s->op != STMT_GLOBAL_DECL) continue;
+            if (!s->decl.attrs.is_used && is_lazy_function_body(tu, s)) continue;
+
+            out[count++] = sym;
+        }
+    }
+
+    qsort(out, count, sizeof(Symbol*), compare_function_bodies);
+    return count;
+}
+
+static void parse_global_symbols(TranslationUnit* tu, Symbol** syms, size_t count, TokenStream tokens) {
+    CUIK_TIMED_BLOCK("phase 3: %zu functions", count) {
         out_of_order_mode = false;
 
-        for (size_t i = start; i < end; i++) {
-            Symbol* sym = &tu->global_symbols[i];
+        for (size_t i = 0; i < count; i++) {
+            Symbol* sym = syms[i];
 
-            // don't worry about normal globals, those have been taken care of...
-            if (sym->current != 0 && (sym->storage_class == STORAGE_STATIC_FUNC || sym->storage_class == STORAGE_FUNC)) {
-                // Spin up a mini parser here
-                tokens.current = sym->current;
+            // Spin up a mini parser here
+            tokens.current = sym->current;
 
-                // intitialize use list
-                symbol_chain_start = symbol_chain_current = NULL;
+            // intitialize use list
+            symbol_chain_start = symbol_chain_current = NULL;
 
-                // Some sanity checks in case a local symbol is leaked funny.
-                assert(local_symbol_start == 0 && local_symbol_count == 0);
-                parse_function_definition(tu, &tokens, sym->stmt);
-                local_symbol_start = local_symbol_count = 0;
+            // Some sanity checks in case a local symbol is leaked funny.
+            assert(local_symbol_start == 0 && local_symbol_count == 0);
+            parse_function_definition(tu, &tokens, sym->stmt);
+            pop_local_scope(0, 0);
+            local_symbol_start = 0;
 
-                // finalize use list
-                sym->stmt->decl.first_symbol = symbol_chain_start;
-            }
+            // finalize use list
+            sym->stmt->decl.first_symbol = symbol_chain_start;
         }
     }
 }
 
+// moves the AST nodes this thread made into the TU's AST arena
+static void flush_local_ast_arena(TranslationUnit* tu) {
+    mtx_lock(&tu->arena_mutex);
+
+    arena_trim(&local_ast_arena);
+    arena_append(&tu->ast_arena, &local_ast_arena);
+    local_ast_arena = (Arena){0};
+
+    mtx_unlock(&tu->arena_mutex);
+}
+
 static void phase3_parse_task(void* arg) {
     ParserTaskInfo task = *((ParserTaskInfo*)arg);
     reset_global_parser_state();
@@ -279,10 +490,7 @@ static void phase3_parse_task(void* arg) {
     atoms_init();
 
     // allocate the local symbol tables
-    if (local_symbols == NULL) {
-        local_symbols = realloc(local_symbols, sizeof(Symbol) * MAX_LOCAL_SYMBOLS);
-        local_tags = realloc(local_tags, sizeof(TagEntry) * MAX_LOCAL_TAGS);
-    }
+    alloc_local_symbol_tables();
 
     if (pending_exprs) {
         dyn_array_clear(pending_exprs);
@@ -290,19 +498,164 @@ static void phase3_parse_task(void* arg) {
         pending_exprs = dyn_array_create(PendingExpr);
     }
 
-    parse_global_symbols(task.tu, task.start, task.end, *task.base_token_stream);
+    parse_global_symbols(task.tu, task.syms, task.count, *task.base_token_stream);
+
+    flush_local_ast_arena(task.tu);
+    type_arena_flush(task.tu);
+
+    // only signal once everything is in the TU, the parser walks the type arena
+    // right after the tasks are done.
     *task.tasks_remaining -= 1;
+}
 
-    // move local AST arena to TU's AST arena
-    {
-        mtx_lock(&task.tu->arena_mutex);
+// parse the bodies we know we need, any static or inline function they reference
+// becomes needed and goes into the next wave. the ones which are never reached
+// stay as unused STMT_GLOBAL_DECLs and the later phases just skip them.
+static void parse_function_bodies(TranslationUnit* tu, Cuik_IThreadpool* thread_pool, TokenStream* s) {
+    Symbol** bodies = HEAP_ALLOC(sizeof(Symbol*) * atom_map_count(tu->global_symbols));
+    size_t body_count;
+    while ((body_count = collect_function_bodies(tu, bodies)) != 0) {
+        if (thread_pool != NULL) {
+            // the bodies are sorted biggest first, so the big functions get a task
+            // to themselves while the small ones are packed until they make up a quantum.
+            // worst case is one task per function.
+            ParserTaskInfo* tasks = HEAP_ALLOC(sizeof(ParserTaskInfo) * body_count);
+            size_t task_count = 0;
+
+            for (size_t i = 0; i < body_count;) {
+                size_t start = i, total = 0;
+                while (i < body_count && total < PARSE_TASK_QUANTUM) {
+                    total += function_body_cost(bodies[i]);
+                    i += 1;
+                }
 
-        arena_trim(&local_ast_arena);
-        arena_append(&task.tu->ast_arena, &local_ast_arena);
-        local_ast_arena = (Arena){0};
+                tasks[task_count++] = (ParserTaskInfo){
+                    .syms = &bodies[start],
+                    .count = i - start,
 
-        mtx_unlock(&task.tu->arena_mutex);
+                    // share these bad boys with the other threads, we manage them still they
+                    // just get limited access
+                    .tu = tu,
+                    .base_token_stream = s,
+                };
+            }
+
+            // passed to the threads to identify when things are done
+            atomic_size_t tasks_remaining = task_count;
+            for (size_t i = 0; i < task_count; i++) {
+                tasks[i].tasks_remaining = &tasks_remaining;
+                CUIK_CALL(thread_pool, submit, phase3_parse_task, &tasks[i]);
+            }
+
+            // "highway robbery on steve jobs" job stealing amirite...
+            while (tasks_remaining != 0) {
+                CUIK_CALL(thread_pool, work_one_job);
+            }
+
+            HEAP_FREE(tasks);
+        } else {
+            // single threaded mode
+            parse_global_symbols(tu, bodies, body_count, *s);
+        }
+
+        for (size_t i = 0; i < body_count; i++) {
+            Stmt* restrict stmt = bodies[i]->stmt;
+            if (stmt->decl.attrs.is_used) parser_mark_chain(stmt->decl.first_symbol);
+        }
     }
+    HEAP_FREE(bodies);
+
+    // the single threaded parse (and anything we did between jobs) left nodes here
+    flush_local_ast_arena(tu);
+    type_arena_flush(tu);
+}
+
+// check for any qualified types and resolve them correctly, the ones which are
+// already resolved aren't qualified types anymore so it's fine to run it again.
+static void resolve_qualified_types(TranslationUnit* tu) {
+    type_arena_flush(tu);
+    for (ArenaSegment* a = tu->type_arena.base; a != NULL; a = a->next) {
+        for (size_t used = 0; used < a->used; used += sizeof(Cuik_Type)) {
+            Cuik_Type* type = (Cuik_Type*)&a->data[used];
+
+            if (type->kind == KIND_QUALIFIED_TYPE) {
+                bool is_atomic = type->is_atomic;
+                bool is_const = type->is_const;
+                int align = type->align;
+                Atom aka = type->also_known_as;
+
+                Cuik_Type* based = type->qualified_ty;
+
+                // copy and replace the qualifier slots
+                memcpy(type, based, sizeof(Cuik_Type));
+                type->also_known_as = aka;
+                type->based = based;
+                type->align = align;
+                type->is_const = is_const;
+                type->is_atomic = is_atomic;
+            }
+        }
+    }
+}
+
+static int compare_unresolved_symbols(const void* a, const void* b) {
+    SourceLocIndex a_loc = (*(Diag_UnresolvedSymbol**) a)->loc;
+    SourceLocIndex b_loc = (*(Diag_UnresolvedSymbol**) b)->loc;
+    return (a_loc > b_loc) - (a_loc < b_loc);
+}
+
+// output accumulated diagnostics, returns true if there were any
+static bool report_unresolved_symbols(TranslationUnit* tu) {
+    // the lists were built by any number of threads and the map is in hash order,
+    // so all the uses are sorted by location and relinked per name in that order.
+    size_t count = 0;
+    atom_map_for(it, tu->unresolved_symbols) {
+        for (Diag_UnresolvedSymbol* d = it.value; d != NULL; d = d->next) count++;
+    }
+
+    if (count == 0) {
+        return false;
+    }
+
+    Diag_UnresolvedSymbol** uses = HEAP_ALLOC(count * sizeof(Diag_UnresolvedSymbol*));
+    size_t i = 0;
+    atom_map_for(it, tu->unresolved_symbols) {
+        for (Diag_UnresolvedSymbol* d = it.value; d != NULL; d = d->next) uses[i++] = d;
+    }
+    qsort(uses, count, sizeof(Diag_UnresolvedSymbol*), compare_unresolved_symbols);
+
+    for (i = 0; i < count; i++) {
+        atom_map_put(tu->unresolved_symbols, uses[i]->name, NULL);
+    }
+
+    for (i = count; i--;) {
+        uses[i]->next = atom_map_get(tu->unresolved_symbols, uses[i]->name);
+        atom_map_put(tu->unresolved_symbols, uses[i]->name, uses[i]);
+    }
+
+    // each name is reported where it's first used
+    for (i = 0; i < count; i++) {
+        Diag_UnresolvedSymbol* loc = uses[i];
+        if (atom_map_get(tu->unresolved_symbols, loc->name) != loc) continue;
+
+        report_header(REPORT_ERROR, "could not resolve symbol: %s", loc->name);
+
+        DiagWriter d = diag_writer(&tu->tokens);
+        for (; loc != NULL; loc = loc->next) {
+            if (!diag_writer_is_compatible(&d, loc->loc)) {
+                // end line
+                diag_writer_done(&d);
+                d = diag_writer(&tu->tokens);
+            }
+
+            diag_writer_highlight(&d, loc->loc);
+        }
+        diag_writer_done(&d);
+        printf("\n");
+    }
+
+    HEAP_FREE(uses);
+    return true;
 }
 
 // 0 no cycles
@@ -393,8 +746,134 @@ static void type_resolve_pending_align(TranslationUnit* restrict tu, Cuik_Type*
     abort();
 }
 
+static bool is_anonymous_record(Member* member) {
+    return member->name == NULL && (member->type->kind == KIND_STRUCT || member->type->kind == KIND_UNION);
+}
+
+// the anonymous records have already been laid out (and thus indexed) by the
+// time the parent is so we just splice their entries in.
+static RecordIndex* build_record_index(TranslationUnit* restrict tu, Cuik_Type* type) {
+    Member* kids = type->record.kids;
+    size_t kid_count = type->record.kid_count;
+
+    int entry_count = 0, named_count = 0, bounds = kid_count;
+    for (size_t i = 0; i < kid_count; i++) {
+        Member* member = &kids[i];
+
+        entry_count += 1;
+        if (is_anonymous_record(member)) {
+            RecordIndex* kid = type_get_record_index(tu, member->type);
+            entry_count += kid->entry_count;
+            named_count += kid->named_count;
+
+            // unnamed members can be used
+            bounds += kid->bounds - 1;
+        } else if (member->name != NULL) {
+            named_count += 1;
+        }
+    }
+
+    size_t name_cap = 4;
+    while (name_cap < named_count * 2) name_cap *= 2;
+
+    // types can be laid out from any of the parser or sema threads
+    mtx_lock(&tu->arena_mutex);
+    RecordIndex* idx = ARENA_ALLOC(&tu->ast_arena, RecordIndex);
+    RecordEntry* entries = arena_alloc(&tu->ast_arena, (entry_count ? entry_count : 1) * sizeof(RecordEntry), _Alignof(RecordEntry));
+    int* first_entry = arena_alloc(&tu->ast_arena, (named_count + 1) * sizeof(int), _Alignof(int));
+    int* first_leaf = arena_alloc(&tu->ast_arena, (named_count + 1) * sizeof(int), _Alignof(int));
+    int* names = arena_alloc(&tu->ast_arena, name_cap * sizeof(int), _Alignof(int));
+    mtx_unlock(&tu->arena_mutex);
+
+    int j = 0, base_index = 0;
+    for (size_t i = 0; i < kid_count; i++) {
+        Member* member = &kids[i];
+
+        entries[j++] = (RecordEntry){ member, base_index, member->offset };
+        if (is_anonymous_record(member)) {
+            RecordIndex* kid = member->type->record.flat;
+
+            for (int k = 0; k < kid->entry_count; k++) {
+                RecordEntry* e = &kid->entries[k];
+                entries[j++] = (RecordEntry){ e->member, base_index + e->index, member->offset + e->offset };
+            }
+
+            base_index += kid->named_count;
+        } else if (member->name != NULL) {
+            base_index += 1;
+        }
+    }
+    assert(j == entry_count && base_index == named_count);
+
+    memset(first_entry, -1, (named_count + 1) * sizeof(int));
+    memset(first_leaf, -1, (named_count + 1) * sizeof(int));
+    memset(names, -1, name_cap * sizeof(int));
+
+    for (int i = 0; i < entry_count; i++) {
+        Member* member = entries[i].member;
+        int index = entries[i].index;
+
+        if (first_entry[index] < 0) first_entry[index] = i;
+        if (first_leaf[index] < 0 && !is_anonymous_record(member)) first_leaf[index] = i;
+
+        if (member->name != NULL) {
+            size_t k = atoms_hash(member->name) & (name_cap - 1);
+            while (names[k] >= 0 && entries[names[k]].member->name != member->name) {
+                k = (k + 1) & (name_cap - 1);
+            }
+
+            if (names[k] < 0) names[k] = i;
+        }
+    }
+
+    *idx = (RecordIndex){
+        .bounds = bounds,
+        .named_count = named_count,
+        .entry_count = entry_count,
+        .entries = entries,
+        .first_entry = first_entry,
+        .first_leaf = first_leaf,
+        .name_mask = name_cap - 1,
+        .names = names,
+    };
+    return idx;
+}
+
+// a type which is still missing something after layout (a forward declared record,
+// an array without a count yet) might get finished later so it's not marked as done.
+static bool is_layout_final(Cuik_Type* type) {
+    switch (type->kind) {
+        case KIND_STRUCT: case KIND_UNION: return !type->is_incomplete;
+        case KIND_ARRAY: return type->array_count != 0 && type->array_of->is_laid_out;
+        case KIND_QUALIFIED_TYPE: return type->qualified_ty->is_laid_out;
+        case KIND_VLA: case KIND_TYPEOF: case KIND_PLACEHOLDER: return false;
+        default: return true;
+    }
+}
+
+static void layout_type_locked(TranslationUnit* restrict tu, Cuik_Type* type);
+
+// sema lays types out lazily from many threads and the same types (tags, typedefs,
+// the interned derived types) are shared between all of them, so each type is only
+// laid out once under tu->layout_mutex and published with is_laid_out.
 void type_layout(TranslationUnit* restrict tu, Cuik_Type* type, bool needs_complete) {
-    if (type->kind == KIND_VOID || type->size != 0) return;
+    if (type->kind == KIND_VOID) return;
+    if (atomic_load_explicit(&type->is_laid_out, memory_order_acquire)) return;
+
+    mtx_lock(&tu->layout_mutex);
+    if (!atomic_load_explicit(&type->is_laid_out, memory_order_relaxed)) {
+        layout_type_locked(tu, type);
+    }
+    mtx_unlock(&tu->layout_mutex);
+}
+
+static void layout_type_locked(TranslationUnit* restrict tu, Cuik_Type* type) {
+    // there's nothing to lay out in a record without a body, the caller reports it
+    if ((type->kind == KIND_STRUCT || type->kind == KIND_UNION) && type->is_incomplete) {
+        return;
+    }
+
+    if (type->size != 0) goto done;
     if (type->is_inprogress) {
         REPORT(ERROR, type->loc, "Type has a circular dependency");
         abort();
@@ -434,7 +913,7 @@ void type_layout(TranslationUnit* restrict tu, Cuik_Type* type, bool needs_compl
         type->align = type->array_of->align;
     } else if (type->kind == KIND_QUALIFIED_TYPE) {
         if (type->qualified_ty->size == 0) {
-            type_layout(tu, type->qualified_ty, needs_complete);
+            type_layout(tu, type->qualified_ty, true);
         }
 
         type->size = type->qualified_ty->size;
@@ -532,15 +1011,128 @@ void type_layout(TranslationUnit* restrict tu, Cuik_Type* type, bool needs_compl
     }
 
     type->is_inprogress = false;
+
+    done:
+    // the element type has to be finished too
+    if (type->kind == KIND_ARRAY && type->array_count != 0) {
+        type_layout(tu, type->array_of, true);
+    } else if (type->kind == KIND_QUALIFIED_TYPE) {
+        type_layout(tu, type->qualified_ty, true);
+    }
+
+    if (!is_layout_final(type)) return;
+
+    // it might've already been laid out before it got an index (like
+    // when the qualified types got resolved)
+    if ((type->kind == KIND_STRUCT || type->kind == KIND_UNION) && type->record.flat == NULL) {
+        type->record.flat = build_record_index(tu, type);
+    }
+
+    atomic_store_explicit(&type->is_laid_out, true, memory_order_release);
+}
+
+RecordIndex* type_get_record_index(TranslationUnit* restrict tu, Cuik_Type* type) {
+    assert(type->kind == KIND_STRUCT || type->kind == KIND_UNION);
+    type_layout(tu, type, true);
+
+    // the index is published along with is_laid_out
+    return atomic_load_explicit(&type->is_laid_out, memory_order_acquire) ? type->record.flat : NULL;
+}
+
+int type_find_record_entry(RecordIndex* restrict idx, Atom name) {
+    size_t mask = idx->name_mask;
+    for (size_t i = atoms_hash(name) & mask;; i = (i + 1) & mask) {
+        int e = idx->names[i];
+        if (e < 0 || idx->entries[e].member->name == name) return e;
+    }
 }
 
 static const Cuik_Warnings DEFAULT_WARNINGS = { 0 };
 
-CUIK_API TranslationUnit* cuik_parse_translation_unit(const Cuik_TranslationUnitDesc* restrict desc) {
-    // we can preserve this across multiple uses
-    thread_local static NL_Strmap(Cuik_Type*) s_global_tags;
-    thread_local static NL_Strmap(Symbol) s_global_symbols;
+// puts the cached declarations into the symbol tables the same way phase 1 would've
+static bool import_prelude(TranslationUnit* tu, const void* data, size_t size) {
+    size_t first = dyn_array_length(tu->top_level_stmts);
+
+    AstCacheImport cache;
+    if (!ast_cache_import(tu, data, size, &cache)) return false;
+
+    // tags and enumerators
+    for (size_t i = 0; i < cache.type_count; i++) {
+        Cuik_Type* type = cache.types[i];
+
+        if (type->kind == KIND_STRUCT || type->kind == KIND_UNION) {
+            if (type->record.name != NULL) atom_map_put(tu->global_tags, type->record.name, type);
+        } else if (type->kind == KIND_ENUM) {
+            if (type->enumerator.name != NULL) atom_map_put(tu->global_tags, type->enumerator.name, type);
+
+            for (int j = 0; j < type->enumerator.count; j++) {
+                Atom name = type->enumerator.entries[j].key;
+                put_global_symbol(tu, name, &(Symbol){
+                        .name = name,
+                        .type = type,
+                        .storage_class = STORAGE_ENUM,
+                        .enum_value = j,
+                    });
+            }
+        }
+    }
+    HEAP_FREE(cache.types);
+
+    for (size_t i = first, count = dyn_array_length(tu->top_level_stmts); i < count; i++) {
+        Stmt* restrict n = tu->top_level_stmts[i];
+        AstCacheSymbol* sym = &cache.symbols[i - first];
+        Atom name = n->decl.name;
+        if (name == NULL) {
+            // tag declarations like 'struct Foo;'
+            n->decl.attrs.is_root = true;
+            continue;
+        }
+
+        if (n->decl.attrs.is_typedef) {
+            Cuik_Type* clone = sym->type;
+            if (clone == NULL) {
+                clone = copy_type(tu, new_qualified_type(tu, n->decl.type, n->decl.type->is_atomic, n->decl.type->is_const));
+                clone->also_known_as = name;
+            }
+
+            put_global_symbol(tu, name, &(Symbol){
+                    .name = name,
+                    .type = clone,
+                    .loc = n->loc,
+                    .storage_class = STORAGE_TYPEDEF,
+                });
+        } else {
+            bool is_static = n->decl.attrs.is_static;
+            StorageClass storage_class;
+            if (n->decl.type->kind == KIND_FUNC) {
+                storage_class = is_static ? STORAGE_STATIC_FUNC : STORAGE_FUNC;
+
+                // function bodies are left for phase 3 like any other
+                if (sym->current != 0) {
+                    n->decl.attrs.is_root = n->decl.attrs.is_tls || !(is_static || n->decl.attrs.is_inline);
+                }
+            } else {
+                storage_class = is_static ? STORAGE_STATIC_VAR : STORAGE_GLOBAL;
+                n->decl.attrs.is_root = !n->decl.attrs.is_extern && !is_static;
+            }
 
+            put_global_symbol(tu, name, &(Symbol){
+                    .name = name,
+                    .type = n->decl.type,
+                    .loc = n->loc,
+                    .storage_class = storage_class,
+                    .stmt = n,
+                    .current = sym->current,
+                    .terminator = sym->terminator,
+                });
+        }
+    }
+
+    HEAP_FREE(cache.symbols);
+    return true;
+}
+
+CUIK_API TranslationUnit* cuik_parse_translation_unit(const Cuik_TranslationUnitDesc* restrict desc) {
     if (cuik_is_profiling()) {
         cuik_profile_region_start(cuik_time_in_nanos(), "parse: %s", desc->tokens->filepath);
     }
@@ -560,6 +1152,7 @@ CUIK_API TranslationUnit* cuik_parse_translation_unit(const Cuik_TranslationUnit
     tu->tokens = *desc->tokens;
     tu->errors = desc->errors;
     tu->warnings = desc->warnings ? desc->warnings : &DEFAULT_WARNINGS;
+    tu->check_unreachable = desc->check_unreachable;
 
     #ifdef CUIK_USE_TB
     tu->ir_mod = desc->ir_module;
@@ -569,18 +1162,14 @@ CUIK_API TranslationUnit* cuik_parse_translation_unit(const Cuik_TranslationUnit
     tls_init();
     atoms_init();
     mtx_init(&tu->arena_mutex, mtx_plain);
-    mtx_init(&tu->diag_mutex, mtx_plain);
+    mtx_init(&tu->layout_mutex, mtx_plain | mtx_recursive);
+    mtx_init(&tu->type_interner.lock, mtx_plain);
 
     reset_global_parser_state();
 
-    // use the thread local ones (we'll set our resulting hash map back in
-    // such that if it resized the first time we don't need to resize again
-    // if used on that same thread, just avoiding allocations and such)
-    tu->global_symbols = s_global_symbols;
-    tu->global_tags = s_global_tags;
-
-    nl_strmap_clear(tu->global_symbols);
-    nl_strmap_clear(tu->global_tags);
+    tu->global_symbols = atom_map_create();
+    tu->global_tags = atom_map_create();
+    tu->unresolved_symbols = atom_map_create();
 
     ////////////////////////////////
     // Parse translation unit
@@ -597,6 +1186,13 @@ CUIK_API TranslationUnit* cuik_parse_translation_unit(const Cuik_TranslationUnit
         pending_exprs = dyn_array_create(PendingExpr);
     }
 
+    // splice in the cached declarations before we get to the tokens
+    if (desc->prelude != NULL && !import_prelude(tu, desc->prelude, desc->prelude_size)) {
+        report_header(REPORT_ERROR, "%s: the prelude doesn't match the tokens it starts with, is corrupt or was made by another version", tu->filepath);
+        tu->errors->tally[REPORT_ERROR] += 1;
+        goto parse_error;
+    }
+
     // Phase 1: resolve all top level statements
     CUIK_TIMED_BLOCK("phase 1") {
         while (tokens_get(s)->type) {
@@ -697,7 +1293,8 @@ CUIK_API TranslationUnit* cuik_parse_translation_unit(const Cuik_TranslationUnit
                                     .qualified_ty = decl.type,
                                 };
                             } else {
-                                Cuik_Type* clone = new_qualified_type(tu, decl.type, decl.type->is_atomic, decl.type->is_const);
+                                // the typedef gets its own name so it can't be the shared qualified type
+                                Cuik_Type* clone = copy_type(tu, new_qualified_type(tu, decl.type, decl.type->is_atomic, decl.type->is_const));
                                 clone->also_known_as = decl.name;
 
                                 // add new entry
@@ -707,7 +1304,7 @@ CUIK_API TranslationUnit* cuik_parse_translation_unit(const Cuik_TranslationUnit
                                     .loc = decl.loc,
                                     .storage_class = STORAGE_TYPEDEF,
                                 };
-                                nl_strmap_put_cstr(tu->global_symbols, decl.name, sym);
+                                put_global_symbol(tu, decl.name, &sym);
                             }
                         }
 
@@ -773,20 +1370,15 @@ CUIK_API TranslationUnit* cuik_parse_translation_unit(const Cuik_TranslationUnit
                         };
                         dyn_array_put(tu->top_level_stmts, n);
 
-                        Symbol* sym = find_global_symbol(tu, decl.name);
-                        Symbol* old_definition = sym;
-                        if (sym == NULL) {
-                            // slap that bad boy into the symbol table
-                            ptrdiff_t sym_index = nl_strmap_puti_cstr(tu->global_symbols, decl.name);
-                            sym = &tu->global_symbols[sym_index];
-                        }
+                        Symbol* old_definition = find_global_symbol(tu, decl.name);
 
-                        *sym = (Symbol){
-                            .name = decl.name,
-                            .type = decl.type,
-                            .loc = decl.loc,
-                            .stmt = n,
-                        };
+                        // slap that bad boy into the symbol table
+                        Symbol* sym = put_global_symbol(tu, decl.name, &(Symbol){
+                                .name = decl.name,
+                                .type = decl.type,
+                                .loc = decl.loc,
+                                .stmt = n,
+                            });
 
                         if (decl.type->kind == KIND_FUNC) {
                             sym->storage_class = (attr.is_static ? STORAGE_STATIC_FUNC : STORAGE_FUNC);
@@ -944,6 +1536,10 @@ CUIK_API TranslationUnit* cuik_parse_translation_unit(const Cuik_TranslationUnit
                             }
                         }
 
+                        if (sym->current != 0) {
+                            n->decl.token_count = s->current - sym->current;
+                        }
+
                         if (!requires_terminator) {
                             // function bodies just end the declaration list
                             break;
@@ -971,10 +1567,6 @@ CUIK_API TranslationUnit* cuik_parse_translation_unit(const Cuik_TranslationUnit
     }
     out_of_order_mode = false;
 
-    // synchronize the thread symbol tables
-    s_global_symbols = tu->global_symbols;
-    s_global_tags = tu->global_tags;
-
     if (has_reports(REPORT_ERROR, tu->errors)) goto parse_error;
 
     // Phase 2: resolve top level types, layout records and anything else so that
@@ -983,6 +1575,8 @@ CUIK_API TranslationUnit* cuik_parse_translation_unit(const Cuik_TranslationUnit
         ////////////////////////////////
         // first we wanna check for cycles
         ////////////////////////////////
+        type_arena_flush(tu);
+
         size_t type_count = 0;
         for (ArenaSegment* a = tu->type_arena.base; a != NULL; a = a->next) {
             for (size_t used = 0; used < a->used; used += sizeof(Cuik_Type)) {
@@ -1019,45 +1613,57 @@ CUIK_API TranslationUnit* cuik_parse_translation_unit(const Cuik_TranslationUnit
 
         if (has_reports(REPORT_ERROR, tu->errors)) goto parse_error;
 
-        // parse all global declarations
-        nl_strmap_for(i, tu->global_symbols) {
-            Symbol* sym = &tu->global_symbols[i];
+        // parse all global declarations, in source order so the diagnostics
+        // don't come out in whatever order the symbol table hashed them
+        Symbol** globals = HEAP_ALLOC((atom_map_count(tu->global_symbols) + 1) * sizeof(Symbol*));
+        size_t global_count = 0;
+        atom_map_for(it, tu->global_symbols) {
+            Symbol* sym = it.value;
 
             if (sym->current != 0 &&
                 (sym->storage_class == STORAGE_STATIC_VAR || sym->storage_class == STORAGE_GLOBAL)) {
-                // Spin up a mini parser here
-                TokenStream mini_lex = *s;
-                mini_lex.current = sym->current;
+                globals[global_count++] = sym;
+            }
+        }
+        qsort(globals, global_count, sizeof(Symbol*), compare_symbol_order);
 
-                // intitialize use list
-                symbol_chain_start = symbol_chain_current = NULL;
+        for (size_t i = 0; i < global_count; i++) {
+            Symbol* sym = globals[i];
 
-                Expr* e;
-                if (tokens_get(&mini_lex)->type == '@') {
-                    // function literals are a Cuik extension
-                    // TODO(NeGate): error messages
-                    tokens_next(&mini_lex);
+            // Spin up a mini parser here
+            TokenStream mini_lex = *s;
+            mini_lex.current = sym->current;
 
-                    e = parse_function_literal(tu, &mini_lex, sym->type);
-                } else if (tokens_get(&mini_lex)->type == '{') {
-                    tokens_next(&mini_lex);
+            // intitialize use list
+            symbol_chain_start = symbol_chain_current = NULL;
 
-                    e = parse_initializer(tu, &mini_lex, NULL);
-                } else {
-                    e = parse_expr_l14(tu, &mini_lex);
-                    expect(tu, &mini_lex, sym->terminator);
-                }
+            Expr* e;
+            if (tokens_get(&mini_lex)->type == '@') {
+                // function literals are a Cuik extension
+                // TODO(NeGate): error messages
+                tokens_next(&mini_lex);
 
-                sym->stmt->decl.initial = e;
+                e = parse_function_literal(tu, &mini_lex, sym->type);
+            } else if (tokens_get(&mini_lex)->type == '{') {
+                tokens_next(&mini_lex);
 
-                // finalize use list
-                sym->stmt->decl.first_symbol = symbol_chain_start;
+                e = parse_initializer(tu, &mini_lex, NULL);
+            } else {
+                e = parse_expr_l14(tu, &mini_lex);
+                expect(tu, &mini_lex, sym->terminator);
             }
+
+            sym->stmt->decl.initial = e;
+
+            // finalize use list
+            sym->stmt->decl.first_symbol = symbol_chain_start;
         }
+        HEAP_FREE(globals);
 
         if (has_reports(REPORT_ERROR, tu->errors)) goto parse_error;
 
         // do record layouts and shi
+        type_arena_flush(tu);
         for (ArenaSegment* a = tu->type_arena.base; a != NULL; a = a->next) {
             for (size_t used = 0; used < a->used; used += sizeof(Cuik_Type)) {
                 Cuik_Type* type = (Cuik_Type*)&a->data[used];
@@ -1114,93 +1720,44 @@ CUIK_API TranslationUnit* cuik_parse_translation_unit(const Cuik_TranslationUnit
     // Phase 3: resolve all expressions or function bodies
     // This part is parallel because im the fucking GOAT
     CUIK_TIMED_BLOCK("phase 3") {
-        // append any AST nodes we might've created in this thread
-        arena_trim(&local_ast_arena);
-        arena_append(&tu->ast_arena, &local_ast_arena);
-        local_ast_arena = (Arena){0};
+        // append any AST nodes and types we might've created in this thread, we
+        // might run other TUs' jobs while waiting so they can't stay here.
+        flush_local_ast_arena(tu);
+        type_arena_flush(tu);
 
         // allocate the local symbol tables
-        if (local_symbols == NULL) {
-            local_symbols = realloc(local_symbols, sizeof(Symbol) * MAX_LOCAL_SYMBOLS);
-            local_tags = realloc(local_tags, sizeof(TagEntry) * MAX_LOCAL_TAGS);
-        }
-
-        if (desc->thread_pool != NULL) {
-            // disabled until we change the tables to arenas
-            size_t count = nl_strmap_get_load(tu->global_symbols);
-            size_t padded = (count + (PARSE_MUNCH_SIZE - 1)) & ~(PARSE_MUNCH_SIZE - 1);
-
-            // passed to the threads to identify when things are done
-            atomic_size_t tasks_remaining = (count + (PARSE_MUNCH_SIZE - 1)) / PARSE_MUNCH_SIZE;
-            ParserTaskInfo* tasks = HEAP_ALLOC(sizeof(ParserTaskInfo) * tasks_remaining);
-
-            size_t j = 0;
-            for (size_t i = 0; i < padded; i += PARSE_MUNCH_SIZE) {
-                size_t limit = i + PARSE_MUNCH_SIZE;
-                if (limit > count) limit = count;
-
-                ParserTaskInfo* task = &tasks[j++];
-                *task = (ParserTaskInfo){
-                    .tasks_remaining = &tasks_remaining,
-                    .start = i,
-                    .end = limit
-                };
+        alloc_local_symbol_tables();
 
-                // share these bad boys with the other threads, we manage them still they
-                // just get limited access
-                task->tu = tu;
-                task->base_token_stream = s;
+        // mark everything the roots and global initializers point to, function bodies
+        // don't have symbol chains yet so we'll pick those up as they get parsed.
+        size_t stmt_count = dyn_array_length(tu->top_level_stmts);
+        for (size_t i = 0; i < stmt_count; i++) {
+            Stmt* restrict stmt = tu->top_level_stmts[i];
 
-                CUIK_CALL(desc->thread_pool, submit, phase3_parse_task, task);
+            if (stmt->decl.attrs.is_root) {
+                stmt->decl.attrs.is_used = true;
+                parser_mark_chain(stmt->decl.first_symbol);
             }
+        }
 
-            // since we can run more tasks on this thread (potentially those from other parser jobs)
-            // until the thread pool we should dettach our copies of the global symbol table
-            s_global_symbols = NULL;
-            s_global_tags = NULL;
-
-            // "highway robbery on steve jobs" job stealing amirite...
-            while (tasks_remaining != 0) {
-                CUIK_CALL(desc->thread_pool, work_one_job);
-            }
+        parse_function_bodies(tu, desc->thread_pool, s);
 
-            HEAP_FREE(tasks);
-        } else {
-            // single threaded mode
-            parse_global_symbols(tu, 0, nl_strmap__get_header(tu->global_symbols)->load, *s);
+        // nobody looks up globals by name after this, unless we're gonna reparse
+        if (!desc->incremental) {
+            atom_map_destroy(tu->global_symbols);
+            atom_map_destroy(tu->global_tags);
+            tu->global_symbols = NULL;
+            tu->global_tags = NULL;
         }
 
-        // detach it because we're cool people
-        tu->global_symbols = NULL;
-        tu->global_tags = NULL;
-
         if (has_reports(REPORT_ERROR, tu->errors)) goto parse_error;
 
-        // check for any qualified types and resolve them correctly
-        for (ArenaSegment* a = tu->type_arena.base; a != NULL; a = a->next) {
-            for (size_t used = 0; used < a->used; used += sizeof(Cuik_Type)) {
-                Cuik_Type* type = (Cuik_Type*)&a->data[used];
+        resolve_qualified_types(tu);
 
-                if (type->kind == KIND_QUALIFIED_TYPE) {
-                    bool is_atomic = type->is_atomic;
-                    bool is_const = type->is_const;
-                    int align = type->align;
-                    Atom aka = type->also_known_as;
-
-                    Cuik_Type* based = type->qualified_ty;
-
-                    // copy and replace the qualifier slots
-                    memcpy(type, based, sizeof(Cuik_Type));
-                    type->also_known_as = aka;
-                    type->based = based;
-                    type->align = align;
-                    type->is_const = is_const;
-                    type->is_atomic = is_atomic;
-                }
-            }
+        // reparsing diffs against the old tokens so the TU holds onto them
+        if (!desc->incremental) {
+            dyn_array_destroy(tu->tokens.tokens);
         }
-
-        dyn_array_destroy(tu->tokens.tokens);
     }
 
     #if 0
@@ -1210,33 +1767,14 @@ CUIK_API TranslationUnit* cuik_parse_translation_unit(const Cuik_TranslationUnit
     atoms_dump_stats();
     #endif
 
-    // output accumulated diagnostics
-    nl_strmap_for(i, tu->unresolved_symbols) {
-        Diag_UnresolvedSymbol* loc = tu->unresolved_symbols[i];
-        report_header(REPORT_ERROR, "could not resolve symbol: %s", loc->name);
-
-        DiagWriter d = diag_writer(&tu->tokens);
-        for (; loc != NULL; loc = loc->next) {
-            if (!diag_writer_is_compatible(&d, loc->loc)) {
-                // end line
-                diag_writer_done(&d);
-                d = diag_writer(&tu->tokens);
-            }
-
-            diag_writer_highlight(&d, loc->loc);
-        }
-        diag_writer_done(&d);
-        printf("\n");
-    }
-
     // if we have unresolved symbols we can't type check
-    if (nl_strmap_get_load(tu->unresolved_symbols) > 0) {
+    if (report_unresolved_symbols(tu)) {
         goto parse_error;
     }
 
     // run type checker
     CUIK_TIMED_BLOCK("phase 4") {
-        cuik__sema_pass(tu, NULL /* desc->thread_pool */);
+        cuik__sema_pass(tu, desc->thread_pool);
         if (has_reports(REPORT_ERROR, tu->errors)) goto parse_error;
     }
 
@@ -1251,12 +1789,141 @@ CUIK_API TranslationUnit* cuik_parse_translation_unit(const Cuik_TranslationUnit
         // free tokens
         dyn_array_destroy(tu->tokens.tokens);
 
+        type_arena_flush(tu);
         cuik_destroy_translation_unit(tu);
         if (cuik_is_profiling()) cuik_profile_region_end();
         return NULL;
     }
 }
 
+CUIK_API Cuik_ReparseStatus cuik_reparse_translation_unit(TranslationUnit* restrict tu, const Cuik_TranslationUnitDesc* restrict desc, Stmt*** out_dirty, size_t* out_dirty_count) {
+    assert(desc->tokens != NULL);
+    assert(desc->errors != NULL);
+    *out_dirty = NULL;
+    *out_dirty_count = 0;
+
+    // the TU didn't hold onto what we need to diff against
+    if (tu->global_symbols == NULL || tu->tokens.tokens == NULL) {
+        return CUIK_REPARSE_FULL;
+    }
+
+    if (cuik_is_profiling()) {
+        cuik_profile_region_start(cuik_time_in_nanos(), "reparse: %s", tu->filepath);
+    }
+
+    ReparseDiff diff;
+    bool same_shape;
+    CUIK_TIMED_BLOCK("reparse: diff") {
+        same_shape = reparse_diff(tu, desc->tokens, &diff);
+    }
+
+    if (!same_shape) {
+        reparse_diff_free(&diff);
+        if (cuik_is_profiling()) cuik_profile_region_end();
+        return CUIK_REPARSE_FULL;
+    }
+
+    memset(desc->errors, 0, sizeof(*desc->errors));
+    compact_ast_free(tu);
+    tls_init();
+    atoms_init();
+    reset_global_parser_state();
+
+    // changed bodies go back to being unparsed, so do the ones nobody used since
+    // we can't tell if sema looked at those.
+    for (size_t i = 0; i < diff.body_count; i++) {
+        Stmt* restrict s = diff.bodies[i].sym->stmt;
+        s->decl.token_count = diff.bodies[i].new_count;
+
+        if (diff.bodies[i].changed || s->op != STMT_FUNC_DECL || !s->decl.attrs.is_used) {
+            s->op = STMT_GLOBAL_DECL;
+            s->decl.initial_as_stmt = NULL;
+            s->decl.first_symbol = NULL;
+        }
+    }
+
+    CUIK_TIMED_BLOCK("reparse: remap") {
+        reparse_remap(tu, &diff);
+    }
+    reparse_diff_free(&diff);
+
+    // the TU takes over the new tokens
+    dyn_array_destroy(tu->tokens.tokens);
+    tu->tokens = *desc->tokens;
+    tu->errors = desc->errors;
+
+    // remember what sema has already seen
+    enum { WAS_FUNC = 1, WAS_USED = 2 };
+    size_t old_count = dyn_array_length(tu->top_level_stmts);
+    uint8_t* was = HEAP_ALLOC(old_count + 1);
+    for (size_t i = 0; i < old_count; i++) {
+        Stmt* restrict s = tu->top_level_stmts[i];
+        was[i] = (s->op == STMT_FUNC_DECL ? WAS_FUNC : 0) | (s->decl.attrs.is_used ? WAS_USED : 0);
+    }
+
+    alloc_local_symbol_tables();
+    if (pending_exprs) {
+        dyn_array_clear(pending_exprs);
+    } else {
+        pending_exprs = dyn_array_create(PendingExpr);
+    }
+
+    CUIK_TIMED_BLOCK("reparse: phase 3") {
+        parse_function_bodies(tu, desc->thread_pool, &tu->tokens);
+    }
+
+    if (has_reports(REPORT_ERROR, tu->errors) || report_unresolved_symbols(tu)) {
+        HEAP_FREE(was);
+        if (cuik_is_profiling()) cuik_profile_region_end();
+        return CUIK_REPARSE_ERROR;
+    }
+    resolve_qualified_types(tu);
+
+    // the new function literals are roots, anything they pull in is used now
+    size_t count = dyn_array_length(tu->top_level_stmts);
+    for (size_t i = old_count; i < count; i++) {
+        Stmt* restrict s = tu->top_level_stmts[i];
+        if (s->decl.attrs.is_root && !s->decl.attrs.is_used) {
+            s->decl.attrs.is_used = true;
+            parser_mark_chain(s->decl.first_symbol);
+        }
+    }
+
+    // the new bodies and the globals which just became used need to be type checked
+    // and have their IR generated, the rest of the TU is left as is.
+    Stmt** dirty = malloc((count + 1) * sizeof(Stmt*));
+    size_t dirty_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        Stmt* restrict s = tu->top_level_stmts[i];
+        uint8_t old = i < old_count ? was[i] : 0;
+
+        if (s->op == STMT_FUNC_DECL) {
+            if ((old & WAS_FUNC) == 0) dirty[dirty_count++] = s;
+        } else if (s->decl.attrs.is_used && (old & WAS_USED) == 0) {
+            if (!s->decl.attrs.is_typedef && s->decl.name != NULL) dirty[dirty_count++] = s;
+        }
+    }
+    HEAP_FREE(was);
+
+    // sema is allowed to shuffle the array so it gets a copy
+    Stmt** stmts = HEAP_ALLOC((dirty_count + 1) * sizeof(Stmt*));
+    memcpy(stmts, dirty, dirty_count * sizeof(Stmt*));
+    CUIK_TIMED_BLOCK("reparse: phase 4") {
+        cuik__sema_stmts(tu, desc->thread_pool, stmts, dirty_count);
+    }
+    HEAP_FREE(stmts);
+
+    if (cuik_is_profiling()) cuik_profile_region_end();
+    if (has_reports(REPORT_ERROR, tu->errors)) {
+        free(dirty);
+        return CUIK_REPARSE_ERROR;
+    }
+
+    *out_dirty = dirty;
+    *out_dirty_count = dirty_count;
+    return CUIK_REPARSE_OK;
+}
+
 CUIK_API void* cuik_set_translation_unit_user_data(TranslationUnit* restrict tu, void* ud) {
     void* old = tu->user_data;
     tu->user_data = ud;
@@ -1279,11 +1946,19 @@ CUIK_API void cuik_release_translation_unit(TranslationUnit* restrict tu) {
 }
 
 CUIK_API void cuik_destroy_translation_unit(TranslationUnit* restrict tu) {
+    compact_ast_free(tu);
     dyn_array_destroy(tu->top_level_stmts);
+    dyn_array_destroy(tu->tokens.tokens);
 
     arena_free(&tu->ast_arena);
     arena_free(&tu->type_arena);
+    atom_map_destroy(tu->global_symbols);
+    atom_map_destroy(tu->global_tags);
+    atom_map_destroy(tu->unresolved_symbols);
     mtx_destroy(&tu->arena_mutex);
+    mtx_destroy(&tu->layout_mutex);
+    mtx_destroy(&tu->type_interner.lock);
+    free(tu->type_interner.entries);
     free(tu);
 }
 
@@ -1337,22 +2012,13 @@ Stmt* resolve_unknown_symbol(TranslationUnit* tu, Expr* e) {
 
 static Symbol* find_local_symbol(TokenStream* restrict s) {
     Token* t = tokens_get(s);
-    const unsigned char* name = t->start;
-    size_t length = t->end - t->start;
-
-    // Try local variables
-    size_t i = local_symbol_count;
-    size_t start = local_symbol_start;
-    while (i-- > start) {
-        const char* sym = local_symbols[i].name;
-        size_t sym_length = strlen(sym);
-
-        if (sym_length == length && memcmp(name, sym, length) == 0) {
-            return &local_symbols[i];
-        }
-    }
+    Atom name = atoms_put(t->end - t->start, t->start);
 
-    return NULL;
+    // Try local variables, anything under the starting point belongs to
+    // the parent function and since the map only gives us the innermost
+    // one we know there's nothing visible past it either.
+    int i = local_name_map_get(&local_symbol_map, name);
+    return i >= local_symbol_start ? &local_symbols[i] : NULL;
 }
 
 ////////////////////////////////
@@ -1374,11 +2040,11 @@ static void parse_function_definition(TranslationUnit* tu, TokenStream* restrict
         Param* p = &param_list[i];
 
         if (p->name) {
-            local_symbols[local_symbol_count++] = (Symbol){
+            push_local_symbol((Symbol){
                 .name = p->name,
                 .type = p->type,
                 .storage_class = STORAGE_PARAM,
-                .param_num = i};
+                .param_num = i});
         }
     }
 
@@ -1912,11 +2578,11 @@ static void parse_decl_or_expr(TranslationUnit* tu, TokenStream* restrict s, siz
                     abort();
                 }
 
-                local_symbols[local_symbol_count++] = (Symbol){
+                push_local_symbol((Symbol){
                     .name = decl.name,
                     .type = decl.type,
                     .storage_class = STORAGE_TYPEDEF,
-                };
+                });
             }
 
             expect(tu, s, ';');
@@ -1955,12 +2621,12 @@ static void parse_decl_or_expr(TranslationUnit* tu, TokenStream* restrict s, siz
                     abort();
                 }
 
-                local_symbols[local_symbol_count++] = (Symbol){
+                push_local_symbol((Symbol){
                     .name = decl.name,
                     .type = decl.type,
                     .storage_class = STORAGE_LOCAL,
                     .stmt = n,
-                };
+                });
 
                 Expr* initial = 0;
                 if (tokens_get(s)->type == '=') {
@@ -7,6 +7,7 @@
 #include <dyn_array.h>
 
 #include "atoms.h"
+#include "atom_map.h"
 #include "../common.h"
 #include "../arena.h"
 #include "../diagnostic.h"
@@ -33,6 +34,55 @@ typedef struct Decl {
     SourceLocIndex loc;
 } Decl;
 
+// derived types are hash consed so the same pointer or qualified type
+// doesn't get materialized every time someone writes it out.
+typedef struct TypeInternEntry {
+    Cuik_TypeKind kind;
+    uint8_t quals;
+    int count;
+    Cuik_Type* base;
+
+    // NULL if the slot is empty
+    Cuik_Type* type;
+} TypeInternEntry;
+
+typedef struct TypeInterner {
+    mtx_t lock;
+
+    size_t capacity, count;
+    TypeInternEntry* entries;
+} TypeInterner;
+
+typedef struct RecordEntry {
+    Member* member;
+    // position as far as positional initializers are concerned, only
+    // named members tick it.
+    int index;
+    // relative to the start of the record
+    int offset;
+} RecordEntry;
+
+// the members of a record with the anonymous records expanded in place (the
+// anonymous record itself comes right before its members) so initializers can
+// find their members without walking the member tree every time.
+typedef struct RecordIndex {
+    // how many initializer slots the record has
+    int bounds;
+    int named_count;
+
+    int entry_count;
+    RecordEntry* entries;
+
+    // position -> first entry with that index, first_leaf skips the anonymous records.
+    // both are -1 if there's no such entry.
+    int* first_entry;
+    int* first_leaf;
+
+    // open addressed table of entries keyed by member name (first one wins), -1 is empty
+    size_t name_mask;
+    int* names;
+} RecordIndex;
+
 typedef enum StorageClass {
     STORAGE_NONE,
 
@@ -105,23 +155,33 @@ struct TranslationUnit {
     // common settings
     bool is_windows_long;
     bool has_tb_debug_info;
+    bool check_unreachable;
 
     Cuik_Entrypoint entrypoint_status;
     Cuik_Target target;
 
     mtx_t arena_mutex;
     Arena ast_arena;
+
+    // held while laying out types, it's recursive since records lay out their members
+    mtx_t layout_mutex;
     Arena type_arena;
+    TypeInterner type_interner;
 
     // DynArray(Stmt*)
     Stmt** top_level_stmts;
 
-    mtx_t diag_mutex;
-    NL_Strmap(Diag_UnresolvedSymbol*) unresolved_symbols;
+    // built on demand by cuik_get_compact_ast, NULL until then
+    Cuik_CompactAST* compact;
+
+    // Atom -> Diag_UnresolvedSymbol*
+    AtomMap* unresolved_symbols;
 
-    // parser state
-    NL_Strmap(Cuik_Type*) global_tags;
-    NL_Strmap(Symbol) global_symbols;
+    // parser state, these are shared by all the parser threads.
+    //   Atom -> Cuik_Type*
+    AtomMap* global_tags;
+    //   Atom -> Symbol*
+    AtomMap* global_symbols;
 };
 
 // builtin types at the start of the type table
@@ -142,27 +202,109 @@ enum {
 };
 extern Cuik_Type builtin_types[BUILTIN_TYPE_COUNT];
 
+// pointers, qualified types and arrays with a known count are interned so don't
+// modify the result, use copy_type if you need your own.
 Cuik_Type* new_func(TranslationUnit* tu);
 Cuik_Type* new_enum(TranslationUnit* tu);
 Cuik_Type* new_blank_type(TranslationUnit* tu);
 Cuik_Type* new_qualified_type(TranslationUnit* tu, Cuik_Type* base, bool is_atomic, bool is_const);
 Cuik_Type* new_record(TranslationUnit* tu, bool is_union);
 Cuik_Type* copy_type(TranslationUnit* tu, Cuik_Type* base);
+
+// registers a pointer, array or resolved qualified type which didn't come from the
+// new_* functions (like the ones loaded from an AST cache) so those share it from now on.
+void intern_cached_type(TranslationUnit* tu, Cuik_Type* type);
 Cuik_Type* new_pointer(TranslationUnit* tu, Cuik_Type* base);
+Cuik_Type* new_qualified_pointer(TranslationUnit* tu, Cuik_Type* base, bool is_atomic, bool is_restrict);
 Cuik_Type* new_typeof(TranslationUnit* tu, Expr* src);
 Cuik_Type* new_array(TranslationUnit* tu, Cuik_Type* base, int count);
 Cuik_Type* new_vector(TranslationUnit* tu, Cuik_Type* base, int count);
 Cuik_Type* get_common_type(TranslationUnit* tu, Cuik_Type* ty1, Cuik_Type* ty2);
+
+// what the global symbol of a cached declaration needs on top of the statement,
+// type is the typedef's own named copy (NULL for everything else) and current is
+// where its body or initializer is in the tokens (0 if it doesn't have one).
+typedef struct {
+    Cuik_Type* type;
+    int current;
+    int terminator;
+} AstCacheSymbol;
+
+typedef struct {
+    Cuik_Type** types;
+    size_t type_count;
+
+    // one per declaration it added to the top level statements
+    AstCacheSymbol* symbols;
+} AstCacheImport;
+
+// loads the declarations from cuik_serialize_translation_unit into the TU's top
+// level statements, the TU's tokens have to start with the ones it was made from
+// and current has to be right after them. returns false if the data is bad or
+// doesn't match, otherwise the arrays in out have to be HEAP_FREE'd.
+bool ast_cache_import(TranslationUnit* tu, const void* data, size_t size, AstCacheImport* out);
+
+// how the new tokens line up against the old ones for cuik_reparse_translation_unit,
+// everything outside of the function bodies is the same so only the bodies move.
+typedef struct ReparseBody {
+    Symbol* sym;
+
+    // where the body ('{' through '}') is in the new tokens
+    int new_start, new_count;
+    bool changed;
+} ReparseBody;
+
+typedef struct ReparseDiff {
+    size_t body_count;
+    ReparseBody* bodies;
+
+    // old token index -> new token index, -1 if it's in a changed body
+    size_t token_count;
+    int* token_map;
+
+    // old location -> new location, 0 if it's gone
+    size_t loc_count;
+    SourceLocIndex* loc_map;
+
+    // start of each old string literal token -> the new one, sorted by old start
+    size_t string_count;
+    struct ReparseString* strings;
+} ReparseDiff;
+
+// lines the new tokens up against the TU's tokens, returns false if something
+// outside of a function body changed.
+bool reparse_diff(TranslationUnit* tu, const TokenStream* tokens, ReparseDiff* out);
+// points all the source locations and token positions which survive the reparse
+// at the new tokens, the bodies being thrown away should be reset beforehand.
+// function literals from the surviving bodies are put back on the top level.
+void reparse_remap(TranslationUnit* tu, ReparseDiff* diff);
+void reparse_diff_free(ReparseDiff* diff);
+
+// frees the TU's compact AST (if it has one) so it's rebuilt next time it's asked for
+void compact_ast_free(TranslationUnit* restrict tu);
+
+// moves the types this thread made into the TU's type arena, has to be called
+// before the thread moves onto another TU and before walking the type arena.
+void type_arena_flush(TranslationUnit* tu);
 bool type_equal(TranslationUnit* tu, Cuik_Type* a, Cuik_Type* b);
 size_t type_as_string(TranslationUnit* tu, size_t max_len, char* buffer, Cuik_Type* type_index);
 
-// is needs_complete is false then the size and alignment don't need to be non-zero
+// is needs_complete is false then the size and alignment don't need to be non-zero.
+// it's safe to call from any thread, records which were only forward declared are
+// left alone (they stay is_incomplete with a size of 0).
 void type_layout(TranslationUnit* restrict tu, Cuik_Type* type, bool needs_complete);
 
+// returns the flattened member index of a struct or union, it's built by type_layout.
+// NULL if the record is incomplete.
+RecordIndex* type_get_record_index(TranslationUnit* restrict tu, Cuik_Type* type);
+int type_find_record_entry(RecordIndex* restrict idx, Atom name);
+
 Stmt* resolve_unknown_symbol(TranslationUnit* tu, Expr* e);
 bool const_eval_try_offsetof_hack(TranslationUnit* tu, const Expr* e, uint64_t* out);
 
 Expr* cuik__optimize_ast(TranslationUnit* tu, Expr* e);
 // if thread_pool is NULL, the semantics are done single threaded
 void cuik__sema_pass(TranslationUnit* restrict tu, Cuik_IThreadpool* restrict thread_pool);
+// type checks just the given top level statements, the array might get reordered
+void cuik__sema_stmts(TranslationUnit* restrict tu, Cuik_IThreadpool* restrict thread_pool, Stmt** stmts, size_t count);
 void cuik__function_analysis(TranslationUnit* restrict tu, Stmt* restrict s);
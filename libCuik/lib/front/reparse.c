@@ -0,0 +1,470 @@
+// Incremental reparsing for cuik_reparse_translation_unit. The new tokens are lined
+// up against the old ones one function body at a time and everything outside of the
+// bodies has to match exactly, that way the types, globals and the symbol tables can
+// all stay as they are. Bodies which didn't change keep their AST too, we just point
+// their source locations (and any string literals sema hasn't copied yet) at the new
+// tokens.
+#include "parser.h"
+
+struct ReparseString {
+    const unsigned char* old_start;
+    const unsigned char* new_start;
+    const unsigned char* new_end;
+};
+
+// everything we need to touch up, the AST isn't strictly a tree (case labels, shared
+// attribute lists, struct copies sharing their members) so we collect the addresses
+// first and remap each one once.
+typedef struct {
+    DynArray(SourceLocIndex*) locs;
+    DynArray(int*) positions;
+    DynArray(Expr*) strings;
+    DynArray(Stmt*) literals;
+} RemapWalk;
+
+// hit_line is only for the preprocessor, the parser doesn't care about whitespace
+static bool token_equals(const Token* a, const Token* b) {
+    if (a->type != b->type) return false;
+
+    size_t len = a->end - a->start;
+    return len == (size_t)(b->end - b->start) && (len == 0 || memcmp(a->start, b->start, len) == 0);
+}
+
+static bool is_string_token(const Token* t) {
+    return t->type == TOKEN_STRING_DOUBLE_QUOTE || t->type == TOKEN_STRING_WIDE_DOUBLE_QUOTE;
+}
+
+static int compare_body_start(const void* a, const void* b) {
+    int a_start = ((const ReparseBody*) a)->sym->current;
+    int b_start = ((const ReparseBody*) b)->sym->current;
+    return (a_start > b_start) - (a_start < b_start);
+}
+
+static int compare_string_start(const void* a, const void* b) {
+    const unsigned char* a_start = ((const struct ReparseString*) a)->old_start;
+    const unsigned char* b_start = ((const struct ReparseString*) b)->old_start;
+    return (a_start > b_start) - (a_start < b_start);
+}
+
+static int compare_ptr(const void* a, const void* b) {
+    uintptr_t a_ptr = (uintptr_t) *(void**) a;
+    uintptr_t b_ptr = (uintptr_t) *(void**) b;
+    return (a_ptr > b_ptr) - (a_ptr < b_ptr);
+}
+
+// sorts the pointers and drops the duplicates, returns the new count
+static size_t sort_unique_ptrs(void** ptrs, size_t count) {
+    if (count == 0) return 0;
+    qsort(ptrs, count, sizeof(void*), compare_ptr);
+
+    size_t j = 1;
+    for (size_t i = 1; i < count; i++) {
+        if (ptrs[i] != ptrs[j - 1]) ptrs[j++] = ptrs[i];
+    }
+    return j;
+}
+
+static void map_token(ReparseDiff* restrict d, const Token* old_tokens, const Token* new_tokens, size_t i, size_t j) {
+    d->token_map[i] = j;
+    d->loc_map[old_tokens[i].location] = new_tokens[j].location;
+
+    if (is_string_token(&old_tokens[i])) {
+        d->strings[d->string_count++] = (struct ReparseString){
+            old_tokens[i].start, new_tokens[j].start, new_tokens[j].end
+        };
+    }
+}
+
+bool reparse_diff(TranslationUnit* tu, const TokenStream* tokens, ReparseDiff* out) {
+    *out = (ReparseDiff){ 0 };
+
+    const Token* old_tokens = tu->tokens.tokens;
+    const Token* new_tokens = tokens->tokens;
+    size_t old_count = dyn_array_length(old_tokens);
+    size_t new_count = dyn_array_length(new_tokens);
+
+    // every function body we skipped over in phase 1, in the order they show up
+    out->bodies = HEAP_ALLOC((atom_map_count(tu->global_symbols) + 1) * sizeof(ReparseBody));
+    atom_map_for(it, tu->global_symbols) {
+        Symbol* sym = it.value;
+
+        if ((sym->storage_class == STORAGE_STATIC_FUNC || sym->storage_class == STORAGE_FUNC) &&
+            sym->current != 0 && sym->terminator == '}') {
+            out->bodies[out->body_count++] = (ReparseBody){ .sym = sym };
+        }
+    }
+    qsort(out->bodies, out->body_count, sizeof(ReparseBody), compare_body_start);
+
+    size_t string_cap = 0;
+    for (size_t i = 0; i < old_count; i++) {
+        if (old_tokens[i].location >= out->loc_count) out->loc_count = old_tokens[i].location + 1;
+        string_cap += is_string_token(&old_tokens[i]);
+    }
+
+    out->token_count = old_count;
+    out->token_map = HEAP_ALLOC((old_count + 1) * sizeof(int));
+    memset(out->token_map, 0xFF, (old_count + 1) * sizeof(int));
+
+    out->loc_map = HEAP_ALLOC((out->loc_count + 1) * sizeof(SourceLocIndex));
+    memset(out->loc_map, 0, (out->loc_count + 1) * sizeof(SourceLocIndex));
+
+    out->strings = HEAP_ALLOC((string_cap + 1) * sizeof(struct ReparseString));
+
+    size_t i = 0, j = 0;
+    for (size_t b = 0;; b++) {
+        // the declarations between the bodies have to match token for token
+        size_t end = b < out->body_count ? (size_t) out->bodies[b].sym->current : old_count;
+        if (end < i || j + (end - i) > new_count) return false;
+
+        for (; i < end; i++, j++) {
+            if (!token_equals(&old_tokens[i], &new_tokens[j])) return false;
+            map_token(out, old_tokens, new_tokens, i, j);
+        }
+
+        if (b == out->body_count) break;
+
+        ReparseBody* restrict body = &out->bodies[b];
+        size_t old_len = body->sym->stmt->decl.token_count;
+        if (old_len < 2 || i + old_len > old_count) return false;
+
+        // balance some brackets to find where the body ends now
+        if (j >= new_count || new_tokens[j].type != '{') return false;
+
+        size_t k = j + 1;
+        for (int depth = 1; depth;) {
+            if (k >= new_count || new_tokens[k].type == 0) return false;
+
+            if (new_tokens[k].type == '{') depth++;
+            else if (new_tokens[k].type == '}') depth--;
+            k++;
+        }
+
+        size_t new_len = k - j;
+        body->new_start = j;
+        body->new_count = new_len;
+        body->changed = (old_len != new_len);
+        for (size_t l = 0; l < old_len && !body->changed; l++) {
+            body->changed = !token_equals(&old_tokens[i + l], &new_tokens[j + l]);
+        }
+
+        if (body->changed) {
+            // the AST is thrown away so only the braces line up
+            map_token(out, old_tokens, new_tokens, i, j);
+            map_token(out, old_tokens, new_tokens, i + old_len - 1, j + new_len - 1);
+        } else {
+            for (size_t l = 0; l < old_len; l++) {
+                map_token(out, old_tokens, new_tokens, i + l, j + l);
+            }
+        }
+
+        i += old_len, j += new_len;
+    }
+
+    if (j != new_count) return false;
+
+    qsort(out->strings, out->string_count, sizeof(struct ReparseString), compare_string_start);
+    return true;
+}
+
+void reparse_diff_free(ReparseDiff* diff) {
+    HEAP_FREE(diff->bodies);
+    HEAP_FREE(diff->token_map);
+    HEAP_FREE(diff->loc_map);
+    HEAP_FREE(diff->strings);
+    *diff = (ReparseDiff){ 0 };
+}
+
+static void remap_walk_expr(RemapWalk* restrict w, Expr* e);
+static void remap_walk_stmt(RemapWalk* restrict w, Stmt* s);
+
+static InitNode* remap_walk_init(RemapWalk* restrict w, InitNode* n) {
+    dyn_array_put(w->locs, &n->loc);
+    remap_walk_expr(w, n->expr);
+
+    // the kids are right after us
+    InitNode* kid = n + 1;
+    for (int i = 0; i < n->kids_count; i++) {
+        kid = remap_walk_init(w, kid);
+    }
+    return kid;
+}
+
+static void remap_walk_expr(RemapWalk* restrict w, Expr* e) {
+    if (e == NULL) return;
+
+    dyn_array_put(w->locs, &e->start_loc);
+    dyn_array_put(w->locs, &e->end_loc);
+
+    switch (e->op) {
+        case EXPR_STR:
+        case EXPR_WSTR:
+        dyn_array_put(w->strings, e);
+        break;
+
+        case EXPR_FUNCTION:
+        dyn_array_put(w->literals, e->func.src);
+        remap_walk_stmt(w, e->func.src);
+        break;
+
+        case EXPR_INITIALIZER: {
+            InitNode* n = e->init.nodes;
+            for (int i = 0; i < e->init.count; i++) {
+                n = remap_walk_init(w, n);
+            }
+            break;
+        }
+
+        case EXPR_GENERIC:
+        remap_walk_expr(w, e->generic_.controlling_expr);
+        for (int i = 0; i < e->generic_.case_count; i++) {
+            remap_walk_expr(w, e->generic_.cases[i].value);
+        }
+        break;
+
+        case EXPR_CALL:
+        remap_walk_expr(w, e->call.target);
+        for (int i = 0; i < e->call.param_count; i++) {
+            remap_walk_expr(w, e->call.param_start[i]);
+        }
+        break;
+
+        case EXPR_TERNARY:
+        remap_walk_expr(w, e->ternary_op.left);
+        remap_walk_expr(w, e->ternary_op.middle);
+        remap_walk_expr(w, e->ternary_op.right);
+        break;
+
+        case EXPR_SUBSCRIPT:
+        remap_walk_expr(w, e->subscript.base);
+        remap_walk_expr(w, e->subscript.index);
+        break;
+
+        case EXPR_DOT:
+        case EXPR_ARROW:
+        case EXPR_DOT_R:
+        case EXPR_ARROW_R:
+        remap_walk_expr(w, e->dot_arrow.base);
+        break;
+
+        case EXPR_SIZEOF:
+        case EXPR_ALIGNOF:
+        remap_walk_expr(w, e->x_of_expr.expr);
+        break;
+
+        case EXPR_VA_ARG:
+        case EXPR_CAST:
+        case EXPR_NOT:
+        case EXPR_ADDR:
+        case EXPR_DEREF:
+        case EXPR_NEGATE:
+        case EXPR_PRE_INC:
+        case EXPR_PRE_DEC:
+        case EXPR_POST_INC:
+        case EXPR_POST_DEC:
+        case EXPR_LOGICAL_NOT:
+        remap_walk_expr(w, e->unary_op.src);
+        break;
+
+        case EXPR_COMMA:
+        case EXPR_PTRADD:
+        case EXPR_PTRSUB:
+        case EXPR_PTRDIFF:
+        case EXPR_LOGICAL_AND:
+        case EXPR_LOGICAL_OR:
+        case EXPR_PLUS:
+        case EXPR_MINUS:
+        case EXPR_TIMES:
+        case EXPR_SLASH:
+        case EXPR_PERCENT:
+        case EXPR_AND:
+        case EXPR_OR:
+        case EXPR_XOR:
+        case EXPR_SHL:
+        case EXPR_SHR:
+        case EXPR_CMPEQ:
+        case EXPR_CMPNE:
+        case EXPR_CMPGT:
+        case EXPR_CMPGE:
+        case EXPR_CMPLT:
+        case EXPR_CMPLE:
+        case EXPR_ASSIGN:
+        case EXPR_PLUS_ASSIGN:
+        case EXPR_MINUS_ASSIGN:
+        case EXPR_TIMES_ASSIGN:
+        case EXPR_SLASH_ASSIGN:
+        case EXPR_PERCENT_ASSIGN:
+        case EXPR_AND_ASSIGN:
+        case EXPR_OR_ASSIGN:
+        case EXPR_XOR_ASSIGN:
+        case EXPR_SHL_ASSIGN:
+        case EXPR_SHR_ASSIGN:
+        remap_walk_expr(w, e->bin_op.left);
+        remap_walk_expr(w, e->bin_op.right);
+        break;
+
+        // leaves, symbols point at declarations which are walked on their own
+        default: break;
+    }
+}
+
+static void remap_walk_stmt(RemapWalk* restrict w, Stmt* s) {
+    if (s == NULL) return;
+
+    dyn_array_put(w->locs, &s->loc);
+    dyn_array_put(w->locs, &s->end_loc);
+
+    switch (s->op) {
+        case STMT_COMPOUND:
+        for (int i = 0; i < s->compound.kids_count; i++) {
+            remap_walk_stmt(w, s->compound.kids[i]);
+        }
+        break;
+
+        case STMT_DECL:
+        case STMT_GLOBAL_DECL:
+        case STMT_FUNC_DECL:
+        for (Cuik_Attribute* a = s->attr_list; a != NULL; a = a->prev) {
+            dyn_array_put(w->locs, &a->start_loc);
+            dyn_array_put(w->locs, &a->end_loc);
+        }
+
+        if (s->op == STMT_FUNC_DECL) {
+            remap_walk_stmt(w, s->decl.initial_as_stmt);
+        } else if (s->decl.type == NULL || s->decl.type->kind != KIND_FUNC) {
+            remap_walk_expr(w, s->decl.initial);
+        }
+        break;
+
+        case STMT_EXPR: remap_walk_expr(w, s->expr.expr); break;
+        case STMT_RETURN: remap_walk_expr(w, s->return_.expr); break;
+        case STMT_GOTO: remap_walk_expr(w, s->goto_.target); break;
+
+        case STMT_IF:
+        remap_walk_expr(w, s->if_.cond);
+        remap_walk_stmt(w, s->if_.body);
+        remap_walk_stmt(w, s->if_.next);
+        break;
+
+        case STMT_WHILE:
+        remap_walk_expr(w, s->while_.cond);
+        remap_walk_stmt(w, s->while_.body);
+        break;
+
+        case STMT_DO_WHILE:
+        remap_walk_expr(w, s->do_while.cond);
+        remap_walk_stmt(w, s->do_while.body);
+        break;
+
+        case STMT_FOR:
+        remap_walk_stmt(w, s->for_.first);
+        remap_walk_expr(w, s->for_.cond);
+        remap_walk_stmt(w, s->for_.body);
+        remap_walk_expr(w, s->for_.next);
+        break;
+
+        // the case chains go through the switch body anyways
+        case STMT_SWITCH:
+        remap_walk_expr(w, s->switch_.condition);
+        remap_walk_stmt(w, s->switch_.body);
+        break;
+
+        case STMT_CASE: remap_walk_stmt(w, s->case_.body); break;
+        case STMT_DEFAULT: remap_walk_stmt(w, s->default_.body); break;
+
+        default: break;
+    }
+}
+
+static void remap_walk_types(RemapWalk* restrict w, TranslationUnit* tu) {
+    for (ArenaSegment* a = tu->type_arena.base; a != NULL; a = a->next) {
+        for (size_t used = 0; used < a->used; used += sizeof(Cuik_Type)) {
+            Cuik_Type* type = (Cuik_Type*)&a->data[used];
+            dyn_array_put(w->locs, &type->loc);
+
+            if (type->kind == KIND_STRUCT || type->kind == KIND_UNION) {
+                for (int i = 0; i < type->record.kid_count; i++) {
+                    dyn_array_put(w->locs, &type->record.kids[i].loc);
+                }
+            } else if (type->kind == KIND_ENUM) {
+                for (int i = 0; i < type->enumerator.count; i++) {
+                    dyn_array_put(w->positions, &type->enumerator.entries[i].lexer_pos);
+                }
+            } else if (type->kind == KIND_ARRAY) {
+                dyn_array_put(w->positions, &type->array_count_lexer_pos);
+            }
+        }
+    }
+}
+
+void reparse_remap(TranslationUnit* tu, ReparseDiff* diff) {
+    RemapWalk w = {
+        .locs = dyn_array_create(SourceLocIndex*),
+        .positions = dyn_array_create(int*),
+        .strings = dyn_array_create(Expr*),
+        .literals = dyn_array_create(Stmt*),
+    };
+
+    // function literals are rediscovered from the bodies we keep, the rest go
+    // down with the old bodies.
+    size_t count = 0;
+    dyn_array_for(i, tu->top_level_stmts) {
+        Stmt* s = tu->top_level_stmts[i];
+        if (s->op == STMT_FUNC_DECL && s->decl.name == NULL) continue;
+
+        tu->top_level_stmts[count++] = s;
+    }
+    dyn_array_set_length(tu->top_level_stmts, count);
+
+    for (size_t i = 0; i < count; i++) {
+        remap_walk_stmt(&w, tu->top_level_stmts[i]);
+    }
+
+    type_arena_flush(tu);
+    remap_walk_types(&w, tu);
+
+    atom_map_for(it, tu->global_symbols) {
+        Symbol* sym = it.value;
+        dyn_array_put(w.locs, &sym->loc);
+        dyn_array_put(w.positions, &sym->current);
+    }
+
+    size_t loc_count = sort_unique_ptrs((void**) w.locs, dyn_array_length(w.locs));
+    for (size_t i = 0; i < loc_count; i++) {
+        SourceLocIndex* loc = w.locs[i];
+        *loc = *loc < diff->loc_count ? diff->loc_map[*loc] : 0;
+    }
+
+    // token positions, zero means there's nothing to parse later
+    size_t pos_count = sort_unique_ptrs((void**) w.positions, dyn_array_length(w.positions));
+    for (size_t i = 0; i < pos_count; i++) {
+        int* pos = w.positions[i];
+        if (*pos > 0 && (size_t) *pos < diff->token_count && diff->token_map[*pos] >= 0) {
+            *pos = diff->token_map[*pos];
+        } else {
+            *pos = 0;
+        }
+    }
+
+    // the string literals sema hasn't gotten to still point into the old source
+    size_t str_count = sort_unique_ptrs((void**) w.strings, dyn_array_length(w.strings));
+    for (size_t i = 0; i < str_count; i++) {
+        Expr* e = w.strings[i];
+
+        struct ReparseString key = { .old_start = e->str.start };
+        struct ReparseString* str = bsearch(&key, diff->strings, diff->string_count, sizeof(struct ReparseString), compare_string_start);
+        if (str != NULL) {
+            e->str.start = str->new_start;
+            e->str.end = str->new_end;
+        }
+    }
+
+    size_t literal_count = sort_unique_ptrs((void**) w.literals, dyn_array_length(w.literals));
+    for (size_t i = 0; i < literal_count; i++) {
+        dyn_array_put(tu->top_level_stmts, w.literals[i]);
+    }
+
+    dyn_array_destroy(w.locs);
+    dyn_array_destroy(w.positions);
+    dyn_array_destroy(w.strings);
+    dyn_array_destroy(w.literals);
+}
@@ -4,12 +4,15 @@
 #include <stdarg.h>
 #include <targets/targets.h>
 
-#define SEMA_MUNCH_SIZE (131072)
+// how many tokens worth of declarations go into one sema task
+#define SEMA_TASK_QUANTUM (16384)
 
 typedef struct {
     // shared state, every run of sema_task will decrement this by one
     atomic_size_t* tasks_remaining;
-    size_t start, end;
+
+    Stmt** stmts;
+    size_t count;
     TranslationUnit* tu;
 } SemaTaskInfo;
 
@@ -238,7 +241,7 @@ typedef struct {
 //   int a[6]
 //
 // would be 6 and scalars are just 1
-static int compute_initializer_bounds(Cuik_Type* type) {
+static int compute_initializer_bounds(TranslationUnit* tu, Cuik_Type* type) {
     // Identify boundaries:
     //   Scalar types are 1
     //   Records depend on the member count
@@ -246,27 +249,10 @@ static int compute_initializer_bounds(Cuik_Type* type) {
     //
     switch (type->kind) {
         case KIND_UNION:
-        case KIND_STRUCT: {
-            size_t bounds = 0;
-
-            Member* kids = type->record.kids;
-            size_t count = type->record.kid_count;
-
-            // it should never be less than the original size since records
-            // can't be empty
-            bounds += count;
-
-            for (size_t i = 0; i < count; i++) {
-                Member* member = &kids[i];
-
-                // unnamed members can be used
-                if (member->name == NULL && (member->type->kind == KIND_STRUCT || member->type->kind == KIND_UNION)) {
-                    bounds += compute_initializer_bounds(member->type) - 1;
-                }
-            }
-
-            return bounds;
-        }
+        case KIND_STRUCT:
+        // unnamed members can be used so those get expanded, the
+        // record index has it precomputed
+        return type_get_record_index(tu, type)->bounds;
 
         case KIND_ARRAY:
         return type->array_count;
@@ -276,62 +262,32 @@ static int compute_initializer_bounds(Cuik_Type* type) {
     }
 }
 
-static InitSearchResult find_member_by_name(Cuik_Type* type, const char* name, int* base_index, int offset) {
-    Member* kids = type->record.kids;
-    size_t count = type->record.kid_count;
+static InitSearchResult find_member_by_name(TranslationUnit* tu, Cuik_Type* type, Atom name) {
+    RecordIndex* idx = type_get_record_index(tu, type);
 
-    for (size_t i = 0; i < count; i++) {
-        Member* member = &kids[i];
-
-        if (member->name != NULL) {
-            if (cstr_equals(name, member->name)) {
-                return (InitSearchResult){member, *base_index, offset + member->offset};
-            }
-
-            // only named members actually count to the indices
-            *base_index += 1;
-        } else if (member->type->kind == KIND_STRUCT || member->type->kind == KIND_UNION) {
-            InitSearchResult search = find_member_by_name(member->type, name, base_index, offset + member->offset);
-            if (search.member != NULL) {
-                return search;
-            }
-        }
+    int i = type_find_record_entry(idx, name);
+    if (i < 0) {
+        return (InitSearchResult){0};
     }
 
-    return (InitSearchResult){0};
+    RecordEntry* e = &idx->entries[i];
+    return (InitSearchResult){e->member, e->index, e->offset};
 }
 
-static InitSearchResult get_next_member_in_type(Cuik_Type* type, int target, int* base_index, int offset, bool stop_at_struct) {
-    Member* kids = type->record.kids;
-    size_t count = type->record.kid_count;
-
-    for (size_t i = 0; i < count; i++) {
-        Member* member = &kids[i];
-
-        // check kids
-        if (member->name == NULL && (member->type->kind == KIND_STRUCT || member->type->kind == KIND_UNION)) {
-            if (stop_at_struct && *base_index == target) {
-                return (InitSearchResult){member, *base_index, offset + member->offset};
-            }
-
-            InitSearchResult search = get_next_member_in_type(
-                member->type, target, base_index, offset + member->offset, stop_at_struct
-            );
-
-            if (search.member != NULL) {
-                return search;
-            }
-        } else if (*base_index == target) {
-            return (InitSearchResult){member, *base_index, offset + member->offset};
-        }
+// if stop_at_struct is set, unnamed records can be returned instead of their first member
+static InitSearchResult get_next_member_in_type(TranslationUnit* tu, Cuik_Type* type, int target, bool stop_at_struct) {
+    RecordIndex* idx = type_get_record_index(tu, type);
+    if (target < 0 || target > idx->named_count) {
+        return (InitSearchResult){0};
+    }
 
-        if (member->name != NULL) {
-            // only named members actually count to the indices
-            *base_index += 1;
-        }
+    int i = stop_at_struct ? idx->first_entry[target] : idx->first_leaf[target];
+    if (i < 0) {
+        return (InitSearchResult){0};
     }
 
-    return (InitSearchResult){0};
+    RecordEntry* e = &idx->entries[i];
+    return (InitSearchResult){e->member, e->index, e->offset};
 }
 
 static InitNode* walk_initializer_layer(
@@ -352,8 +308,7 @@ static InitNode* walk_initializer_layer(
             return NULL;
         }
 
-        int index = 0;
-        InitSearchResult search = find_member_by_name(parent, node->member_name, &index, 0);
+        InitSearchResult search = find_member_by_name(tu, parent, node->member_name);
         if (search.member == NULL) {
             REPORT(ERROR, node->loc, "could not find member '%s' in record", node->member_name);
             return NULL;
@@ -389,8 +344,7 @@ static InitNode* walk_initializer_layer(
     // everything else is trivial
     if (type == NULL) {
         if (parent->kind == KIND_STRUCT || parent->kind == KIND_UNION) {
-            int index = 0;
-            InitSearchResult search = get_next_member_in_type(parent, *cursor - 1, &index, 0, node->kids_count > 0);
+            InitSearchResult search = get_next_member_in_type(tu, parent, *cursor - 1, node->kids_count > 0);
             assert(search.member != NULL);
 
             type = search.member->type;
@@ -408,8 +362,11 @@ static InitNode* walk_initializer_layer(
     }
 
     // sometimes this is just not resolved yet?
-    if (type->size == 0) {
-        type_layout(tu, type, true);
+    type_layout(tu, type, true);
+    if ((type->kind == KIND_STRUCT || type->kind == KIND_UNION) && type->is_incomplete) {
+        type_as_string(tu, sizeof(temp_string0), temp_string0, type);
+        REPORT(ERROR, node->loc, "cannot initialize incomplete type %s", temp_string0);
+        return NULL;
     }
 
     uint32_t pos = base_offset + relative_offset;
@@ -513,7 +470,7 @@ static InitNode* walk_initializer_layer(
         if (type->kind == KIND_STRUCT || type->kind == KIND_UNION) {
             // TODO(NeGate): unions will actually skip all the other entries once
             // you've picked once which is something we should keep in mind later
-            int member_count = compute_initializer_bounds(type);
+            int member_count = compute_initializer_bounds(tu, type);
             for (size_t i = 0; i < node_count; i++) {
                 node = walk_initializer_layer(
                     tu, type, pos, member_count, node, &kid_cursor, &kid_max_cursor, &kid_slots_left
@@ -523,7 +480,7 @@ static InitNode* walk_initializer_layer(
                 if (node == NULL) return NULL;
             }
         } else if (type->kind == KIND_ARRAY) {
-            int array_count = compute_initializer_bounds(type);
+            int array_count = compute_initializer_bounds(tu, type);
             for (int i = 0; i < node_count; i++) {
                 node = walk_initializer_layer(
                     tu, type, pos, array_count, node, &kid_cursor, &kid_max_cursor, &kid_slots_left
@@ -587,7 +544,7 @@ static InitNode* walk_initializer_for_sema(TranslationUnit* tu, Cuik_Type* type,
         type->record.name != NULL &&
         cstr_equals(type->record.name, "Expr")) __debugbreak();*/
 
-    int cursor = 0, max_cursor = 0, slots_left = node_count, bounds = compute_initializer_bounds(type);
+    int cursor = 0, max_cursor = 0, slots_left = node_count, bounds = compute_initializer_bounds(tu, type);
     if (bounds > 0) {
         for (int i = 0; i < bounds && slots_left; i++) {
             node = walk_initializer_layer(tu, type, 0, bounds, node, &cursor, &max_cursor, &slots_left);
@@ -597,7 +554,7 @@ static InitNode* walk_initializer_for_sema(TranslationUnit* tu, Cuik_Type* type,
             node = walk_initializer_layer(tu, type, 0, bounds, node, &cursor, &max_cursor, &slots_left);
         }
 
-        if (type->array_count == 0) {
+        if (type->kind == KIND_ARRAY && type->array_count == 0) {
             type->array_count = max_cursor;
             type_layout(tu, type, true);
         }
@@ -606,11 +563,25 @@ static InitNode* walk_initializer_for_sema(TranslationUnit* tu, Cuik_Type* type,
     return node;
 }
 
+// the typeofs made for typedefs are shared between functions which might be
+// type checked in parallel, so it's resolved once under the layout lock. The
+// type isn't marked as laid out until then so the fast path can skip the lock.
 static void try_resolve_typeof(TranslationUnit* tu, Cuik_Type* ty) {
+    if (atomic_load_explicit(&ty->is_laid_out, memory_order_acquire)) {
+        return;
+    }
+
+    mtx_lock(&tu->layout_mutex);
     if (ty->kind == KIND_TYPEOF) {
         // spoopy...
-        *ty = *sema_expr(tu, ty->typeof_.src);
+        Cuik_Type* src = sema_expr(tu, ty->typeof_.src);
+        type_layout(tu, src, false);
+
+        // everything but the layout flag, type_layout will set it
+        memcpy(ty, src, offsetof(Cuik_Type, is_laid_out));
+        type_layout(tu, ty, false);
     }
+    mtx_unlock(&tu->layout_mutex);
 }
 
 static bool is_assignable_expr(TranslationUnit* tu, Expr* restrict e) {
@@ -692,13 +663,10 @@ Member* sema_resolve_member_access(TranslationUnit* tu, Expr* restrict e, uint32
         return NULL;
     }
 
-    if (record_type->size == 0) {
-        type_layout(tu, record_type, true);
-
-        if (record_type->size == 0) {
-            REPORT_EXPR(ERROR, e, "Cannot access members in incomplete type");
-            return NULL;
-        }
+    type_layout(tu, record_type, true);
+    if (record_type->is_incomplete || record_type->size == 0) {
+        REPORT_EXPR(ERROR, e, "Cannot access members in incomplete type");
+        return NULL;
     }
 
     uint32_t offset = 0;
@@ -917,6 +885,13 @@ Cuik_Type* sema_expr(TranslationUnit* tu, Expr* restrict e) {
                 }
             }*/
 
+            type_layout(tu, type, true);
+            if ((type->kind == KIND_STRUCT || type->kind == KIND_UNION) && type->is_incomplete) {
+                type_as_string(tu, sizeof(temp_string0), temp_string0, type);
+                REPORT_EXPR(ERROR, e, "cannot initialize incomplete type %s", temp_string0);
+                return (e->type = type);
+            }
+
             walk_initializer_for_sema(tu, type, e->init.count, e->init.nodes, 0);
             return (e->type = e->init.type);
         }
@@ -1627,6 +1602,9 @@ static void sema_top_level(TranslationUnit* tu, Stmt* restrict s) {
             assert(type->kind == KIND_FUNC);
 
             #ifdef CUIK_USE_TB
+            // a reparsed function keeps its TB function, the rest of the module
+            // might already be referring to it.
+            TB_Function* old_func = tu->ir_mod != NULL ? s->backing.f : NULL;
             s->backing.f = 0;
             #endif
 
@@ -1642,7 +1620,15 @@ static void sema_top_level(TranslationUnit* tu, Stmt* restrict s) {
             }
 
             if (s->decl.attrs.is_static || s->decl.attrs.is_inline) {
-                if (!s->decl.attrs.is_used) break;
+                if (!s->decl.attrs.is_used) {
+                    // nothing will emit it so we only type check it if asked to
+                    if (tu->check_unreachable) {
+                        function_stmt = s;
+                        sema_stmt(tu, s->decl.initial_as_stmt);
+                        function_stmt = 0;
+                    }
+                    break;
+                }
             }
 
             #ifdef CUIK_USE_TB
@@ -1663,7 +1649,9 @@ static void sema_top_level(TranslationUnit* tu, Stmt* restrict s) {
                 // necessarily the same as static where they all can share a name but
                 // are different and internal.
                 TB_Function* func;
-                if (s->decl.attrs.is_inline) {
+                if (old_func != NULL) {
+                    func = old_func;
+                } else if (s->decl.attrs.is_inline) {
                     linkage = TB_LINKAGE_PRIVATE;
 
                     char temp[1024];
@@ -1806,17 +1794,39 @@ static void sema_mark_children(TranslationUnit* tu, Expr* restrict e) {
     }
 }
 
+// sema_top_level bails out right away on unused globals, typedefs and prototypes
+// so there's no point in scheduling them. headers are mostly made of those.
+static bool sema_needs_top_level(Stmt* restrict s) {
+    if (s->op == STMT_FUNC_DECL) return true;
+    return s->decl.attrs.is_used && !s->decl.attrs.is_typedef && s->decl.name != NULL;
+}
+
+// unused declarations are skipped by sema_top_level so they're basically free
+static size_t sema_top_level_cost(Stmt* restrict s) {
+    if (!s->decl.attrs.is_used || s->decl.token_count <= 0) return 1;
+    return s->decl.token_count;
+}
+
+static int compare_top_level_cost(const void* a, const void* b) {
+    size_t a_cost = sema_top_level_cost(*(Stmt**) a);
+    size_t b_cost = sema_top_level_cost(*(Stmt**) b);
+
+    // biggest first
+    return (a_cost < b_cost) - (a_cost > b_cost);
+}
+
 static void sema_task(void* arg) {
     SemaTaskInfo task = *((SemaTaskInfo*)arg);
 
-    CUIK_TIMED_BLOCK("sema: %zu-%zu", task.start, task.end) {
+    CUIK_TIMED_BLOCK("sema: %zu stmts", task.count) {
         in_the_semantic_phase = true;
 
-        for (size_t i = task.start; i < task.end; i++) {
-            sema_top_level(task.tu, task.tu->top_level_stmts[i]);
+        for (size_t i = 0; i < task.count; i++) {
+            sema_top_level(task.tu, task.stmts[i]);
         }
 
         in_the_semantic_phase = false;
+        type_arena_flush(task.tu);
         *task.tasks_remaining -= 1;
     }
 }
@@ -1831,7 +1841,9 @@ void cuik__sema_pass(TranslationUnit* restrict tu, Cuik_IThreadpool* restrict th
             Stmt* restrict s = tu->top_level_stmts[i];
             assert(s->op == STMT_FUNC_DECL || s->op == STMT_DECL || s->op == STMT_GLOBAL_DECL);
 
-            if (s->decl.attrs.is_root) {
+            // the parser already marked everything reachable while figuring out which
+            // function bodies it needed, so this mostly just picks up function literals
+            if (s->decl.attrs.is_root && !s->decl.attrs.is_used) {
                 s->decl.attrs.is_used = true;
 
                 Expr* sym = s->decl.first_symbol;
@@ -1844,38 +1856,84 @@ void cuik__sema_pass(TranslationUnit* restrict tu, Cuik_IThreadpool* restrict th
     }
 
     // go through all top level statements and type check
-    CUIK_TIMED_BLOCK("sema: type check") {
-        if (thread_pool != NULL) {
-            // disabled until we change the tables to arenas
-            size_t padded = (count + (SEMA_MUNCH_SIZE - 1)) & ~(SEMA_MUNCH_SIZE - 1);
+    Stmt** stmts = HEAP_ALLOC((count ? count : 1) * sizeof(Stmt*));
+    size_t stmt_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        Stmt* restrict s = tu->top_level_stmts[i];
+        if (sema_needs_top_level(s)) stmts[stmt_count++] = s;
+    }
 
-            // passed to the threads to identify when things are done
-            atomic_size_t tasks_remaining = (count + (SEMA_MUNCH_SIZE - 1)) / SEMA_MUNCH_SIZE;
+    cuik__sema_stmts(tu, thread_pool, stmts, stmt_count);
+    HEAP_FREE(stmts);
+}
 
-            for (size_t i = 0; i < padded; i += SEMA_MUNCH_SIZE) {
-                size_t limit = i + SEMA_MUNCH_SIZE;
-                if (limit > count) limit = count;
+void cuik__sema_stmts(TranslationUnit* restrict tu, Cuik_IThreadpool* restrict thread_pool, Stmt** stmts, size_t stmt_count) {
+    CUIK_TIMED_BLOCK("sema: type check") {
+        if (thread_pool != NULL) {
+            // globals are type checked up front on this thread, function bodies
+            // will resolve incomplete arrays (int tbl[] = { ... }) on demand which
+            // rewrites the global's type and initializer so two tasks could end
+            // up doing it at the same time. once they're done they're read-only.
+            size_t func_count = 0;
+            in_the_semantic_phase = true;
+            for (size_t i = 0; i < stmt_count; i++) {
+                if (stmts[i]->op != STMT_FUNC_DECL) {
+                    sema_top_level(tu, stmts[i]);
+                } else {
+                    stmts[func_count++] = stmts[i];
+                }
+            }
+            in_the_semantic_phase = false;
+            stmt_count = func_count;
+
+            // sort the statements biggest first, the big function bodies get their
+            // own task while the small stuff is packed together until it makes up
+            // a quantum.
+            qsort(stmts, stmt_count, sizeof(Stmt*), compare_top_level_cost);
+
+            // worst case is one task per statement
+            SemaTaskInfo* tasks = HEAP_ALLOC((stmt_count ? stmt_count : 1) * sizeof(SemaTaskInfo));
+            size_t task_count = 0;
+
+            for (size_t i = 0; i < stmt_count;) {
+                size_t start = i, total = 0;
+                while (i < stmt_count && total < SEMA_TASK_QUANTUM) {
+                    total += sema_top_level_cost(stmts[i]);
+                    i += 1;
+                }
 
-                SemaTaskInfo* task = tls_push(sizeof(SemaTaskInfo));
-                *task = (SemaTaskInfo){
-                    .tasks_remaining = &tasks_remaining,
-                    .start = i,
-                    .end = limit,
+                tasks[task_count++] = (SemaTaskInfo){
+                    .stmts = &stmts[start],
+                    .count = i - start,
                     .tu = tu
                 };
+            }
 
-                CUIK_CALL(thread_pool, submit, sema_task, task);
+            // passed to the threads to identify when things are done
+            atomic_size_t tasks_remaining = task_count;
+            for (size_t i = 0; i < task_count; i++) {
+                tasks[i].tasks_remaining = &tasks_remaining;
+                CUIK_CALL(thread_pool, submit, sema_task, &tasks[i]);
             }
 
+            // we might be running on one of the pool's threads so we help
+            // out instead of just yielding (that's also why the task list is
+            // on the heap, other jobs will reset our temporary storage and
+            // any types we made have to be in this TU before then)
+            type_arena_flush(tu);
             while (tasks_remaining != 0) {
-                thrd_yield();
+                CUIK_CALL(thread_pool, work_one_job);
             }
+
+            HEAP_FREE(tasks);
         } else {
             in_the_semantic_phase = true;
-            for (size_t i = 0; i < count; i++) {
-                sema_top_level(tu, tu->top_level_stmts[i]);
+            for (size_t i = 0; i < stmt_count; i++) {
+                sema_top_level(tu, stmts[i]);
             }
             in_the_semantic_phase = false;
         }
+
+        type_arena_flush(tu);
     }
 }
@@ -20,13 +20,108 @@ Cuik_Type builtin_types[] = {
     [TYPE_DOUBLE] = {KIND_DOUBLE, 8, 8},
 };
 
+// types are allocated from the thread's own arena and get stitched into the TU's
+// type arena by type_arena_flush once the thread is done with that TU, this way
+// making a type never has to wait on the other threads.
+thread_local static Arena local_type_arena;
+
 static Cuik_Type* alloc_type(TranslationUnit* tu, const Cuik_Type* src) {
+    Cuik_Type* dst = ARENA_ALLOC(&local_type_arena, Cuik_Type);
+    memcpy(dst, src, sizeof(Cuik_Type));
+    return dst;
+}
+
+void type_arena_flush(TranslationUnit* tu) {
+    if (local_type_arena.base == NULL) return;
+
     mtx_lock(&tu->arena_mutex);
-    Cuik_Type* dst = ARENA_ALLOC(&tu->type_arena, Cuik_Type);
+    arena_trim(&local_type_arena);
+    arena_append(&tu->type_arena, &local_type_arena);
     mtx_unlock(&tu->arena_mutex);
 
-    memcpy(dst, src, sizeof(Cuik_Type));
-    return dst;
+    local_type_arena = (Arena){0};
+}
+
+enum {
+    TYPE_QUAL_CONST    = 1,
+    TYPE_QUAL_ATOMIC   = 2,
+    TYPE_QUAL_RESTRICT = 4,
+};
+
+static size_t hash_type_key(Cuik_TypeKind kind, Cuik_Type* base, uint8_t quals, int count) {
+    uint64_t h = (uintptr_t) base;
+    h ^= ((uint64_t) kind << 56) ^ ((uint64_t) quals << 48) ^ (uint32_t) count;
+    h *= 0x9E3779B97F4A7C15ull;
+    return h ^ (h >> 32);
+}
+
+// returns the existing type with the same key or makes one out of src, if type is
+// non-NULL it's used as the new entry instead of a copy of src.
+static Cuik_Type* intern_type_entry(TranslationUnit* tu, uint8_t quals, int count, Cuik_Type* base, const Cuik_Type* src, Cuik_Type* type) {
+    TypeInterner* restrict interner = &tu->type_interner;
+    Cuik_TypeKind kind = src->kind;
+
+    mtx_lock(&interner->lock);
+    if ((interner->count + 1) * 2 > interner->capacity) {
+        // keep the load factor under 50%
+        size_t new_cap = interner->capacity ? interner->capacity * 2 : 256;
+        TypeInternEntry* new_entries = calloc(new_cap, sizeof(TypeInternEntry));
+
+        for (size_t i = 0; i < interner->capacity; i++) {
+            TypeInternEntry* e = &interner->entries[i];
+            if (e->type == NULL) continue;
+
+            size_t j = hash_type_key(e->kind, e->base, e->quals, e->count) & (new_cap - 1);
+            while (new_entries[j].type != NULL) j = (j + 1) & (new_cap - 1);
+            new_entries[j] = *e;
+        }
+
+        free(interner->entries);
+        interner->entries = new_entries;
+        interner->capacity = new_cap;
+    }
+
+    // we compare against the key instead of the type since the qualified types
+    // get rewritten in place once parsing is done.
+    size_t mask = interner->capacity - 1;
+    size_t i = hash_type_key(kind, base, quals, count) & mask;
+    for (;; i = (i + 1) & mask) {
+        TypeInternEntry* e = &interner->entries[i];
+        if (e->type == NULL) break;
+
+        if (e->kind == kind && e->base == base && e->quals == quals && e->count == count) {
+            Cuik_Type* type = e->type;
+            mtx_unlock(&interner->lock);
+            return type;
+        }
+    }
+
+    if (type == NULL) type = alloc_type(tu, src);
+    interner->entries[i] = (TypeInternEntry){ kind, quals, count, base, type };
+    interner->count += 1;
+    mtx_unlock(&interner->lock);
+
+    return type;
+}
+
+static Cuik_Type* intern_type(TranslationUnit* tu, uint8_t quals, int count, Cuik_Type* base, const Cuik_Type* src) {
+    return intern_type_entry(tu, quals, count, base, src, NULL);
+}
+
+void intern_cached_type(TranslationUnit* tu, Cuik_Type* type) {
+    // named copies (typedefs) aren't what any of the new_* would've made
+    if (type->also_known_as != NULL) return;
+
+    if (type->based != NULL) {
+        // qualified types which already got resolved, same key as new_qualified_type
+        uint8_t quals = (type->is_const ? TYPE_QUAL_CONST : 0) | (type->is_atomic ? TYPE_QUAL_ATOMIC : 0);
+        intern_type_entry(tu, quals, 0, type->based, &(Cuik_Type){ .kind = KIND_QUALIFIED_TYPE }, type);
+    } else if (type->kind == KIND_PTR) {
+        uint8_t quals = (type->is_atomic ? TYPE_QUAL_ATOMIC : 0) | (type->is_ptr_restrict ? TYPE_QUAL_RESTRICT : 0);
+        intern_type_entry(tu, quals, 0, type->ptr_to, type, type);
+    } else if (type->kind == KIND_ARRAY && type->array_count != 0) {
+        intern_type_entry(tu, 0, type->array_count, type->array_of, type, type);
+    }
 }
 
 Cuik_Type* new_enum(TranslationUnit* tu) {
@@ -49,10 +144,13 @@ Cuik_Type* copy_type(TranslationUnit* tu, Cuik_Type* base) {
 
 Cuik_Type* new_qualified_type(TranslationUnit* tu, Cuik_Type* base, bool is_atomic, bool is_const) {
     assert(base != NULL);
-    return alloc_type(tu, &(Cuik_Type){
+    uint8_t quals = (is_const ? TYPE_QUAL_CONST : 0) | (is_atomic ? TYPE_QUAL_ATOMIC : 0);
+
+    return intern_type(tu, quals, 0, base, &(Cuik_Type){
             .kind = KIND_QUALIFIED_TYPE,
             .size = base->size,
             .align = base->align,
+            .loc = base->loc,
             .qualified_ty = base,
             .is_atomic = is_atomic,
             .is_const = is_const
@@ -66,7 +164,7 @@ Cuik_Type* new_record(TranslationUnit* tu, bool is_union) {
 }
 
 Cuik_Type* new_pointer(TranslationUnit* tu, Cuik_Type* base) {
-    return alloc_type(tu, &(Cuik_Type){
+    return intern_type(tu, 0, 0, base, &(Cuik_Type){
             .kind = KIND_PTR,
             .size = 8,
             .align = 8,
@@ -74,6 +172,19 @@ Cuik_Type* new_pointer(TranslationUnit* tu, Cuik_Type* base) {
         });
 }
 
+Cuik_Type* new_qualified_pointer(TranslationUnit* tu, Cuik_Type* base, bool is_atomic, bool is_restrict) {
+    uint8_t quals = (is_atomic ? TYPE_QUAL_ATOMIC : 0) | (is_restrict ? TYPE_QUAL_RESTRICT : 0);
+
+    return intern_type(tu, quals, 0, base, &(Cuik_Type){
+            .kind = KIND_PTR,
+            .size = 8,
+            .align = 8,
+            .ptr_to = base,
+            .is_atomic = is_atomic,
+            .is_ptr_restrict = is_restrict,
+        });
+}
+
 Cuik_Type* new_typeof(TranslationUnit* tu, Expr* src) {
     return alloc_type(tu, &(Cuik_Type){
             .kind = KIND_TYPEOF,
@@ -90,7 +201,8 @@ Cuik_Type* new_typeof(TranslationUnit* tu, Expr* src) {
 
 Cuik_Type* new_array(TranslationUnit* tu, Cuik_Type* base, int count) {
     if (count == 0) {
-        // these zero-sized arrays don't actually care about incomplete element types
+        // these zero-sized arrays don't actually care about incomplete element types,
+        // they also get their count filled in later so they can't be shared.
         return alloc_type(tu, &(Cuik_Type){
                 .kind = KIND_ARRAY,
                 .size = 0,
@@ -109,7 +221,7 @@ Cuik_Type* new_array(TranslationUnit* tu, Cuik_Type* base, int count) {
     }
 
     assert(align != 0);
-    return alloc_type(tu, &(Cuik_Type){
+    return intern_type(tu, 0, count, base, &(Cuik_Type){
             .kind = KIND_ARRAY,
             .size = dst,
             .align = align,
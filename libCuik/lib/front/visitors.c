@@ -8,6 +8,18 @@
 #define SWITCH2(a, b) SWITCH_ITER { CASE_YIELD(0, a); CASE_YIELD(1, b); CASE_END(2); }
 
 CUIK_API bool cuik_next_stmt_kid(Cuik_StmtIter* it) {
+    if (it->compact_ != NULL) {
+        Cuik_CompactAST* restrict ast = it->compact_;
+        Cuik_CompactLinks kids = ast->stmt_kids[it->parent_index_];
+        if (it->index_ >= kids.count) {
+            return false;
+        }
+
+        it->stmt_index = ast->links[kids.start + it->index_++];
+        it->stmt = ast->stmts[it->stmt_index];
+        return true;
+    }
+
     Stmt* restrict s = it->parent_;
     switch (s->op) {
         case STMT_NONE:
@@ -76,8 +88,21 @@ CUIK_API bool cuik_next_stmt_kid(Cuik_StmtIter* it) {
 }
 
 CUIK_API bool cuik_next_expr_kid(Cuik_ExprIter* it) {
+    if (it->compact_ != NULL) {
+        Cuik_CompactAST* restrict ast = it->compact_;
+        Cuik_CompactLinks kids = ast->expr_kids[it->parent_index_];
+        if (it->index_ >= kids.count) {
+            return false;
+        }
+
+        it->expr_index = ast->links[kids.start + it->index_++];
+        it->expr = ast->exprs[it->expr_index];
+        return true;
+    }
+
     Expr* restrict e = it->parent_;
     switch (e->op) {
+        case EXPR_BUILTIN_SYMBOL:
         case EXPR_UNKNOWN_SYMBOL:
         case EXPR_VA_ARG:
         case EXPR_INT:
@@ -97,9 +122,18 @@ CUIK_API bool cuik_next_expr_kid(Cuik_ExprIter* it) {
         case EXPR_PARAM:
         return false;
 
-        case EXPR_INITIALIZER:
-        assert(0);
-        return false;
+        case EXPR_INITIALIZER: {
+            // the expressions at the leaves of the initializer
+            while (it->index_ < e->init.count) {
+                InitNode* restrict n = &e->init.nodes[it->index_++];
+                if (n->kids_count == 0 && n->expr != NULL) {
+                    it->expr = n->expr;
+                    return true;
+                }
+            }
+
+            return false;
+        }
 
         case EXPR_NOT:
         case EXPR_ADDR:
@@ -158,7 +192,7 @@ CUIK_API bool cuik_next_expr_kid(Cuik_ExprIter* it) {
         switch (it->index_++) {
             case 0: it->expr = e->ternary_op.left; return true;
             case 1: it->expr = e->ternary_op.middle; return true;
-            case 2: it->expr = e->ternary_op.middle; return true;
+            case 2: it->expr = e->ternary_op.right; return true;
             case 3: return false;
             default: __builtin_unreachable();
         }
@@ -200,6 +234,7 @@ CUIK_API bool cuik_next_expr_kid(Cuik_ExprIter* it) {
         case EXPR_ASSIGN:
         case EXPR_TIMES_ASSIGN:
         case EXPR_SLASH_ASSIGN:
+        case EXPR_PERCENT_ASSIGN:
         case EXPR_AND_ASSIGN:
         case EXPR_OR_ASSIGN:
         case EXPR_XOR_ASSIGN:
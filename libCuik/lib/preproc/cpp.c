@@ -11,6 +11,7 @@
 #include "../diagnostic.h"
 
 #include "lexer.h"
+#include <stdatomic.h>
 #include <sys/stat.h>
 
 #if USE_INTRIN
@@ -21,6 +22,14 @@
 #define NL_STRING_MAP_INLINE
 #include "../string_map.h"
 
+// running total across every translation unit, fed to the profiler's counter track
+static _Atomic int64_t total_token_count;
+
+// the file lexing happens in the packet handler so it can't be charged to a preprocessor
+// directly, it's tallied per thread and the preprocessor takes the difference across
+// the GET_FILE.
+static thread_local uint64_t lexed_bytes, lexed_lines;
+
 static void preprocess_file(Cuik_CPP* restrict c, TokenStream* restrict s, size_t parent_entry, SourceLocIndex include_loc, const char* directory, const char* filepath, int depth);
 static uint64_t hash_ident(const void* key, size_t len);
 static bool is_defined(Cuik_CPP* restrict c, const unsigned char* start, size_t length);
@@ -126,6 +135,23 @@ CUIK_API const char* cuikpp_get_main_file(TokenStream* tokens) {
     return tokens->filepath;
 }
 
+CUIK_API size_t cuikpp_count_prelude_tokens(TokenStream* tokens) {
+    size_t count = dyn_array_length(tokens->tokens) - 1;
+    for (size_t i = 0; i < count; i++) {
+        // macro expansions live in made up files, we care about where they got expanded
+        SourceLoc* l = &tokens->locations[tokens->tokens[i].location];
+        while (l->line->filepath[0] == '<' && l->line->parent != 0) {
+            l = &tokens->locations[l->line->parent];
+        }
+
+        if (strcmp(l->line->filepath, tokens->filepath) == 0) {
+            return i;
+        }
+    }
+
+    return count;
+}
+
 CUIK_API bool cuikpp_is_in_main_file(TokenStream* tokens, SourceLocIndex loc) {
     if (loc != 0) {
         return false;
@@ -138,6 +164,7 @@ CUIK_API bool cuikpp_is_in_main_file(TokenStream* tokens, SourceLocIndex loc) {
 CUIK_API void cuikpp_init(Cuik_CPP* ctx, const char filepath[FILENAME_MAX]) {
     size_t sz = sizeof(void*) * MACRO_BUCKET_COUNT * SLOTS_PER_MACRO_BUCKET;
     size_t sz2 = sizeof(SourceLocIndex) * MACRO_BUCKET_COUNT * SLOTS_PER_MACRO_BUCKET;
+    size_t sz3 = sizeof(uint32_t) * MACRO_BUCKET_COUNT * SLOTS_PER_MACRO_BUCKET;
 
     *ctx = (Cuik_CPP){
         .files = dyn_array_create(Cuik_FileEntry),
@@ -149,6 +176,7 @@ CUIK_API void cuikpp_init(Cuik_CPP* ctx, const char filepath[FILENAME_MAX]) {
         .macro_bucket_values_start = cuik__valloc(sz),
         .macro_bucket_values_end = cuik__valloc(sz),
         .macro_bucket_source_locs = cuik__valloc(sz2),
+        .macro_bucket_expansions = cuik__valloc(sz3),
 
         .the_shtuffs = cuik__valloc(THE_SHTUFFS_SIZE),
     };
@@ -156,6 +184,7 @@ CUIK_API void cuikpp_init(Cuik_CPP* ctx, const char filepath[FILENAME_MAX]) {
     // initialize dynamic arrays
     ctx->system_include_dirs = dyn_array_create(char*);
     ctx->files = dyn_array_create(Cuik_FileEntry);
+    ctx->undef_macro_stats = dyn_array_create(Cuik_MacroStat);
 
     ctx->stack_ptr = 1;
     char* slash = strrchr(filepath, '\\');
@@ -186,7 +215,28 @@ CUIK_API void cuikpp_init(Cuik_CPP* ctx, const char filepath[FILENAME_MAX]) {
 }
 
 CUIK_API TokenStream cuiklex_buffer(const char* filepath, const char* contents) {
-    return get_all_tokens_in_buffer(filepath, (const uint8_t*) contents, NULL);
+    TokenStream s = get_all_tokens_in_buffer(filepath, (const uint8_t*) contents, NULL);
+
+    // the last token before the EOF is as far as the lexer got
+    size_t count = dyn_array_length(s.tokens);
+    if (count > 1) {
+        Token* last = &s.tokens[count - 2];
+        lexed_bytes += last->end - (const unsigned char*) contents;
+        lexed_lines += s.locations[last->location].line->line;
+    }
+    return s;
+}
+
+static void mark_lexed(Cuik_CPP* ctx) {
+    ctx->lexed_bytes_mark = lexed_bytes;
+    ctx->lexed_lines_mark = lexed_lines;
+}
+
+static void count_file_read(Cuik_CPP* ctx, uint64_t start_time) {
+    ctx->stats.include_time += cuik_time_in_nanos() - start_time;
+    ctx->stats.files_read += 1;
+    ctx->stats.bytes_lexed += lexed_bytes - ctx->lexed_bytes_mark;
+    ctx->stats.lines_lexed += lexed_lines - ctx->lexed_lines_mark;
 }
 
 static void print_token_stream(TokenStream* s, size_t start, size_t end) {
@@ -309,6 +359,7 @@ CUIK_API Cuikpp_Status cuikpp_next(Cuik_CPP* ctx, Cuikpp_Packet* packet) {
                 packet->file.input_path = slot->filepath;
                 packet->file.tokens = (TokenStream){ 0 };
                 packet->file.is_primary = true;
+                mark_lexed(ctx);
                 return CUIKPP_CONTINUE;
             }
 
@@ -319,10 +370,7 @@ CUIK_API Cuikpp_Status cuikpp_next(Cuik_CPP* ctx, Cuikpp_Packet* packet) {
                     return CUIKPP_ERROR;
                 }
 
-                #if CUIK__CPP_STATS
-                ctx->total_io_time += (cuik_time_in_nanos() - slot->start_time);
-                ctx->total_files_read += 1;
-                #endif
+                count_file_read(ctx, slot->start_time);
 
                 // initialize the file & lexer in the stack slot
                 slot->file_id = dyn_array_length(ctx->files);
@@ -360,10 +408,6 @@ CUIK_API Cuikpp_Status cuikpp_next(Cuik_CPP* ctx, Cuikpp_Packet* packet) {
         ////////////////////////////////
         assert(packet->tag == CUIKPP_PACKET_QUERY_FILE);
         if (!packet->query.found) {
-            #if CUIK__CPP_STATS
-            ctx->total_fstats += 1;
-            #endif
-
             // we didn't find a match
             ctx->state2 += 1;
             int index = ctx->state2 - 1;
@@ -382,6 +426,7 @@ CUIK_API Cuikpp_Status cuikpp_next(Cuik_CPP* ctx, Cuikpp_Packet* packet) {
             // it's ok this const removal is based
             char* path = (char*) packet->query.input_path;
             sprintf_s(path, FILENAME_MAX, "%s%s", ctx->system_include_dirs[index], slot->filepath);
+            ctx->stats.include_probes += 1;
 
             packet->query.found = false;
             return CUIKPP_CONTINUE;
@@ -434,6 +479,7 @@ CUIK_API Cuikpp_Status cuikpp_next(Cuik_CPP* ctx, Cuikpp_Packet* packet) {
             packet->file.input_path = filepath;
             packet->file.tokens = (TokenStream){ 0 };
             packet->file.is_primary = false;
+            mark_lexed(ctx);
 
             // fprintf(stderr, "PRAGMA ONCE DONT GOT IT %s\n", filepath);
             return CUIKPP_CONTINUE;
@@ -451,10 +497,7 @@ CUIK_API Cuikpp_Status cuikpp_next(Cuik_CPP* ctx, Cuikpp_Packet* packet) {
             cuik_profile_region_start(cuik_time_in_nanos(), "preprocess: %s", filepath);
         }
 
-        #if CUIK__CPP_STATS
-        ctx->total_io_time += (cuik_time_in_nanos() - slot->start_time);
-        ctx->total_files_read += 1;
-        #endif
+        count_file_read(ctx, slot->start_time);
 
         // initialize the file & lexer in the stack slot
         slot->include_guard = (struct CPPIncludeGuard){ 0 };
@@ -518,6 +561,11 @@ CUIK_API Cuikpp_Status cuikpp_next(Cuik_CPP* ctx, Cuikpp_Packet* packet) {
                 Token t = {0, true, 0, NULL, NULL};
                 dyn_array_put(s->tokens, t);
 
+                if (cuik_is_profiling()) {
+                    int64_t count = dyn_array_length(s->tokens);
+                    cuik_profile_counter("tokens", atomic_fetch_add(&total_token_count, count) + count);
+                }
+
                 s->current = 0;
                 return CUIKPP_DONE;
             }
@@ -620,6 +668,12 @@ CUIK_API Cuikpp_Status cuikpp_next(Cuik_CPP* ctx, Cuikpp_Packet* packet) {
 
                         if (ctx->macro_bucket_keys_length[e] == key.length &&
                             memcmp(ctx->macro_bucket_keys[e], key.data, key.length) == 0) {
+                            // keep the count around, it's not gonna be in the buckets anymore
+                            if (ctx->macro_bucket_expansions[e]) {
+                                Cuik_MacroStat stat = { key.length, (const char*) ctx->macro_bucket_keys[e], ctx->macro_bucket_expansions[e] };
+                                dyn_array_put(ctx->undef_macro_stats, stat);
+                            }
+
                             // remove swap
                             size_t last = base + (count - 1);
 
@@ -629,6 +683,7 @@ CUIK_API Cuikpp_Status cuikpp_next(Cuik_CPP* ctx, Cuikpp_Packet* packet) {
                                 ctx->macro_bucket_values_start[e] = ctx->macro_bucket_values_start[last];
                                 ctx->macro_bucket_values_end[e] = ctx->macro_bucket_values_end[last];
                                 ctx->macro_bucket_source_locs[e] = ctx->macro_bucket_source_locs[last];
+                                ctx->macro_bucket_expansions[e] = ctx->macro_bucket_expansions[last];
                             }
                             ctx->macro_bucket_count[slot] -= 1;
                             break;
@@ -757,6 +812,7 @@ CUIK_API Cuikpp_Status cuikpp_next(Cuik_CPP* ctx, Cuikpp_Packet* packet) {
                     ctx->macro_bucket_values_start[e] = value.data;
                     ctx->macro_bucket_values_end[e] = value.data + value.length;
                     ctx->macro_bucket_source_locs[e] = macro_loc;
+                    ctx->macro_bucket_expansions[e] = 0;
                 } else if (memcmp(directive.data, "pragma", 6) == 0) {
                     success = true;
                     tokens_next(in);
@@ -945,11 +1001,8 @@ CUIK_API Cuikpp_Status cuikpp_next(Cuik_CPP* ctx, Cuikpp_Packet* packet) {
                     // quote includes will prioritize the local directory over the search paths
                     // if we don't have any search paths then we'll also run this first since it's
                     // our only real option.
+                    ctx->stats.include_probes += 1;
                     if (!is_lib_include || (num_system_include_dirs == 0 && is_lib_include)) {
-                        #if CUIK__CPP_STATS
-                        ctx->total_fstats += 1;
-                        #endif
-
                         // Try local includes
                         ctx->state2 = 0;
                         sprintf_s(path, FILENAME_MAX, "%s%s", slot->directory, filename);
@@ -1027,30 +1080,6 @@ CUIK_API Cuikpp_Status cuikpp_next(Cuik_CPP* ctx, Cuikpp_Packet* packet) {
 }
 
 CUIK_API void cuikpp_deinit(Cuik_CPP* ctx) {
-    #if CUIK__CPP_STATS
-    //printf("%40s | %zu file read | %zu fstats\n", ctx->files[0].filepath, ctx->total_files_read, ctx->total_fstats);
-    #if 1
-    printf(" %40s | %.06f ms read+lex\t| %4zu files read\t| %zu fstats\t| %f ms (%zu defines)\n",
-        ctx->files[0].filepath,
-        ctx->total_io_time / 1000000.0,
-        ctx->total_files_read,
-        ctx->total_fstats,
-        ctx->total_define_access_time / 1000000.0,
-        ctx->total_define_accesses);
-    #else
-    dyn_array_for(i, ctx->files) {
-        printf("%s,%zu\n", ctx->files[i].filepath, ctx->files[i].content_len);
-    }
-    /*printf("%s,%.06f,%.06f,%4zu,%.06f,%zu,\n",
-        ctx->files[0].filepath,
-        ctx->total_lex_time / 1000000.0,
-        ctx->total_io_time / 1000000.0,
-        ctx->total_files_read,
-        ctx->total_io_space / 1000000.0,
-        ctx->total_fstats);*/
-    #endif
-    #endif
-
     if (ctx->macro_bucket_keys) {
         cuikpp_finalize(ctx);
     }
@@ -1065,6 +1094,7 @@ CUIK_API void cuikpp_deinit(Cuik_CPP* ctx) {
 
     cuik__vfree((void*)ctx->the_shtuffs, THE_SHTUFFS_SIZE);
     dyn_array_destroy(ctx->files);
+    dyn_array_destroy(ctx->undef_macro_stats);
     ctx->the_shtuffs = NULL;
     ctx->files = NULL;
 }
@@ -1083,12 +1113,14 @@ CUIK_API void cuikpp_finalize(Cuik_CPP* ctx) {
     CUIK_TIMED_BLOCK("cuikpp_finalize") {
         size_t sz = sizeof(void*) * MACRO_BUCKET_COUNT * SLOTS_PER_MACRO_BUCKET;
         size_t sz2 = sizeof(SourceLocIndex) * MACRO_BUCKET_COUNT * SLOTS_PER_MACRO_BUCKET;
+        size_t sz3 = sizeof(uint32_t) * MACRO_BUCKET_COUNT * SLOTS_PER_MACRO_BUCKET;
 
         cuik__vfree((void*)ctx->macro_bucket_keys, sz);
         cuik__vfree((void*)ctx->macro_bucket_keys_length, sz);
         cuik__vfree((void*)ctx->macro_bucket_values_start, sz);
         cuik__vfree((void*)ctx->macro_bucket_values_end, sz);
         cuik__vfree((void*)ctx->macro_bucket_source_locs, sz2);
+        cuik__vfree((void*)ctx->macro_bucket_expansions, sz3);
         cuik__vfree((void*)ctx->stack, 1024 * sizeof(CPPStackSlot));
 
         ctx->macro_bucket_keys = NULL;
@@ -1096,6 +1128,7 @@ CUIK_API void cuikpp_finalize(Cuik_CPP* ctx) {
         ctx->macro_bucket_values_start = NULL;
         ctx->macro_bucket_values_end = NULL;
         ctx->macro_bucket_source_locs = NULL;
+        ctx->macro_bucket_expansions = NULL;
         ctx->stack = NULL;
     }
 }
@@ -1112,6 +1145,48 @@ CUIK_API Cuik_FileEntry* cuikpp_get_file_table(Cuik_CPP* ctx) {
     return &ctx->files[0];
 }
 
+CUIK_API Cuik_CPPStats cuikpp_get_stats(Cuik_CPP* ctx) {
+    return ctx->stats;
+}
+
+CUIK_API void cuikpp_reset_token_counter(void) {
+    atomic_store(&total_token_count, 0);
+}
+
+static int compare_macro_stats(const void* a, const void* b) {
+    uint64_t x = ((const Cuik_MacroStat*) a)->expansions, y = ((const Cuik_MacroStat*) b)->expansions;
+    return (x < y) - (x > y);
+}
+
+CUIK_API size_t cuikpp_get_macro_stats(Cuik_CPP* ctx, size_t count, Cuik_MacroStat* out) {
+    assert(ctx->macro_bucket_keys != NULL && "cuikpp_get_macro_stats can't be called after cuikpp_finalize");
+
+    Cuik_MacroStat* stats = dyn_array_create(Cuik_MacroStat);
+    dyn_array_for(i, ctx->undef_macro_stats) {
+        dyn_array_put(stats, ctx->undef_macro_stats[i]);
+    }
+
+    for (size_t i = 0; i < MACRO_BUCKET_COUNT; i++) {
+        size_t base = i * SLOTS_PER_MACRO_BUCKET;
+
+        for (size_t j = 0; j < ctx->macro_bucket_count[i]; j++) {
+            size_t e = base + j;
+            if (ctx->macro_bucket_expansions[e] == 0) continue;
+
+            Cuik_MacroStat stat = { ctx->macro_bucket_keys_length[e], (const char*) ctx->macro_bucket_keys[e], ctx->macro_bucket_expansions[e] };
+            dyn_array_put(stats, stat);
+        }
+    }
+
+    size_t length = dyn_array_length(stats);
+    qsort(stats, length, sizeof(Cuik_MacroStat), compare_macro_stats);
+
+    if (count > length) count = length;
+    memcpy(out, stats, count * sizeof(Cuik_MacroStat));
+    dyn_array_destroy(stats);
+    return count;
+}
+
 CUIK_API void cuikpp_dump(Cuik_CPP* ctx) {
     int count = 0;
 
@@ -1156,7 +1231,10 @@ static SourceLocIndex get_source_location(Cuik_CPP* restrict c, TokenStream* res
     // just extract the one that's attached to the input token and chop it's heading
     SourceLoc* old = &in->locations[in->tokens[in->current].location];
 
-    if (c->last_source_line == NULL || c->last_source_line->line != old->line->line) {
+    if (c->last_source_line == NULL ||
+        c->last_source_line->line != old->line->line ||
+        c->last_source_line->filepath != old->line->filepath ||
+        c->last_source_line->parent != parent_loc) {
         // make a new source line... we'll miss our fallen brother, he's not
         // dead but for when he dies...
         SourceLine* l = arena_alloc(&thread_arena, sizeof(SourceLine), _Alignof(SourceLine));
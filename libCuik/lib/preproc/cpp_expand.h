@@ -297,6 +297,8 @@ static void expand_ident(Cuik_CPP* restrict c, TokenStream* restrict s, TokenStr
         size_t def_i;
         if (find_define(c, &def_i, token_data, token_length)) {
             int line_of_expansion = tokens_get_location_line(in);
+            c->macro_bucket_expansions[def_i] += 1;
+            c->stats.macro_expansions += 1;
 
             SourceLocIndex expanded_loc = get_source_location(
                 c, in, s, parent_loc, SOURCE_LOC_MACRO
@@ -18,6 +18,12 @@ static intmax_t eval(Cuik_CPP* restrict c, TokenStream* restrict s, TokenStream*
         s->current = old_tokens_length;
         intmax_t result = eval_l13(c, s);
 
+        // anything left over means an operator we don't know stopped the parse early
+        if (!tokens_eof(s)) {
+            report(REPORT_ERROR, NULL, s, tokens_get_location_index(s), "unexpected token in preprocessor expression");
+            abort();
+        }
+
         // Restore stuff
         dyn_array_set_length(s->tokens, old_tokens_length);
         s->current = old_tokens_length;
@@ -77,24 +83,55 @@ static intmax_t eval_l0(Cuik_CPP* restrict c, TokenStream* restrict s) {
 
 static intmax_t eval_l2(Cuik_CPP* restrict c, TokenStream* restrict s) {
     if (tokens_get(s)->type == '-') {
-        return -eval_l0(c, s);
+        tokens_next(s);
+        return -eval_l2(c, s);
     } else if (tokens_get(s)->type == '+') {
         tokens_next(s);
-        return eval_l0(c, s);
+        return eval_l2(c, s);
+    } else if (tokens_get(s)->type == '~') {
+        tokens_next(s);
+        return ~eval_l2(c, s);
     } else {
         return eval_l0(c, s);
     }
 }
 
-static intmax_t eval_l4(Cuik_CPP* restrict c, TokenStream* restrict s) {
+static intmax_t eval_l3(Cuik_CPP* restrict c, TokenStream* restrict s) {
     intmax_t left = eval_l2(c, s);
 
+    while (tokens_get(s)->type == '*' ||
+        tokens_get(s)->type == '/' ||
+        tokens_get(s)->type == '%') {
+        int t = tokens_get(s)->type;
+        tokens_next(s);
+
+        // both sides of && and || get evaluated here so something like
+        // 'defined(N) && 100 / N' can divide by zero in the half that doesn't
+        // count, it's just 0.
+        intmax_t right = eval_l2(c, s);
+        if (t == '*') {
+            left = (left * right);
+        } else if (right == 0) {
+            left = 0;
+        } else if (t == '/') {
+            left = (left / right);
+        } else {
+            left = (left % right);
+        }
+    }
+
+    return left;
+}
+
+static intmax_t eval_l4(Cuik_CPP* restrict c, TokenStream* restrict s) {
+    intmax_t left = eval_l3(c, s);
+
     while (tokens_get(s)->type == '+' ||
         tokens_get(s)->type == '-') {
         int t = tokens_get(s)->type;
         tokens_next(s);
 
-        intmax_t right = eval_l2(c, s);
+        intmax_t right = eval_l3(c, s);
         if (t == '+')
             left = (left + right);
         else
@@ -30,6 +30,7 @@ CUIK_API void cuikpp_define_empty_slice(Cuik_CPP* ctx, size_t keylen, const char
     ctx->macro_bucket_values_start[e] = NULL;
     ctx->macro_bucket_values_end[e] = NULL;
     ctx->macro_bucket_source_locs[e] = 0;
+    ctx->macro_bucket_expansions[e] = 0;
 }
 
 CUIK_API void cuikpp_define_slice(Cuik_CPP* ctx, size_t keylen, const char* key, size_t vallen, const char* value) {
@@ -63,6 +64,7 @@ CUIK_API void cuikpp_define_slice(Cuik_CPP* ctx, size_t keylen, const char* key,
         ctx->macro_bucket_values_start[e] = (const unsigned char*)newvalue;
         ctx->macro_bucket_values_end[e] = (const unsigned char*)newvalue + vallen;
         ctx->macro_bucket_source_locs[e] = 0;
+        ctx->macro_bucket_expansions[e] = 0;
     }
 }
 
@@ -136,9 +138,7 @@ static bool memory_equals16(const unsigned char* src1, const unsigned char* src2
 }
 
 static bool find_define(Cuik_CPP* restrict c, size_t* out_index, const unsigned char* start, size_t length) {
-    #if CUIK__CPP_STATS
-    uint64_t start_ns = cuik_time_in_nanos();
-    #endif
+    c->stats.define_lookups += 1;
 
     uint64_t slot = hash_ident(start, length);
     size_t count = c->macro_bucket_count[slot];
@@ -160,11 +160,6 @@ static bool find_define(Cuik_CPP* restrict c, size_t* out_index, const unsigned
         i++;
     }
 
-    #if CUIK__CPP_STATS
-    uint64_t end_ns = cuik_time_in_nanos();
-    c->total_define_access_time += (end_ns - start_ns);
-    c->total_define_accesses += 1;
-    #endif
     return found;
 }
 
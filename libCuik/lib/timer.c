@@ -1,8 +1,13 @@
+// Profiler events don't get formatted or locked on the thread which reports them,
+// they're appended to a per-thread ring (the format string and raw arguments) and
+// a background thread drains the rings, formats the labels and hands them to the
+// profiler. This keeps the overhead low enough to leave --time on.
 #include <common.h>
 #include <threads.h>
 #include <cuik.h>
 #include <stdarg.h>
 #include <stdatomic.h>
+#include <stddef.h>
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -13,13 +18,107 @@ static LARGE_INTEGER timer_start;
 #else
 #include <time.h>
 #include <unistd.h>
+#include <pthread.h>
 #endif
 
-static mtx_t timer_mutex;
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#endif
+
+// 1 << RING_EXP is the size of each thread's ring in bytes
+#define RING_EXP 20
+
+// begin events leave this much room so the matching end events always fit
+#define END_RESERVE 8192
+
+// regions nested deeper than this don't get hardware counters
+#define MAX_HW_DEPTH 64
+
+// arguments past these limits are dropped from the label
+#define MAX_EVENT_ARGS 16
+#define MAX_EVENT_STRING 128
+
+enum {
+    EVENT_BEGIN,
+    EVENT_END,
+    EVENT_COUNTER,
+
+    // fills the end of the ring when an event doesn't fit before the wrap
+    EVENT_PAD,
+};
+
+typedef struct {
+    // in bytes, including this header and always a multiple of 8
+    uint32_t size;
+    uint32_t kind;
+    uint64_t nanos;
+
+    // followed by the arguments, 8 bytes each except for strings which are
+    // copied inline (NUL terminated and padded to 8 bytes) since they might
+    // not outlive the event. counters have their name here and the value
+    // as the only argument. ends are followed by the hardware counter
+    // deltas if they're on.
+    const char* fmt;
+} ProfileEvent;
+
+typedef struct ProfileRing ProfileRing;
+struct ProfileRing {
+    ProfileRing* next;
+    uint32_t tid;
+
+    // only the owning thread moves the head and only the flusher moves the tail
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+
+    // regions begun on this ring which haven't ended, an end while this is 0
+    // belongs to a region that began before the profiler started.
+    size_t depth;
+
+    // once a begin is dropped everything nested inside it (and the
+    // matching end) is dropped too.
+    size_t dropped_depth;
+
+    // perf_event group for this thread (-1 if there's none), hw_index maps
+    // each Cuik_HWCounter to its place in the group's reads or -1 if the CPU
+    // doesn't have it.
+    int hw_fd;
+    int hw_fds[CUIK_HW_COUNTER_COUNT];
+    int hw_index[CUIK_HW_COUNTER_COUNT];
+
+    // counter values when each open region started
+    size_t hw_depth;
+    uint64_t hw_stack[MAX_HW_DEPTH][CUIK_HW_COUNTER_COUNT];
+
+    _Alignas(8) uint8_t data[1u << RING_EXP];
+};
 
-static bool should_lock_profiler;
 static const Cuik_IProfiler* profiler;
-static uint64_t global_profiler_start;
+
+// every ring made for the current profiler, pushed to by the threads as they
+// report their first event.
+static _Atomic(ProfileRing*) rings;
+static _Atomic size_t dropped_events;
+
+// rings from an older profiler session are gone, the generation tells us
+// without touching them.
+static _Atomic uint32_t ring_generation;
+static thread_local ProfileRing* thread_ring;
+static thread_local uint32_t thread_ring_generation;
+
+static thrd_t flusher;
+static atomic_bool flusher_running;
+
+static bool hw_counters_enabled;
+
+static const char* hw_counter_names[CUIK_HW_COUNTER_COUNT] = {
+    [CUIK_HW_CYCLES]        = "cycles",
+    [CUIK_HW_INSTRUCTIONS]  = "instructions",
+    [CUIK_HW_L1D_MISSES]    = "L1D misses",
+    [CUIK_HW_LLC_MISSES]    = "LLC misses",
+    [CUIK_HW_BRANCH_MISSES] = "branch misses",
+};
 
 CUIK_API void init_timer_system(void) {
     #ifdef _WIN32
@@ -28,33 +127,435 @@ CUIK_API void init_timer_system(void) {
     #endif
 }
 
-CUIK_API void cuik_start_global_profiler(const Cuik_IProfiler* p, bool lock_on_plot) {
+static uint32_t get_thread_id(void) {
+    #if defined(_WIN32)
+    return GetCurrentThreadId();
+    #elif defined(__linux__)
+    return syscall(SYS_gettid);
+    #elif defined(__APPLE__)
+    uint64_t tid;
+    pthread_threadid_np(NULL, &tid);
+    return tid;
+    #else
+    return (uint32_t) (uintptr_t) pthread_self();
+    #endif
+}
+
+////////////////////////////////
+// Hardware counters
+////////////////////////////////
+#ifdef __linux__
+static int open_hw_counter(Cuik_HWCounter c, int group_fd) {
+    struct perf_event_attr attr = {
+        .size = sizeof(attr),
+        .read_format = PERF_FORMAT_GROUP,
+        // user space only, that's all perf_event_paranoid=2 lets us see anyways
+        .exclude_kernel = 1,
+        .exclude_hv = 1,
+    };
+
+    switch (c) {
+        case CUIK_HW_CYCLES:        attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+        case CUIK_HW_INSTRUCTIONS:  attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+        case CUIK_HW_LLC_MISSES:    attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+        case CUIK_HW_BRANCH_MISSES: attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+        case CUIK_HW_L1D_MISSES: {
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        }
+        default: return -1;
+    }
+
+    // pid 0 + cpu -1 is the calling thread on whichever core it's on
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+// the group is led by the first counter we manage to open, VMs tend to be
+// missing the cache events so it's fine if those don't show up.
+static int open_hw_group(int fds[CUIK_HW_COUNTER_COUNT], int hw_index[CUIK_HW_COUNTER_COUNT]) {
+    int leader = -1, count = 0;
+    for (int i = 0; i < CUIK_HW_COUNTER_COUNT; i++) {
+        fds[i] = open_hw_counter(i, leader);
+        if (fds[i] < 0) {
+            hw_index[i] = -1;
+            continue;
+        }
+
+        if (leader < 0) leader = fds[i];
+        hw_index[i] = count++;
+    }
+    return leader;
+}
+
+static void close_hw_group(int fds[CUIK_HW_COUNTER_COUNT]) {
+    for (int i = 0; i < CUIK_HW_COUNTER_COUNT; i++) {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+}
+
+static void read_hw_counters(ProfileRing* ring, uint64_t out[CUIK_HW_COUNTER_COUNT]) {
+    // with PERF_FORMAT_GROUP it's the count followed by the values
+    uint64_t values[1 + CUIK_HW_COUNTER_COUNT] = { 0 };
+    if (read(ring->hw_fd, values, sizeof(values)) < 0) {
+        memset(values, 0, sizeof(values));
+    }
+
+    for (int i = 0; i < CUIK_HW_COUNTER_COUNT; i++) {
+        out[i] = ring->hw_index[i] >= 0 ? values[1 + ring->hw_index[i]] : 0;
+    }
+}
+#else
+static int open_hw_group(int fds[CUIK_HW_COUNTER_COUNT], int hw_index[CUIK_HW_COUNTER_COUNT]) {
+    return -1;
+}
+
+static void close_hw_group(int fds[CUIK_HW_COUNTER_COUNT]) {
+}
+
+static void read_hw_counters(ProfileRing* ring, uint64_t out[CUIK_HW_COUNTER_COUNT]) {
+    memset(out, 0, CUIK_HW_COUNTER_COUNT * sizeof(uint64_t));
+}
+#endif
+
+CUIK_API bool cuik_profile_hw_counters(bool enable) {
+    if (enable) {
+        // see if we can open them at all
+        int fds[CUIK_HW_COUNTER_COUNT], hw_index[CUIK_HW_COUNTER_COUNT];
+        if (open_hw_group(fds, hw_index) < 0) return false;
+
+        close_hw_group(fds);
+    }
+
+    hw_counters_enabled = enable;
+    return true;
+}
+
+CUIK_API const char* cuik_hw_counter_name(Cuik_HWCounter counter) {
+    return counter < CUIK_HW_COUNTER_COUNT ? hw_counter_names[counter] : NULL;
+}
+
+static ProfileRing* get_thread_ring(void) {
+    uint32_t gen = atomic_load_explicit(&ring_generation, memory_order_relaxed);
+    if (thread_ring != NULL && thread_ring_generation == gen) {
+        return thread_ring;
+    }
+
+    ProfileRing* ring = cuik__valloc(sizeof(ProfileRing));
+    ring->tid = get_thread_id();
+    ring->hw_fd = hw_counters_enabled ? open_hw_group(ring->hw_fds, ring->hw_index) : -1;
+
+    ring->next = atomic_load(&rings);
+    while (!atomic_compare_exchange_weak(&rings, &ring->next, ring)) {}
+
+    thread_ring = ring;
+    thread_ring_generation = gen;
+    return ring;
+}
+
+static bool push_event(ProfileRing* ring, const ProfileEvent* e, size_t reserve) {
+    const size_t capacity = 1u << RING_EXP;
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    size_t offset = head & (capacity - 1);
+    size_t pad = offset + e->size > capacity ? capacity - offset : 0;
+    if ((capacity - (head - tail)) < pad + e->size + reserve) {
+        return false;
+    }
+
+    if (pad) {
+        ProfileEvent* p = (ProfileEvent*) &ring->data[offset];
+        p->size = pad;
+        p->kind = EVENT_PAD;
+        offset = 0;
+    }
+
+    memcpy(&ring->data[offset], e, e->size);
+    atomic_store_explicit(&ring->head, head + pad + e->size, memory_order_release);
+    return true;
+}
+
+////////////////////////////////
+// Deferred formatting
+////////////////////////////////
+typedef struct {
+    // where the conversion spec ends in the format string
+    const char* end;
+
+    // number of * in the width and precision
+    int stars;
+
+    char conv;
+    char length;
+} FormatSpec;
+
+static FormatSpec parse_format_spec(const char* p) {
+    FormatSpec spec = { 0 };
+    while (*p && strchr("-+ #0123456789.*", *p)) {
+        spec.stars += (*p == '*');
+        p++;
+    }
+
+    // hh and ll are squashed into a single modifier
+    if (*p == 'h' || *p == 'l') {
+        spec.length = *p++;
+        if (*p == spec.length) spec.length = (*p++ == 'l') ? 'q' : 'H';
+    } else if (*p && strchr("zjtL", *p)) {
+        spec.length = *p++;
+    }
+
+    spec.conv = *p ? *p++ : 0;
+    spec.end = p;
+    return spec;
+}
+
+static uint64_t read_int_arg(va_list* ap, char length) {
+    switch (length) {
+        case 'l': return va_arg(*ap, long);
+        case 'q': return va_arg(*ap, long long);
+        case 'z': return va_arg(*ap, size_t);
+        case 'j': return va_arg(*ap, intmax_t);
+        case 't': return va_arg(*ap, ptrdiff_t);
+        default:  return va_arg(*ap, int);
+    }
+}
+
+// copies the arguments into the event (which has room for the biggest possible
+// event) and sets its size, anything past the limits is left out.
+static void capture_args(ProfileEvent* e, va_list* ap) {
+    uint8_t* out = (uint8_t*) &e[1];
+    uint8_t* limit = out + (MAX_EVENT_ARGS * MAX_EVENT_STRING);
+
+    for (const char* p = e->fmt; *p; p++) {
+        if (*p != '%') continue;
+        if (p[1] == '%') { p++; continue; }
+
+        FormatSpec spec = parse_format_spec(p + 1);
+        p = spec.end - 1;
+
+        if (out + 8 * (spec.stars + 1) + MAX_EVENT_STRING > limit) {
+            break;
+        }
+
+        for (int i = 0; i < spec.stars; i++) {
+            uint64_t x = va_arg(*ap, int);
+            memcpy(out, &x, 8), out += 8;
+        }
+
+        switch (spec.conv) {
+            case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c': {
+                uint64_t x = read_int_arg(ap, spec.length);
+                memcpy(out, &x, 8), out += 8;
+                break;
+            }
+
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+                double x = spec.length == 'L' ? (double) va_arg(*ap, long double) : va_arg(*ap, double);
+                memcpy(out, &x, 8), out += 8;
+                break;
+            }
+
+            case 'p': {
+                void* x = va_arg(*ap, void*);
+                memcpy(out, &x, 8), out += 8;
+                break;
+            }
+
+            case 's': {
+                const char* str = va_arg(*ap, const char*);
+                if (str == NULL) str = "(null)";
+
+                size_t len = strlen(str);
+                if (len >= MAX_EVENT_STRING) len = MAX_EVENT_STRING - 1;
+
+                memcpy(out, str, len);
+                out[len] = 0;
+                out += (len + 8) & ~7;
+                break;
+            }
+
+            // anything else doesn't consume arguments we know about
+            default: goto done;
+        }
+    }
+
+    done:
+    e->size = out - (uint8_t*) e;
+}
+
+static void format_event(char* label, size_t cap, const ProfileEvent* e) {
+    const uint8_t* in = (const uint8_t*) &e[1];
+    const uint8_t* end = (const uint8_t*) e + e->size;
+
+    size_t len = 0;
+    for (const char* p = e->fmt; *p && len + 1 < cap;) {
+        if (*p != '%' || p[1] == '%') {
+            label[len++] = *p;
+            p += (*p == '%') ? 2 : 1;
+            continue;
+        }
+
+        FormatSpec spec = parse_format_spec(p + 1);
+        size_t spec_len = spec.end - p;
+
+        size_t need = (spec.stars + 1) * 8;
+        if (spec_len >= 32 || in + need > end) break;
+
+        char tmp[32];
+        memcpy(tmp, p, spec_len);
+        tmp[spec_len] = 0;
+        p = spec.end;
+
+        int stars[2] = { 0 };
+        for (int i = 0; i < spec.stars && i < 2; i++) {
+            uint64_t x;
+            memcpy(&x, in, 8), in += 8;
+            stars[i] = (int) x;
+        }
+
+        uint64_t x;
+        memcpy(&x, in, 8);
+
+        #define FORMAT(...) (spec.stars == 2 ? snprintf(&label[len], cap - len, tmp, stars[0], stars[1], __VA_ARGS__) : \
+                             spec.stars == 1 ? snprintf(&label[len], cap - len, tmp, stars[0], __VA_ARGS__) : \
+                             snprintf(&label[len], cap - len, tmp, __VA_ARGS__))
+        int n = 0;
+        switch (spec.conv) {
+            case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c': {
+                switch (spec.length) {
+                    case 'l': n = FORMAT((long) x); break;
+                    case 'q': n = FORMAT((long long) x); break;
+                    case 'z': n = FORMAT((size_t) x); break;
+                    case 'j': n = FORMAT((intmax_t) x); break;
+                    case 't': n = FORMAT((ptrdiff_t) x); break;
+                    default:  n = FORMAT((int) x); break;
+                }
+                in += 8;
+                break;
+            }
+
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+                double d;
+                memcpy(&d, &x, 8), in += 8;
+                n = spec.length == 'L' ? FORMAT((long double) d) : FORMAT(d);
+                break;
+            }
+
+            case 'p': {
+                n = FORMAT((void*) (uintptr_t) x);
+                in += 8;
+                break;
+            }
+
+            case 's': {
+                const char* str = (const char*) in;
+                n = FORMAT(str);
+                in += (strlen(str) + 8) & ~7;
+                break;
+            }
+        }
+        #undef FORMAT
+
+        if (n < 0) break;
+        len += n;
+        if (len >= cap) len = cap - 1;
+    }
+
+    label[len] = 0;
+}
+
+////////////////////////////////
+// Flushing
+////////////////////////////////
+static void drain_ring(const Cuik_IProfiler* p, ProfileRing* ring) {
+    const size_t capacity = 1u << RING_EXP;
+
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    while (tail != head) {
+        const ProfileEvent* e = (const ProfileEvent*) &ring->data[tail & (capacity - 1)];
+
+        if (e->kind == EVENT_BEGIN) {
+            char label[256];
+            format_event(label, sizeof(label), e);
+            CUIK_CALL(p, begin_plot, e->nanos, ring->tid, label);
+        } else if (e->kind == EVENT_END) {
+            const uint64_t* counters = e->size > sizeof(ProfileEvent) ? (const uint64_t*) &e[1] : NULL;
+            CUIK_CALL(p, end_plot, e->nanos, ring->tid, counters);
+        } else if (e->kind == EVENT_COUNTER && p->counter != NULL) {
+            int64_t value;
+            memcpy(&value, &e[1], sizeof(value));
+            CUIK_CALL(p, counter, e->nanos, ring->tid, e->fmt, value);
+        }
+
+        tail += e->size;
+    }
+
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+}
+
+static void drain_rings(const Cuik_IProfiler* p) {
+    for (ProfileRing* r = atomic_load(&rings); r != NULL; r = r->next) {
+        drain_ring(p, r);
+    }
+}
+
+static int flusher_thread(void* arg) {
+    while (atomic_load_explicit(&flusher_running, memory_order_relaxed)) {
+        drain_rings(arg);
+        thrd_sleep(&(struct timespec){ .tv_nsec = 1000000 }, NULL);
+    }
+    return 0;
+}
+
+CUIK_API void cuik_start_global_profiler(const Cuik_IProfiler* p) {
     assert(p != NULL);
     assert(profiler == NULL);
 
-    profiler = p;
-    should_lock_profiler = lock_on_plot;
+    atomic_fetch_add(&ring_generation, 1);
+    atomic_store(&dropped_events, 0);
 
-    if (lock_on_plot) {
-        mtx_init(&timer_mutex, mtx_plain);
-    }
+    CUIK_CALL(p, start);
 
-    CUIK_CALL(profiler, start);
+    flusher_running = true;
+    if (thrd_create(&flusher, flusher_thread, (void*) p) != thrd_success) {
+        fprintf(stderr, "error: could not create profiler thread!\n");
+        abort();
+    }
 
-    global_profiler_start = cuik_time_in_nanos();
-    CUIK_CALL(profiler, begin_plot, global_profiler_start, "libCuik");
+    profiler = p;
+    cuik_profile_region_start(cuik_time_in_nanos(), "libCuik");
 }
 
 CUIK_API void cuik_stop_global_profiler(void) {
     assert(profiler != NULL);
+    cuik_profile_region_end();
+
+    // no more events after this point
+    const Cuik_IProfiler* p = profiler;
+    profiler = NULL;
 
-    CUIK_CALL(profiler, end_plot, cuik_time_in_nanos());
-    CUIK_CALL(profiler, stop);
+    flusher_running = false;
+    thrd_join(flusher, NULL);
+    drain_rings(p);
 
-    if (should_lock_profiler) {
-        mtx_destroy(&timer_mutex);
+    CUIK_CALL(p, stop);
+
+    ProfileRing* r = atomic_exchange(&rings, NULL);
+    while (r != NULL) {
+        ProfileRing* next = r->next;
+        if (r->hw_fd >= 0) close_hw_group(r->hw_fds);
+        cuik__vfree(r, sizeof(ProfileRing));
+        r = next;
+    }
+
+    size_t dropped = atomic_load(&dropped_events);
+    if (dropped) {
+        fprintf(stderr, "warning: profiler dropped %zu events (the flusher couldn't keep up)\n", dropped);
     }
-    profiler = NULL;
 }
 
 CUIK_API bool cuik_is_profiling(void) {
@@ -78,25 +579,93 @@ CUIK_API uint64_t cuik_time_in_nanos(void) {
 CUIK_API void cuik_profile_region_start(uint64_t nanos, const char* fmt, ...) {
     if (profiler == NULL) return;
 
-    // lock if necessary
-    if (should_lock_profiler) mtx_lock(&timer_mutex);
+    ProfileRing* ring = get_thread_ring();
+    if (ring->dropped_depth > 0) {
+        ring->dropped_depth += 1;
+        atomic_fetch_add_explicit(&dropped_events, 1, memory_order_relaxed);
+        return;
+    }
+
+    _Alignas(8) uint8_t buffer[sizeof(ProfileEvent) + (MAX_EVENT_ARGS * MAX_EVENT_STRING)];
+    ProfileEvent* e = (ProfileEvent*) buffer;
+    e->kind = EVENT_BEGIN;
+    e->nanos = nanos;
+    e->fmt = fmt;
 
-    char label[256];
     va_list ap;
     va_start(ap, fmt);
-    vsnprintf(label, sizeof(label), fmt, ap);
-    label[sizeof(label) - 1] = '\0';
+    capture_args(e, &ap);
     va_end(ap);
 
-    CUIK_CALL(profiler, begin_plot, nanos, label);
-    if (should_lock_profiler) mtx_unlock(&timer_mutex);
+    if (!push_event(ring, e, END_RESERVE)) {
+        ring->dropped_depth = 1;
+        atomic_fetch_add_explicit(&dropped_events, 1, memory_order_relaxed);
+        return;
+    }
+    ring->depth += 1;
+
+    // sampled last so the region doesn't pay for its own bookkeeping
+    if (ring->hw_fd >= 0) {
+        if (ring->hw_depth < MAX_HW_DEPTH) {
+            read_hw_counters(ring, ring->hw_stack[ring->hw_depth]);
+        }
+        ring->hw_depth += 1;
+    }
 }
 
 CUIK_API void cuik_profile_region_end(void) {
     if (profiler == NULL) return;
     uint64_t nanos = cuik_time_in_nanos();
 
-    if (should_lock_profiler) mtx_lock(&timer_mutex);
-    CUIK_CALL(profiler, end_plot, nanos);
-    if (should_lock_profiler) mtx_unlock(&timer_mutex);
+    ProfileRing* ring = get_thread_ring();
+    uint64_t now[CUIK_HW_COUNTER_COUNT];
+    if (ring->hw_fd >= 0) {
+        read_hw_counters(ring, now);
+    }
+
+    if (ring->dropped_depth > 0) {
+        ring->dropped_depth -= 1;
+        return;
+    }
+
+    // its begin went to an older profiler (or none at all), the ring never saw it
+    if (ring->depth == 0) {
+        return;
+    }
+    ring->depth -= 1;
+
+    struct {
+        ProfileEvent e;
+        uint64_t counters[CUIK_HW_COUNTER_COUNT];
+    } end = { { sizeof(ProfileEvent), EVENT_END, nanos } };
+
+    if (ring->hw_fd >= 0) {
+        ring->hw_depth -= 1;
+
+        if (ring->hw_depth < MAX_HW_DEPTH) {
+            for (int i = 0; i < CUIK_HW_COUNTER_COUNT; i++) {
+                end.counters[i] = now[i] - ring->hw_stack[ring->hw_depth][i];
+            }
+            end.e.size = sizeof(end);
+        }
+    }
+
+    // the begins left room for this, if it's really that nested we wait
+    while (!push_event(ring, &end.e, 0)) {
+        thrd_yield();
+    }
+}
+
+CUIK_API void cuik_profile_counter(const char* name, int64_t value) {
+    if (profiler == NULL) return;
+
+    struct {
+        ProfileEvent e;
+        int64_t value;
+    } c = { { sizeof(c), EVENT_COUNTER, cuik_time_in_nanos(), name }, value };
+
+    // losing a sample isn't a big deal, the next one corrects it
+    if (!push_event(get_thread_ring(), &c.e, END_RESERVE)) {
+        atomic_fetch_add_explicit(&dropped_events, 1, memory_order_relaxed);
+    }
 }
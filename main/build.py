@@ -57,6 +57,28 @@ for f in list:
 	objs.append("bin/"+obj)
 
 ninja.write(f"build cuik{exe_ext}: link {' '.join(objs)} ../libCuik/libcuik.lib ../tilde-backend/tildebackend.lib\n")
+
+# the benchmark driver lives with the other drivers but it wants to sit next to cuik
+# since it finds the repo (and the test suite) the same way
+bench_objs = ["bin/bench_driver.o"] + [o for o in objs if "threads_msvc" in o]
+ninja.write(f"build bin/bench_driver.o: cc ../drivers/bench_driver.c\n  cflags = $cflags -I src\n")
+ninja.write(f"build cuik_bench{exe_ext}: link {' '.join(bench_objs)} ../libCuik/libcuik.lib ../tilde-backend/tildebackend.lib\n")
+
+# checks the AST caches against a normal parse over tests/the_prelude
+ninja.write(f"build bin/prelude_test.o: cc ../drivers/prelude_test.c\n  cflags = $cflags -I src\n")
+ninja.write(f"build cuik_prelude_test{exe_ext}: link bin/prelude_test.o {' '.join(bench_objs[1:])} ../libCuik/libcuik.lib ../tilde-backend/tildebackend.lib\n")
+
+# links and runs tests/the_increment/link with the built-in ELF linker
+ninja.write(f"build bin/link_test.o: cc ../drivers/link_test.c\n  cflags = $cflags -I src\n")
+ninja.write(f"build cuik_link_test{exe_ext}: link bin/link_test.o {' '.join(bench_objs[1:])} ../libCuik/libcuik.lib ../tilde-backend/tildebackend.lib\n")
+
+# reparses tests/the_reparse/base.c as each of its edits and checks it against a full parse
+ninja.write(f"build bin/reparse_test.o: cc ../drivers/reparse_test.c\n  cflags = $cflags -I src\n")
+ninja.write(f"build cuik_reparse_test{exe_ext}: link bin/reparse_test.o {' '.join(bench_objs[1:])} ../libCuik/libcuik.lib ../tilde-backend/tildebackend.lib\n")
+
+# walks the compact AST of a few files in tests in lockstep with the normal one
+ninja.write(f"build bin/compact_test.o: cc ../drivers/compact_test.c\n  cflags = $cflags -I src\n")
+ninja.write(f"build cuik_compact_test{exe_ext}: link bin/compact_test.o {' '.join(bench_objs[1:])} ../libCuik/libcuik.lib ../tilde-backend/tildebackend.lib\n")
 ninja.close()
 
 subprocess.call(['ninja'])
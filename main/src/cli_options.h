@@ -7,10 +7,12 @@ OPTION(HELP,       h, help,        0, "print all the options and exit")
 OPTION(OUT,        o, output,      1, "set the output path")
 OPTION(INCLUDE,    I, include,     1, "add include directory")
 OPTION(PREPROC,    P, preprocess,  0, "preprocess file and output to stdout")
-OPTION(RUN,        r, run,         0, "execute compiled program")
+OPTION(RUN,        r, run,         0, "execute compiled program, arguments after -- are passed to it")
 OPTION(LIB,        l, lib,         1, "add library to compilation unit")
 OPTION(NOCRT,      _, nocrt,       0, "don't include and link against the default CRT")
-OPTION(TIME,       T, time,        0, "profile the compile times")
+OPTION(TIME,       T, time,        0, "profile the compile times and print a summary at exit")
+OPTION(HWCOUNTERS, _, hwcounters,  0, "profile with cycles, instructions, cache and branch misses per region (Linux only)")
+OPTION(PERFETTO,   _, perfetto,    0, "profile the compile times into a Chrome/Perfetto JSON trace with counter tracks")
 OPTION(FLAVOR,     _, flavor,      1, "choose the output file format (`--list flavors` to list options)")
 OPTION(DEBUG,      g, debugsyms,   0, "emit debug information")
 OPTION(OBJ,        c, obj,         0, "dont link, only emit the object file")
@@ -28,6 +30,11 @@ OPTION(VERBOSE,    _, verbose,     0, "verbose")
 OPTION(THREADS,    _, threads,     1, "number of extra threads spawned")
 OPTION(SYNTAX_ONLY,_, syntax,      0, "type check only")
 OPTION(EXERCISE,   _, exercise,    0, "motion sickness from using a decent compiler")
+OPTION(WATCH,      _, watch,       0, "stay alive and recompile whenever an input or one of its includes changes (Linux only)")
+OPTION(INCLINK,    _, incremental, 0, "relink by patching the previous executable when possible (Linux only)")
+OPTION(PRELUDE,    _, prelude,     0, "parse the headers files start with once and share the declarations between them")
+OPTION(SERVER,     _, server,      1, "stay resident and take compile requests over this unix socket")
+OPTION(CONNECT,    _, connect,     1, "forward the compile to a server on this unix socket")
 
 OPTION(TBTESTS,    _, tbtests,     0, "runs the TB test suite")
 
@@ -5,46 +5,29 @@
 #define SPALL_IMPLEMENTATION
 #include "flint.h"
 
+// libCuik calls us from a single flushing thread so one buffer does the job
 static SpallProfile ctx;
-static _Thread_local SpallBuffer muh_buffer;
+static SpallBuffer muh_buffer;
 
-void flintperf__start_thread(void) {
+static void flintperf__start(void* user_data) {
     size_t size = 4 * 1024 * 1024;
+    ctx = SpallInit((char*) user_data, 1.0 / 1000.0);
     muh_buffer = (SpallBuffer){ malloc(size), size };
     SpallBufferInit(&ctx, &muh_buffer);
 }
 
-void flintperf__stop_thread(void) {
-    SpallBufferQuit(&ctx, &muh_buffer);
-}
-
-static void flintperf__start(void* user_data) {
-    ctx = SpallInit((char*) user_data, 1.0 / 1000.0);
-    flintperf__start_thread();
-}
-
 static void flintperf__stop(void* user_data) {
-    flintperf__stop_thread();
+    SpallBufferQuit(&ctx, &muh_buffer);
+    free(muh_buffer.data);
     SpallQuit(&ctx);
 }
 
-static void flintperf__begin_plot(void* user_data, uint64_t nanos, const char* label) {
-    #if _WIN32
-    uint32_t tid = GetCurrentThreadId();
-    #else
-    uint32_t tid = getpid();
-    #endif
-
+static void flintperf__begin_plot(void* user_data, uint64_t nanos, uint32_t tid, const char* label) {
     SpallTraceBeginTid(&ctx, &muh_buffer, nanos, label, tid);
 }
 
-static void flintperf__end_plot(void* user_data, uint64_t nanos) {
-    #if _WIN32
-    uint32_t tid = GetCurrentThreadId();
-    #else
-    uint32_t tid = getpid();
-    #endif
-
+// spall has nowhere to put the hardware counters
+static void flintperf__end_plot(void* user_data, uint64_t nanos, uint32_t tid, const uint64_t* counters) {
     SpallTraceEndTid(&ctx, &muh_buffer, nanos, tid);
 }
 
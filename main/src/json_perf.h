@@ -1,45 +1,90 @@
-#if 0
+// Chrome's trace event format, it loads in Perfetto (ui.perfetto.dev) and chrome://tracing.
+// the counters show up as their own tracks so memory and the job queue line up with
+// the phases.
 #include <stdio.h>
-#include <threads.h>
 
 static FILE* jsonperf__file;
+static bool jsonperf__first;
+
+static void jsonperf__begin_event(const char* ph, uint64_t nanos, uint32_t tid) {
+    fprintf(jsonperf__file,
+        "%s{\"ph\":\"%s\",\"pid\":0,\"tid\":%u,\"ts\":%.3f",
+        jsonperf__first ? "" : ",\n", ph, tid, nanos / 1000.0);
+
+    jsonperf__first = false;
+}
+
+static void jsonperf__write_name(const char* name) {
+    fputs(",\"name\":\"", jsonperf__file);
+    for (const char* p = name; *p; p++) {
+        // paths on windows are full of backslashes
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', jsonperf__file);
+            fputc(*p, jsonperf__file);
+        } else if ((unsigned char) *p < 0x20) {
+            fprintf(jsonperf__file, "\\u%04x", *p);
+        } else {
+            fputc(*p, jsonperf__file);
+        }
+    }
+    fputc('"', jsonperf__file);
+}
 
 static void jsonperf__start(void* user_data) {
     jsonperf__file = fopen((char*) user_data, "wb");
-    fprintf(jsonperf__file, "{\"otherData\": {},\"traceEvents\":[");
+    if (jsonperf__file == NULL) {
+        fprintf(stderr, "error: could not open %s for the trace\n", (char*) user_data);
+        return;
+    }
+
+    jsonperf__first = true;
+    fprintf(jsonperf__file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
 }
 
 static void jsonperf__stop(void* user_data) {
-    fseek(jsonperf__file, -2, SEEK_CUR);
-    fprintf(jsonperf__file, "\n]}");
+    if (jsonperf__file == NULL) return;
+
+    fprintf(jsonperf__file, "\n]}\n");
     fclose(jsonperf__file);
+    jsonperf__file = NULL;
 }
 
-static void jsonperf__plot(void* user_data, uint64_t start_ns, uint64_t end_ns, const char* label) {
-    double elapsed_in_microseconds = (end_ns - start_ns) / 1000.0;
-    double start_in_microseconds = start_ns / 1000.0;
+static void jsonperf__begin_plot(void* user_data, uint64_t nanos, uint32_t tid, const char* label) {
+    if (jsonperf__file == NULL) return;
 
-    #if _WIN32
-    uint32_t tid = GetCurrentThreadId();
-    #else
-    uint32_t tid = pthread_self();
-    #endif
+    jsonperf__begin_event("B", nanos, tid);
+    jsonperf__write_name(label);
+    fputc('}', jsonperf__file);
+}
 
-    fprintf(jsonperf__file,
-        "{\"cat\":\"function\", "
-        "\"dur\":%f, "
-        "\"name\":\"%s\", "
-        "\"ph\":\"X\", "
-        "\"pid\":0, "
-        "\"tid\": %u, "
-        "\"ts\": %f},\n",
-        elapsed_in_microseconds, label, tid,
-        start_in_microseconds);
+static void jsonperf__end_plot(void* user_data, uint64_t nanos, uint32_t tid, const uint64_t* counters) {
+    if (jsonperf__file == NULL) return;
+
+    jsonperf__begin_event("E", nanos, tid);
+
+    // the args on the end get merged into the slice
+    if (counters != NULL) {
+        fputs(",\"args\":{", jsonperf__file);
+        for (int i = 0; i < CUIK_HW_COUNTER_COUNT; i++) {
+            fprintf(jsonperf__file, "%s\"%s\":%llu", i ? "," : "", cuik_hw_counter_name(i), (unsigned long long) counters[i]);
+        }
+        fputc('}', jsonperf__file);
+    }
+    fputc('}', jsonperf__file);
+}
+
+static void jsonperf__counter(void* user_data, uint64_t nanos, uint32_t tid, const char* name, int64_t value) {
+    if (jsonperf__file == NULL) return;
+
+    jsonperf__begin_event("C", nanos, tid);
+    jsonperf__write_name(name);
+    fprintf(jsonperf__file, ",\"args\":{\"value\":%lld}}", (long long) value);
 }
 
 static Cuik_IProfiler jsonperf_profiler = {
-    .start = jsonperf__start,
-    .stop = jsonperf__stop,
-    .plot = jsonperf__plot
+    .start      = jsonperf__start,
+    .stop       = jsonperf__stop,
+    .begin_plot = jsonperf__begin_plot,
+    .end_plot   = jsonperf__end_plot,
+    .counter    = jsonperf__counter,
 };
-#endif
\ No newline at end of file
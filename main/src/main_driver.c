@@ -5,6 +5,7 @@
 #include "json_perf.h"
 #include "flint_perf.h"
 #include "bindgen.h"
+#include "time_report.h"
 #include <dyn_array.h>
 
 #ifndef __CUIK__
@@ -19,10 +20,33 @@
 #include "threadpool.h"
 #endif
 
+#ifdef __linux__
+#include <dlfcn.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+// tasks are packed until they reach roughly this much work, the costs
+// are estimated from the token counts of the function bodies
 enum {
-    IRGEN_TASK_BATCH_SIZE = 8192,
-    TB_TASK_BATCH_SIZE = 8192,
+    IRGEN_TASK_QUANTUM = 16384,
+    TB_TASK_QUANTUM = 16384,
 };
+
+// --watch waits for the events to stop for this long before rebuilding, saving a
+// file tends to come in a few steps (write a temporary, rename it over the original)
+enum { WATCH_SETTLE_MS = 50 };
 #define TIMESTAMP(x) if (args_verbose) mark_timestamp(x)
 
 // compiler arguments
@@ -45,24 +69,101 @@ static bool args_nocrt;
 static bool args_pploc;
 static bool args_assembly;
 static bool args_time;
+static bool args_perfetto;
+static bool args_hw_counters;
 static bool args_verbose;
 static bool args_syntax_only;
 static bool args_debug_info;
 static bool args_preprocess;
 static bool args_exercise;
+static bool args_watch;
+static bool args_incremental_link;
+static bool args_prelude;
+static bool server_mode;
 static bool args_use_syslinker = true;
 static int args_threads = -1;
 
 static Bindgen* args_bindgen;
 static int args_opt_level;
 
+// everything after a -- is handed to the program when we --run it
+static int jit_argc;
+static char** jit_argv;
+static int jit_exit_code;
+
 static TB_Module* mod;
 static Cuik_FileCache* fscache;
 
+// filled in by irgen, the codegen will reuse the same cost estimates
+typedef struct {
+    TranslationUnit* tu;
+    Stmt* stmt;
+    TB_Function* func;
+    size_t cost;
+} WorkItem;
+
+static WorkItem* work_items;
+static size_t work_item_count;
+
 static Cuik_IThreadpool* ithread_pool;
 static CompilationUnit compilation_unit;
 static Cuik_Target target_desc;
 
+#if CUIK_ALLOW_THREADS
+static threadpool_t* thread_pool;
+#endif
+
+// --watch and --server report errors without exiting and hold onto
+// the caches between builds
+static bool keep_alive;
+
+// only set when keep_alive, otherwise a failed build just exits
+static bool build_failed;
+
+// in --watch every input remembers which files it pulled in so an edit only
+// rebuilds the TUs which could've seen it.
+typedef struct {
+    const char* input;
+
+    // everything the preprocessor loaded (including the input itself)
+    DynArray(char*) deps;
+
+    // only kept by the type checking modes since TB can't drop a TU's functions
+    // out of a module, NULL if the last parse failed.
+    TranslationUnit* tu;
+    bool dirty;
+} WatchTarget;
+
+// we watch the directories rather than the files because editors like to save
+// by renaming a new file over the old one which kills a watch on the file itself.
+typedef struct {
+    int wd;
+    // ends with a slash
+    char* path;
+} WatchDir;
+
+// parallel to input_files
+static WatchTarget* watch_targets;
+static DynArray(WatchDir) watch_dirs;
+
+// --prelude parses the headers a file includes up top once and every other file
+// which starts with the same tokens loads the declarations from the cache.
+typedef struct {
+    uint64_t hash;
+    size_t token_count;
+
+    // the type layouts in the cache depend on the target
+    const Cuik_ArchDesc* arch;
+    Cuik_System sys;
+
+    // NULL if the tokens don't parse on their own or can't be cached
+    void* data;
+    size_t size;
+} PreludeEntry;
+
+// it's keyed on the tokens so --server holds onto it between requests
+static DynArray(PreludeEntry) preludes;
+
 static struct {
     const char* key;
 
@@ -138,6 +239,21 @@ static void tp_submit(void* user_data, void fn(void*), void* arg) {
 static void tp_work_one_job(void* user_data) {
     threadpool_work_one_job((threadpool_t*) user_data);
 }
+
+static void start_thread_pool(void) {
+    int thread_count = args_threads >= 0 ? args_threads : calculate_worker_thread_count();
+    if (thread_count > 1) {
+        if (args_verbose) printf("Starting with %d threads...\n", thread_count);
+
+        thread_pool = threadpool_create(thread_count - 1, 4096);
+        ithread_pool = malloc(sizeof(Cuik_IThreadpool));
+        *ithread_pool = (Cuik_IThreadpool){
+            .user_data = thread_pool,
+            .submit = tp_submit,
+            .work_one_job = tp_work_one_job
+        };
+    }
+}
 #endif
 
 static int count_pp_lines(TokenStream* s) {
@@ -218,9 +334,7 @@ static void dump_tokens(FILE* out_file, TokenStream* s) {
 }
 
 typedef struct {
-    TranslationUnit* tu;
-
-    Stmt** stmts;
+    WorkItem* items;
     size_t count;
 
     #if CUIK_ALLOW_THREADS
@@ -228,6 +342,27 @@ typedef struct {
     #endif
 } IRGenTask;
 
+static int compare_work_items(const void* a, const void* b) {
+    size_t a_cost = ((const WorkItem*) a)->cost;
+    size_t b_cost = ((const WorkItem*) b)->cost;
+
+    // biggest first
+    return (a_cost < b_cost) - (a_cost > b_cost);
+}
+
+// returns the number of items from the front of the list which make up one
+// batch, the items are sorted by cost so the huge ones end up on their own
+// and the tiny ones are packed together until they make up a quantum.
+static size_t next_work_batch(WorkItem* items, size_t count, size_t quantum) {
+    size_t i = 0, total = 0;
+    while (i < count && total < quantum) {
+        total += items[i].cost;
+        i += 1;
+    }
+
+    return i;
+}
+
 static void irgen_job(void* arg) {
     IRGenTask task = *((IRGenTask*) arg);
 
@@ -243,22 +378,19 @@ static void irgen_job(void* arg) {
     CUIK_TIMED_BLOCK("IrGen: %zu", task.count) {
         size_t i = 0;
         while (i < task.count) {
-            // skip all the typedefs
-            if (task.stmts[i]->decl.attrs.is_typedef || !task.stmts[i]->decl.attrs.is_used) {
-                i += 1;
-                continue;
-            }
+            WorkItem* item = &task.items[i];
 
             TB_Function* func = NULL;
-            const char* name = task.stmts[i]->decl.name;
+            const char* name = item->stmt->decl.name;
             if (name == NULL) {
                 // these are untracked in the gen ir because they don't map to named IR stuff
-                func = cuik_stmt_gen_ir(task.tu, task.stmts[i]);
+                func = cuik_stmt_gen_ir(item->tu, item->stmt);
             } else {
                 CUIK_TIMED_BLOCK("IrGen: %s", name) {
-                    func = cuik_stmt_gen_ir(task.tu, task.stmts[i]);
+                    func = cuik_stmt_gen_ir(item->tu, item->stmt);
                 }
             }
+            item->func = func;
 
             if (func != NULL) {
                 CUIK_TIMED_BLOCK("Canonicalize: %s", name) {
@@ -287,7 +419,8 @@ static void irgen_job(void* arg) {
 }
 
 typedef struct {
-    TB_Function* start;
+    WorkItem* items;
+    size_t count;
 
     #if CUIK_ALLOW_THREADS
     atomic_size_t* remaining;
@@ -297,12 +430,9 @@ typedef struct {
 static void codegen_job(void* arg) {
     CodegenTask task = *((CodegenTask*) arg);
 
-    CUIK_TIMED_BLOCK("Codegen") {
-        TB_Function* f = task.start;
-
-        for (size_t i = 0; i < TB_TASK_BATCH_SIZE && f != NULL; i++) {
-            tb_module_compile_function(mod, f, TB_ISEL_FAST);
-            f = tb_next_function(f);
+    CUIK_TIMED_BLOCK("Codegen: %zu", task.count) {
+        for (size_t i = 0; i < task.count; i++) {
+            tb_module_compile_function(mod, task.items[i].func, TB_ISEL_FAST);
         }
     }
 
@@ -311,6 +441,46 @@ static void codegen_job(void* arg) {
     #endif
 }
 
+static void free_preprocessor(Cuik_CPP* cpp) {
+    cuikpp_deinit(cpp);
+    free(cpp);
+}
+
+static void mark_build_failed(void) {
+    cuik_lock_compilation_unit(&compilation_unit);
+    build_failed = true;
+    cuik_unlock_compilation_unit(&compilation_unit);
+}
+
+static WatchTarget* find_watch_target(const char* input) {
+    if (watch_targets == NULL) return NULL;
+
+    dyn_array_for(i, input_files) {
+        if (strcmp(watch_targets[i].input, input) == 0) {
+            return &watch_targets[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void record_watch_deps(Cuik_CPP* cpp) {
+    WatchTarget* target = find_watch_target(cuikpp_get_main_file(cuikpp_get_token_stream(cpp)));
+    if (target == NULL) return;
+
+    dyn_array_for(i, target->deps) {
+        free(target->deps[i]);
+    }
+    dyn_array_clear(target->deps);
+
+    CUIKPP_FOR_FILES(it, cpp) {
+        // skip the fake files like <temp>
+        if (it.file->filepath[0] != '<') {
+            dyn_array_put(target->deps, strdup(it.file->filepath));
+        }
+    }
+}
+
 // it'll use the normal CLI crap to do so
 static Cuik_CPP* make_preprocessor(const char* filepath) {
     Cuik_CPP* cpp = malloc(sizeof(Cuik_CPP));
@@ -341,8 +511,25 @@ static Cuik_CPP* make_preprocessor(const char* filepath) {
     }
 
     // run the preprocessor
-    if (cuikpp_default_run(cpp, fscache) == CUIKPP_ERROR) {
-        abort();
+    Cuikpp_Status status = cuikpp_default_run(cpp, fscache);
+
+    // even a broken include is worth tracking, fixing it should trigger a rebuild
+    if (watch_targets != NULL) {
+        record_watch_deps(cpp);
+    }
+
+    if (status == CUIKPP_ERROR) {
+        if (!keep_alive) abort();
+
+        mark_build_failed();
+        free_preprocessor(cpp);
+        return NULL;
+    }
+
+    if (args_time) {
+        cuik_lock_compilation_unit(&compilation_unit);
+        timereport_add_preprocessor(cpp);
+        cuik_unlock_compilation_unit(&compilation_unit);
     }
 
     if (args_bindgen != NULL) {
@@ -369,9 +556,99 @@ static Cuik_CPP* make_preprocessor(const char* filepath) {
     return cpp;
 }
 
-static void free_preprocessor(Cuik_CPP* cpp) {
-    cuikpp_deinit(cpp);
-    free(cpp);
+// files somewhere between preprocessing and the compilation unit, it's plotted
+// next to the job queue to see how well the frontend is saturating the threads.
+static atomic_int tus_in_flight;
+
+static void track_tus_in_flight(int delta) {
+    cuik_profile_counter("TUs in flight", atomic_fetch_add(&tus_in_flight, delta) + delta);
+}
+
+static PreludeEntry* find_prelude(uint64_t hash, size_t token_count) {
+    dyn_array_for(i, preludes) {
+        PreludeEntry* e = &preludes[i];
+        if (e->hash == hash && e->token_count == token_count && e->arch == target_desc.arch && e->sys == target_desc.sys) {
+            return e;
+        }
+    }
+
+    return NULL;
+}
+
+// parses the first token_count tokens as a TU of their own and caches it, the
+// TU has to be incremental so the bodies can be found in the tokens later.
+static PreludeEntry make_prelude(TokenStream* tokens, size_t token_count, uint64_t hash) {
+    PreludeEntry e = { hash, token_count, target_desc.arch, target_desc.sys };
+
+    // the TU takes ownership of the token array
+    TokenStream prefix = *tokens;
+    prefix.tokens = dyn_array_create_with_initial_cap(Token, token_count + 1);
+    prefix.current = 0;
+    for (size_t i = 0; i < token_count; i++) {
+        dyn_array_put(prefix.tokens, tokens->tokens[i]);
+    }
+
+    Token eof = { 0, true, 0, NULL, NULL };
+    dyn_array_put(prefix.tokens, eof);
+
+    Cuik_ErrorStatus errors;
+    Cuik_TranslationUnitDesc desc = {
+        .tokens      = &prefix,
+        .errors      = &errors,
+        .target      = &target_desc,
+        #if CUIK_ALLOW_THREADS
+        .thread_pool = ithread_pool ? ithread_pool : NULL,
+        #endif
+        .incremental = true,
+    };
+
+    // if the headers don't stand on their own (they end halfway through a declaration
+    // the file finishes) we just don't have a prelude for them.
+    TranslationUnit* tu = cuik_parse_translation_unit(&desc);
+    if (tu != NULL) {
+        e.data = cuik_serialize_translation_unit(tu, &e.size);
+        cuik_destroy_translation_unit(tu);
+    }
+
+    return e;
+}
+
+// sets up the prelude for the headers the file starts with, the tokens are skipped
+// to the first one it doesn't cover.
+static void use_prelude(Cuik_TranslationUnitDesc* desc) {
+    TokenStream* tokens = desc->tokens;
+    size_t token_count = cuikpp_count_prelude_tokens(tokens);
+    if (token_count == 0) return;
+
+    uint64_t hash = cuik_hash_tokens(tokens, token_count);
+
+    cuik_lock_compilation_unit(&compilation_unit);
+    PreludeEntry* e = find_prelude(hash, token_count);
+    PreludeEntry found = e ? *e : (PreludeEntry){ 0 };
+    cuik_unlock_compilation_unit(&compilation_unit);
+
+    if (e == NULL) {
+        // it's built without the lock, if someone beat us to it we toss ours
+        CUIK_TIMED_BLOCK("prelude") {
+            found = make_prelude(tokens, token_count, hash);
+        }
+
+        cuik_lock_compilation_unit(&compilation_unit);
+        e = find_prelude(hash, token_count);
+        if (e != NULL) {
+            free(found.data);
+            found = *e;
+        } else {
+            dyn_array_put(preludes, found);
+        }
+        cuik_unlock_compilation_unit(&compilation_unit);
+    }
+
+    if (found.data != NULL) {
+        desc->prelude = found.data;
+        desc->prelude_size = found.size;
+        tokens->current = token_count;
+    }
 }
 
 static void compile_file(void* arg) {
@@ -388,12 +665,53 @@ static void compile_file(void* arg) {
         #if CUIK_ALLOW_THREADS
         .thread_pool    = ithread_pool ? ithread_pool : NULL,
         #endif
+        // if we're only checking the code, the diagnostics are the point
+        .check_unreachable = args_syntax_only || args_types,
+        // without a module --watch keeps the TUs to patch the function bodies
+        .incremental = args_watch && mod == NULL,
     };
 
+    // incremental TUs diff against their tokens so they don't take preludes
+    if (args_prelude && !desc.incremental) {
+        use_prelude(&desc);
+    }
+
+    WatchTarget* target = desc.incremental ? find_watch_target(cuikpp_get_main_file(desc.tokens)) : NULL;
+    if (target != NULL && target->tu != NULL) {
+        TranslationUnit* old = target->tu;
+
+        Stmt** dirty;
+        size_t dirty_count;
+        Cuik_ReparseStatus status = cuik_reparse_translation_unit(old, &desc, &dirty, &dirty_count);
+        if (status == CUIK_REPARSE_OK) {
+            // we're not generating IR so we don't care which ones changed
+            free(dirty);
+            free_preprocessor(cuik_set_translation_unit_user_data(old, cpp));
+            return;
+        }
+
+        // the old TU can't be patched, the rechecks run one TU at a time
+        // so nobody else is touching the compilation unit.
+        cuik_remove_from_compilation_unit(&compilation_unit, old);
+        free_preprocessor(cuik_set_translation_unit_user_data(old, NULL));
+        cuik_destroy_translation_unit(old);
+        target->tu = NULL;
+
+        if (status == CUIK_REPARSE_ERROR) {
+            mark_build_failed();
+            free_preprocessor(cpp);
+            return;
+        }
+    }
+
     TranslationUnit* tu = cuik_parse_translation_unit(&desc);
     if (tu == NULL) {
-        printf("Failed to parse with errors...");
-        exit(1);
+        printf("Failed to parse with errors...\n");
+        if (!keep_alive) exit(1);
+
+        mark_build_failed();
+        free_preprocessor(cpp);
+        return;
     }
 
     if (args_bindgen != NULL) {
@@ -415,18 +733,32 @@ static void compile_file(void* arg) {
 
     cuik_set_translation_unit_user_data(tu, cpp);
     cuik_add_to_compilation_unit(&compilation_unit, tu);
+
+    if (target != NULL) {
+        target->tu = tu;
+    }
+}
+
+static void compile_file_task(void* arg) {
+    compile_file(arg);
+    track_tus_in_flight(-1);
 }
 
 static void preproc_file(void* arg) {
     const char* input = (const char*)arg;
+    track_tus_in_flight(1);
 
     // preproc
     Cuik_CPP* cpp = make_preprocessor(input);
+    if (cpp == NULL) {
+        track_tus_in_flight(-1);
+        return;
+    }
 
     if (ithread_pool != NULL) {
-        CUIK_CALL(ithread_pool, submit, compile_file, cpp);
+        CUIK_CALL(ithread_pool, submit, compile_file_task, cpp);
     } else {
-        compile_file(cpp);
+        compile_file_task(cpp);
     }
 }
 
@@ -533,81 +865,129 @@ static void irgen(void) {
     TIMESTAMP("IR generation");
 
     CUIK_TIMED_BLOCK("IR generation") {
+        // collect all the declarations which need IR, typedefs and unused
+        // symbols are skipped here so they don't skew the batches
+        size_t capacity = 0;
+        FOR_EACH_TU(tu, &compilation_unit) {
+            capacity += cuik_num_of_top_level_stmts(tu);
+        }
+
+        work_items = malloc(capacity * sizeof(WorkItem));
+        work_item_count = 0;
+
+        FOR_EACH_TU(tu, &compilation_unit) {
+            // dispose the preprocessor crap now
+            free_preprocessor((Cuik_CPP*) cuik_set_translation_unit_user_data(tu, NULL));
+
+            Stmt** stmts = cuik_get_top_level_stmts(tu);
+            size_t count = cuik_num_of_top_level_stmts(tu);
+            for (size_t i = 0; i < count; i++) {
+                if (stmts[i]->decl.attrs.is_typedef || !stmts[i]->decl.attrs.is_used) {
+                    continue;
+                }
+
+                size_t cost = stmts[i]->decl.token_count;
+                work_items[work_item_count++] = (WorkItem){
+                    .tu = tu,
+                    .stmt = stmts[i],
+                    .cost = cost ? cost : 1
+                };
+            }
+        }
+
         if (ithread_pool != NULL) {
             #if CUIK_ALLOW_THREADS
-            size_t task_capacity = 0;
-            FOR_EACH_TU(tu, &compilation_unit) {
-                size_t c = cuik_num_of_top_level_stmts(tu);
-                task_capacity += (c + (IRGEN_TASK_BATCH_SIZE - 1)) / IRGEN_TASK_BATCH_SIZE;
-            }
+            // largest first, that way the big functions start early and
+            // the small batches fill in the gaps at the end
+            qsort(work_items, work_item_count, sizeof(WorkItem), compare_work_items);
 
-            IRGenTask* tasks = malloc(task_capacity * sizeof(IRGenTask));
-            atomic_size_t tasks_remaining = task_capacity;
+            // worst case is one task per item
+            IRGenTask* tasks = malloc(work_item_count * sizeof(IRGenTask));
+            atomic_size_t tasks_remaining = 0;
 
             size_t task_count = 0;
-            FOR_EACH_TU(tu, &compilation_unit) {
-                // dispose the preprocessor crap now
-                free_preprocessor((Cuik_CPP*) cuik_set_translation_unit_user_data(tu, NULL));
-
-                CUIK_FOR_TOP_LEVEL_STMT(it, tu, 8192) {
-                    assert(task_count < task_capacity);
-                    IRGenTask* task = &tasks[task_count++];
-                    *task = (IRGenTask){
-                        .tu = tu,
-                        .stmts = it.start,
-                        .count = it.count,
-                        .remaining = &tasks_remaining
-                    };
-
-                    CUIK_CALL(ithread_pool, submit, irgen_job, task);
-                }
+            for (size_t i = 0; i < work_item_count;) {
+                size_t n = next_work_batch(&work_items[i], work_item_count - i, IRGEN_TASK_QUANTUM);
+                tasks[task_count++] = (IRGenTask){
+                    .items = &work_items[i],
+                    .count = n,
+                    .remaining = &tasks_remaining
+                };
+                i += n;
+            }
+
+            // the counter must be set before anything is submitted
+            tasks_remaining = task_count;
+            for (size_t i = 0; i < task_count; i++) {
+                CUIK_CALL(ithread_pool, submit, irgen_job, &tasks[i]);
             }
 
             // "highway robbery on steve jobs" job stealing amirite...
             while (atomic_load(&tasks_remaining) != 0) {
                 CUIK_CALL(ithread_pool, work_one_job);
             }
+
+            free(tasks);
             #else
             fprintf(stderr, "Please compile with -DCUIK_ALLOW_THREADS if you wanna spin up threads");
             abort();
             #endif
-            // free(tasks);
         } else {
-            FOR_EACH_TU(tu, &compilation_unit) {
-                Cuik_CPP* cpp = cuik_get_translation_unit_user_data(tu);
-                free_preprocessor(cpp);
-
-                size_t c = cuik_num_of_top_level_stmts(tu);
-                IRGenTask task = {
-                    .tu = tu,
-                    .stmts = cuik_get_top_level_stmts(tu),
-                    .count = c
-                };
+            IRGenTask task = {
+                .items = work_items,
+                .count = work_item_count
+            };
 
-                irgen_job(&task);
-            }
+            irgen_job(&task);
         }
     }
 }
 
+static void codegen_single_threaded(void) {
+    TB_FOR_FUNCTIONS(f, mod) {
+        tb_module_compile_function(mod, f, TB_ISEL_FAST);
+    }
+}
+
 static void codegen(void) {
     if (ithread_pool != NULL) {
         #if CUIK_ALLOW_THREADS
-        size_t count = 0, capacity = (tb_module_get_function_count(mod) + TB_TASK_BATCH_SIZE - 1) / TB_TASK_BATCH_SIZE;
-        atomic_size_t tasks_remaining = capacity;
+        // every function in the module should've been generated from one of the
+        // work items so we just compact those down (they're still sorted by cost)
+        size_t func_count = 0;
+        for (size_t i = 0; i < work_item_count; i++) {
+            if (work_items[i].func != NULL) {
+                work_items[func_count++] = work_items[i];
+            }
+        }
 
-        CodegenTask* tasks = malloc(capacity * sizeof(CodegenTask));
-        size_t i = 0;
-        TB_FOR_FUNCTIONS(f, mod) {
-            if ((i % TB_TASK_BATCH_SIZE) == 0) {
-                assert(count < capacity);
+        // if anything made functions on the side the tasks would never compile
+        // them, it's not worth guessing which ones so just do all of them here.
+        if (func_count != tb_module_get_function_count(mod)) {
+            fprintf(stderr, "warning: IR generation made %zu functions but the module has %zu, compiling them on one thread\n",
+                func_count, (size_t) tb_module_get_function_count(mod));
 
-                tasks[count] = (CodegenTask){ .start = f, .remaining = &tasks_remaining };
-                CUIK_CALL(ithread_pool, submit, codegen_job, &tasks[count]);
-                count += 1;
-            }
+            codegen_single_threaded();
+            return;
+        }
 
-            i += 1;
+        CodegenTask* tasks = malloc(func_count * sizeof(CodegenTask));
+        atomic_size_t tasks_remaining = 0;
+
+        size_t count = 0;
+        for (size_t i = 0; i < func_count;) {
+            size_t n = next_work_batch(&work_items[i], func_count - i, TB_TASK_QUANTUM);
+            tasks[count++] = (CodegenTask){
+                .items = &work_items[i],
+                .count = n,
+                .remaining = &tasks_remaining
+            };
+            i += n;
+        }
+
+        tasks_remaining = count;
+        for (size_t i = 0; i < count; i++) {
+            CUIK_CALL(ithread_pool, submit, codegen_job, &tasks[i]);
         }
 
         // "highway robbery on steve jobs" job stealing amirite...
@@ -621,13 +1001,79 @@ static void codegen(void) {
         abort();
         #endif /* CUIK_ALLOW_THREADS */
     } else {
-        TB_FOR_FUNCTIONS(f, mod) {
-            tb_module_compile_function(mod, f, TB_ISEL_FAST);
+        codegen_single_threaded();
+    }
+}
+
+#ifdef __linux__
+// glibc 2.34 folded these into libc.so.6, there's only versioned stubs left of them
+static const char* jit_libc_parts[] = { "c", "pthread", "dl", "rt" };
+
+static void jit_load_script_input(void* user_data, const char* name, bool as_needed) {
+    // AS_NEEDED ones and archives are skipped
+    if (as_needed || strstr(name, ".so") == NULL) return;
+
+    void** first = user_data;
+    void* lib = dlopen(name, RTLD_NOW | RTLD_GLOBAL);
+    if (*first == NULL) *first = lib;
+}
+
+// on glibc libfoo.so is usually a tiny linker script which dlopen can't read:
+//   GROUP ( /lib/x86_64-linux-gnu/libm.so.6 AS_NEEDED ( /lib/x86_64-linux-gnu/libmvec.so.1 ) )
+// so we find it where the linker would and load the shared objects it names, the
+// result is the first one.
+static void* jit_load_linker_script(const char* filename) {
+    char text[4096];
+    size_t length = 0;
+    for (const char* const* dir = cuiklink_default_libpaths(); *dir != NULL && length == 0; dir++) {
+        char path[FILENAME_MAX];
+        snprintf(path, FILENAME_MAX, "%s/%s", *dir, filename);
+
+        FILE* f = fopen(path, "rb");
+        if (f != NULL) {
+            length = fread(text, 1, sizeof(text), f);
+            fclose(f);
+        }
+    }
+
+    void* first = NULL;
+    cuiklink_parse_linker_script(text, length, &first, jit_load_script_input);
+    return first;
+}
+
+// libraries are passed like they would be to the linker (-lm, -lfoo.lib) so
+// we turn them into something dlopen can find
+static void* jit_load_library(const char* name) {
+    if (strchr(name, '/') != NULL || strstr(name, ".so") != NULL) {
+        return dlopen(name, RTLD_NOW | RTLD_GLOBAL);
+    }
+
+    char base[FILENAME_MAX];
+    size_t len = strlen(name);
+    if (len > 4 && strcmp(name + len - 4, ".lib") == 0) {
+        snprintf(base, FILENAME_MAX, "%.*s", (int) (len - 4), name);
+    } else {
+        snprintf(base, FILENAME_MAX, "%s", name);
+    }
+
+    char tmp[FILENAME_MAX];
+    snprintf(tmp, FILENAME_MAX, "lib%s.so", base);
+
+    void* lib = dlopen(tmp, RTLD_NOW | RTLD_GLOBAL);
+    if (lib == NULL) lib = jit_load_linker_script(tmp);
+
+    for (size_t i = 0; lib == NULL && i < sizeof(jit_libc_parts) / sizeof(jit_libc_parts[0]); i++) {
+        if (strcmp(base, jit_libc_parts[i]) == 0) {
+            lib = dlopen("libc.so.6", RTLD_NOW | RTLD_GLOBAL);
         }
     }
+
+    return lib ? lib : dlopen(name, RTLD_NOW | RTLD_GLOBAL);
 }
+#endif
 
-static void run_as_jit(void) {
+static int run_as_jit(int argc, char** argv) {
+    #if defined(_WIN32) || defined(__linux__)
     #ifdef _WIN32
     dyn_array_put(input_libraries, "kernel32.lib");
 
@@ -649,26 +1095,57 @@ static void run_as_jit(void) {
             abort();
         }
     }
+    #else
+    // libc goes first since it's what everything ends up calling, the
+    // module list is one bigger than the libraries to make room for it.
+    size_t module_count = dyn_array_length(input_libraries) + 1;
+    void** modules = malloc(sizeof(void*) * module_count);
+    modules[0] = dlopen("libc.so.6", RTLD_NOW | RTLD_GLOBAL);
+    if (modules[0] == NULL) {
+        fprintf(stderr, "error: Could not load libc: %s\n", dlerror());
+        return EXIT_FAILURE;
+    }
+
+    dyn_array_for(i, input_libraries) {
+        modules[i + 1] = jit_load_library(input_libraries[i]);
+        if (modules[i + 1] == NULL) {
+            fprintf(stderr, "error: Could not load: %s (%s)\n", input_libraries[i], dlerror());
+            return EXIT_FAILURE;
+        }
+    }
+    #endif
 
     TB_FOR_EXTERNALS(e, mod) {
         const char* name = tb_symbol_get_name((TB_Symbol*) e);
-        printf("  %s\n", name);
+        if (args_verbose) printf("  %s\n", name);
 
         void* p = NULL;
+        #ifdef _WIN32
         dyn_array_for(i, input_libraries) {
             p = GetProcAddress(modules[i], name);
             if (p != NULL) {
-                printf("    Loaded from %s (%p)\n", input_libraries[i], p);
+                if (args_verbose) printf("    Loaded from %s (%p)\n", input_libraries[i], p);
+                break;
+            }
+        }
+        #else
+        for (size_t i = 0; i < module_count; i++) {
+            p = dlsym(modules[i], name);
+            if (p != NULL) {
+                if (args_verbose) printf("    Loaded from %s (%p)\n", i ? input_libraries[i - 1] : "libc", p);
                 break;
             }
         }
+        #endif
 
         if (p == NULL) {
             fprintf(stderr, "error: Could not load symbol: %s\n", name);
-            abort();
+            free(modules);
+            return EXIT_FAILURE;
         }
         tb_symbol_bind_ptr((TB_Symbol*) e, p);
     }
+    free(modules);
 
     tb_module_export_jit(mod);
 
@@ -683,14 +1160,18 @@ static void run_as_jit(void) {
 
     if (func == NULL) {
         fprintf(stderr, "error: Could not find entrypoint 'main'\n");
-        abort();
+        return EXIT_FAILURE;
     }
 
-    void(*jit_entry)(void) = tb_function_get_jit_pos(func);
-    jit_entry();
+    // the libraries stay loaded, the program might've registered atexit
+    // handlers or handed out pointers into them
+    int(*jit_entry)(int, char**) = (int(*)(int, char**)) tb_function_get_jit_pos(func);
+    int exit_code = jit_entry(argc, argv);
+    fflush(stdout);
+    return exit_code;
     #else
     fprintf(stderr, "error: JIT not supported yet!\n");
-    abort();
+    return EXIT_FAILURE;
     #endif
 }
 
@@ -741,10 +1222,13 @@ static bool export_output(void) {
             return true;
         }
 
+        bool linked = false;
         TIMESTAMP("Linker");
         CUIK_TIMED_BLOCK("linker") {
             Cuik_Linker l;
             if (cuiklink_init(&l)) {
+                cuiklink_set_threadpool(&l, ithread_pool);
+
                 // we'll use subsystem windows if they defined WinMain in any of the TUs
                 bool subsystem_windows = false;
                 FOR_EACH_TU(tu, &compilation_unit) {
@@ -785,35 +1269,644 @@ static bool export_output(void) {
                     #endif
                 }
 
-                cuiklink_invoke(&l, output_path_no_ext, "ucrt");
+                #ifdef _WIN32
+                const char* crt_name = "ucrt";
+                #else
+                const char* crt_name = args_nocrt ? NULL : "c";
+                #endif
+
+                // rebuilds under --watch usually only touch a few functions
+                cuiklink_set_incremental(&l, args_incremental_link || args_watch);
+
+                linked = cuiklink_invoke(&l, output_path_no_ext, crt_name);
                 cuiklink_deinit(&l);
             }
         }
 
-        return true;
+        return linked;
     }
 }
 
-#if 0
-static uint64_t table[256];
-
-static void emit_range(uint64_t min, uint64_t max, uint64_t old, uint64_t next) {
-    old *= 4;
+// makes the compilation unit and the module for the next build
+static void start_build(void) {
+    cuik_create_compilation_unit(&compilation_unit);
 
-    for (size_t i = min; i < max; i++) {
-        table[i] |= (next & 15) << old;
+    if (!args_ast && !args_types) {
+        TB_FeatureSet features = {0};
+        mod = tb_module_create(
+            TB_ARCH_X86_64, cuik_system_to_tb(target_desc.sys), &features, false
+        );
     }
 }
 
-static void emit_chars(const char* str, uint64_t old, uint64_t next) {
-    old *= 4;
-
-    for (; *str; str++) {
-        table[(ptrdiff_t) *str] |= (next & 15) << old;
-    }
-}
+// returns false if the build failed, outside of --watch most errors just exit
+static bool build(void) {
+    ////////////////////////////////
+    // frontend work
+    ////////////////////////////////
+    TIMESTAMP("Frontend");
+    CUIK_TIMED_BLOCK("Frontend") {
+        if (ithread_pool != NULL) {
+            #if CUIK_ALLOW_THREADS
+            dyn_array_for(i, input_files) {
+                tp_submit(thread_pool, preproc_file, (void*) input_files[i]);
+            }
 
-static void emit_all_chars(const char* str, uint64_t old, uint64_t next) {
+            threadpool_wait(thread_pool);
+            #endif
+        } else {
+            dyn_array_for(i, input_files) {
+                preproc_file((void*) input_files[i]);
+            }
+        }
+
+        TIMESTAMP("Internal link");
+        CUIK_TIMED_BLOCK("internal link") {
+            if (!cuik_internal_link_compilation_unit(&compilation_unit)) {
+                printf("Failed to link with errors...\n");
+                if (!keep_alive) exit(1);
+
+                build_failed = true;
+            }
+        }
+    }
+
+    // returning inside the timed block would leave the region open
+    if (build_failed) return false;
+    // there's no module when type checking so we stop here too
+    if (args_syntax_only || args_types) return true;
+
+    if (args_ast) {
+        FOR_EACH_TU(tu, &compilation_unit) {
+            cuik_dump_translation_unit(stdout, tu, true);
+        }
+        return true;
+    }
+
+    ////////////////////////////////
+    // backend work
+    ////////////////////////////////
+    // --watch and --server keep the cached headers for the next build
+    if (!keep_alive) {
+        cuik_fscache_destroy(fscache);
+        fscache = NULL;
+    }
+
+    irgen();
+    cuik_destroy_compilation_unit(&compilation_unit);
+
+    if (dyn_array_length(da_passes) != 0) {
+        // TODO: we probably want to do the fancy threading soon
+        TIMESTAMP("Optimizer");
+        CUIK_TIMED_BLOCK("Optimizer") {
+            tb_module_optimize(mod, dyn_array_length(da_passes), da_passes);
+        }
+    }
+
+    if (args_ir) {
+        TIMESTAMP("IR Printer");
+        TB_FOR_FUNCTIONS(f, mod) {
+            tb_function_print(f, tb_default_print_callback, stdout, false);
+            printf("\n\n");
+        }
+        return true;
+    }
+
+    CUIK_TIMED_BLOCK("CodeGen") {
+        codegen();
+    }
+
+    free(work_items);
+    work_items = NULL;
+
+    if (args_run) {
+        // argv[0] is what the program would've been called had we written it out
+        char** argv = malloc(sizeof(char*) * (jit_argc + 2));
+        argv[0] = (char*) output_name;
+        memcpy(&argv[1], jit_argv, sizeof(char*) * jit_argc);
+        argv[jit_argc + 1] = NULL;
+
+        jit_exit_code = run_as_jit(jit_argc + 1, argv);
+        free(argv);
+    } else {
+        if (!export_output()) {
+            return false;
+        }
+    }
+
+    tb_free_thread_resources();
+    tb_module_destroy(mod);
+    mod = NULL;
+    return true;
+}
+
+// throws away whatever the last build left alive
+static void discard_build(void) {
+    // destroyed compilation units are zeroed
+    if (compilation_unit.lock != NULL) {
+        FOR_EACH_TU(tu, &compilation_unit) {
+            Cuik_CPP* cpp = cuik_set_translation_unit_user_data(tu, NULL);
+            if (cpp != NULL) free_preprocessor(cpp);
+        }
+
+        cuik_destroy_compilation_unit(&compilation_unit);
+    }
+
+    if (mod != NULL) {
+        tb_free_thread_resources();
+        tb_module_destroy(mod);
+        mod = NULL;
+    }
+
+    free(work_items);
+    work_items = NULL;
+    build_failed = false;
+}
+
+#ifdef __linux__
+static void restart_build(void) {
+    discard_build();
+    start_build();
+}
+
+// without a module the TUs are kept around so only the dirty ones are redone, they go
+// one at a time since replacing a TU can't race with the others being added (each of
+// them still uses the thread pool internally).
+static bool recheck_dirty_targets(void) {
+    build_failed = false;
+
+    TIMESTAMP("Frontend");
+    CUIK_TIMED_BLOCK("Frontend") {
+        dyn_array_for(i, input_files) {
+            if (!watch_targets[i].dirty) continue;
+
+            Cuik_CPP* cpp = make_preprocessor(input_files[i]);
+            if (cpp != NULL) compile_file(cpp);
+        }
+
+        TIMESTAMP("Internal link");
+        if (!cuik_internal_link_compilation_unit(&compilation_unit)) {
+            printf("Failed to link with errors...\n");
+            build_failed = true;
+        }
+    }
+
+    if (build_failed) return false;
+
+    if (args_ast) {
+        FOR_EACH_TU(tu, &compilation_unit) {
+            cuik_dump_translation_unit(stdout, tu, true);
+        }
+    }
+
+    return true;
+}
+
+static void watch_directories(int fd) {
+    dyn_array_for(i, input_files) {
+        WatchTarget* target = &watch_targets[i];
+
+        dyn_array_for(j, target->deps) {
+            const char* dep = target->deps[j];
+            const char* slash = strrchr(dep, '/');
+            if (slash == NULL) continue;
+
+            size_t len = (slash - dep) + 1;
+            bool found = false;
+            dyn_array_for(k, watch_dirs) {
+                if (strncmp(watch_dirs[k].path, dep, len) == 0 && watch_dirs[k].path[len] == 0) {
+                    found = true;
+                    break;
+                }
+            }
+
+            if (found) continue;
+
+            // we keep the failed ones around so we don't try them again
+            char* path = strndup(dep, len);
+            int wd = inotify_add_watch(fd, path, IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE);
+            if (wd < 0) {
+                fprintf(stderr, "warning: could not watch %s\n", path);
+            }
+
+            dyn_array_put(watch_dirs, (WatchDir){ wd, path });
+        }
+    }
+}
+
+// returns true if any of the inputs depend on the file
+static bool watch_file_changed(int wd, const char* name) {
+    const char* dir = NULL;
+    dyn_array_for(i, watch_dirs) {
+        if (watch_dirs[i].wd == wd) {
+            dir = watch_dirs[i].path;
+            break;
+        }
+    }
+
+    if (dir == NULL) return false;
+
+    char path[FILENAME_MAX];
+    sprintf_s(path, FILENAME_MAX, "%s%s", dir, name);
+
+    bool hit = false;
+    dyn_array_for(i, input_files) {
+        WatchTarget* target = &watch_targets[i];
+
+        dyn_array_for(j, target->deps) {
+            if (strcmp(target->deps[j], path) == 0) {
+                target->dirty = true;
+                hit = true;
+                break;
+            }
+        }
+    }
+
+    // the cached tokens are stale now
+    if (hit) cuik_fscache_invalidate(fscache, path);
+    return hit;
+}
+
+// keeps the process, file cache and thread pool alive, only returns if
+// inotify gives up on us.
+static void watch_and_rebuild(void) {
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "error: could not start inotify\n");
+        return;
+    }
+
+    for (;;) {
+        watch_directories(fd);
+
+        printf("\nWatching %zu directories for changes...\n", dyn_array_length(watch_dirs));
+        fflush(stdout);
+
+        // block until something happens then keep reading until it settles down
+        bool changed = false;
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        while (poll(&pfd, 1, changed ? WATCH_SETTLE_MS : -1) > 0) {
+            _Alignas(struct inotify_event) char buffer[4096];
+            ssize_t len = read(fd, buffer, sizeof(buffer));
+            if (len <= 0) {
+                fprintf(stderr, "error: could not read inotify events\n");
+                close(fd);
+                return;
+            }
+
+            for (char* p = buffer; p < buffer + len;) {
+                struct inotify_event* ev = (struct inotify_event*) p;
+                if (ev->len > 0 && watch_file_changed(ev->wd, ev->name)) {
+                    changed = true;
+                }
+
+                p += sizeof(struct inotify_event) + ev->len;
+            }
+        }
+
+        if (!changed) continue;
+
+        uint64_t t1 = cuik_time_in_nanos();
+        bool success;
+        if (args_ast || args_types) {
+            success = recheck_dirty_targets();
+        } else {
+            restart_build();
+            success = build();
+        }
+
+        uint64_t t2 = cuik_time_in_nanos();
+        printf("%s in %f ms\n", success ? "Rebuilt" : "Failed", (t2 - t1) / 1000000.0);
+
+        dyn_array_for(i, input_files) {
+            watch_targets[i].dirty = false;
+        }
+    }
+}
+#endif /* __linux__ */
+
+#ifndef _WIN32
+////////////////////////////////
+// --server & --connect
+////////////////////////////////
+// the build system spawns tons of tiny compiles, the server keeps the file cache
+// and thread pool warm between them. The client passes its stdout and stderr over
+// the socket so the diagnostics go straight to wherever the client's would have,
+// then it sends the working directory and the command line:
+//
+//   client -> server: u32 length, fds { stdout, stderr }
+//                     length bytes of "cwd\0argv[0]\0argv[1]\0..."
+//   server -> client: i32 exit code
+//
+// the driver is all globals so the requests are handled one at a time, each of
+// them still gets the whole thread pool.
+static int driver_main(int argc, char** argv);
+
+// puts the driver globals back how main found them
+static void reset_driver_state(void) {
+    dyn_array_for(i, input_files) free((char*) input_files[i]);
+    dyn_array_for(i, input_objects) free((char*) input_objects[i]);
+    dyn_array_for(i, include_directories) free((char*) include_directories[i]);
+
+    dyn_array_destroy(include_directories);
+    dyn_array_destroy(input_libraries);
+    dyn_array_destroy(input_objects);
+    dyn_array_destroy(input_files);
+    dyn_array_destroy(input_defines);
+    dyn_array_destroy(da_passes);
+
+    output_name = NULL;
+    output_path_no_ext[0] = 0;
+    flavor = TB_FLAVOR_EXECUTABLE;
+    target_desc = (Cuik_Target){ 0 };
+
+    args_ir = args_ast = args_types = args_run = args_nocrt = false;
+    args_pploc = args_assembly = args_time = args_perfetto = args_hw_counters = args_verbose = false;
+    args_syntax_only = args_debug_info = args_preprocess = args_exercise = false;
+    args_watch = args_incremental_link = args_prelude = false;
+    jit_argc = jit_exit_code = 0;
+    jit_argv = NULL;
+    args_use_syslinker = true;
+    args_threads = -1;
+    args_bindgen = NULL;
+    args_opt_level = 0;
+
+    // the profiler state outlives the request, the next one might not want counters
+    if (cuik_is_profiling()) cuik_stop_global_profiler();
+    cuik_profile_hw_counters(false);
+    cuikpp_reset_token_counter();
+}
+
+static bool write_all(int fd, const void* data, size_t size) {
+    const char* p = data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+
+        p += n, size -= n;
+    }
+
+    return true;
+}
+
+static bool read_all(int fd, void* data, size_t size) {
+    char* p = data;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+
+        p += n, size -= n;
+    }
+
+    return true;
+}
+
+static void serve_request(int client) {
+    // the header comes with the client's stdout & stderr
+    uint32_t length;
+    int fds[2];
+
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = { .iov_base = &length, .iov_len = sizeof(length) };
+    struct msghdr msg = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = control, .msg_controllen = sizeof(control),
+    };
+
+    if (recvmsg(client, &msg, MSG_WAITALL) != sizeof(length)) return;
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        fprintf(stderr, "error: compile request didn't come with stdout & stderr\n");
+        return;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+    char* payload = malloc(length + 1);
+    if (!read_all(client, payload, length)) {
+        free(payload);
+        close(fds[0]), close(fds[1]);
+        return;
+    }
+    payload[length] = 0;
+
+    // first string is the working directory then it's argv
+    DynArray(char*) args = dyn_array_create(char*);
+    const char* cwd = payload;
+    for (char* p = payload + strlen(payload) + 1; p < payload + length; p += strlen(p) + 1) {
+        dyn_array_put(args, p);
+    }
+
+    int status = EXIT_FAILURE;
+    int old_cwd = open(".", O_RDONLY);
+    if (dyn_array_length(args) > 0 && chdir(cwd) == 0) {
+        fflush(stdout), fflush(stderr);
+        int old_stdout = dup(STDOUT_FILENO), old_stderr = dup(STDERR_FILENO);
+        dup2(fds[0], STDOUT_FILENO);
+        dup2(fds[1], STDERR_FILENO);
+
+        // anything which changed on disk since the last request is reloaded
+        cuik_fscache_invalidate_stale(fscache);
+        status = driver_main(dyn_array_length(args), args);
+
+        discard_build();
+        reset_driver_state();
+
+        fflush(stdout), fflush(stderr);
+        dup2(old_stdout, STDOUT_FILENO), close(old_stdout);
+        dup2(old_stderr, STDERR_FILENO), close(old_stderr);
+    }
+
+    if (old_cwd >= 0) {
+        fchdir(old_cwd);
+        close(old_cwd);
+    }
+
+    close(fds[0]), close(fds[1]);
+    dyn_array_destroy(args);
+    free(payload);
+
+    int32_t code = status;
+    write_all(client, &code, sizeof(code));
+}
+
+static int run_server(const char* socket_path) {
+    if (server_mode) {
+        fprintf(stderr, "error: can't start a compile server from a compile request\n");
+        return EXIT_FAILURE;
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "error: socket path is too long: %s\n", socket_path);
+        return EXIT_FAILURE;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    // a dead server leaves its socket behind, we don't wanna clobber anything else though
+    struct stat st;
+    if (stat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(socket_path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+        fprintf(stderr, "error: could not listen on %s (%s)\n", socket_path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    // clients hanging up mid-compile shouldn't take us down with them
+    signal(SIGPIPE, SIG_IGN);
+
+    #if CUIK_ALLOW_THREADS
+    start_thread_pool();
+    #endif
+    fscache = cuik_fscache_create();
+
+    // the server's own flags don't apply to the requests
+    reset_driver_state();
+    server_mode = true;
+
+    printf("Listening on %s...\n", socket_path);
+    fflush(stdout);
+
+    for (;;) {
+        int client = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+
+            fprintf(stderr, "error: could not accept compile requests (%s)\n", strerror(errno));
+            break;
+        }
+
+        // a client which connects and never sends the request would hang the server
+        struct timeval timeout = { .tv_sec = 10 };
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        serve_request(client);
+        close(client);
+    }
+
+    close(fd);
+    unlink(socket_path);
+    return EXIT_FAILURE;
+}
+
+static int run_client(const char* socket_path, int argc, char** argv) {
+    // everything but the --connect gets forwarded
+    DynArray(char*) args = dyn_array_create(char*);
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--connect") == 0) {
+            i += 1;
+        } else if (strncmp(argv[i], "--connect", 9) != 0) {
+            dyn_array_put(args, argv[i]);
+        }
+    }
+
+    // the server would die on a broken command line (the parser exits) so we
+    // walk the whole thing here first.
+    for (int i = 1; i < argc;) {
+        if (argv[i][0] == '-' && argv[i][1] == 'O') {
+            i += 1;
+            continue;
+        } else if (strcmp(argv[i], "--") == 0) {
+            break;
+        }
+
+        get_cli_arg(&i, argc, argv);
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (strlen(socket_path) >= sizeof(addr.sun_path) || fd < 0) {
+        fprintf(stderr, "error: could not connect to %s\n", socket_path);
+        return EXIT_FAILURE;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        // no server? no problem, we'll just do it ourselves
+        close(fd);
+        reset_driver_state();
+
+        int status = driver_main(dyn_array_length(args), args);
+        dyn_array_destroy(args);
+        return status;
+    }
+
+    char cwd[FILENAME_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        fprintf(stderr, "error: could not get the working directory\n");
+        return EXIT_FAILURE;
+    }
+
+    size_t length = strlen(cwd) + 1;
+    dyn_array_for(i, args) {
+        length += strlen(args[i]) + 1;
+    }
+
+    char* payload = malloc(length);
+    char* p = payload;
+    memcpy(p, cwd, strlen(cwd) + 1), p += strlen(cwd) + 1;
+    dyn_array_for(i, args) {
+        size_t len = strlen(args[i]) + 1;
+        memcpy(p, args[i], len), p += len;
+    }
+
+    uint32_t header = length;
+    int fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+
+    char control[CMSG_SPACE(sizeof(fds))] = { 0 };
+    struct iovec iov = { .iov_base = &header, .iov_len = sizeof(header) };
+    struct msghdr msg = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = control, .msg_controllen = sizeof(control),
+    };
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    // anything we printed has to land before the server's output
+    fflush(stdout), fflush(stderr);
+
+    int32_t status;
+    if (sendmsg(fd, &msg, 0) != sizeof(header) || !write_all(fd, payload, length) || !read_all(fd, &status, sizeof(status))) {
+        fprintf(stderr, "error: compile server hung up on us\n");
+        status = EXIT_FAILURE;
+    }
+
+    close(fd);
+    free(payload);
+    dyn_array_destroy(args);
+    return status;
+}
+#endif /* _WIN32 */
+
+#if 0
+static uint64_t table[256];
+
+static void emit_range(uint64_t min, uint64_t max, uint64_t old, uint64_t next) {
+    old *= 4;
+
+    for (size_t i = min; i < max; i++) {
+        table[i] |= (next & 15) << old;
+    }
+}
+
+static void emit_chars(const char* str, uint64_t old, uint64_t next) {
+    old *= 4;
+
+    for (; *str; str++) {
+        table[(ptrdiff_t) *str] |= (next & 15) << old;
+    }
+}
+
+static void emit_all_chars(const char* str, uint64_t old, uint64_t next) {
     old *= 4;
 
     for (size_t i = 0; i < 256; i++) {
@@ -917,10 +2010,7 @@ int main(int argc, char** argv) {
     return 0;
 }
 #else
-int main(int argc, char** argv) {
-    cuik_init();
-    find_system_deps();
-
+static int driver_main(int argc, char** argv) {
     mark_timestamp(NULL);
 
     program_name = argv[0];
@@ -929,6 +2019,7 @@ int main(int argc, char** argv) {
     input_objects = dyn_array_create(const char*);
     input_files = dyn_array_create(const char*);
     input_defines = dyn_array_create(const char*);
+    if (preludes == NULL) preludes = dyn_array_create(PreludeEntry);
 
     // get default system
     #if defined(_WIN32)
@@ -952,6 +2043,13 @@ int main(int argc, char** argv) {
             continue;
         }
 
+        // program arguments
+        if (i < argc && strcmp(argv[i], "--") == 0) {
+            jit_argc = argc - (i + 1);
+            jit_argv = &argv[i + 1];
+            break;
+        }
+
         Arg arg = get_cli_arg(&i, argc, argv);
         switch (arg.key) {
             case ARG_NONE: {
@@ -1069,6 +2167,8 @@ int main(int argc, char** argv) {
             case ARG_PREPROC: args_preprocess = true; break;
             case ARG_PPLOC: args_pploc = true; break;
             case ARG_TIME: args_time = true; break;
+            case ARG_PERFETTO: args_perfetto = args_time = true; break;
+            case ARG_HWCOUNTERS: args_hw_counters = args_time = true; break;
             case ARG_ASM: args_assembly = true; break;
             case ARG_SYNTAX_ONLY: args_syntax_only = true; break;
             case ARG_AST: args_ast = true; break;
@@ -1077,6 +2177,25 @@ int main(int argc, char** argv) {
             case ARG_NOCRT: args_nocrt = true; break;
             case ARG_VERBOSE: args_verbose = true; break;
             case ARG_EXERCISE: args_exercise = true; break;
+            case ARG_WATCH: args_watch = true; break;
+            case ARG_INCLINK: args_incremental_link = true; break;
+            case ARG_PRELUDE: args_prelude = true; break;
+            case ARG_SERVER: {
+                #ifndef _WIN32
+                return run_server(arg.value);
+                #else
+                fprintf(stderr, "error: --server isn't supported on Windows yet\n");
+                return EXIT_FAILURE;
+                #endif
+            }
+            case ARG_CONNECT: {
+                #ifndef _WIN32
+                return run_client(arg.value, argc, argv);
+                #else
+                fprintf(stderr, "error: --connect isn't supported on Windows yet\n");
+                return EXIT_FAILURE;
+                #endif
+            }
             case ARG_BASED: args_use_syslinker = false; break;
             case ARG_THREADS: args_threads = atoi(arg.value); break;
             case ARG_DEBUG: args_debug_info = true; break;
@@ -1113,6 +2232,31 @@ int main(int argc, char** argv) {
         return EXIT_FAILURE;
     }
 
+    if (server_mode && (args_watch || args_run)) {
+        fprintf(stderr, "error: the compile server can't --watch or --run\n");
+        return EXIT_FAILURE;
+    }
+
+    keep_alive = args_watch || server_mode;
+    if (args_watch) {
+        #ifdef __linux__
+        if (args_preprocess || args_pploc || args_bindgen != NULL) {
+            fprintf(stderr, "error: --watch can't be used with -P, --pploc or --bindgen\n");
+            return EXIT_FAILURE;
+        }
+
+        watch_targets = calloc(dyn_array_length(input_files), sizeof(WatchTarget));
+        watch_dirs = dyn_array_create(WatchDir);
+        dyn_array_for(i, input_files) {
+            watch_targets[i].input = input_files[i];
+            watch_targets[i].deps = dyn_array_create(char*);
+        }
+        #else
+        fprintf(stderr, "error: --watch is only supported on Linux\n");
+        return EXIT_FAILURE;
+        #endif
+    }
+
     {
         const char* filename = output_name ? output_name : input_files[0];
         const char* ext = strrchr(filename, '.');
@@ -1146,52 +2290,45 @@ int main(int argc, char** argv) {
     if (args_time) {
         char* perf_output_path = malloc(FILENAME_MAX);
 
-        #if 0
-        sprintf_s(perf_output_path, FILENAME_MAX, "%s.json", output_path_no_ext);
+        if (args_perfetto) {
+            sprintf_s(perf_output_path, FILENAME_MAX, "%s.json", output_path_no_ext);
 
-        jsonperf_profiler.user_data = perf_output_path;
-        cuik_start_global_profiler(&jsonperf_profiler, false);
-        #else
-        sprintf_s(perf_output_path, FILENAME_MAX, "%s.flint", output_path_no_ext);
+            jsonperf_profiler.user_data = perf_output_path;
+            timereport__inner = &jsonperf_profiler;
+        } else {
+            sprintf_s(perf_output_path, FILENAME_MAX, "%s.flint", output_path_no_ext);
 
-        flintperf_profiler.user_data = perf_output_path;
-        cuik_start_global_profiler(&flintperf_profiler, false);
-        #endif
+            flintperf_profiler.user_data = perf_output_path;
+            timereport__inner = &flintperf_profiler;
+        }
+
+        if (args_hw_counters && !cuik_profile_hw_counters(true)) {
+            fprintf(stderr, "warning: hardware counters aren't available (check /proc/sys/kernel/perf_event_paranoid)\n");
+        }
+
+        // the summary gets printed when the profiler stops
+        cuik_start_global_profiler(&timereport_profiler);
     }
 
-    // spin up worker threads
+    // spin up worker threads, the server already has them running
     #if CUIK_ALLOW_THREADS
-    threadpool_t* thread_pool = NULL;
-    int thread_count = args_threads >= 0 ? args_threads : calculate_worker_thread_count();
-    if (thread_count > 1) {
-        if (args_verbose) printf("Starting with %d threads...\n", thread_count);
-
-        thread_pool = threadpool_create(thread_count - 1, 4096);
-        ithread_pool = malloc(sizeof(Cuik_IThreadpool));
-        *ithread_pool = (Cuik_IThreadpool){
-            .user_data = thread_pool,
-            .submit = tp_submit,
-            .work_one_job = tp_work_one_job
-        };
+    if (!server_mode) {
+        start_thread_pool();
     }
     #endif
 
     initialize_opt_passes();
-    cuik_create_compilation_unit(&compilation_unit);
+    start_build();
 
-    if (!args_ast && !args_types) {
-        TB_FeatureSet features = {0};
-        mod = tb_module_create(
-            TB_ARCH_X86_64, cuik_system_to_tb(target_desc.sys), &features, false
-        );
+    if (fscache == NULL) {
+        fscache = cuik_fscache_create();
     }
 
-    fscache = cuik_fscache_create();
-
     if (args_pploc) {
         int total = 0;
         dyn_array_for(i, input_files) {
             Cuik_CPP* cpp = make_preprocessor(input_files[i]);
+            if (cpp == NULL) return EXIT_FAILURE;
 
             int c = count_pp_lines(cuikpp_get_token_stream(cpp));
             printf("%s : %d (%zu tokens)\n", input_files[i], c, cuik_get_token_count(cuikpp_get_token_stream(cpp)));
@@ -1204,6 +2341,7 @@ int main(int argc, char** argv) {
     } else if (args_preprocess) {
         // preproc only
         Cuik_CPP* cpp = make_preprocessor(input_files[0]);
+        if (cpp == NULL) return EXIT_FAILURE;
 
         dump_tokens(stdout, cuikpp_get_token_stream(cpp));
         free_preprocessor(cpp);
@@ -1211,86 +2349,18 @@ int main(int argc, char** argv) {
         return EXIT_SUCCESS;
     }
 
-    ////////////////////////////////
-    // frontend work
-    ////////////////////////////////
-    TIMESTAMP("Frontend");
-    CUIK_TIMED_BLOCK("Frontend") {
-        if (ithread_pool != NULL) {
-            #if CUIK_ALLOW_THREADS
-            dyn_array_for(i, input_files) {
-                tp_submit(thread_pool, preproc_file, (void*) input_files[i]);
-            }
-
-            threadpool_wait(thread_pool);
-            #endif
-        } else {
-            dyn_array_for(i, input_files) {
-                preproc_file((void*) input_files[i]);
-            }
-        }
-
-        TIMESTAMP("Internal link");
-        CUIK_TIMED_BLOCK("internal link") {
-            cuik_internal_link_compilation_unit(&compilation_unit);
-        }
-
-        if (args_syntax_only) goto done;
-    }
-
-    if (args_ast) {
-        FOR_EACH_TU(tu, &compilation_unit) {
-            cuik_dump_translation_unit(stdout, tu, true);
-        }
-        goto done;
-    }
-
-    ////////////////////////////////
-    // backend work
-    ////////////////////////////////
-    cuik_fscache_destroy(fscache);
-    irgen();
-    cuik_destroy_compilation_unit(&compilation_unit);
-
-    if (dyn_array_length(da_passes) != 0) {
-        // TODO: we probably want to do the fancy threading soon
-        TIMESTAMP("Optimizer");
-        CUIK_TIMED_BLOCK("Optimizer") {
-            tb_module_optimize(mod, dyn_array_length(da_passes), da_passes);
-        }
-    }
-
-    if (args_ir) {
-        TIMESTAMP("IR Printer");
-        TB_FOR_FUNCTIONS(f, mod) {
-            tb_function_print(f, tb_default_print_callback, stdout, false);
-            printf("\n\n");
-        }
-        goto done;
-    }
-
-    CUIK_TIMED_BLOCK("CodeGen") {
-        codegen();
-    }
-
-    if (args_run) {
-        // printf("JIT compiling...\n");
-        fprintf(stderr, "error: JIT not supported yet!\n");
-        abort();
-        // run_as_jit();
-    } else {
-        if (!export_output()) {
-            return 1;
-        }
+    bool success = build();
+    if (args_watch) {
+        #ifdef __linux__
+        watch_and_rebuild();
+        #endif
+    } else if (!success) {
+        return EXIT_FAILURE;
     }
 
-    tb_free_thread_resources();
-    tb_module_destroy(mod);
-
-    done:
     TIMESTAMP("Done");
     #if CUIK_ALLOW_THREADS
-    if (thread_pool != NULL) {
+    if (thread_pool != NULL && !server_mode) {
         threadpool_free(thread_pool);
         thread_pool = NULL;
     }
@@ -1327,25 +2397,17 @@ int main(int argc, char** argv) {
 
     if (args_time) cuik_stop_global_profiler();
 
-    ////////////////////////////////
-    // Running executable
-    ////////////////////////////////
-    /*if (args_run) {
-        char* exe = strdup(output_name);
-
-        #ifdef _WIN32
-        for (char* s = exe; *s; s++) {
-            if (*s == '/') *s = '\\';
-        }
-        #endif
+    if (args_run) {
+        return jit_exit_code;
+    }
 
-        printf("\n\nRunning: %s...\n", exe);
-        int exit_code = system(exe);
-        printf("Exit code: %d\n", exit_code);
+    return 0;
+}
 
-        return exit_code;
-    }*/
+int main(int argc, char** argv) {
+    cuik_init();
+    find_system_deps();
 
-    return 0;
+    return driver_main(argc, argv);
 }
 #endif
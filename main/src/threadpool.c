@@ -18,8 +18,6 @@
 
 // HACK(NeGate): i wanna call tb_free_thread_resources on thread exit...
 extern void tb_free_thread_resources(void);
-extern void flintperf__start_thread(void);
-extern void flintperf__stop_thread(void);
 
 typedef _Atomic uint32_t atomic_uint32_t;
 
@@ -44,6 +42,12 @@ struct threadpool_t {
     #endif
 };
 
+// jobs waiting in the queue, only worth computing if someone's plotting it
+static void report_queue_depth(uint32_t r) {
+    uint32_t mask = (1u << QEXP) - 1;
+    cuik_profile_counter("job queue", ((r & mask) - ((r >> 16) & mask)) & mask);
+}
+
 static work_t* ask_for_work(threadpool_t* threadpool, uint32_t* save) {
     uint32_t r = *save = threadpool->queue;
     uint32_t mask = (1u << QEXP) - 1;
@@ -67,6 +71,8 @@ static bool do_work(threadpool_t* threadpool) {
         // don't continue until we successfully commited the queue pop
     } while (!atomic_compare_exchange_strong(&threadpool->queue, &save, save + 0x10000));
 
+    if (cuik_is_profiling()) report_queue_depth(save + 0x10000);
+
     job->fn(job->arg);
     threadpool->jobs_done -= 1;
     return false;
@@ -74,8 +80,6 @@ static bool do_work(threadpool_t* threadpool) {
 
 static int threadpool_thread(void* arg) {
     threadpool_t* threadpool = arg;
-    flintperf__start_thread();
-
     CUIK_TIMED_BLOCK("thread") {
         while (threadpool->running) {
             if (do_work(threadpool)) {
@@ -90,7 +94,6 @@ static int threadpool_thread(void* arg) {
         }
     }
 
-    flintperf__stop_thread();
     tb_free_thread_resources();
     cuik_free_thread_resources();
     return 0;
@@ -152,7 +155,8 @@ void threadpool_submit(threadpool_t* threadpool, work_routine fn, void* arg) {
 
     threadpool->work[i] = (work_t){ fn, arg };
     threadpool->jobs_done += 1;
-    threadpool->queue += 1;
+    uint32_t r = (threadpool->queue += 1);
+    if (cuik_is_profiling()) report_queue_depth(r);
 
     #ifdef _WIN32
     ReleaseSemaphore(threadpool->sem, 1, 0);
@@ -191,14 +195,14 @@ void threadpool_free(threadpool_t* threadpool) {
     }
     CloseHandle(threadpool->sem);
     #else
-    for (int i = 0; i < threadpool->thread_count; i++) {
-        thrd_join(threadpool->threads[i], NULL);
-    }
-
-    // wake everyone
+    // wake everyone, they can't notice running is off while they're asleep
     for (size_t i = 0; i < threadpool->thread_count; i++) {
         sem_post(&threadpool->sem);
     }
+
+    for (int i = 0; i < threadpool->thread_count; i++) {
+        thrd_join(threadpool->threads[i], NULL);
+    }
     sem_destroy(&threadpool->sem);
     #endif
 
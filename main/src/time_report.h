@@ -0,0 +1,369 @@
+// --time prints a summary when the profiler stops, this sits in front of the trace
+// writer (Spall or JSON) and aggregates the regions as they're flushed so it doesn't
+// need any sites of its own, just the CUIK_TIMED_BLOCK labels.
+#include <stdio.h>
+#include "stb_ds.h"
+
+enum {
+    TIMEREPORT_TOP_N = 10,
+    // how many of each TU's macros get merged into the report
+    TIMEREPORT_MACROS_PER_TU = 256,
+};
+
+typedef enum {
+    TIMEREPORT_PREPROCESS,
+    TIMEREPORT_PHASE1,
+    TIMEREPORT_PHASE2,
+    TIMEREPORT_PHASE3,
+    TIMEREPORT_SEMA,
+    TIMEREPORT_REPARSE,
+    TIMEREPORT_INTERNAL_LINK,
+    TIMEREPORT_IRGEN,
+    TIMEREPORT_CANONICALIZE,
+    TIMEREPORT_OPTIMIZER,
+    TIMEREPORT_CODEGEN,
+    TIMEREPORT_EXPORT,
+    TIMEREPORT_LINK,
+
+    TIMEREPORT_PHASE_COUNT,
+    TIMEREPORT_NONE = TIMEREPORT_PHASE_COUNT,
+} TimeReportPhase;
+
+static const char* timereport__phase_names[] = {
+    "preprocess", "parse: phase 1", "parse: phase 2", "parse: phase 3", "sema",
+    "reparse", "internal link", "irgen", "canonicalize", "optimizer",
+    "codegen", "export", "link",
+};
+
+// the first matching prefix wins
+static const struct {
+    const char* prefix;
+    TimeReportPhase phase;
+} timereport__prefixes[] = {
+    { "preprocess: ",   TIMEREPORT_PREPROCESS    },
+    { "phase 1",        TIMEREPORT_PHASE1        },
+    { "phase 2",        TIMEREPORT_PHASE2        },
+    { "phase 3",        TIMEREPORT_PHASE3        },
+    { "phase 4",        TIMEREPORT_SEMA          },
+    { "sema: ",         TIMEREPORT_SEMA          },
+    { "reparse: ",      TIMEREPORT_REPARSE       },
+    { "internal link",  TIMEREPORT_INTERNAL_LINK },
+    // a TU's symbols getting exported into the compilation unit
+    { "export: ",       TIMEREPORT_INTERNAL_LINK },
+    { "IrGen: ",        TIMEREPORT_IRGEN         },
+    { "Canonicalize: ", TIMEREPORT_CANONICALIZE  },
+    { "Optimizer",      TIMEREPORT_OPTIMIZER     },
+    { "Codegen: ",      TIMEREPORT_CODEGEN       },
+    { "CodeGen",        TIMEREPORT_CODEGEN       },
+    { "Export",         TIMEREPORT_EXPORT        },
+    { "linker",         TIMEREPORT_LINK          },
+};
+
+typedef enum {
+    TIMEREPORT_KEY_NONE,
+    TIMEREPORT_KEY_FILE,
+    TIMEREPORT_KEY_FUNCTION,
+    TIMEREPORT_KEY_HEADER,
+} TimeReportKey;
+
+typedef struct {
+    uint64_t start, children;
+    TimeReportPhase phase;
+    TimeReportKey kind;
+    char* key;
+} TimeReportFrame;
+
+typedef struct {
+    uint32_t tid;
+    DynArray(TimeReportFrame) stack;
+
+    // a phase nested in itself (phase 3 inside phase 3, includes inside the
+    // main file) only counts once.
+    int depth[TIMEREPORT_PHASE_COUNT];
+} TimeReportThread;
+
+typedef struct {
+    uint64_t start, end;
+} TimeReportInterval;
+
+typedef struct {
+    char* key;
+    uint64_t value;
+} TimeReportEntry;
+
+static const Cuik_IProfiler* timereport__inner;
+static uint64_t timereport__start_time, timereport__end_time;
+
+static DynArray(TimeReportThread) timereport__threads;
+static uint64_t timereport__totals[TIMEREPORT_PHASE_COUNT];
+static uint64_t timereport__counters[TIMEREPORT_PHASE_COUNT][CUIK_HW_COUNTER_COUNT];
+static bool timereport__has_counters;
+static DynArray(TimeReportInterval) timereport__intervals[TIMEREPORT_PHASE_COUNT];
+
+static TimeReportEntry* timereport__files;
+static TimeReportEntry* timereport__functions;
+static TimeReportEntry* timereport__headers;
+
+static Cuik_CPPStats timereport__cpp;
+static TimeReportEntry* timereport__macros;
+
+static TimeReportThread* timereport__get_thread(uint32_t tid) {
+    dyn_array_for(i, timereport__threads) {
+        if (timereport__threads[i].tid == tid) return &timereport__threads[i];
+    }
+
+    TimeReportThread t = { .tid = tid, .stack = dyn_array_create(TimeReportFrame) };
+    dyn_array_put(timereport__threads, t);
+    return &timereport__threads[dyn_array_length(timereport__threads) - 1];
+}
+
+static void timereport__add(TimeReportEntry** map, const char* key, uint64_t value) {
+    ptrdiff_t i = shgeti(*map, key);
+    if (i < 0) {
+        shput(*map, key, value);
+    } else {
+        (*map)[i].value += value;
+    }
+}
+
+static void timereport__start(void* user_data) {
+    if (timereport__inner) CUIK_CALL(timereport__inner, start);
+
+    timereport__threads = dyn_array_create(TimeReportThread);
+    for (int i = 0; i < TIMEREPORT_PHASE_COUNT; i++) {
+        timereport__totals[i] = 0;
+        memset(timereport__counters[i], 0, sizeof(timereport__counters[i]));
+        timereport__intervals[i] = dyn_array_create(TimeReportInterval);
+    }
+
+    sh_new_strdup(timereport__files);
+    sh_new_strdup(timereport__functions);
+    sh_new_strdup(timereport__headers);
+    sh_new_strdup(timereport__macros);
+    timereport__cpp = (Cuik_CPPStats){ 0 };
+    timereport__start_time = timereport__end_time = 0;
+    timereport__has_counters = false;
+}
+
+// the preprocessor stats don't come from the trace, the driver hands each preprocessor
+// over before finalizing it (it's called from the worker threads so it needs a lock).
+static void timereport_add_preprocessor(Cuik_CPP* cpp) {
+    Cuik_CPPStats stats = cuikpp_get_stats(cpp);
+    timereport__cpp.include_time     += stats.include_time;
+    timereport__cpp.files_read       += stats.files_read;
+    timereport__cpp.include_probes   += stats.include_probes;
+    timereport__cpp.define_lookups   += stats.define_lookups;
+    timereport__cpp.macro_expansions += stats.macro_expansions;
+    timereport__cpp.bytes_lexed      += stats.bytes_lexed;
+    timereport__cpp.lines_lexed      += stats.lines_lexed;
+
+    Cuik_MacroStat macros[TIMEREPORT_MACROS_PER_TU];
+    size_t count = cuikpp_get_macro_stats(cpp, TIMEREPORT_MACROS_PER_TU, macros);
+    for (size_t i = 0; i < count; i++) {
+        char name[256];
+        snprintf(name, sizeof(name), "%.*s", (int) macros[i].name_len, macros[i].name);
+        timereport__add(&timereport__macros, name, macros[i].expansions);
+    }
+}
+
+static void timereport__begin_plot(void* user_data, uint64_t nanos, uint32_t tid, const char* label) {
+    if (timereport__inner) CUIK_CALL(timereport__inner, begin_plot, nanos, tid, label);
+    if (timereport__start_time == 0 || nanos < timereport__start_time) timereport__start_time = nanos;
+
+    TimeReportThread* t = timereport__get_thread(tid);
+    TimeReportFrame f = { .start = nanos, .phase = TIMEREPORT_NONE };
+
+    size_t count = sizeof(timereport__prefixes) / sizeof(timereport__prefixes[0]);
+    for (size_t i = 0; i < count; i++) {
+        size_t len = strlen(timereport__prefixes[i].prefix);
+        if (strncmp(label, timereport__prefixes[i].prefix, len) == 0) {
+            f.phase = timereport__prefixes[i].phase;
+            break;
+        }
+    }
+
+    // the labels with a file or function name in them
+    const char* name = strchr(label, ' ');
+    name = name ? name + 1 : label;
+
+    if (f.phase == TIMEREPORT_PREPROCESS) {
+        f.kind = t->depth[f.phase] ? TIMEREPORT_KEY_HEADER : TIMEREPORT_KEY_FILE;
+    } else if (strncmp(label, "parse: ", 7) == 0 || strncmp(label, "export: ", 8) == 0) {
+        f.kind = TIMEREPORT_KEY_FILE;
+    } else if (f.phase == TIMEREPORT_REPARSE && t->depth[f.phase] == 0) {
+        f.kind = TIMEREPORT_KEY_FILE;
+    } else if (f.phase == TIMEREPORT_CANONICALIZE || (f.phase == TIMEREPORT_IRGEN && t->depth[f.phase])) {
+        // the outer IrGen region is a batch of functions
+        f.kind = TIMEREPORT_KEY_FUNCTION;
+    }
+
+    if (f.kind != TIMEREPORT_KEY_NONE) {
+        f.key = strdup(name);
+    }
+
+    if (f.phase != TIMEREPORT_NONE) {
+        t->depth[f.phase] += 1;
+    }
+    dyn_array_put(t->stack, f);
+}
+
+static void timereport__end_plot(void* user_data, uint64_t nanos, uint32_t tid, const uint64_t* counters) {
+    if (timereport__inner) CUIK_CALL(timereport__inner, end_plot, nanos, tid, counters);
+    if (nanos > timereport__end_time) timereport__end_time = nanos;
+
+    TimeReportThread* t = timereport__get_thread(tid);
+    if (dyn_array_length(t->stack) == 0) return;
+
+    TimeReportFrame f = t->stack[dyn_array_length(t->stack) - 1];
+    dyn_array_set_length(t->stack, dyn_array_length(t->stack) - 1);
+
+    uint64_t duration = nanos - f.start;
+    if (dyn_array_length(t->stack) > 0) {
+        t->stack[dyn_array_length(t->stack) - 1].children += duration;
+    }
+
+    if (f.phase != TIMEREPORT_NONE && --t->depth[f.phase] == 0) {
+        timereport__totals[f.phase] += duration;
+
+        TimeReportInterval interval = { f.start, nanos };
+        dyn_array_put(timereport__intervals[f.phase], interval);
+
+        if (counters != NULL) {
+            for (int i = 0; i < CUIK_HW_COUNTER_COUNT; i++) {
+                timereport__counters[f.phase][i] += counters[i];
+            }
+            timereport__has_counters = true;
+        }
+    }
+
+    switch (f.kind) {
+        case TIMEREPORT_KEY_FILE: timereport__add(&timereport__files, f.key, duration); break;
+        case TIMEREPORT_KEY_FUNCTION: timereport__add(&timereport__functions, f.key, duration); break;
+        // headers only count their own lexing, not what they include
+        case TIMEREPORT_KEY_HEADER: timereport__add(&timereport__headers, f.key, duration - f.children); break;
+        default: break;
+    }
+    free(f.key);
+}
+
+static void timereport__counter(void* user_data, uint64_t nanos, uint32_t tid, const char* name, int64_t value) {
+    if (timereport__inner && timereport__inner->counter) {
+        CUIK_CALL(timereport__inner, counter, nanos, tid, name, value);
+    }
+}
+
+static int timereport__compare_intervals(const void* a, const void* b) {
+    uint64_t x = ((const TimeReportInterval*) a)->start, y = ((const TimeReportInterval*) b)->start;
+    return (x > y) - (x < y);
+}
+
+static int timereport__compare_entries(const void* a, const void* b) {
+    uint64_t x = ((const TimeReportEntry*) a)->value, y = ((const TimeReportEntry*) b)->value;
+    return (x < y) - (x > y);
+}
+
+// the time at least one thread spent in the phase, if nothing overlapped it's
+// the same as the total.
+static uint64_t timereport__wall_time(DynArray(TimeReportInterval) intervals) {
+    size_t count = dyn_array_length(intervals);
+    qsort(intervals, count, sizeof(TimeReportInterval), timereport__compare_intervals);
+
+    uint64_t wall = 0, start = 0, end = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (i == 0 || intervals[i].start > end) {
+            wall += end - start;
+            start = intervals[i].start;
+            end = intervals[i].end;
+        } else if (intervals[i].end > end) {
+            end = intervals[i].end;
+        }
+    }
+    return wall + (end - start);
+}
+
+static void timereport__print_top(const char* title, TimeReportEntry* map, bool is_time) {
+    size_t count = shlen(map);
+    if (count == 0) return;
+
+    qsort(map, count, sizeof(TimeReportEntry), timereport__compare_entries);
+
+    printf("\n%s:\n", title);
+    for (size_t i = 0; i < count && i < TIMEREPORT_TOP_N; i++) {
+        if (is_time) {
+            printf("  %10.3f ms  %s\n", map[i].value / 1000000.0, map[i].key);
+        } else {
+            printf("  %13llu  %s\n", (unsigned long long) map[i].value, map[i].key);
+        }
+    }
+}
+
+static void timereport__stop(void* user_data) {
+    if (timereport__inner) CUIK_CALL(timereport__inner, stop);
+
+    printf("\n%-16s %12s %12s\n", "phase", "total ms", "wall ms");
+    for (int i = 0; i < TIMEREPORT_PHASE_COUNT; i++) {
+        if (dyn_array_length(timereport__intervals[i]) == 0) continue;
+
+        printf(
+            "%-16s %12.3f %12.3f\n", timereport__phase_names[i],
+            timereport__totals[i] / 1000000.0,
+            timereport__wall_time(timereport__intervals[i]) / 1000000.0
+        );
+    }
+    printf("%-16s %12s %12.3f\n", "overall", "", (timereport__end_time - timereport__start_time) / 1000000.0);
+
+    if (timereport__has_counters) {
+        printf("\n%-16s %8s %16s %16s %16s\n", "phase", "IPC", "L1D miss/kinst", "LLC miss/kinst", "br miss/kinst");
+        for (int i = 0; i < TIMEREPORT_PHASE_COUNT; i++) {
+            const uint64_t* c = timereport__counters[i];
+            if (c[CUIK_HW_CYCLES] == 0 || c[CUIK_HW_INSTRUCTIONS] == 0) continue;
+
+            double kinst = c[CUIK_HW_INSTRUCTIONS] / 1000.0;
+            printf(
+                "%-16s %8.2f %16.2f %16.2f %16.2f\n", timereport__phase_names[i],
+                (double) c[CUIK_HW_INSTRUCTIONS] / c[CUIK_HW_CYCLES],
+                c[CUIK_HW_L1D_MISSES] / kinst,
+                c[CUIK_HW_LLC_MISSES] / kinst,
+                c[CUIK_HW_BRANCH_MISSES] / kinst
+            );
+        }
+    }
+
+    // sorting in place breaks the maps' hash index but they're freed right after
+    if (timereport__cpp.files_read > 0) {
+        const Cuik_CPPStats* c = &timereport__cpp;
+        printf("\nPreprocessor:\n");
+        printf("  %-18s %llu\n", "files read", (unsigned long long) c->files_read);
+        printf("  %-18s %.3f ms\n", "include time", c->include_time / 1000000.0);
+        printf("  %-18s %llu\n", "include probes", (unsigned long long) c->include_probes);
+        printf("  %-18s %llu (%llu lines)\n", "bytes lexed", (unsigned long long) c->bytes_lexed, (unsigned long long) c->lines_lexed);
+        printf("  %-18s %llu\n", "define lookups", (unsigned long long) c->define_lookups);
+        printf("  %-18s %llu\n", "macro expansions", (unsigned long long) c->macro_expansions);
+    }
+
+    timereport__print_top("Slowest files", timereport__files, true);
+    timereport__print_top("Slowest functions", timereport__functions, true);
+    timereport__print_top("Headers by lex time", timereport__headers, true);
+    timereport__print_top("Most expanded macros", timereport__macros, false);
+
+    dyn_array_for(i, timereport__threads) {
+        dyn_array_destroy(timereport__threads[i].stack);
+    }
+    dyn_array_destroy(timereport__threads);
+    for (int i = 0; i < TIMEREPORT_PHASE_COUNT; i++) {
+        dyn_array_destroy(timereport__intervals[i]);
+    }
+
+    shfree(timereport__files);
+    shfree(timereport__functions);
+    shfree(timereport__headers);
+    shfree(timereport__macros);
+}
+
+static Cuik_IProfiler timereport_profiler = {
+    .start      = timereport__start,
+    .stop       = timereport__stop,
+    .begin_plot = timereport__begin_plot,
+    .end_plot   = timereport__end_plot,
+    .counter    = timereport__counter,
+};
@@ -11,3 +11,11 @@ int foo() { return 16; }
 #else
 int foo() { return 24; }
 #endif
+
+// multiplicative and unary operators in #if, the second line is from cosmopolitan.h
+#if !defined(__STRICT_ANSI__) && 4 * 2 == 8 && \
+    ((__GNUC__ + 0) * 100 + (__GNUC_MINOR__ + 0) >= 406 || defined(__CUIK__))
+int baz() { return 7 / 2 + 7 % 4 + -1 + ~0; }
+#else
+#error "broken #if arithmetic"
+#endif
@@ -0,0 +1,19 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// environ lives in libc so it needs a copy relocation, sqrt comes from the
+// libm linker script.
+extern char** environ;
+
+int counter = 5;
+static const char* msg = "hello";
+
+int main(int argc, char** argv) {
+    char* p = malloc(32);
+    strcpy(p, msg);
+    printf("%s %d sqrt=%.1f env=%d\n", p, counter, sqrt(argc + 15.0), environ != NULL);
+    free(p);
+    return 3;
+}
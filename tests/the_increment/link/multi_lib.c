@@ -0,0 +1,16 @@
+static const int table[] = { 1, 2, 3, 4, 5 };
+
+static int square(int x) { return x * x; }
+
+int (*callback)(int) = square;
+int ctor_ran;
+
+__attribute__((constructor)) static void init(void) {
+    ctor_ran = 1;
+}
+
+int table_sum(int n) {
+    int sum = 0;
+    for (int i = 0; i < n; i++) sum += table[i];
+    return sum;
+}
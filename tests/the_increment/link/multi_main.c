@@ -0,0 +1,17 @@
+#include <stdio.h>
+
+// the other half is in multi_lib.c
+extern int table_sum(int n);
+extern int (*callback)(int);
+extern int ctor_ran;
+
+// never defined anywhere so it has to resolve to NULL
+__attribute__((weak)) int missing(void);
+
+int shared_bss[64];
+
+int main(void) {
+    shared_bss[63] = 4;
+    printf("sum=%d callback=%d ctor=%d weak=%d\n", table_sum(shared_bss[63]), callback(7), ctor_ran, missing == NULL);
+    return 0;
+}
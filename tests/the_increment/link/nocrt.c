@@ -0,0 +1,14 @@
+// linked without the C runtime so it brings its own entry point
+static long sys3(long n, long a, long b, long c) {
+    long ret;
+    __asm__ volatile ("syscall" : "=a"(ret) : "a"(n), "D"(a), "S"(b), "d"(c) : "rcx", "r11", "memory");
+    return ret;
+}
+
+static const char msg[] = "nocrt\n";
+
+void _start(void) {
+    sys3(1, 1, (long) msg, sizeof(msg) - 1);
+    sys3(60, 42, 0, 0);
+    for (;;) {}
+}
@@ -0,0 +1,15 @@
+#include <stdio.h>
+
+// built twice with STEP set to 1 and 2, the second link patches the first
+const char* step_name = STEP == 1 ? "old" : "new";
+
+static int work(int x) {
+    int a[8] = { 0 };
+    for (int i = 0; i < 8; i++) a[i] = x * i * STEP;
+    return a[7] + a[3];
+}
+
+int main(void) {
+    printf("%s %d\n", step_name, work(2));
+    return STEP;
+}
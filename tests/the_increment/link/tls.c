@@ -0,0 +1,25 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <errno.h>
+
+__thread int tls_x = 7;
+static __thread int tls_y;
+
+static void* worker(void* arg) {
+    tls_y = (int) (long) arg;
+    tls_x += tls_y;
+    return (void*) (long) tls_x;
+}
+
+int main(void) {
+    pthread_t t;
+    void* result;
+    pthread_create(&t, NULL, worker, (void*) 5);
+    pthread_join(t, &result);
+
+    // errno is thread local inside of libc
+    errno = 0;
+    FILE* f = fopen("/nonexistent/file", "r");
+    printf("main=%d worker=%ld errno=%d\n", tls_x, (long) result, f == NULL && errno == ENOENT);
+    return 0;
+}
@@ -0,0 +1,11 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(void) {
+    char* str = malloc(16);
+    strcpy(str, "hello");
+    printf("%s %zu\n", str, strlen(str));
+    free(str);
+    return 0;
+}
@@ -0,0 +1,9 @@
+#include "shared.h"
+
+int list_main(void) {
+    struct Node tail = { 0, 3 };
+    struct Node head = { &tail, 4 };
+
+    enum Color color = GREEN;
+    return list_sum(&head) + color + (int) name_length(names[color - GREEN]) + other;
+}
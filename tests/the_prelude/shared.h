@@ -0,0 +1,41 @@
+// everything in here gets cached into the prelude, the files which include it
+// use each kind of declaration at least once.
+typedef unsigned long usize;
+typedef const char* cstr;
+typedef struct Vec2 { float x, y; } Vec2;
+
+enum Color { RED, GREEN = 4, BLUE };
+
+struct Node;
+struct Node { struct Node* next; int value : 12; int flags : 4; };
+
+int printf(const char* fmt, ...);
+extern int shared_counter;
+
+static const int table[] = { 1, 2, 3, 4 };
+static const char* names[3] = { "red", "green", "blue" };
+static int counter = 5, other = 6;
+
+static inline Vec2 vec2_add(Vec2 a, Vec2 b) {
+    Vec2 r = { a.x + b.x, a.y + b.y };
+    return r;
+}
+
+// never referenced, it shouldn't get parsed in either TU
+static inline int unused_helper(int x) {
+    return x * table[1];
+}
+
+static inline int list_sum(struct Node* n) {
+    int s = 0;
+    for (; n; n = n->next) s += n->value;
+    return s + counter;
+}
+
+static inline usize name_length(cstr str) {
+    usize i = 0;
+    while (str[i]) i++;
+    return i;
+}
+
+#define SQUARE(x) ((x) * (x))
@@ -0,0 +1,12 @@
+#include "shared.h"
+
+int shared_counter;
+
+int main(void) {
+    Vec2 a = { 1, 2 }, b = { 3, 4 };
+    Vec2 c = vec2_add(a, b);
+
+    struct Node n = { 0 };
+    printf("%f %d %d\n", c.x, list_sum(&n), SQUARE(table[2]));
+    return 0;
+}
@@ -0,0 +1,29 @@
+// drivers/reparse_test.c parses base.c and then reparses it as each of the
+// edit_*.c files, they only differ in one spot.
+typedef struct {
+    int x, y;
+} Point;
+
+int counter = 3;
+
+static int helper(int x) {
+    return x * 2;
+}
+
+static int unused_helper(int x) {
+    return x + 100;
+}
+
+static inline int twice(int x) {
+    return x + x;
+}
+
+int compute(int a) {
+    Point p = { a, helper(a) };
+    return p.x + p.y + twice(a);
+}
+
+int other(int b) {
+    const char* name = "other";
+    return b - counter + name[0];
+}